@@ -0,0 +1,290 @@
+//==========================================================
+//  Check of the fixed-point wheel control kernel
+//
+//  Replays the same setpoints and encoder measurements
+//  through
+//    - the float feedforward polynomial and PID_v1, as
+//      computeMotorInputs() runs them without
+//      FIXED_POINT_CONTROL (float, as double is on AVR)
+//    - controlKernelRun() of sml_nexus_control_kernel.h
+//  with the gains of a PID parameter file, and reports
+//  how far the PWM commands are apart and the cost of one
+//  pass over the four wheels on the host.
+//
+//  Usage: control_kernel_check [nexus_pid_params.yaml]
+//  Exits with an error if, starting from the same
+//  controller state, any PWM command differs by more than
+//  one count per truncated term (feedforward and PID).
+//==========================================================
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "sml_nexus_control_kernel.h"
+#include "sml_nexus_kinematics.h"
+
+#ifndef PID_PARAMS_FILE
+#define PID_PARAMS_FILE "nexus_pid_params.yaml"
+#endif
+
+static const char* wheel_names[4] = {"UL", "UR", "LL", "LR"};
+static const float tick_period = 0.01f;                          //s, 100 Hz control tick
+static const float tick_to_meters = nexusGeometry<nexusMecanum2x>::tickToMeters();
+static const float min_speed = 0.008f;
+static const float max_speed = 0.5f;
+
+struct WheelParams
+{
+    float pid[3];
+    float feedforward[5];
+    int min_cmd;
+};
+
+//=====================================================
+//  Read PID_XX, feedforward_XX and min_cmd_XX entries
+//=====================================================
+static bool readFloats(const std::string& line, const std::string& key, float* values, int count){
+    if (line.compare(0, key.size() + 1, key + ":") != 0) return false;
+    const char* p = std::strchr(line.c_str(), '[');
+    if (!p) return false;
+    p++;
+    for (int i = 0; i < count; i++){
+        char* end;
+        values[i] = std::strtof(p, &end);
+        if (end == p) return false;
+        p = end;
+        while (*p == ',' || *p == ' ') p++;
+    }
+    return true;
+}
+
+static bool loadParams(const char* path, WheelParams params[4]){
+    FILE* file = std::fopen(path, "r");
+    if (!file) return false;
+    int found = 0;
+    char buffer[256];
+    while (std::fgets(buffer, sizeof(buffer), file)){
+        const std::string line(buffer);
+        for (int w = 0; w < 4; w++){
+            const std::string name(wheel_names[w]);
+            if (readFloats(line, "PID_" + name, params[w].pid, 3)) found++;
+            if (readFloats(line, "feedforward_" + name, params[w].feedforward, 5)) found++;
+            const std::string min_key = "min_cmd_" + name + ":";
+            if (line.compare(0, min_key.size(), min_key) == 0){
+                params[w].min_cmd = std::atoi(line.c_str() + min_key.size());
+                found++;
+            }
+        }
+    }
+    std::fclose(file);
+    return found == 12;
+}
+
+//==============================================
+//  Float reference: PID_v1 Compute() with the
+//  tunings setupPIDParams() gives it
+//==============================================
+struct FloatPID
+{
+    float kp, ki, kd;
+    float output_sum, last_input;
+
+    void setup(const float pid[3]){
+        kp = pid[0];
+        ki = pid[1] * tick_period;
+        kd = pid[2] / tick_period;
+        output_sum = 0;
+        last_input = 0;
+    }
+
+    float compute(float input, float setpoint){
+        const float error = setpoint - input;
+        const float d_input = input - last_input;
+        output_sum += ki * error;
+        if (output_sum > 200) output_sum = 200;
+        else if (output_sum < -200) output_sum = -200;
+        float output = kp * error + output_sum - kd * d_input;
+        if (output > 200) output = 200;
+        else if (output < -200) output = -200;
+        last_input = input;
+        return output;
+    }
+};
+
+static int constrainInt(int x, int a, int b){
+    return x < a ? a : (x > b ? b : x);
+}
+
+static int floatMotorInput(FloatPID& pid, const WheelParams& p, float speed, float measured){
+    if (std::fabs(speed) <= min_speed) return 0;
+    float poly = 0;
+    for (int i = 0; i < 5; i++) poly += p.feedforward[i] * std::pow(std::fabs(speed), (float)i);
+    if (speed < 0) poly = -poly;
+    int pwm = (int)poly + (int)pid.compute(measured, speed);
+    if (speed > 0) return constrainInt(pwm, p.min_cmd, 245);
+    return constrainInt(pwm, -245, -p.min_cmd);
+}
+
+//=====================================================
+//  Setpoints and encoder measurements of a test run:
+//  steps, ramps and reversals, wheels lagging behind
+//  their setpoint, measured through encoder ticks
+//=====================================================
+struct Sample
+{
+    float setpoint[4];
+    float measured[4];
+};
+
+static std::vector<Sample> makeRun(){
+    std::vector<Sample> run;
+    std::srand(7);
+    float speed[4] = {0, 0, 0, 0};
+    for (int k = 0; k < 200000; k++){
+        Sample s;
+        const int segment = (k / 150) % 8;
+        for (int w = 0; w < 4; w++){
+            float target;
+            switch (segment){
+                case 0: target = 0.3f; break;
+                case 1: target = -0.45f; break;
+                case 2: target = 0.5f * std::sin(0.01f * k + w); break;
+                case 3: target = 0.005f; break;
+                case 4: target = (std::rand() % 1001 - 500) / 1000.0f; break;
+                case 5: target = 0.1f * (w - 1.5f); break;
+                case 6: target = -0.02f; break;
+                default: target = 0.0f; break;
+            }
+            if (target > max_speed) target = max_speed;
+            if (target < -max_speed) target = -max_speed;
+            s.setpoint[w] = target;
+
+            //Wheel following its setpoint, with some noise, read through the encoder
+            speed[w] += 0.2f * (target - speed[w]) + (std::rand() % 201 - 100) * 1e-4f;
+            const int ticks = (int)std::floor(speed[w] * tick_period / tick_to_meters + 0.5f);
+            s.measured[w] = ticks * tick_to_meters * (1.0f/tick_period);
+        }
+        run.push_back(s);
+    }
+    return run;
+}
+
+int main(int argc, char** argv){
+    const char* path = argc > 1 ? argv[1] : PID_PARAMS_FILE;
+    WheelParams params[4];
+    if (!loadParams(path, params)){
+        std::fprintf(stderr, "Could not read the PID, feedforward and min_cmd parameters of %s\n", path);
+        return 1;
+    }
+
+    const std::vector<Sample> run = makeRun();
+    const int16_t min_speed_q15 = toQ15(min_speed);
+
+    FloatPID float_pids[4];
+    wheelController wheels[4];
+
+    //------------------------------------------------------
+    // Step by step: the kernel starts every step from the
+    // float controller state. The feedforward and the PID
+    // output are each truncated to an integer, so each may
+    // land one count apart: the commands must agree to
+    // within two PWM counts. Setpoints within one Q15 step
+    // of min_speed may fall on either side of the dead band.
+    //------------------------------------------------------
+    for (int w = 0; w < 4; w++){
+        float_pids[w].setup(params[w].pid);
+        controlKernelSetGains(wheels[w], params[w].feedforward, params[w].pid, params[w].min_cmd, tick_period);
+    }
+    unsigned long compared = 0, exact = 0, dead_band_edge = 0;
+    int max_difference[4] = {0, 0, 0, 0};
+    for (size_t k = 0; k < run.size(); k++){
+        for (int w = 0; w < 4; w++){
+            wheels[w].integral = toQ16(float_pids[w].output_sum);
+            wheels[w].lastMeasured = toQ15(float_pids[w].last_input);
+            wheels[w].setpoint = toQ15(run[k].setpoint[w]);
+            wheels[w].measured = toQ15(run[k].measured[w]);
+        }
+        controlKernelRun(wheels, 4, min_speed_q15);
+        for (int w = 0; w < 4; w++){
+            const int reference = floatMotorInput(float_pids[w], params[w], run[k].setpoint[w], run[k].measured[w]);
+            if (std::fabs(std::fabs(run[k].setpoint[w]) - min_speed) < 1.0f / KERNEL_Q15_ONE){
+                dead_band_edge++;
+                continue;
+            }
+            const int difference = std::abs(reference - wheels[w].pwm);
+            if (difference == 0) exact++;
+            if (difference > max_difference[w]) max_difference[w] = difference;
+            compared++;
+        }
+    }
+
+    //------------------------------------------------------
+    // Free running: both controllers integrate on their
+    // own, the integrals drift apart with the Q15 rounding
+    // of the measurements
+    //------------------------------------------------------
+    for (int w = 0; w < 4; w++){
+        float_pids[w].setup(params[w].pid);
+        wheels[w].measured = 0;
+        controlKernelStart(wheels[w]);
+    }
+    unsigned long free_exact = 0;
+    int free_max_difference = 0;
+    float max_integral_drift = 0;
+    for (size_t k = 0; k < run.size(); k++){
+        for (int w = 0; w < 4; w++){
+            wheels[w].setpoint = toQ15(run[k].setpoint[w]);
+            wheels[w].measured = toQ15(run[k].measured[w]);
+        }
+        controlKernelRun(wheels, 4, min_speed_q15);
+        for (int w = 0; w < 4; w++){
+            const int difference = std::abs(floatMotorInput(float_pids[w], params[w], run[k].setpoint[w], run[k].measured[w])
+                                            - wheels[w].pwm);
+            if (difference == 0) free_exact++;
+            if (difference > free_max_difference) free_max_difference = difference;
+            const float drift = std::fabs(float_pids[w].output_sum - wheels[w].integral / (float)KERNEL_Q16_ONE);
+            if (drift > max_integral_drift) max_integral_drift = drift;
+        }
+    }
+
+    //----------------------------
+    // Cost of one four-wheel pass
+    //----------------------------
+    volatile int sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < run.size(); k++){
+        for (int w = 0; w < 4; w++){
+            sink += floatMotorInput(float_pids[w], params[w], run[k].setpoint[w], run[k].measured[w]);
+        }
+    }
+    const double float_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()
+                            / run.size();
+    start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < run.size(); k++){
+        for (int w = 0; w < 4; w++){
+            wheels[w].setpoint = toQ15(run[k].setpoint[w]);
+            wheels[w].measured = toQ15(run[k].measured[w]);
+        }
+        controlKernelRun(wheels, 4, min_speed_q15);
+        sink += wheels[0].pwm;
+    }
+    const double kernel_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()
+                             / run.size();
+
+    std::printf("parameters: %s\n", path);
+    std::printf("step by step: %lu commands compared, %.3f%% identical, %lu at the dead band edge\n",
+                compared, 100.0 * exact / compared, dead_band_edge);
+    bool ok = true;
+    for (int w = 0; w < 4; w++){
+        std::printf("  %s max PWM difference: %d\n", wheel_names[w], max_difference[w]);
+        if (max_difference[w] > 2) ok = false;
+    }
+    std::printf("free running: %.3f%% identical, max PWM difference %d, max integral drift %.3f\n",
+                100.0 * free_exact / (4.0 * run.size()), free_max_difference, max_integral_drift);
+    std::printf("host cost per 4-wheel pass: float %.1f ns, fixed-point %.1f ns\n", float_ns, kernel_ns);
+    std::printf("on target, see the last value of control_tick_stats (CPU cycles)\n");
+    return ok ? 0 : 1;
+}
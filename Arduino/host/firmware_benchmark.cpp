@@ -0,0 +1,231 @@
+//==========================================================
+//  Closed-loop benchmark of the firmware on the host
+//
+//  Runs the whole sketch (setup() and loop(), the control
+//  tick interrupt, the encoder interrupts and the sonar
+//  state machine) against four simulated DC motors and
+//  four simulated URM04 sensors, and reports
+//    - the step response of every wheel to a sequence of
+//      velocity commands: rise time, overshoot,
+//      steady-state error and speed ripple
+//    - the error of the wheel speeds the controllers
+//      measure, against the tick count estimate
+//    - the host cost of the control tick, encoder
+//      interrupts and loop() pass
+//    - the rate of the sonar range topics, with the
+//      pipelined pairs and with all four sensors
+//      triggered at once
+//
+//  Usage: firmware_benchmark [pid_params.yaml]
+//==========================================================
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "firmware_core.h"
+#include "motor_plant.h"
+#include "urm04_bus_sim.h"
+
+#ifndef PID_PARAMS_FILE
+#define PID_PARAMS_FILE "nexus_pid_params.yaml"
+#endif
+
+static const unsigned long sim_step_us = 50;      //plant and encoder step
+static const unsigned long loop_period_us = 1000; //main loop pass
+static const double segment_s = 2.0;
+static const double tick_to_meters = robotGeometry::tickToMeters();
+
+struct Segment
+{
+    const char* name;
+    double vx, vy, w;
+};
+
+static const Segment segments[] = {
+    {"vx 0.3", 0.3, 0.0, 0.0},
+    {"vy 0.2", 0.0, 0.2, 0.0},
+    {"w 1.0", 0.0, 0.0, 1.0},
+    {"vx -0.2", -0.2, 0.0, 0.0},
+    {"vx 0.05", 0.05, 0.0, 0.0},
+    {"stop", 0.0, 0.0, 0.0},
+};
+
+static const char* range_topics[4] = {"right_range", "front_range", "left_range", "rear_range"};
+
+struct StepResponse
+{
+    double target;
+    double rise_time;  //s, 10% to 90% of the step
+    double overshoot;  //% of the step
+    double steady_error; //m/s, mean over the last 0.5 s
+    double ripple;       //m/s, standard deviation over the last 0.5 s
+};
+
+//================================================
+//  Step response of one wheel speed trace, from
+//  the speed at the start of the segment
+//================================================
+static StepResponse analyze(const std::vector<double>& speeds, double target, double dt){
+    StepResponse r;
+    r.target = target;
+    const double start = speeds.front();
+    const double step = target - start;
+    double t10 = -1, t90 = -1, peak = 0;
+    for (size_t i = 0; i < speeds.size(); i++){
+        const double progress = step != 0 ? (speeds[i] - start) / step : 1.0;
+        if (t10 < 0 && progress >= 0.1) t10 = i * dt;
+        if (t90 < 0 && progress >= 0.9) t90 = i * dt;
+        if (progress - 1.0 > peak) peak = progress - 1.0;
+    }
+    r.rise_time = (t10 >= 0 && t90 >= 0) ? t90 - t10 : NAN;
+    r.overshoot = std::fabs(step) > 1e-6 ? 100.0 * peak : 0.0;
+    const size_t tail = static_cast<size_t>(0.5 / dt);
+    double sum = 0, square_sum = 0;
+    for (size_t i = speeds.size() - tail; i < speeds.size(); i++){
+        sum += speeds[i];
+        square_sum += speeds[i] * speeds[i];
+    }
+    const double mean = sum / tail;
+    r.steady_error = mean - target;
+    r.ripple = std::sqrt(std::max(0.0, square_sum / tail - mean * mean));
+    return r;
+}
+
+//================================================
+//  Mean rate of the range topics over a run of
+//  the sketch with the given sonar schedule, the
+//  motors standing still
+//================================================
+static double sonarRate(urm04BusSim& sonars, int staggered, double seconds, unsigned long& missed){
+    //Start over from a fresh cycle, with the sensors triggered again
+    sensorStaggeredPairs = staggered;
+    sensorCycleCount = 0;
+    sensorReadingStep = sensorScheduleLength;
+
+    unsigned long before = 0;
+    for (int i = 0; i < 4; i++) before += nh.findPublisher(range_topics[i])->count;
+    const unsigned long missed_before = sonars.missedReplies;
+    for (unsigned long t = 0; t < seconds * 1e6; t += loop_period_us){
+        hal::advanceMicros(loop_period_us);
+        loop();
+        sonars.step(Serial2);
+    }
+    unsigned long after = 0;
+    for (int i = 0; i < 4; i++) after += nh.findPublisher(range_topics[i])->count;
+    missed = sonars.missedReplies - missed_before;
+    return (after - before) / 4.0 / seconds;
+}
+
+int main(int argc, char** argv){
+    const char* params = argc > 1 ? argv[1] : PID_PARAMS_FILE;
+    if (!hal::loadParams(params)){
+        std::fprintf(stderr, "Could not read %s\n", params);
+        return 1;
+    }
+
+    setup();
+
+    std::vector<simulatedWheel> wheels;
+    for (int i = 0; i < 4; i++) wheels.push_back(simulatedWheel(firmwareWheels[i]));
+    urm04BusSim sonars;
+
+    unsigned long ranges_before[4];
+    for (int i = 0; i < 4; i++) ranges_before[i] = nh.findPublisher(range_topics[i])->count;
+    const hal::interruptStats ticks_before = hal::timerInterruptStats();
+    const hal::interruptStats edges_before = hal::pinInterruptStats();
+
+    //Speed estimate errors against the wheel speed at each control tick
+    double count_square_error = 0, measured_square_error = 0;
+    unsigned long estimates = 0;
+    unsigned long last_tick = hal::timerInterruptStats().count;
+
+    double loop_wall_ns = 0;
+    unsigned long loop_passes = 0;
+    const double dt = sim_step_us * 1e-6;
+    const size_t steps_per_segment = static_cast<size_t>(segment_s / dt);
+    const size_t segment_count = sizeof(segments) / sizeof(segments[0]);
+
+    std::printf("%-8s %-3s %9s %10s %11s %16s %14s\n", "segment", "", "target", "rise [ms]", "overshoot",
+                "ss error [mm/s]", "ripple [mm/s]");
+    const std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+    for (size_t s = 0; s < segment_count; s++){
+        std::vector<double> speeds[4];
+        double targets[4] = {0, 0, 0, 0};
+        for (size_t k = 0; k < steps_per_segment; k++){
+            //Velocity command, resent at 10 Hz like the host does
+            if (k % (100000 / sim_step_us) == 0){
+                sml_nexus_msgs::VelocityCommand cmd;
+                cmd.vx = (int16_t)lround(segments[s].vx * 1000);
+                cmd.vy = (int16_t)lround(segments[s].vy * 1000);
+                cmd.w = (int16_t)lround(segments[s].w * 1000);
+                compactCmdCb(cmd);
+            }
+
+            for (int i = 0; i < 4; i++){
+                wheels[i].step(dt);
+                speeds[i].push_back(wheels[i].plant.speed());
+            }
+            hal::advanceMicros(sim_step_us);
+
+            if (hal::timerInterruptStats().count != last_tick){
+                last_tick = hal::timerInterruptStats().count;
+                const double measured[4] = {measUL, measUR, measLL, measLR};
+                for (int i = 0; i < 4; i++){
+                    const double count_speed = encoderTicks[i] * tick_to_meters * 1000 / (double)updateOldness;
+                    count_square_error += std::pow(count_speed - wheels[i].plant.speed(), 2);
+                    measured_square_error += std::pow(measured[i] - wheels[i].plant.speed(), 2);
+                }
+                estimates += 4;
+            }
+
+            if (micros() % loop_period_us < sim_step_us){
+                const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                loop();
+                loop_wall_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                loop_passes++;
+                sonars.step(Serial2);
+            }
+        }
+        targets[0] = ULspeed;
+        targets[1] = URspeed;
+        targets[2] = LLspeed;
+        targets[3] = LRspeed;
+
+        for (int i = 0; i < 4; i++){
+            const StepResponse r = analyze(speeds[i], targets[i], dt);
+            std::printf("%-8s %-3s %9.3f %10.1f %10.1f%% %16.2f %14.2f\n", i == 0 ? segments[s].name : "",
+                        firmwareWheels[i].name, r.target, r.rise_time * 1000, r.overshoot, r.steady_error * 1000,
+                        r.ripple * 1000);
+        }
+    }
+    const double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    const double sim_s = segment_count * segment_s;
+
+    const hal::interruptStats ticks = hal::timerInterruptStats();
+    const unsigned long tick_count = ticks.count - ticks_before.count;
+    std::printf("\ncontrol ticks: %lu (%.1f Hz), %.0f ns per tick on the host\n", tick_count, tick_count / sim_s,
+                (ticks.wallNanoseconds - ticks_before.wallNanoseconds) / tick_count);
+    std::printf("speed estimate RMS error: tick count %.2f mm/s, controllers %.2f mm/s\n",
+                1000 * std::sqrt(count_square_error / estimates), 1000 * std::sqrt(measured_square_error / estimates));
+    const hal::interruptStats edges = hal::pinInterruptStats();
+    const unsigned long edge_count = edges.count - edges_before.count;
+    std::printf("encoder interrupts: %lu, %.0f ns per interrupt on the host\n", edge_count,
+                (edges.wallNanoseconds - edges_before.wallNanoseconds) / edge_count);
+    std::printf("loop passes: %lu, %.0f ns per pass on the host\n", loop_passes, loop_wall_ns / loop_passes);
+    std::printf("sonar ranges:");
+    for (int i = 0; i < 4; i++){
+        std::printf(" %s %.1f Hz", range_topics[i], (nh.findPublisher(range_topics[i])->count - ranges_before[i]) / sim_s);
+    }
+    std::printf("\nsonar replies: %lu, distance requests before the measurement: %lu\n",
+                sonars.replies, sonars.missedReplies);
+
+    unsigned long pipelined_missed, all_at_once_missed;
+    const double pipelined = sonarRate(sonars, 1, 10.0, pipelined_missed);
+    const double all_at_once = sonarRate(sonars, 0, 10.0, all_at_once_missed);
+    std::printf("sonar range rate per sensor: pipelined pairs %.1f Hz, all four at once %.1f Hz (%+.0f%%), "
+                "early distance requests %lu and %lu\n", pipelined, all_at_once,
+                100.0 * (pipelined / all_at_once - 1.0), pipelined_missed, all_at_once_missed);
+    std::printf("simulated %.0f s in %.2f s (%.0fx real time)\n", sim_s, wall_s, sim_s / wall_s);
+    return 0;
+}
@@ -0,0 +1,13 @@
+//Build the sketch itself, against the stand-ins of hal/
+#include "sml_nexus_firmware.ino"
+#include "firmware_core.h"
+
+//Motor pins as the nexusMotor objects of sml_nexus_common.h are built.
+//The simulation keeps pin 12 apart as LL motor PWM output and LR encoder B
+//input, on the board both share the pin.
+const firmwareWheel firmwareWheels[4] = {
+  {"UL", 7, 6, MOTOR2_ENC_A, MOTOR2_ENC_B, -1},
+  {"UR", 8, 9, MOTOR3_ENC_A, MOTOR3_ENC_B, 1},
+  {"LL", 5, 12, MOTOR1_ENC_A, MOTOR1_ENC_B, -1},
+  {"LR", 10, 11, MOTOR4_ENC_A, MOTOR4_ENC_B, 1},
+};
@@ -0,0 +1,71 @@
+/*
+Host build of the firmware: sml_nexus_firmware.ino compiled against the
+Arduino and rosserial stand-ins of hal/, as the sml_nexus_firmware_core
+library. This declares what simulations and benchmarks drive it through.
+*/
+
+#ifndef SML_NEXUS_HOST_FIRMWARE_CORE_H
+#define SML_NEXUS_HOST_FIRMWARE_CORE_H
+
+#include "Arduino.h"
+#include "ros.h"
+#include <geometry_msgs/Twist.h>
+#include <sml_nexus_msgs/VelocityCommand.h>
+#include <sml_nexus_msgs/VelocityTrajectory.h>
+#include "sml_nexus_kinematics.h"
+
+/******************** Sketch ****************/
+extern ros::NodeHandle nh;
+void setup();
+void loop();
+
+/******************** Control core ****************/
+void messageCb(const geometry_msgs::Twist& msg);
+void compactCmdCb(const sml_nexus_msgs::VelocityCommand& msg);
+void trajectoryCb(const sml_nexus_msgs::VelocityTrajectory& msg);
+void computeWheelVelCmd();
+void getWheelVel();
+void computeMotorInputs();
+void controlTick();
+void runSensor();
+
+extern double ULspeed, URspeed, LLspeed, LRspeed;
+extern double measUL, measUR, measLL, measLR;
+extern int pwmUL, pwmUR, pwmLL, pwmLR;
+extern int16_t encoderTicks[4];
+extern long double updateOldness;
+extern long double vx, vy, w;
+
+#if ENCODER_QUADRATURE_4X
+typedef nexusGeometry<nexusMecanum4x> robotGeometry;
+#else
+typedef nexusGeometry<nexusMecanum2x> robotGeometry;
+#endif
+extern mecanumKinematics<float> kinematics;
+
+/******************** Sonar schedule ****************/
+extern int sensorStaggeredPairs;
+extern unsigned int sensorCycleCount;
+extern byte sensorReadingStep;
+extern byte sensorScheduleLength;
+
+//--------------------------------------------------
+// Wiring of a wheel, for the simulated motors and
+// encoders: PWM pins of the motor driver, encoder
+// pins, and the count direction of the encoder
+// interrupt when both channels are at the same level
+//--------------------------------------------------
+struct firmwareWheel
+{
+  const char* name;
+  uint8_t pwmPin1;
+  uint8_t pwmPin2;
+  uint8_t encoderA;
+  uint8_t encoderB;
+  int8_t sameLevelCount;
+};
+
+//UL, UR, LL, LR
+extern const firmwareWheel firmwareWheels[4];
+
+#endif // SML_NEXUS_HOST_FIRMWARE_CORE_H
@@ -0,0 +1 @@
+//Host stand-in, the motor shield is not used by the firmware
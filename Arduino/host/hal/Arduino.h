@@ -0,0 +1,124 @@
+/*
+Host stand-in for the Arduino core, for the host builds of the firmware.
+
+Only the part of the Arduino API the firmware uses is provided. Time only
+moves when the simulation advances it (see sim_hal.h), pins are plain
+arrays mirrored into the port registers of the encoder pins, the AVR timer
+and pin change registers are plain variables and ISR() registers
+the interrupt handler so that the simulation can call it.
+*/
+
+#ifndef SML_NEXUS_HOST_ARDUINO_H
+#define SML_NEXUS_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define CHANGE 1
+
+//Arduino Mega analog pins
+#define A12 66
+#define A14 68
+#define NUM_PINS 70
+
+#define F_CPU 16000000UL
+
+#define B00000001 1
+#define B11111000 248
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+/******************** Time ****************/
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+/******************** Pins ****************/
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+
+/******************** Interrupts ****************/
+#define digitalPinToInterrupt(pin) (pin)
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode);
+void noInterrupts();
+void interrupts();
+#define cli() noInterrupts()
+#define sei() interrupts()
+
+//Interrupt vectors are registered by name when defined with ISR()
+namespace hal
+{
+struct isrRegistrar
+{
+  isrRegistrar(const char* vector, void (*handler)());
+};
+}
+#define ISR(vector) \
+  void vector(); \
+  static hal::isrRegistrar vector##_registrar(#vector, &vector); \
+  void vector()
+
+/******************** AVR timer registers ****************/
+extern volatile uint8_t TCCR1B, TCCR2B, TCCR3B, TCCR4B;
+extern volatile uint8_t TCCR5A, TCCR5B, TIMSK5, TIFR5;
+extern volatile uint16_t TCNT5, OCR5A;
+#define CS50 0
+#define CS51 1
+#define CS52 2
+#define WGM52 3
+#define OCIE5A 1
+#define OCF5A 1
+
+/******************** AVR port input and pin change registers ****************/
+//Only the ports of the encoder pins, kept in step with the pin levels
+extern volatile uint8_t PINB, PIND, PINE, PINK;
+#define PB6 6
+#define PB7 7
+#define PD2 2
+#define PD3 3
+#define PE4 4
+#define PE5 5
+#define PK4 4
+#define PK6 6
+
+extern volatile uint8_t PCICR, PCIFR, PCMSK0, PCMSK2;
+#define PCIE0 0
+#define PCIE2 2
+#define PCIF0 0
+#define PCIF2 2
+#define PCINT7 7
+#define PCINT20 4
+#define PCINT22 6
+
+/******************** Serial ports ****************/
+class HardwareSerial
+{
+  public:
+    void begin(unsigned long baud);
+    int available();
+    int read();
+    size_t write(uint8_t data);
+
+    //Simulation side
+    uint8_t rxBuffer[256];
+    uint8_t rxHead, rxTail;
+    uint8_t txBuffer[256];
+    uint8_t txHead, txTail;
+    unsigned long baud;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial2;
+
+#endif // SML_NEXUS_HOST_ARDUINO_H
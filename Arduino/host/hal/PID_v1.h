@@ -0,0 +1,113 @@
+/*
+Host stand-in for the Arduino PID_v1 library, same interface and algorithm:
+computes once SampleTime ms have elapsed on millis(), proportional on error,
+integral clamped to the output limits, derivative on measurement.
+*/
+
+#ifndef SML_NEXUS_HOST_PID_V1_H
+#define SML_NEXUS_HOST_PID_V1_H
+
+#include "Arduino.h"
+
+#define AUTOMATIC 1
+#define MANUAL 0
+#define DIRECT 0
+#define REVERSE 1
+
+class PID
+{
+  public:
+    PID(double* input, double* output, double* setpoint, double Kp, double Ki, double Kd, int direction)
+      : myInput(input), myOutput(output), mySetpoint(setpoint), inAuto(false),
+        sampleTime(100), outMin(0), outMax(255), controllerDirection(direction)
+    {
+      SetTunings(Kp, Ki, Kd);
+      lastTime = millis() - sampleTime;
+      outputSum = 0;
+      lastInput = 0;
+    }
+
+    bool Compute()
+    {
+      if (!inAuto) return false;
+      unsigned long now = millis();
+      if (now - lastTime < sampleTime) return false;
+
+      double input = *myInput;
+      double error = *mySetpoint - input;
+      double dInput = input - lastInput;
+      outputSum += ki * error;
+      outputSum = clamp(outputSum);
+      double output = kp * error + outputSum - kd * dInput;
+      *myOutput = clamp(output);
+
+      lastInput = input;
+      lastTime = now;
+      return true;
+    }
+
+    void SetMode(int mode)
+    {
+      bool newAuto = (mode == AUTOMATIC);
+      if (newAuto && !inAuto){
+        outputSum = clamp(*myOutput);
+        lastInput = *myInput;
+      }
+      inAuto = newAuto;
+    }
+
+    void SetOutputLimits(double min, double max)
+    {
+      if (min >= max) return;
+      outMin = min;
+      outMax = max;
+      if (inAuto){
+        *myOutput = clamp(*myOutput);
+        outputSum = clamp(outputSum);
+      }
+    }
+
+    void SetTunings(double Kp, double Ki, double Kd)
+    {
+      if (Kp < 0 || Ki < 0 || Kd < 0) return;
+      double sampleTimeInSec = sampleTime / 1000.0;
+      kp = Kp;
+      ki = Ki * sampleTimeInSec;
+      kd = Kd / sampleTimeInSec;
+      if (controllerDirection == REVERSE){
+        kp = -kp;
+        ki = -ki;
+        kd = -kd;
+      }
+    }
+
+    void SetSampleTime(int newSampleTime)
+    {
+      if (newSampleTime <= 0) return;
+      double ratio = (double)newSampleTime / sampleTime;
+      ki *= ratio;
+      kd /= ratio;
+      sampleTime = newSampleTime;
+    }
+
+  private:
+    double clamp(double value) const
+    {
+      if (value > outMax) return outMax;
+      if (value < outMin) return outMin;
+      return value;
+    }
+
+    double* myInput;
+    double* myOutput;
+    double* mySetpoint;
+    bool inAuto;
+    unsigned long sampleTime; //ms
+    double outMin, outMax;
+    int controllerDirection;
+    double kp, ki, kd;
+    unsigned long lastTime;
+    double outputSum, lastInput;
+};
+
+#endif // SML_NEXUS_HOST_PID_V1_H
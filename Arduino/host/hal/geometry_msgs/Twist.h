@@ -0,0 +1,17 @@
+#ifndef SML_NEXUS_HOST_GEOMETRY_MSGS_TWIST_H
+#define SML_NEXUS_HOST_GEOMETRY_MSGS_TWIST_H
+#include "ros.h"
+namespace geometry_msgs
+{
+struct Vector3
+{
+  Vector3() : x(0), y(0), z(0) {}
+  double x, y, z;
+};
+struct Twist : public ros::Msg
+{
+  Vector3 linear;
+  Vector3 angular;
+};
+}
+#endif
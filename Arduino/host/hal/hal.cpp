@@ -0,0 +1,286 @@
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include "sim_hal.h"
+
+/******************** Simulation state ****************/
+static unsigned long simMicros = 0;
+static uint8_t pinLevel[NUM_PINS];
+static int pinPwm[NUM_PINS];
+static void (*pinHandler[NUM_PINS])();
+static bool interruptsEnabled = true;
+
+static unsigned long nextCompareMicros = 0;
+static unsigned long timerInterrupts = 0;
+static double timerWallNanoseconds = 0;
+static unsigned long pinInterrupts = 0;
+static double pinWallNanoseconds = 0;
+static unsigned long warnings = 0;
+
+static std::map<std::string, void (*)()>& vectors(){
+  static std::map<std::string, void (*)()> table;
+  return table;
+}
+
+static std::map<std::string, std::vector<float> >& params(){
+  static std::map<std::string, std::vector<float> > table;
+  return table;
+}
+
+static std::vector<ros::Publisher*>& publishers(){
+  static std::vector<ros::Publisher*> list;
+  return list;
+}
+
+static std::vector<ros::SubscriberBase*>& subscribers(){
+  static std::vector<ros::SubscriberBase*> list;
+  return list;
+}
+
+/******************** AVR registers ****************/
+volatile uint8_t TCCR1B, TCCR2B, TCCR3B, TCCR4B;
+volatile uint8_t TCCR5A, TCCR5B, TIMSK5, TIFR5;
+volatile uint16_t TCNT5, OCR5A;
+
+volatile uint8_t PINB, PIND, PINE, PINK;
+volatile uint8_t PCICR, PCIFR, PCMSK0, PCMSK2;
+
+//Port bit and pin change group of the encoder pins of the Arduino Mega
+struct portPin
+{
+  uint8_t pin;
+  volatile uint8_t* port;
+  uint8_t bit;
+  int8_t pinChangeGroup;  //-1: none
+};
+
+static const portPin portPins[] = {
+  {2, &PINE, PE4, -1},
+  {3, &PINE, PE5, -1},
+  {12, &PINB, PB6, 0},
+  {13, &PINB, PB7, 0},
+  {18, &PIND, PD3, -1},
+  {19, &PIND, PD2, -1},
+  {A12, &PINK, PK4, 2},
+  {A14, &PINK, PK6, 2},
+};
+
+static const portPin* findPortPin(uint8_t pin){
+  for (size_t i = 0; i < sizeof(portPins) / sizeof(portPins[0]); i++){
+    if (portPins[i].pin == pin) return &portPins[i];
+  }
+  return 0;
+}
+
+static void writePinLevel(uint8_t pin, uint8_t level){
+  pinLevel[pin] = level;
+  const portPin* p = findPortPin(pin);
+  if (!p) return;
+  if (level) *p->port |= (1 << p->bit);
+  else *p->port &= ~(1 << p->bit);
+}
+
+HardwareSerial Serial;
+HardwareSerial Serial2;
+
+/******************** Arduino API ****************/
+unsigned long millis(){ return simMicros / 1000; }
+unsigned long micros(){ return simMicros; }
+void delay(unsigned long ms){ hal::advanceMicros(ms * 1000); }
+
+void pinMode(uint8_t, uint8_t){}
+void digitalWrite(uint8_t pin, uint8_t level){ if (pin < NUM_PINS) writePinLevel(pin, level); }
+int digitalRead(uint8_t pin){ return pin < NUM_PINS ? pinLevel[pin] : LOW; }
+void analogWrite(uint8_t pin, int value){ if (pin < NUM_PINS) pinPwm[pin] = value; }
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int){
+  if (interrupt < NUM_PINS) pinHandler[interrupt] = handler;
+}
+void noInterrupts(){ interruptsEnabled = false; }
+void interrupts(){ interruptsEnabled = true; }
+
+hal::isrRegistrar::isrRegistrar(const char* vector, void (*handler)()){
+  vectors()[vector] = handler;
+}
+
+void HardwareSerial::begin(unsigned long b){
+  baud = b;
+  rxHead = rxTail = txHead = txTail = 0;
+}
+int HardwareSerial::available(){ return (uint8_t)(rxHead - rxTail); }
+int HardwareSerial::read(){
+  if (rxHead == rxTail) return -1;
+  return rxBuffer[rxTail++];
+}
+size_t HardwareSerial::write(uint8_t data){
+  txBuffer[txHead++] = data;
+  return 1;
+}
+
+/******************** rosserial API ****************/
+namespace ros
+{
+
+Time NodeHandle::now(){
+  return Time(simMicros / 1000000, (simMicros % 1000000) * 1000);
+}
+
+bool NodeHandle::advertise(Publisher& p){
+  publishers().push_back(&p);
+  return true;
+}
+
+bool NodeHandle::registerSubscriber(SubscriberBase* s){
+  subscribers().push_back(s);
+  return true;
+}
+
+bool NodeHandle::getParam(const char* name, int* param, int length, int){
+  std::map<std::string, std::vector<float> >::const_iterator it = params().find(name);
+  if (it == params().end() || (int)it->second.size() != length) return false;
+  for (int i = 0; i < length; i++) param[i] = (int)lroundf(it->second[i]);
+  return true;
+}
+
+bool NodeHandle::getParam(const char* name, float* param, int length, int){
+  std::map<std::string, std::vector<float> >::const_iterator it = params().find(name);
+  if (it == params().end() || (int)it->second.size() != length) return false;
+  for (int i = 0; i < length; i++) param[i] = it->second[i];
+  return true;
+}
+
+void NodeHandle::logwarn(const char*){ warnings++; }
+void NodeHandle::loginfo(const char*){}
+
+Publisher* NodeHandle::findPublisher(const char* topic){
+  for (size_t i = 0; i < publishers().size(); i++){
+    if (strcmp(publishers()[i]->topic, topic) == 0) return publishers()[i];
+  }
+  return 0;
+}
+
+SubscriberBase* NodeHandle::findSubscriber(const char* topic){
+  for (size_t i = 0; i < subscribers().size(); i++){
+    if (strcmp(subscribers()[i]->topic, topic) == 0) return subscribers()[i];
+  }
+  return 0;
+}
+
+} // namespace ros
+
+/******************** Simulation API ****************/
+namespace hal
+{
+
+void advanceMicros(unsigned long us){
+  const unsigned long target = simMicros + us;
+  while (true){
+    //Timer5 in CTC mode with a prescaler of 64, as set up by the firmware
+    const bool timerRunning = (TCCR5B & ((1 << CS52) | (1 << CS51) | (1 << CS50))) != 0;
+    const unsigned long period = (OCR5A + 1UL) * 64 / (F_CPU / 1000000UL);
+    if (!timerRunning){
+      nextCompareMicros = 0;
+      simMicros = target;
+      return;
+    }
+    if (nextCompareMicros == 0) nextCompareMicros = simMicros + period;
+    if (nextCompareMicros > target) break;
+
+    simMicros = nextCompareMicros;
+    nextCompareMicros += period;
+    TCNT5 = 0;
+    std::map<std::string, void (*)()>::const_iterator it = vectors().find("TIMER5_COMPA_vect");
+    if ((TIMSK5 & (1 << OCIE5A)) && interruptsEnabled && it != vectors().end()){
+      TIFR5 &= ~(1 << OCF5A);
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      it->second();
+      interruptsEnabled = true; //reti
+      timerWallNanoseconds += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+      timerInterrupts++;
+    }
+  }
+  simMicros = target;
+  const unsigned long period = (OCR5A + 1UL) * 64 / (F_CPU / 1000000UL);
+  TCNT5 = (uint16_t)((period - (nextCompareMicros - simMicros)) / 4);
+}
+
+//Run an interrupt handler as the CPU would, timing it
+static void runPinInterrupt(void (*handler)()){
+  if (!interruptsEnabled) return;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  interruptsEnabled = false;
+  handler();
+  interruptsEnabled = true; //reti
+  pinWallNanoseconds += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  pinInterrupts++;
+}
+
+void setPinLevel(uint8_t pin, uint8_t level){
+  if (pin >= NUM_PINS || pinLevel[pin] == level) return;
+  writePinLevel(pin, level);
+
+  //attachInterrupt(..., CHANGE)
+  if (pinHandler[pin]) runPinInterrupt(pinHandler[pin]);
+
+  //Pin change interrupt of the group, when the pin is enabled in its mask
+  const portPin* p = findPortPin(pin);
+  if (!p || p->pinChangeGroup < 0 || !(PCICR & (1 << p->pinChangeGroup))) return;
+  const uint8_t mask = p->pinChangeGroup == 0 ? PCMSK0 : PCMSK2;
+  if (!(mask & (1 << p->bit))) return;
+  std::map<std::string, void (*)()>::const_iterator it =
+      vectors().find(p->pinChangeGroup == 0 ? "PCINT0_vect" : "PCINT2_vect");
+  if (it != vectors().end()) runPinInterrupt(it->second);
+}
+
+int pwmOutput(uint8_t pin){
+  return pin < NUM_PINS ? pinPwm[pin] : 0;
+}
+
+void setParam(const char* name, const float* values, int length){
+  params()[name] = std::vector<float>(values, values + length);
+}
+
+bool loadParams(const char* path){
+  FILE* file = fopen(path, "r");
+  if (!file) return false;
+  char line[256];
+  while (fgets(line, sizeof(line), file)){
+    char* colon = strchr(line, ':');
+    if (!colon || line[0] == '#' || line[0] == ' ') continue;
+    *colon = '\0';
+    std::vector<float> values;
+    char* p = colon + 1;
+    while (*p == ' ' || *p == '[') p++;
+    while (*p){
+      char* end;
+      const float value = strtof(p, &end);
+      if (end == p) break;
+      values.push_back(value);
+      p = end;
+      while (*p == ',' || *p == ' ' || *p == ']') p++;
+    }
+    if (!values.empty()) params()[line] = values;
+  }
+  fclose(file);
+  return true;
+}
+
+interruptStats timerInterruptStats(){
+  interruptStats stats;
+  stats.count = timerInterrupts;
+  stats.wallNanoseconds = timerWallNanoseconds;
+  return stats;
+}
+
+interruptStats pinInterruptStats(){
+  interruptStats stats;
+  stats.count = pinInterrupts;
+  stats.wallNanoseconds = pinWallNanoseconds;
+  return stats;
+}
+
+unsigned long warningCount(){ return warnings; }
+
+} // namespace hal
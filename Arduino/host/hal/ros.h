@@ -0,0 +1,139 @@
+/*
+Host stand-in for rosserial_arduino, for the host builds of the firmware.
+
+Messages are plain structs. Publishers count what they publish and keep the
+last message, subscribers keep their callback so the simulation can deliver
+messages, and parameters are served from a table the simulation fills (see
+sim_hal.h).
+*/
+
+#ifndef SML_NEXUS_HOST_ROS_H
+#define SML_NEXUS_HOST_ROS_H
+
+#include "Arduino.h"
+
+namespace ros
+{
+
+class Msg
+{
+};
+
+class Duration
+{
+  public:
+    Duration() : sec(0), nsec(0) {}
+    Duration(uint32_t s, uint32_t ns) : sec(s), nsec(ns) {}
+    int32_t sec, nsec;
+};
+
+class Time
+{
+  public:
+    Time() : sec(0), nsec(0) {}
+    Time(uint32_t s, uint32_t ns) : sec(s), nsec(ns) {}
+    double toSec() const { return sec + 1e-9 * nsec; }
+    Time& operator-=(const Duration& rhs)
+    {
+      int64_t total = (int64_t)sec * 1000000000LL + nsec - ((int64_t)rhs.sec * 1000000000LL + rhs.nsec);
+      sec = total / 1000000000LL;
+      nsec = total % 1000000000LL;
+      return *this;
+    }
+    uint32_t sec, nsec;
+};
+
+//--------------
+//  Publisher
+//--------------
+class Publisher
+{
+  public:
+    Publisher(const char* topic_name, Msg* msg) : topic(topic_name), message(msg), count(0), last(0) {}
+    int publish(const Msg* msg)
+    {
+      last = msg;
+      count++;
+      return 1;
+    }
+
+    const char* topic;
+    Msg* message;
+    unsigned long count; //Messages published
+    const Msg* last;     //Last message published
+};
+
+//--------------
+//  Subscriber
+//--------------
+class SubscriberBase
+{
+  public:
+    explicit SubscriberBase(const char* topic_name) : topic(topic_name) {}
+    virtual ~SubscriberBase() {}
+    const char* topic;
+};
+
+template <typename MsgT>
+class Subscriber : public SubscriberBase
+{
+  public:
+    typedef void (*CallbackT)(const MsgT&);
+    Subscriber(const char* topic_name, CallbackT cb) : SubscriberBase(topic_name), callback(cb) {}
+    CallbackT callback;
+};
+
+class Hardware
+{
+  public:
+    void setBaud(long b) { baud = b; }
+    long baud;
+};
+
+//--------------
+//  Node handle
+//--------------
+class NodeHandle
+{
+  public:
+    void initNode() {}
+    bool connected() { return true; }
+    void spinOnce() {}
+    Hardware* getHardware() { return &hardware; }
+    Time now();
+
+    bool advertise(Publisher& p);
+    template <typename MsgT>
+    bool subscribe(Subscriber<MsgT>& s)
+    {
+      return registerSubscriber(&s);
+    }
+
+    bool getParam(const char* name, int* param, int length = 1, int timeout = 1000);
+    bool getParam(const char* name, float* param, int length = 1, int timeout = 1000);
+
+    void logwarn(const char* msg);
+    void loginfo(const char* msg);
+
+    //Simulation side
+    Publisher* findPublisher(const char* topic);
+    SubscriberBase* findSubscriber(const char* topic);
+
+  private:
+    bool registerSubscriber(SubscriberBase* s);
+    Hardware hardware;
+};
+
+} // namespace ros
+
+namespace std_msgs
+{
+struct Header
+{
+  uint32_t seq;
+  ros::Time stamp;
+  const char* frame_id;
+};
+}
+
+#endif // SML_NEXUS_HOST_ROS_H
@@ -0,0 +1,18 @@
+#ifndef SML_NEXUS_HOST_SENSOR_MSGS_RANGE_H
+#define SML_NEXUS_HOST_SENSOR_MSGS_RANGE_H
+#include "ros.h"
+namespace sensor_msgs
+{
+struct Range : public ros::Msg
+{
+  Range() : radiation_type(0), field_of_view(0), min_range(0), max_range(0), range(0) { header.frame_id = ""; }
+  enum { ULTRASOUND = 0, INFRARED = 1 };
+  std_msgs::Header header;
+  uint8_t radiation_type;
+  float field_of_view;
+  float min_range;
+  float max_range;
+  float range;
+};
+}
+#endif
@@ -0,0 +1,14 @@
+#ifndef SML_NEXUS_HOST_SENSOR_MSGS_TEMPERATURE_H
+#define SML_NEXUS_HOST_SENSOR_MSGS_TEMPERATURE_H
+#include "ros.h"
+namespace sensor_msgs
+{
+struct Temperature : public ros::Msg
+{
+  Temperature() : temperature(0), variance(0) { header.frame_id = ""; }
+  std_msgs::Header header;
+  double temperature;
+  double variance;
+};
+}
+#endif
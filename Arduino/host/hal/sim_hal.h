@@ -0,0 +1,46 @@
+/*
+Simulation side of the host stand-ins of Arduino.h and ros.h: moves time,
+drives input pins, reads PWM outputs, serves parameters and exposes the
+ROS topics of the firmware.
+*/
+
+#ifndef SML_NEXUS_HOST_SIM_HAL_H
+#define SML_NEXUS_HOST_SIM_HAL_H
+
+#include "Arduino.h"
+#include "ros.h"
+
+namespace hal
+{
+
+//Advance the clock, running the Timer5 compare interrupt when it is due
+void advanceMicros(unsigned long us);
+
+//Input pins: a level change runs the interrupt attached to the pin
+//and the pin change interrupt of its group, when enabled
+void setPinLevel(uint8_t pin, uint8_t level);
+
+//Last analogWrite() value of a pin
+int pwmOutput(uint8_t pin);
+
+//Parameter server, from "name: value" and "name: [v1, v2, ...]" lines
+void setParam(const char* name, const float* values, int length);
+bool loadParams(const char* path);
+
+//Time spent in the Timer5 compare interrupt
+struct interruptStats
+{
+  unsigned long count;
+  double wallNanoseconds;
+};
+interruptStats timerInterruptStats();
+
+//Time spent in the pin and pin change interrupts
+interruptStats pinInterruptStats();
+
+//Warnings logged by the firmware
+unsigned long warningCount();
+
+} // namespace hal
+
+#endif // SML_NEXUS_HOST_SIM_HAL_H
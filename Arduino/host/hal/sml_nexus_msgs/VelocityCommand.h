@@ -0,0 +1,12 @@
+#ifndef SML_NEXUS_HOST_SML_NEXUS_MSGS_VELOCITYCOMMAND_H
+#define SML_NEXUS_HOST_SML_NEXUS_MSGS_VELOCITYCOMMAND_H
+#include "ros.h"
+namespace sml_nexus_msgs
+{
+struct VelocityCommand : public ros::Msg
+{
+  VelocityCommand() : vx(0), vy(0), w(0) {}
+  int16_t vx, vy, w;
+};
+}
+#endif
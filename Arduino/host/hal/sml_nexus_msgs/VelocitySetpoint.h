@@ -0,0 +1,13 @@
+#ifndef SML_NEXUS_HOST_SML_NEXUS_MSGS_VELOCITYSETPOINT_H
+#define SML_NEXUS_HOST_SML_NEXUS_MSGS_VELOCITYSETPOINT_H
+#include "ros.h"
+namespace sml_nexus_msgs
+{
+struct VelocitySetpoint : public ros::Msg
+{
+  VelocitySetpoint() : t(0), vx(0), vy(0), w(0) {}
+  uint16_t t;
+  int16_t vx, vy, w;
+};
+}
+#endif
@@ -0,0 +1,15 @@
+#ifndef SML_NEXUS_HOST_SML_NEXUS_MSGS_VELOCITYTRAJECTORY_H
+#define SML_NEXUS_HOST_SML_NEXUS_MSGS_VELOCITYTRAJECTORY_H
+#include "ros.h"
+#include "sml_nexus_msgs/VelocitySetpoint.h"
+namespace sml_nexus_msgs
+{
+struct VelocityTrajectory : public ros::Msg
+{
+  VelocityTrajectory() : setpoints_length(0), setpoints(0) {}
+  ros::Time stamp;
+  uint32_t setpoints_length;
+  VelocitySetpoint* setpoints;
+};
+}
+#endif
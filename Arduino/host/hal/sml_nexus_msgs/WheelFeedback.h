@@ -0,0 +1,19 @@
+#ifndef SML_NEXUS_HOST_SML_NEXUS_MSGS_WHEELFEEDBACK_H
+#define SML_NEXUS_HOST_SML_NEXUS_MSGS_WHEELFEEDBACK_H
+#include "ros.h"
+namespace sml_nexus_msgs
+{
+struct WheelFeedback : public ros::Msg
+{
+  WheelFeedback() : seq(0), dt(0)
+  {
+    ticks[0] = ticks[1] = ticks[2] = ticks[3] = 0;
+    speed[0] = speed[1] = speed[2] = speed[3] = 0;
+  }
+  uint16_t seq;
+  uint16_t dt;
+  int16_t ticks[4];
+  int16_t speed[4];
+};
+}
+#endif
@@ -0,0 +1,14 @@
+#ifndef SML_NEXUS_HOST_SML_NEXUS_MSGS_WHEELVELOCITYSTAMPED_H
+#define SML_NEXUS_HOST_SML_NEXUS_MSGS_WHEELVELOCITYSTAMPED_H
+#include "ros.h"
+namespace sml_nexus_msgs
+{
+struct WheelVelocityStamped : public ros::Msg
+{
+  WheelVelocityStamped() : UL(0), UR(0), LL(0), LR(0), dt(0) { header.frame_id = ""; }
+  std_msgs::Header header;
+  float UL, UR, LL, LR;
+  float dt;
+};
+}
+#endif
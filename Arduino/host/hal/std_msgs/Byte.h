@@ -0,0 +1,12 @@
+#ifndef SML_NEXUS_HOST_STD_MSGS_BYTE_H
+#define SML_NEXUS_HOST_STD_MSGS_BYTE_H
+#include "ros.h"
+namespace std_msgs
+{
+struct Byte : public ros::Msg
+{
+  Byte() : data(0) {}
+  int8_t data;
+};
+}
+#endif
@@ -0,0 +1,13 @@
+#ifndef SML_NEXUS_HOST_STD_MSGS_BYTEMULTIARRAY_H
+#define SML_NEXUS_HOST_STD_MSGS_BYTEMULTIARRAY_H
+#include "ros.h"
+namespace std_msgs
+{
+struct ByteMultiArray : public ros::Msg
+{
+  ByteMultiArray() : data_length(0), data(0) {}
+  uint32_t data_length;
+  int8_t* data;
+};
+}
+#endif
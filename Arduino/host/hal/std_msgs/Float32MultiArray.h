@@ -0,0 +1,13 @@
+#ifndef SML_NEXUS_HOST_STD_MSGS_FLOAT32MULTIARRAY_H
+#define SML_NEXUS_HOST_STD_MSGS_FLOAT32MULTIARRAY_H
+#include "ros.h"
+namespace std_msgs
+{
+struct Float32MultiArray : public ros::Msg
+{
+  Float32MultiArray() : data_length(0), data(0) {}
+  uint32_t data_length;
+  float* data;
+};
+}
+#endif
@@ -0,0 +1,12 @@
+#ifndef SML_NEXUS_HOST_STD_MSGS_STRING_H
+#define SML_NEXUS_HOST_STD_MSGS_STRING_H
+#include "ros.h"
+namespace std_msgs
+{
+struct String : public ros::Msg
+{
+  String() : data("") {}
+  const char* data;
+};
+}
+#endif
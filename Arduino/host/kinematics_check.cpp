@@ -0,0 +1,251 @@
+//==========================================================
+//  Cross-check of the robot kinematics
+//
+//  sml_nexus_kinematics.h is the single source of the
+//  geometry of the robots. This checks that what still
+//  maps twists and wheel speeds elsewhere agrees with it:
+//    - computeWheelVelCmd() and the calibrated travel per
+//      tick of the firmware, compiled from the sketch
+//    - computeVel(), computeWheelVel() and the slip
+//      residual of PlanarOdometry (sml_nexus_robot), on
+//      which the EKF, the calibration and the fleet
+//      odometry server run
+//    - MecanumWheelModel of the Gazebo plugin and the
+//      FleetSimulation of the fleet simulator, which map
+//      through it, and their default parameters
+//    - the wheel radius of sml_nexus.xacro and the
+//      geometry of the plugin in sml_nexus.gazebo
+//  for random twists and wheelbases.
+//
+//  Usage: kinematics_check
+//  Exits with an error on any disagreement.
+//==========================================================
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include "firmware_core.h"
+#include "sml_nexus_kinematics.h"
+#include "sml_nexus_robot/planar_odometry.h"
+#include "sml_nexus_gazebo/mecanum_wheel_model.h"
+#include "sml_nexus_gazebo/fleet_simulation.h"
+
+#ifndef DESCRIPTION_DIR
+#define DESCRIPTION_DIR "sml_nexus_description/urdf"
+#endif
+
+typedef nexusGeometry<nexusMecanum2x> geometry;
+
+static_assert(nexusGeometry<nexusMecanum4x>::leverArm() == geometry::leverArm(), "Variants share the base");
+static_assert(geometry::tickToMeters() > 2.0453e-4 && geometry::tickToMeters() < 2.0454e-4, "2 pi 0.05 m / 1536");
+
+static int failures = 0;
+
+static void report(const char* name, double error, double tolerance){
+    const bool ok = error <= tolerance;
+    if (!ok) failures++;
+    std::printf("%-44s %12.3g %12.3g  %s\n", name, error, tolerance, ok ? "ok" : "FAILED");
+}
+
+//Random twist within 0.5 m/s per wheel, the firmware max_speed
+static void randomTwist(std::mt19937& random, double twist[3]){
+    std::uniform_real_distribution<double> unit(-1.0, 1.0);
+    twist[0] = 0.2 * unit(random);
+    twist[1] = 0.15 * unit(random);
+    twist[2] = 0.45 * unit(random);
+}
+
+//=====================================================
+//  Firmware: wheel setpoints of the velocity command,
+//  nominal and with a calibrated wheelbase
+//=====================================================
+static void checkFirmware(std::mt19937& random){
+    double nominal = 0, calibrated = 0;
+    for (int n = 0; n < 10000; n++){
+        double twist[3];
+        randomTwist(random, twist);
+        vx = twist[0];
+        vy = twist[1];
+        w = twist[2];
+
+        const float scales[4] = {1, 1, 1, 1};
+        mecanumKinematicsSetup(kinematics, (float)geometry::wheelbase(), (float)robotGeometry::tickToMeters(), scales);
+        computeWheelVelCmd();
+        double firmware[4] = {ULspeed, URspeed, LLspeed, LRspeed};
+        for (int i = 0; i < 4; i++){
+            nominal = std::max(nominal, std::fabs(firmware[i] - geometry::wheelSpeed(i, twist[0], twist[1], twist[2])));
+        }
+
+        const double wheelbase = 0.13 + 0.04 * (n % 100) / 100.0;
+        mecanumKinematicsSetup(kinematics, (float)wheelbase, (float)robotGeometry::tickToMeters(), scales);
+        computeWheelVelCmd();
+        sml_nexus_robot::PlanarOdometry odometry(wheelbase);
+        sml_nexus_robot::PlanarTwist planar = {twist[0], twist[1], twist[2]};
+        double expected[4];
+        odometry.computeWheelVel(planar, expected);
+        firmware[0] = ULspeed;
+        firmware[1] = URspeed;
+        firmware[2] = LLspeed;
+        firmware[3] = LRspeed;
+        for (int i = 0; i < 4; i++) calibrated = std::max(calibrated, std::fabs(firmware[i] - expected[i]));
+    }
+    report("firmware wheel setpoints, nominal [m/s]", nominal, 1e-6);
+    report("firmware wheel setpoints, calibrated [m/s]", calibrated, 1e-6);
+
+    //Calibrated travel per tick
+    const float scales[4] = {0.98f, 1.0f, 1.01f, 1.03f};
+    mecanumKinematicsSetup(kinematics, (float)geometry::wheelbase(), (float)robotGeometry::tickToMeters(), scales);
+#if ENCODER_QUADRATURE_4X
+    const int counts = 3072;
+#else
+    const int counts = 1536;
+#endif
+    double travel = 0;
+    for (int i = 0; i < 4; i++){
+        const double expected = 2.0 * M_PI * 0.05 * scales[i] / counts;
+        travel = std::max(travel, std::fabs(kinematics.tickToMeters[i] - expected) / expected);
+    }
+    report("firmware travel per tick [relative]", travel, 1e-6);
+}
+
+//=====================================================
+//  Odometry: forward map, wheel speeds and slip
+//  residual of PlanarOdometry
+//=====================================================
+static void checkOdometry(std::mt19937& random){
+    std::uniform_real_distribution<double> unit(-1.0, 1.0);
+    double forward = 0, inverse = 0, residual = 0;
+    for (int n = 0; n < 10000; n++){
+        const double wheelbase = 0.13 + 0.04 * (n % 100) / 100.0;
+        const double scales[4] = {1, 1, 1, 1};
+        mecanumKinematics<double> kinematics;
+        mecanumKinematicsSetup(kinematics, wheelbase, geometry::tickToMeters(), scales);
+        sml_nexus_robot::PlanarOdometry odometry(wheelbase);
+
+        double wheels[4], twist[3];
+        for (int i = 0; i < 4; i++) wheels[i] = 0.5 * unit(random);
+        mecanumForward(kinematics, wheels, twist);
+        const sml_nexus_robot::PlanarTwist planar = odometry.computeVel(wheels[0], wheels[1], wheels[2], wheels[3]);
+        forward = std::max(forward, std::max(std::fabs(planar.vx - twist[0]),
+                                             std::max(std::fabs(planar.vy - twist[1]), std::fabs(planar.wz - twist[2]))));
+
+        //What the twist does not explain is the slip residual, on (1, 1, -1, -1)
+        double fitted[4];
+        mecanumInverse(kinematics, twist[0], twist[1], twist[2], fitted);
+        const double slip = odometry.computeSlipResidual(wheels[0], wheels[1], wheels[2], wheels[3]);
+        const double pattern[4] = {1, 1, -1, -1};
+        for (int i = 0; i < 4; i++) residual = std::max(residual, std::fabs(wheels[i] - fitted[i] - slip * pattern[i]));
+
+        double planar_wheels[4];
+        odometry.computeWheelVel(planar, planar_wheels);
+        for (int i = 0; i < 4; i++) inverse = std::max(inverse, std::fabs(planar_wheels[i] - fitted[i]));
+    }
+    report("PlanarOdometry::computeVel [m/s, rad/s]", forward, 1e-12);
+    report("PlanarOdometry::computeWheelVel [m/s]", inverse, 1e-12);
+    report("PlanarOdometry::computeSlipResidual [m/s]", residual, 1e-12);
+}
+
+//=====================================================
+//  Simulation: MecanumWheelModel maps, FleetSimulation
+//  wheels driven without lag, and their defaults
+//=====================================================
+static void checkSimulation(std::mt19937& random){
+    const sml_nexus_gazebo::MecanumWheelModel::Parameters parameters;
+    const double scales[4] = {1, 1, 1, 1};
+    mecanumKinematics<double> kinematics;
+    mecanumKinematicsSetup(kinematics, parameters.wheelbase, geometry::tickToMeters(), scales);
+    double maps = 0;
+    for (int n = 0; n < 10000; n++){
+        double twist[3], wheels[4], model_wheels[4];
+        randomTwist(random, twist);
+        const sml_nexus_gazebo::PlanarVelocity velocity = {twist[0], twist[1], twist[2]};
+        mecanumInverse(kinematics, twist[0], twist[1], twist[2], wheels);
+        sml_nexus_gazebo::MecanumWheelModel::inverse(velocity, parameters.wheelbase, model_wheels);
+        const sml_nexus_gazebo::PlanarVelocity back = sml_nexus_gazebo::MecanumWheelModel::forward(model_wheels, parameters.wheelbase);
+        for (int i = 0; i < 4; i++) maps = std::max(maps, std::fabs(wheels[i] - model_wheels[i]));
+        maps = std::max(maps, std::max(std::fabs(back.x - twist[0]), std::max(std::fabs(back.y - twist[1]), std::fabs(back.yaw - twist[2]))));
+    }
+    report("MecanumWheelModel maps [m/s, rad/s]", maps, 1e-12);
+    report("MecanumWheelModel default wheelbase [m]", std::fabs(parameters.wheelbase - geometry::wheelbase()), 0);
+    report("MecanumWheelModel default wheel radius [m]", std::fabs(parameters.wheel_radius - nexusMecanum2x::wheelRadius()), 0);
+    report("MecanumWheelModel default encoder CPR", std::abs(parameters.encoder_cpr - nexusMecanum2x::encoderCPR()), 0);
+
+    //The wheels of a fleet robot reach their setpoints in one step, and
+    //its twist is then the command
+    sml_nexus_gazebo::FleetSimulation::Parameters fleet_parameters;
+    fleet_parameters.time_constant = 0.0;
+    fleet_parameters.max_wheel_speed = 10.0;
+    sml_nexus_gazebo::FleetSimulation fleet(1, fleet_parameters);
+    double fleet_maps = 0;
+    for (int n = 0; n < 1000; n++){
+        double twist[3], vx, vy, w;
+        randomTwist(random, twist);
+        fleet.setCommand(0, twist[0], twist[1], twist[2], n * 0.01);
+        fleet.step(n * 0.01, 0.01);
+        fleet.velocity(0, vx, vy, w);
+        fleet_maps = std::max(fleet_maps, std::max(std::fabs(vx - twist[0]), std::max(std::fabs(vy - twist[1]), std::fabs(w - twist[2]))));
+    }
+    const sml_nexus_gazebo::FleetSimulation::Parameters fleet_defaults;
+    report("FleetSimulation wheel round trip [m/s, rad/s]", fleet_maps, 1e-12);
+    report("FleetSimulation default wheelbase [m]", std::fabs(fleet_defaults.wheelbase - geometry::wheelbase()), 0);
+    report("FleetSimulation default wheel radius [m]", std::fabs(fleet_defaults.wheel_radius - nexusMecanum2x::wheelRadius()), 0);
+    report("FleetSimulation default encoder CPR", std::abs(fleet_defaults.encoder_cpr - nexusMecanum2x::encoderCPR()), 0);
+}
+
+//=====================================================
+//  Robot description: numbers in the xacro property
+//  and the plugin tags, missing ones reported as such
+//=====================================================
+static bool readFile(const std::string& path, std::string& text){
+    std::ifstream file(path.c_str());
+    if (!file) return false;
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    text = buffer.str();
+    return true;
+}
+
+//Number after the first occurrence of key, skipping quotes and spaces
+static bool numberAfter(const std::string& text, const std::string& key, double& value){
+    const size_t start = text.find(key);
+    if (start == std::string::npos) return false;
+    const char* begin = text.c_str() + start + key.size();
+    while (*begin == '"' || *begin == ' ') begin++;
+    char* end;
+    value = std::strtod(begin, &end);
+    return end != begin;
+}
+
+static void checkDescription(){
+    const std::string directory = DESCRIPTION_DIR;
+    std::string xacro, gazebo;
+    double radius = NAN, wheelbase = NAN, plugin_radius = NAN, cpr = NAN;
+    if (readFile(directory + "/sml_nexus.xacro", xacro)) numberAfter(xacro, "name=\"wheel_radius\" value=", radius);
+    if (readFile(directory + "/sml_nexus.gazebo", gazebo)){
+        numberAfter(gazebo, "<wheelbase>", wheelbase);
+        numberAfter(gazebo, "<wheelRadius>", plugin_radius);
+        numberAfter(gazebo, "<encoderCpr>", cpr);
+    }
+    //NaN when not found: reported as a failure
+    report("sml_nexus.xacro wheel_radius [m]", std::isnan(radius) ? INFINITY : std::fabs(radius - nexusMecanum2x::wheelRadius()), 0);
+    report("sml_nexus.gazebo wheelbase [m]", std::isnan(wheelbase) ? INFINITY : std::fabs(wheelbase - geometry::wheelbase()), 0);
+    report("sml_nexus.gazebo wheelRadius [m]", std::isnan(plugin_radius) ? INFINITY : std::fabs(plugin_radius - nexusMecanum2x::wheelRadius()), 0);
+    report("sml_nexus.gazebo encoderCpr", std::isnan(cpr) ? INFINITY : std::fabs(cpr - nexusMecanum2x::encoderCPR()), 0);
+}
+
+int main(){
+    std::mt19937 random(1);
+    std::printf("lever arm L1 + L2 %.3f m, travel per tick %.6g m (%d counts), %.6g m (%d counts)\n\n",
+                geometry::leverArm(), geometry::tickToMeters(), (int)nexusMecanum2x::encoderCPR(),
+                nexusGeometry<nexusMecanum4x>::tickToMeters(), (int)nexusMecanum4x::encoderCPR());
+    std::printf("%-44s %12s %12s\n", "", "max error", "tolerance");
+    checkFirmware(random);
+    checkOdometry(random);
+    checkSimulation(random);
+    checkDescription();
+    std::printf("%s\n", failures == 0 ? "OK" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
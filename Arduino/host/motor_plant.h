@@ -0,0 +1,101 @@
+/*
+Simulated DC gear motor and encoder of a nexus wheel, for the host builds.
+
+The motor is driven by the PWM duty of its two driver pins:
+  J dw/dt = kt/R (V - ke w) - b w - Coulomb friction,  V = duty * supply
+with static friction holding the wheel until the drive torque exceeds it.
+The default constants put the speed/PWM curve close to the feedforward
+polynomials of nexus_pid_params.yaml: about 20 PWM to break away, 120 PWM
+at 0.3 m/s and a 50 ms mechanical time constant.
+
+The encoder side turns wheel rotation into the quadrature sequence of the
+A and B pins, one level change at a time, in the phase order the firmware
+interrupts read as the right direction.
+*/
+
+#ifndef SML_NEXUS_HOST_MOTOR_PLANT_H
+#define SML_NEXUS_HOST_MOTOR_PLANT_H
+
+#include <cmath>
+#include "sim_hal.h"
+#include "firmware_core.h"
+
+struct dcMotorParams
+{
+  dcMotorParams()
+    : supplyVoltage(12.0), resistance(2.0), motorConstant(0.78), inertia(0.0152),
+      viscousFriction(0.0), coulombFriction(0.37), wheelRadius(0.05), encoderCPR(1536) {}
+  double supplyVoltage;   //V
+  double resistance;      //Ohm
+  double motorConstant;   //V.s/rad and N.m/A, at the wheel
+  double inertia;         //kg.m^2, wheel and share of the robot, at the wheel
+  double viscousFriction; //N.m.s/rad
+  double coulombFriction; //N.m
+  double wheelRadius;     //m
+  int encoderCPR;         //channel A edges per wheel revolution, half the quadrature states
+};
+
+class dcMotorPlant
+{
+  public:
+    explicit dcMotorPlant(const dcMotorParams& p = dcMotorParams()) : params(p), omega(0), angle(0) {}
+
+    //Integrate over dt seconds with duty in [-1, 1]
+    void step(double duty, double dt)
+    {
+      const double drive = params.motorConstant / params.resistance
+                           * (duty * params.supplyVoltage - params.motorConstant * omega);
+      if (omega == 0 && std::fabs(drive) <= params.coulombFriction) return; //held by static friction
+
+      const double friction = params.coulombFriction * (omega != 0 ? (omega > 0 ? 1 : -1) : (drive > 0 ? 1 : -1));
+      const double next = omega + dt * (drive - params.viscousFriction * omega - friction) / params.inertia;
+      //Kinetic friction stops the wheel, it does not reverse it
+      omega = (omega != 0 && next * omega < 0) ? 0 : next;
+      angle += omega * dt;
+    }
+
+    double speed() const { return omega * params.wheelRadius; } //m/s
+    long encoderCount() const { return (long)std::floor(angle / (2 * M_PI) * params.encoderCPR); }
+    long quadratureCount() const { return (long)std::floor(angle / (2 * M_PI) * 2 * params.encoderCPR); }
+
+    dcMotorParams params;
+    double omega; //rad/s
+    double angle; //rad
+};
+
+//--------------------------------------------
+// Motor and encoder wired to firmware pins
+//--------------------------------------------
+class simulatedWheel
+{
+  public:
+    simulatedWheel(const firmwareWheel& w, const dcMotorParams& p = dcMotorParams())
+      : wiring(w), plant(p), phase(0)
+    {
+      hal::setPinLevel(wiring.encoderA, LOW);
+      hal::setPinLevel(wiring.encoderB, LOW);
+    }
+
+    void step(double dt)
+    {
+      const double duty = (hal::pwmOutput(wiring.pwmPin1) - hal::pwmOutput(wiring.pwmPin2)) / 255.0;
+      plant.step(duty, dt);
+
+      //Walk the quadrature phases one at a time: (A, B) = 00, 10, 11, 01.
+      //Stepping forward, A changes with B at the other level, which the
+      //firmware counts down when sameLevelCount is positive
+      const long target = -wiring.sameLevelCount * plant.quadratureCount();
+      while (phase != target){
+        phase += target > phase ? 1 : -1;
+        const int state = (int)(((phase % 4) + 4) % 4);
+        hal::setPinLevel(wiring.encoderA, state == 1 || state == 2 ? HIGH : LOW);
+        hal::setPinLevel(wiring.encoderB, state >= 2 ? HIGH : LOW);
+      }
+    }
+
+    firmwareWheel wiring;
+    dcMotorPlant plant;
+    long phase;  //Quadrature phase of the encoder
+};
+
+#endif // SML_NEXUS_HOST_MOTOR_PLANT_H
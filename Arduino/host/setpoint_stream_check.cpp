@@ -0,0 +1,258 @@
+//==========================================================
+//  Check of the setpoint streaming buffer
+//
+//  A host follows a smooth reference twist and talks to
+//  the controller at 20 Hz over a link with 5 to 15 ms of
+//  delay and, in the hiccup runs, an outage of 50 to
+//  100 ms every 2 s after which the queued messages arrive
+//  at once. The host either
+//    - sends the twist of the moment, held by the
+//      controller until the next one (cmd_vel_compact)
+//    - streams batches of 7 setpoints 50 ms apart, 300 ms
+//      ahead, sampled by sml_nexus_setpoint_buffer.h at
+//      every control tick as the firmware does
+//      (cmd_vel_trajectory)
+//  and reports the RMS and largest error of the wheel
+//  setpoints against the reference, the stop of the
+//  stream when the link goes silent, and the cost of
+//  sampling the buffer on the host.
+//
+//  Usage: setpoint_stream_check [-s seconds]
+//  Exits with an error if the hiccups degrade the streamed
+//  setpoints, or if the stop ramp decelerates faster than
+//  the stop deceleration or does not reach a standstill.
+//==========================================================
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include "sml_nexus_setpoint_buffer.h"
+#include "sml_nexus_kinematics.h"
+
+static const double tick_period = 0.01;     //s, 100 Hz control tick
+static const double send_period = 0.05;     //s, 20 Hz host
+static const double turn_radius = nexusGeometry<nexusMecanum2x>::leverArm(); //m, L1 + L2
+static const double stop_deceleration = 1.0; //m/s^2, default of the firmware
+static const double comm_timeout = 0.5;     //s
+static const int batch_size = 7;
+static const double batch_spacing = 0.05;   //s
+
+//Reference twist: vx, vy (m/s), w (rad/s), within 0.5 m/s per wheel
+static void reference(double t, double twist[3]){
+    twist[0] = 0.25 * std::sin(0.8 * t);
+    twist[1] = 0.1 * std::sin(0.5 * t + 1.0);
+    twist[2] = 0.5 * std::sin(0.6 * t + 2.0);
+}
+
+//Wheel speeds UL, UR, LL, LR as computeWheelVelCmd() maps them
+static void wheelSpeeds(const double twist[3], double wheels[4]){
+    for (int i = 0; i < 4; i++) wheels[i] = nexusGeometry<nexusMecanum2x>::wheelSpeed(i, twist[0], twist[1], twist[2]);
+}
+
+struct Message
+{
+    double sent;     //s, host time
+    double arrival;  //s, device time
+};
+
+struct Result
+{
+    double rms;      //m/s, wheel setpoint error
+    double max;      //m/s
+};
+
+//=====================================================
+//  Arrival times of the messages sent at send_period
+//  over duration, FIFO, with hiccups if asked
+//=====================================================
+static std::deque<Message> linkMessages(double duration, bool hiccups, unsigned seed){
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> jitter(0.005, 0.015);
+    std::uniform_real_distribution<double> outage(0.05, 0.1);
+    std::deque<Message> messages;
+    double outage_start = 1.0, outage_end = hiccups ? 1.0 + outage(random) : 0.0;
+    double last_arrival = 0.0;
+    for (double t = 0.0; t < duration; t += send_period){
+        Message message;
+        message.sent = t;
+        message.arrival = t + jitter(random);
+        if (hiccups){
+            if (t >= outage_end){
+                outage_start += 2.0;
+                outage_end = outage_start + outage(random);
+            }
+            if (message.arrival >= outage_start && message.arrival < outage_end) message.arrival = outage_end + 0.001;
+        }
+        message.arrival = std::max(message.arrival, last_arrival);
+        last_arrival = message.arrival;
+        messages.push_back(message);
+    }
+    return messages;
+}
+
+static uint32_t toMicros(double t){
+    return static_cast<uint32_t>(std::llround(t * 1e6));
+}
+
+//Error of the wheel setpoints at a control tick
+static void accumulate(double t, const double twist[3], double& square_sum, double& max_error, long& samples){
+    double expected[3], wheels[4], expected_wheels[4];
+    reference(t, expected);
+    wheelSpeeds(twist, wheels);
+    wheelSpeeds(expected, expected_wheels);
+    for (int i = 0; i < 4; i++){
+        const double error = wheels[i] - expected_wheels[i];
+        square_sum += error * error;
+        max_error = std::max(max_error, std::fabs(error));
+    }
+    samples += 4;
+}
+
+//=====================================================
+//  Controller holding the last twist received
+//=====================================================
+static Result runDirect(double duration, bool hiccups){
+    std::deque<Message> messages = linkMessages(duration, hiccups, 1);
+    double twist[3] = {0, 0, 0}, held[3] = {0, 0, 0};
+    double timeout = -1.0, square_sum = 0, max_error = 0;
+    long samples = 0;
+    for (double t = tick_period; t < duration; t += tick_period){
+        while (!messages.empty() && messages.front().arrival <= t){
+            reference(messages.front().sent, held);
+            for (int k = 0; k < 3; k++) held[k] = std::round(held[k] * 1000) * 0.001; //mm/s, mrad/s
+            timeout = messages.front().arrival + comm_timeout;
+            messages.pop_front();
+        }
+        for (int k = 0; k < 3; k++) twist[k] = t < timeout ? held[k] : 0.0;
+        if (t > 1.0) accumulate(t, twist, square_sum, max_error, samples);
+    }
+    Result result = {std::sqrt(square_sum / samples), max_error};
+    return result;
+}
+
+//=====================================================
+//  Controller sampling the streamed setpoints, as
+//  trajectoryCb() and sampleStreamedSetpoints() do
+//=====================================================
+static void loadBatch(setpointBuffer& buffer, double sent, double arrival, const float current[3]){
+    const int32_t age = static_cast<int32_t>(std::lround((arrival - sent) * 1e6));
+    setpointBufferClear(buffer, toMicros(arrival) - age);
+    if (age < 0){
+        setpointBufferAppend(buffer, age, (int16_t)(current[0] * 1000), (int16_t)(current[1] * 1000),
+                             (int16_t)(current[2] * 1000));
+    }
+    for (int i = 0; i < batch_size; i++){
+        double twist[3];
+        reference(sent + i * batch_spacing, twist);
+        setpointBufferAppend(buffer, static_cast<int32_t>(std::lround(i * batch_spacing * 1e6)),
+                             (int16_t)std::lround(twist[0] * 1000), (int16_t)std::lround(twist[1] * 1000),
+                             (int16_t)std::lround(twist[2] * 1000));
+    }
+    setpointBufferFinish(buffer, stop_deceleration, turn_radius);
+}
+
+static Result runStreamed(double duration, bool hiccups){
+    std::deque<Message> messages = linkMessages(duration, hiccups, 1);
+    setpointBuffer buffer;
+    setpointBufferClear(buffer, 0);
+    float setpoint[3] = {0, 0, 0};
+    double square_sum = 0, max_error = 0;
+    long samples = 0;
+    for (double t = tick_period; t < duration; t += tick_period){
+        while (!messages.empty() && messages.front().arrival <= t){
+            loadBatch(buffer, messages.front().sent, messages.front().arrival, setpoint);
+            messages.pop_front();
+        }
+        setpointBufferSample(buffer, toMicros(t), setpoint);
+        const double twist[3] = {setpoint[0], setpoint[1], setpoint[2]};
+        if (t > 1.0) accumulate(t, twist, square_sum, max_error, samples);
+    }
+    Result result = {std::sqrt(square_sum / samples), max_error};
+    return result;
+}
+
+//=====================================================
+//  Link silent after a batch sent at full speed: the
+//  fastest wheel must ramp down at the stop
+//  deceleration and reach a standstill
+//=====================================================
+static bool checkStop(){
+    setpointBuffer buffer;
+    const float current[3] = {0, 0, 0};
+    //Moment of the reference with the fastest wheels
+    double sent = 0, fastest = 0;
+    for (double t = 0; t < 20; t += 0.01){
+        double twist[3];
+        reference(t, twist);
+        const double speed = std::fabs(twist[0]) + std::fabs(twist[1]) + turn_radius * std::fabs(twist[2]);
+        if (speed > fastest){
+            fastest = speed;
+            sent = t;
+        }
+    }
+    sent -= (batch_size - 1) * batch_spacing;
+    loadBatch(buffer, sent, sent + 0.01, current);
+
+    const double horizon = sent + (batch_size - 1) * batch_spacing;
+    double twist[3], last_speed = 0, worst_deceleration = 0, stopped_at = -1;
+    float setpoint[3];
+    for (double t = horizon; t < horizon + 2.0; t += tick_period){
+        const bool streaming = setpointBufferSample(buffer, toMicros(t), setpoint);
+        for (int k = 0; k < 3; k++) twist[k] = setpoint[k];
+        const double speed = std::fabs(twist[0]) + std::fabs(twist[1]) + turn_radius * std::fabs(twist[2]);
+        if (t > horizon) worst_deceleration = std::max(worst_deceleration, (last_speed - speed) / tick_period);
+        last_speed = speed;
+        if (!streaming && stopped_at < 0) stopped_at = t - horizon;
+    }
+    const double expected_stop = fastest / stop_deceleration;
+    std::printf("\nstream stop: fastest wheel at %.3f m/s, standstill %.0f ms after the last setpoint (%.0f ms at %.1f m/s^2), "
+                "largest deceleration %.3f m/s^2\n", fastest, stopped_at * 1000, expected_stop * 1000,
+                stop_deceleration, worst_deceleration);
+    return stopped_at >= 0 && stopped_at <= expected_stop + 2 * tick_period
+           && worst_deceleration <= stop_deceleration * 1.01 + 0.002 / tick_period;
+}
+
+//Host cost of sampling the buffer once per tick over a batch
+static double sampleCost(){
+    setpointBuffer buffer;
+    const float current[3] = {0, 0, 0};
+    const int rounds = 200000;
+    float setpoint[3], sum = 0;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++){
+        if (r % 40 == 0) loadBatch(buffer, r * tick_period, r * tick_period + 0.01, current);
+        setpointBufferSample(buffer, toMicros(r * tick_period + 0.015), setpoint);
+        sum += setpoint[0];
+    }
+    const double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    volatile float sink = sum; //keep the loop from being optimized away
+    (void)sink;
+    return elapsed / rounds;
+}
+
+int main(int argc, char** argv){
+    double duration = 120.0;
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc) duration = std::atof(argv[++i]);
+    }
+    duration = std::max(duration, 5.0);
+
+    std::printf("wheel setpoint error against the reference over %.0f s, host at %.0f Hz [mm/s]\n", duration, 1 / send_period);
+    std::printf("%-24s %12s %12s %12s %12s\n", "", "RMS", "max", "RMS hiccups", "max hiccups");
+    const Result direct = runDirect(duration, false), direct_hiccups = runDirect(duration, true);
+    const Result streamed = runStreamed(duration, false), streamed_hiccups = runStreamed(duration, true);
+    std::printf("%-24s %12.2f %12.2f %12.2f %12.2f\n", "held twist", direct.rms * 1000, direct.max * 1000,
+                direct_hiccups.rms * 1000, direct_hiccups.max * 1000);
+    std::printf("%-24s %12.2f %12.2f %12.2f %12.2f\n", "streamed setpoints", streamed.rms * 1000, streamed.max * 1000,
+                streamed_hiccups.rms * 1000, streamed_hiccups.max * 1000);
+
+    bool ok = streamed_hiccups.rms <= streamed.rms * 1.1 + 0.001 && streamed_hiccups.max <= streamed.max * 1.1 + 0.001;
+    if (!checkStop()) ok = false;
+    std::printf("sampling: %.1f ns per control tick on the host\n", sampleCost());
+    std::printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+/*
+Simulated URM04 sensors on the RS-485 bus of Serial2, for the host builds.
+
+Commands written by the firmware are parsed from the serial transmit
+buffer. A sensor measures for 40 ms after a trigger; distance and
+temperature requests are answered with a reply frame in the receive buffer.
+*/
+
+#ifndef SML_NEXUS_HOST_URM04_BUS_SIM_H
+#define SML_NEXUS_HOST_URM04_BUS_SIM_H
+
+#include "sim_hal.h"
+#include "sml_nexus_urm04_parser.h"
+
+class urm04BusSim
+{
+  public:
+    urm04BusSim() : replies(0), missedReplies(0), commandLength(0)
+    {
+      for (int i = 0; i < 4; i++){
+        distance[i] = 100 + 50 * i;   //cm
+        temperature[i] = 235;         //0.1 C
+        triggerMicros[i] = 0;
+        triggered[i] = false;
+      }
+    }
+
+    //Handle the commands sent since the last call
+    void step(HardwareSerial& port)
+    {
+      while (port.txTail != port.txHead){
+        const uint8_t data = port.txBuffer[port.txTail++];
+        if (commandLength == 0 && data != URM04_HEADER_1) continue;
+        command[commandLength++] = data;
+        if (commandLength < 6) continue;
+        commandLength = 0;
+        if (command[1] != URM04_HEADER_2 || urm04Checksum(command, 5) != command[5]) continue;
+        handleCommand(port, command[2], command[4]);
+      }
+    }
+
+    unsigned int distance[4];     //cm, of sensors 0x11 to 0x14
+    unsigned int temperature[4];  //0.1 C
+    unsigned long replies;        //Reply frames sent
+    unsigned long missedReplies;  //Distance requested before the measurement was done
+
+  private:
+    void handleCommand(HardwareSerial& port, uint8_t address, uint8_t cmd)
+    {
+      const int id = address - 0x11;
+      if (id < 0 || id > 3) return;
+      if (cmd == 0x01){
+        triggerMicros[id] = micros();
+        triggered[id] = true;
+        return;
+      }
+      unsigned int value;
+      if (cmd == 0x02){
+        if (!triggered[id] || micros() - triggerMicros[id] < 40000){
+          missedReplies++;
+          return;
+        }
+        value = distance[id];
+      }
+      else if (cmd == 0x03){
+        value = temperature[id];
+      }
+      else return;
+
+      uint8_t frame[URM04_FRAME_LENGTH] = {URM04_HEADER_1, URM04_HEADER_2, address, 0x02, cmd,
+                                           (uint8_t)(value >> 8), (uint8_t)(value & 0xFF), 0};
+      frame[7] = urm04Checksum(frame, 7);
+      for (int i = 0; i < URM04_FRAME_LENGTH; i++) port.rxBuffer[port.rxHead++] = frame[i];
+      replies++;
+    }
+
+    uint8_t command[6];
+    uint8_t commandLength;
+    unsigned long triggerMicros[4];
+    bool triggered[4];
+};
+
+#endif // SML_NEXUS_HOST_URM04_BUS_SIM_H
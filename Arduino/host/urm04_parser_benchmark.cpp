@@ -0,0 +1,106 @@
+//==========================================================
+//  Benchmark of the URM04 RS-485 frame parser
+//
+//  Feeds a byte stream through urm04Parser one byte at a
+//  time, as readSensorData() does on the board, and
+//  reports the parsing cost and the frames recovered.
+//
+//  Usage: urm04_parser_benchmark [capture.bin]
+//  Without a capture, a synthetic stream of sensor replies
+//  with line noise and corrupted frames is generated and
+//  the decoded frame count is checked against it.
+//==========================================================
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "sml_nexus_urm04_parser.h"
+
+static const uint8_t sensor_addresses[] = {0x11, 0x12, 0x13, 0x14};
+
+//=============================================
+//  Synthetic stream: distance and temperature
+//  replies, some corrupted, some noise bytes
+//=============================================
+static void generateStream(std::vector<uint8_t>& stream, unsigned long& valid_frames, unsigned long& corrupted_frames){
+    std::srand(42);
+    valid_frames = 0;
+    corrupted_frames = 0;
+    for (int i = 0; i < 200000; i++){
+        uint8_t frame[URM04_FRAME_LENGTH];
+        const uint16_t value = std::rand() % 500;
+        frame[0] = URM04_HEADER_1;
+        frame[1] = URM04_HEADER_2;
+        frame[2] = sensor_addresses[i % 4];
+        frame[3] = 0x02;
+        frame[4] = (i / 4) % 2 ? 0x03 : 0x02;
+        frame[5] = value >> 8;
+        frame[6] = value & 0xFF;
+        frame[7] = urm04Checksum(frame, URM04_FRAME_LENGTH - 1);
+
+        //1 in 20 replies corrupted on the line
+        if (std::rand() % 20 == 0){
+            frame[5 + std::rand() % 2] ^= 0x10;
+            corrupted_frames++;
+        }
+        else{
+            valid_frames++;
+        }
+        stream.insert(stream.end(), frame, frame + URM04_FRAME_LENGTH);
+
+        //Occasional bus noise between replies, never a header byte
+        if (std::rand() % 10 == 0){
+            stream.push_back(0x00);
+            stream.push_back(0xFF);
+        }
+    }
+}
+
+int main(int argc, char** argv){
+    std::vector<uint8_t> stream;
+    unsigned long expected_frames = 0, expected_errors = 0;
+    const bool synthetic = argc < 2;
+
+    if (synthetic){
+        generateStream(stream, expected_frames, expected_errors);
+    }
+    else{
+        FILE* file = std::fopen(argv[1], "rb");
+        if (!file){
+            std::fprintf(stderr, "Could not open %s\n", argv[1]);
+            return 1;
+        }
+        int c;
+        while ((c = std::fgetc(file)) != EOF) stream.push_back(static_cast<uint8_t>(c));
+        std::fclose(file);
+    }
+
+    const int repeats = 20;
+    urm04Parser parser;
+    unsigned long distance_sum = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++){
+        parser = urm04Parser();
+        for (size_t i = 0; i < stream.size(); i++){
+            if (parser.parseByte(stream[i])){
+                distance_sum += parser.frame()[5] * 256 + parser.frame()[6];
+            }
+        }
+    }
+    const auto stop = std::chrono::steady_clock::now();
+    const double bytes = static_cast<double>(stream.size()) * repeats;
+    const double ns_per_byte = std::chrono::duration<double, std::nano>(stop - start).count() / bytes;
+
+    std::printf("bytes:           %zu\n", stream.size());
+    std::printf("ns/byte:         %.2f\n", ns_per_byte);
+    std::printf("frames:          %lu\n", parser.frameCount);
+    std::printf("checksum errors: %lu\n", parser.checksumErrors);
+    std::printf("(value checksum: %lu)\n", distance_sum);
+
+    if (synthetic && (parser.frameCount != expected_frames || parser.checksumErrors != expected_errors)){
+        std::fprintf(stderr, "Expected %lu frames and %lu checksum errors\n", expected_frames, expected_errors);
+        return 1;
+    }
+    return 0;
+}
@@ -13,39 +13,138 @@ TO BE USED ON ARDUINO MEGA
 #include <Adafruit_MotorShield.h>
 #include <geometry_msgs/Twist.h>
 #include <std_msgs/Float32MultiArray.h>
+#include <sml_nexus_msgs/WheelVelocityStamped.h>
+#include <sml_nexus_msgs/WheelFeedback.h>
+#include <sml_nexus_msgs/VelocityCommand.h>
+#include <sml_nexus_msgs/VelocityTrajectory.h>
 #include <PID_v1.h>
 #include "sml_nexus_motor.h"
+#include "sml_nexus_control_kernel.h"
+#include "sml_nexus_speed_estimator.h"
+#include "sml_nexus_setpoint_buffer.h"
+#include "sml_nexus_kinematics.h"
 
 /******************** Variables ****************/
 
-unsigned long prevUpdateTime;
-double long updateOldness;
-double long now;
+double long updateOldness;   //ms, time since the previous encoder latch
+ros::Time encoderLatchTime; //Device time at which the encoder counts were last latched
+unsigned long encoderLatchMicros = 0;
+int16_t encoderTicks[4];      //Tick deltas of the last latch: UL, UR, LL, LR
+
+//Exchange the compact sml_nexus_msgs/WheelFeedback and VelocityCommand messages
+//over the serial link instead of the float arrays and Twist. Needs the
+//cmd_vel_compactor node on the host to translate cmd_vel.
+#define COMPACT_SERIAL_MESSAGES 1
+
+//Also publish the unstamped 5-element wheel_velocity feedback, for nodes that still rely on it.
+//With COMPACT_SERIAL_MESSAGES, also keep wheel_velocity_stamped and the cmd_vel subscriber,
+//at the cost of part of the link bandwidth the compact messages save. Off by default, the
+//odometry nodes decode wheel_feedback; opt in with -DPUBLISH_LEGACY_WHEEL_VELOCITY=1
+#ifndef PUBLISH_LEGACY_WHEEL_VELOCITY
+#define PUBLISH_LEGACY_WHEEL_VELOCITY 0
+#endif
+
+//Wheel speeds are published as floats, on wheel_velocity_stamped. The identification
+//firmware keeps them for the feedforward_identification node
+#define PUBLISH_WHEEL_VELOCITY (!COMPACT_SERIAL_MESSAGES || PUBLISH_LEGACY_WHEEL_VELOCITY || OPEN_LOOP_PWM_COMMAND)
+
+//Run the wheel controllers with the fixed-point kernel of sml_nexus_control_kernel.h
+//instead of the float feedforward polynomial and PID_v1
+#define FIXED_POINT_CONTROL 1
+
+//Decode both encoder channels (4x, 3072 counts per wheel revolution) instead of
+//the edges of channel A only (2x, 1536 counts). Channel B of the LR encoder is on
+//pin 12, also driven by the LL motor, so the LR encoder stays on channel A and
+//counts 2 per edge. Set the encoder_cpr parameter of the odometry broadcaster to
+//3072 when enabled.
+#ifndef ENCODER_QUADRATURE_4X
+#define ENCODER_QUADRATURE_4X 0
+#endif
+
+//Measure wheel speeds from the time between encoder edges, blended with the
+//tick count over the period, instead of the tick count only
+#define ENCODER_EDGE_TIMING 1
+
+//Accept batches of future velocity setpoints on cmd_vel_trajectory, interpolated
+//at every control tick and ramped down to a stop when the stream runs out, so that
+//the host can stream ahead of link hiccups. Commands on cmd_vel or cmd_vel_compact
+//cancel the stream
+#define SETPOINT_STREAMING 1
+
+//Drive the motors open loop from PWM commands on cmd_pwm (UL, UR, LL, LR, -245 to 245),
+//for the feedforward identification. Velocity commands take over while they are received.
+//Only enable it in the firmware flashed for the identification, for instance with
+//arduino-cli compile --build-property compiler.cpp.extra_flags=-DOPEN_LOOP_PWM_COMMAND=1
+#ifndef OPEN_LOOP_PWM_COMMAND
+#define OPEN_LOOP_PWM_COMMAND 0
+#endif
+
+/************ Control tick configuration ************/
+#define CONTROL_TICK_RATE_HZ 100                              //Control loop rate, 100 to 200 Hz
+#define CONTROL_TICK_PERIOD_US (1000000UL / CONTROL_TICK_RATE_HZ)
+#define FEEDBACK_DECIMATION 2                                 //Publish wheel feedback every N control ticks
+#define FEEDBACK_RATE_HZ ((float)CONTROL_TICK_RATE_HZ / FEEDBACK_DECIMATION) //Nominal wheel feedback rate
+#define TICK_STATS_PERIOD 1000                                //ms, period of the tick statistics
+
+//Encoder pins are read from their port registers in the interrupts,
+//PINx and bit of each pin on the Arduino Mega
 
 //UR wheel motor
-int intCount3 = 0;
+volatile int16_t intCount3 = 0;
 #define MOTOR3_ENC_A 18
 #define MOTOR3_ENC_B A14
+#define MOTOR3_ENC_A_PORT PIND
+#define MOTOR3_ENC_A_BIT (1 << PD3)
+#define MOTOR3_ENC_B_PORT PINK
+#define MOTOR3_ENC_B_BIT (1 << PK6)
 nexusMotor URMotor(8, 9);
 
 //LR wheel motor
-int intCount4 = 0;
+volatile int16_t intCount4 = 0;
 #define MOTOR4_ENC_A 2
 #define MOTOR4_ENC_B 12
+#define MOTOR4_ENC_A_PORT PINE
+#define MOTOR4_ENC_A_BIT (1 << PE4)
+#define MOTOR4_ENC_B_PORT PINB
+#define MOTOR4_ENC_B_BIT (1 << PB6)
 nexusMotor LRMotor(10, 11);
 
 //LL wheel motor
-int intCount1 = 0;
+volatile int16_t intCount1 = 0;
 #define MOTOR1_ENC_A 3
 #define MOTOR1_ENC_B 13
+#define MOTOR1_ENC_A_PORT PINE
+#define MOTOR1_ENC_A_BIT (1 << PE5)
+#define MOTOR1_ENC_B_PORT PINB
+#define MOTOR1_ENC_B_BIT (1 << PB7)
 nexusMotor LLMotor(5, 12);
 
 //UL wheel motor
-int intCount2 = 0;
+volatile int16_t intCount2 = 0;
 #define MOTOR2_ENC_A 19
 #define MOTOR2_ENC_B A12
+#define MOTOR2_ENC_A_PORT PIND
+#define MOTOR2_ENC_A_BIT (1 << PD2)
+#define MOTOR2_ENC_B_PORT PINK
+#define MOTOR2_ENC_B_BIT (1 << PK4)
 nexusMotor ULMotor(7, 6);
 
+#if ENCODER_QUADRATURE_4X
+#define ENCODER_LR_STEP 2      //Counts per channel A edge of the LR encoder
+uint8_t prevEncoderLevelsK = 0; //Levels of port K at the last pin change interrupt
+#else
+#define ENCODER_LR_STEP 1
+#endif
+
+//Time of the last edge of each encoder, recorded by the interrupts
+volatile unsigned long edgeMicros1 = 0;
+volatile unsigned long edgeMicros2 = 0;
+volatile unsigned long edgeMicros3 = 0;
+volatile unsigned long edgeMicros4 = 0;
+edgeSpeedEstimator speedEstimators[4]; //UL, UR, LL, LR
+
+unsigned long encoderHandlerCycles = 0; //CPU cycles of the slowest encoder handler, measured at startup
+
 double outputPIDUL = 0;
 double outputPIDUR = 0;
 double outputPIDLL = 0;
@@ -55,12 +154,8 @@ float control_signal;
 
 double measUL, measUR, measLL, measLR;
 
-double L1 = 0.15; //distance between upper wheels, in m
-double L2 = 0.15; //distance between upper and lower wheel axles, in m
-
 double long lastReceivedCommTimeout;
 double long commTimeout = 500; // ms
-double long updateRate = 50.0; // ms
 double long vx, vy, w;
 
 float errorUL = 0;
@@ -86,12 +181,21 @@ double polyCmdLL = 0;
 double polyCmdLR = 0;
 
 /************ Robot-specific constants ************/
-const int encoder_CPR = 1536;
-const float wheel_radius = 0.05;  //Wheel radius (in m)
+//Wheel radius, wheelbase and encoder resolution, see sml_nexus_kinematics.h
+#if ENCODER_QUADRATURE_4X
+typedef nexusGeometry<nexusMecanum4x> robotGeometry;
+#else
+typedef nexusGeometry<nexusMecanum2x> robotGeometry;
+#endif
+const float tick_to_meters = robotGeometry::tickToMeters(); //Nominal wheel travel per encoder tick (in m)
+float wheel_scale[4] = {1, 1, 1, 1};    //Calibrated wheel radius scales, UL, UR, LL, LR
+mecanumKinematics<float> kinematics = {robotGeometry::leverArm(), robotGeometry::invFourLeverArm(),
+                                       {tick_to_meters, tick_to_meters, tick_to_meters, tick_to_meters}}; //Calibrated lever arm L1 + L2 and travel per tick
 const double speed_to_pwm_ratio = 120;     //Ratio to convert speed (in m/s) to PWM value. It was obtained by plotting the wheel speed in relation to the PWM motor command.
 
 double max_speed = 0.5; //max speed per wheel in m/s
 double min_speed = 0.008; //minimum that will stop the motor command if reached, in m/s
+const int16_t minSpeedQ15 = 262; //min_speed in Q15, for the fixed-point kernel
 
 //-----------------------------------
 // Setup a PID object for each wheel
@@ -116,6 +220,11 @@ float feedForwardPolyUR[5];
 float feedForwardPolyLL[5];
 float feedForwardPolyLR[5];
 
+#if FIXED_POINT_CONTROL
+//Fixed-point controllers, respectively UL, UR, LL and LR
+wheelController wheelControllers[4];
+#endif
+
 //PID(&Input, &Output, &Setpoint, Kp, Ki, Kd, Direction) 
 PID PID_UL(&measUL, &outputPIDUL, &ULspeed, PID_default_params[0], PID_default_params[1], PID_default_params[2], DIRECT);
 PID PID_UR(&measUR, &outputPIDUR, &URspeed, PID_default_params[0], PID_default_params[1], PID_default_params[2], DIRECT);
@@ -123,32 +232,105 @@ PID PID_LL(&measLL, &outputPIDLL, &LLspeed, PID_default_params[0], PID_default_p
 PID PID_LR(&measLR, &outputPIDLR, &LRspeed, PID_default_params[0], PID_default_params[1], PID_default_params[2], DIRECT);
 
 
-////-------------------------------
-//// PWM command callback function
-////-------------------------------
-//void pwmSubCb(const std_msgs::Float32MultiArray& msg){
-//  pwmUL = (int)msg.data[0];
-//  pwmUR = (int)msg.data[1];
-//  pwmLL = (int)msg.data[2];
-//  pwmLR = (int)msg.data[3];
-//}
+#if SETPOINT_STREAMING
+//The callback fills the buffer the control tick is not sampling, then hands it over
+setpointBuffer setpointBuffers[2];
+setpointBuffer* volatile streamedSetpoints = 0; //Buffer sampled by the control tick, 0 when not streaming
+float stopDeceleration = 1.0;                   //m/s^2, of the fastest wheel when the stream runs out
+#endif
+
+#if OPEN_LOOP_PWM_COMMAND
+volatile int pwmCmd[4] = {0, 0, 0, 0}; //Open loop PWM commands, UL, UR, LL, LR
+double long lastReceivedPwmTimeout;
+
+/************ PWM command callback function ************/
+void pwmSubCb(const std_msgs::Float32MultiArray& msg){
+  if (msg.data_length != 4) return;
+  //The control tick interrupt reads the command
+  noInterrupts();
+  for (int i = 0; i < 4; i++) pwmCmd[i] = constrain((int)msg.data[i], -245, 245);
+  lastReceivedPwmTimeout = millis() + commTimeout;
+  interrupts();
+}
+#endif
 
 
 
 
 /************ Velocity command callback function ************/
 void messageCb( const geometry_msgs::Twist& msg){
+  //The control tick interrupt reads the command
+  noInterrupts();
   vx = (float)msg.linear.x;
   vy = (float)msg.linear.y;
   w = (float)msg.angular.z;
+#if SETPOINT_STREAMING
+  streamedSetpoints = 0;
+#endif
+
+  lastReceivedCommTimeout = millis() + commTimeout;
+  interrupts();
+}
+
+
+
+/************ Compact velocity command callback function ************/
+void compactCmdCb( const sml_nexus_msgs::VelocityCommand& msg){
+  //The control tick interrupt reads the command
+  noInterrupts();
+  vx = msg.vx * 0.001; //mm/s to m/s
+  vy = msg.vy * 0.001;
+  w = msg.w * 0.001;   //mrad/s to rad/s
+#if SETPOINT_STREAMING
+  streamedSetpoints = 0;
+#endif
 
   lastReceivedCommTimeout = millis() + commTimeout;
+  interrupts();
+}
+
+
+
+#if SETPOINT_STREAMING
+/************ Velocity setpoint batch callback function ************/
+void trajectoryCb( const sml_nexus_msgs::VelocityTrajectory& msg){
+  unsigned long now = micros();
+  setpointBuffer& buffer = streamedSetpoints == &setpointBuffers[0] ? setpointBuffers[1] : setpointBuffers[0];
+
+  //Age of the batch stamp on the synchronized clock. A batch without stamp,
+  //or stamped more than a second away, starts at its reception
+  long ageMicros = 0;
+  if (msg.stamp.sec != 0){
+    ros::Time time = nh.now();
+    long ageSec = (long)(time.sec - msg.stamp.sec);
+    if (ageSec >= -1 && ageSec <= 1) ageMicros = ageSec * 1000000L + ((long)time.nsec - (long)msg.stamp.nsec) / 1000;
+  }
+  setpointBufferClear(buffer, now - ageMicros);
+
+  //Continue from the current setpoint when the batch starts ahead
+  if (msg.setpoints_length > 0 && (long)msg.setpoints[0].t * 1000 > ageMicros){
+    noInterrupts();
+    int16_t current[3] = {(int16_t)(vx * 1000), (int16_t)(vy * 1000), (int16_t)(w * 1000)};
+    interrupts();
+    setpointBufferAppend(buffer, ageMicros, current[0], current[1], current[2]);
+  }
+  for (uint32_t i = 0; i < msg.setpoints_length; i++){
+    const sml_nexus_msgs::VelocitySetpoint& setpoint = msg.setpoints[i];
+    setpointBufferAppend(buffer, (long)setpoint.t * 1000, setpoint.vx, setpoint.vy, setpoint.w);
+  }
+  setpointBufferFinish(buffer, stopDeceleration, kinematics.leverArm);
+
+  //The control tick interrupt samples the buffer
+  noInterrupts();
+  streamedSetpoints = buffer.count > 0 ? &buffer : 0;
+  interrupts();
 }
+#endif
 
 
 
 /************ PID tuning callback function ************/
-void pidCb( const std_msgs :: Float32MultiArray& msg){
+void pidCb( const std_msgs :: Float32MultiArray& /*msg*/){
 //Receives Kp, Ki and Kd for UL, UR, LL and LR respectively
   //if message has length 12
 //  if (msg.data_lenght == 12){
@@ -175,9 +357,20 @@ static inline int8_t sgn(int val) {
 // Setup ROS publishers & subscribers
 //------------------------------------
 ros::Subscriber<geometry_msgs::Twist> cmd_sub("cmd_vel", &messageCb );
+ros::Subscriber<sml_nexus_msgs::VelocityCommand> compact_cmd_sub("cmd_vel_compact", &compactCmdCb );
+#if SETPOINT_STREAMING
+ros::Subscriber<sml_nexus_msgs::VelocityTrajectory> trajectory_sub("cmd_vel_trajectory", &trajectoryCb );
+#endif
+#if OPEN_LOOP_PWM_COMMAND
+ros::Subscriber<std_msgs::Float32MultiArray> pwm_sub("cmd_pwm", &pwmSubCb );
+#endif
 //ros::Subscriber<std_msgs :: Float32MultiArray> pid_sub("pid_tuning", &pidCb );
 std_msgs :: Float32MultiArray meas_msg;
 ros::Publisher measuredVelPub("wheel_velocity", &meas_msg);
+sml_nexus_msgs::WheelVelocityStamped meas_stamped_msg;
+ros::Publisher measuredVelStampedPub("wheel_velocity_stamped", &meas_stamped_msg);
+sml_nexus_msgs::WheelFeedback wheel_feedback_msg;
+ros::Publisher wheelFeedbackPub("wheel_feedback", &wheel_feedback_msg);
 //std_msgs :: Float32MultiArray output_msg;
 //std_msgs :: Float32MultiArray pwm_msg;
 //ros::Publisher output_pub("output", &output_msg);
@@ -190,7 +383,6 @@ void setupPIDParams(){
   //------------------------------------------------------------------------------------
   // Get PID parameters from ROS parameter server. If not available, set default params
   //------------------------------------------------------------------------------------
-  int count = 0;
   //nh.spinOnce();
 //  if(!nh.getParam("test", &test)){
 //    nh.logwarn("TEST FAILED;");
@@ -277,14 +469,29 @@ void setupPIDParams(){
   //------------------------
   // Setting PID parameters
   //------------------------
-  PID_UL.SetTunings(PID_UL_params[0], PID_UL_params[1], PID_UL_params[2]);
-  PID_UR.SetTunings(PID_UR_params[0], PID_UR_params[1], PID_UR_params[2]);
-  PID_LL.SetTunings(PID_LL_params[0], PID_LL_params[1], PID_LL_params[2]);
-  PID_LR.SetTunings(PID_LR_params[0], PID_LR_params[1], PID_LR_params[2]);
-  PID_UL.SetSampleTime(50);
-  PID_UR.SetSampleTime(50);
-  PID_LL.SetSampleTime(50);
-  PID_LR.SetSampleTime(50);
+#if FIXED_POINT_CONTROL
+  const float tickPeriodS = CONTROL_TICK_PERIOD_US / 1000000.0;
+  controlKernelSetGains(wheelControllers[0], feedForwardPolyUL, PID_UL_params, min_cmd_UL, tickPeriodS);
+  controlKernelSetGains(wheelControllers[1], feedForwardPolyUR, PID_UR_params, min_cmd_UR, tickPeriodS);
+  controlKernelSetGains(wheelControllers[2], feedForwardPolyLL, PID_LL_params, min_cmd_LL, tickPeriodS);
+  controlKernelSetGains(wheelControllers[3], feedForwardPolyLR, PID_LR_params, min_cmd_LR, tickPeriodS);
+  for (int i = 0; i < 4; i++){
+    wheelControllers[i].measured = 0;
+    controlKernelStart(wheelControllers[i]);
+  }
+#else
+  // PID_v1 only computes once SampleTime ms have elapsed on millis(), which
+  // jitters by 1 ms around the control tick period. It is run with a 1 ms
+  // sample time, the gains being scaled to act over the real tick period.
+  const float tickPeriodMs = CONTROL_TICK_PERIOD_US / 1000.0;
+  PID_UL.SetSampleTime(1);
+  PID_UR.SetSampleTime(1);
+  PID_LL.SetSampleTime(1);
+  PID_LR.SetSampleTime(1);
+  PID_UL.SetTunings(PID_UL_params[0], PID_UL_params[1] * tickPeriodMs, PID_UL_params[2] / tickPeriodMs);
+  PID_UR.SetTunings(PID_UR_params[0], PID_UR_params[1] * tickPeriodMs, PID_UR_params[2] / tickPeriodMs);
+  PID_LL.SetTunings(PID_LL_params[0], PID_LL_params[1] * tickPeriodMs, PID_LL_params[2] / tickPeriodMs);
+  PID_LR.SetTunings(PID_LR_params[0], PID_LR_params[1] * tickPeriodMs, PID_LR_params[2] / tickPeriodMs);
   PID_UL.SetOutputLimits(-200, 200);
   PID_UR.SetOutputLimits(-200, 200);
   PID_LL.SetOutputLimits(-200, 200);
@@ -293,6 +500,7 @@ void setupPIDParams(){
   PID_UR.SetMode(AUTOMATIC);
   PID_LL.SetMode(AUTOMATIC);
   PID_LR.SetMode(AUTOMATIC);
+#endif
 
 }
 
@@ -301,46 +509,158 @@ void setupPIDParams(){
 /************ Setup topics over ROS ************/
 void setupCommonTopics(){
   nh.getHardware()->setBaud(57600);         //set baud for ROS serial communication
+#if COMPACT_SERIAL_MESSAGES
+  nh.subscribe(compact_cmd_sub);
+  nh.advertise(wheelFeedbackPub);
+#endif
+#if !COMPACT_SERIAL_MESSAGES || PUBLISH_LEGACY_WHEEL_VELOCITY
   nh.subscribe(cmd_sub);
- // nh.subscribe(pid_sub);
+#endif
+#if PUBLISH_LEGACY_WHEEL_VELOCITY
   nh.advertise(measuredVelPub);
+#endif
+#if PUBLISH_WHEEL_VELOCITY
+  nh.advertise(measuredVelStampedPub);
+#endif
+#if SETPOINT_STREAMING
+  nh.subscribe(trajectory_sub);
+#endif
+#if OPEN_LOOP_PWM_COMMAND
+  nh.subscribe(pwm_sub);
+#endif
+ // nh.subscribe(pid_sub);
  //nh.advertise(output_pub);
   //nh.advertise(pwm_pub);
 }
 
 
 
+/************ Robot geometry from the calibration file ************/
+void setupGeometryParams(){
+  //-------------------------------------------------------------
+  // Wheelbase and wheel radius scales from the calibration file
+  // loaded with the PID parameters, nominal values otherwise
+  //-------------------------------------------------------------
+  float wheelbase;
+  if(!nh.getParam("wheelbase", &wheelbase, 1, 300)){
+    nh.logwarn("Wheelbase: loading default values;");
+    wheelbase = robotGeometry::wheelbase();
+  }
+
+  if(!nh.getParam("wheel_scale", wheel_scale, 4, 300)){
+    nh.logwarn("Wheel radius scales: loading default values;");
+  }
+  mecanumKinematicsSetup(kinematics, wheelbase, tick_to_meters, wheel_scale);
+
+#if SETPOINT_STREAMING
+  if(!nh.getParam("stop_deceleration", &stopDeceleration, 1, 300)){
+    nh.logwarn("Stop deceleration: loading default value;");
+  }
+#endif
+}
+
+
+
+#if SETPOINT_STREAMING
+/************ Get main velocity command ************
+         from the streamed setpoints, if any      */
+bool sampleStreamedSetpoints(unsigned long nowMicros){
+  setpointBuffer* buffer = streamedSetpoints;
+  if (!buffer) return false;
+  float setpoint[3];
+  bool streaming = setpointBufferSample(*buffer, nowMicros, setpoint);
+  vx = setpoint[0];
+  vy = setpoint[1];
+  w = setpoint[2];
+  //Stopped after the last setpoint
+  if (!streaming) streamedSetpoints = 0;
+  return streaming;
+}
+#endif
+
+
+
 /************ Get wheel velocity commands ************
               from main velocity command            */  
 void computeWheelVelCmd(){
   //===================================
   // Map vx, vy, w to each wheel speed 
   //===================================
-  ULspeed = constrain(1*vx - 1*vy - (L1+L2)*w, -max_speed, max_speed);
-  URspeed = constrain(1*vx + 1*vy + (L1+L2)*w, -max_speed, max_speed);
-  LLspeed = constrain(1*vx + 1*vy - (L1+L2)*w, -max_speed, max_speed);
-  LRspeed = constrain(1*vx - 1*vy + (L1+L2)*w, -max_speed, max_speed);
+  float wheels[4];
+  mecanumInverse(kinematics, (float)vx, (float)vy, (float)w, wheels);
+  ULspeed = constrain(wheels[0], -max_speed, max_speed);
+  URspeed = constrain(wheels[1], -max_speed, max_speed);
+  LLspeed = constrain(wheels[2], -max_speed, max_speed);
+  LRspeed = constrain(wheels[3], -max_speed, max_speed);
 }
 
 
 
 /************ Get wheel velocities from encoders  ************/
 void getWheelVel(){
-  //Compute speed:  Get rads from tick increments       convert to rad/s      |v=wr| convert to m/s
-  measUR = ((float)intCount3/1536)*(2*3.1415) * ((float)1000/updateOldness) * wheel_radius;
-  intCount3 = 0;
-  measLR = ((float)intCount4/1536)*(2*3.1415) * ((float)1000/updateOldness) * wheel_radius;
-  intCount4 = 0;
-  measLL = ((float)intCount1/1536)*(2*3.1415) * ((float)1000/updateOldness) * wheel_radius;
+  unsigned long edgeMicros[4];
+
+  //Take and reset the four counts at once: an encoder interrupt
+  //between a read and its reset would lose its count
+  noInterrupts();
+  encoderLatchMicros = micros();
+  encoderTicks[0] = intCount2;
+  encoderTicks[1] = intCount3;
+  encoderTicks[2] = intCount1;
+  encoderTicks[3] = intCount4;
+  edgeMicros[0] = edgeMicros2;
+  edgeMicros[1] = edgeMicros3;
+  edgeMicros[2] = edgeMicros1;
+  edgeMicros[3] = edgeMicros4;
   intCount1 = 0;
-  measUL = ((float)intCount2/1536)*(2*3.1415) * ((float)1000/updateOldness) * wheel_radius;
   intCount2 = 0;
+  intCount3 = 0;
+  intCount4 = 0;
+  interrupts();
+
+#if ENCODER_EDGE_TIMING
+  //Compute speed from the time between the last edges of this and the previous period
+  unsigned long periodMicros = updateOldness * 1000;
+  measUL = edgeSpeedUpdate(speedEstimators[0], encoderTicks[0], edgeMicros[0], encoderLatchMicros, periodMicros, kinematics.tickToMeters[0]);
+  measUR = edgeSpeedUpdate(speedEstimators[1], encoderTicks[1], edgeMicros[1], encoderLatchMicros, periodMicros, kinematics.tickToMeters[1]);
+  measLL = edgeSpeedUpdate(speedEstimators[2], encoderTicks[2], edgeMicros[2], encoderLatchMicros, periodMicros, kinematics.tickToMeters[2]);
+  measLR = edgeSpeedUpdate(speedEstimators[3], encoderTicks[3], edgeMicros[3], encoderLatchMicros, periodMicros, kinematics.tickToMeters[3]);
+#else
+  //Compute speed:  wheel travel from tick increments over the control period,
+  //set by the timer, convert to m/s
+  measUL = encoderTicks[0] * kinematics.tickToMeters[0] * (float)CONTROL_TICK_RATE_HZ;
+  measUR = encoderTicks[1] * kinematics.tickToMeters[1] * (float)CONTROL_TICK_RATE_HZ;
+  measLL = encoderTicks[2] * kinematics.tickToMeters[2] * (float)CONTROL_TICK_RATE_HZ;
+  measLR = encoderTicks[3] * kinematics.tickToMeters[3] * (float)CONTROL_TICK_RATE_HZ;
+#endif
 }
 
 
 
 /************ Compute motor inputs from feedforward and PID  ************/
 void computeMotorInputs(){
+#if FIXED_POINT_CONTROL
+  //--------------------------------------------------
+  //  All four wheels in one pass of the fixed-point
+  //  kernel. Feedforward and PID outputs are kept in
+  //               wheelControllers
+  //--------------------------------------------------
+  wheelControllers[0].setpoint = toQ15(ULspeed);
+  wheelControllers[1].setpoint = toQ15(URspeed);
+  wheelControllers[2].setpoint = toQ15(LLspeed);
+  wheelControllers[3].setpoint = toQ15(LRspeed);
+  wheelControllers[0].measured = toQ15(measUL);
+  wheelControllers[1].measured = toQ15(measUR);
+  wheelControllers[2].measured = toQ15(measLL);
+  wheelControllers[3].measured = toQ15(measLR);
+
+  controlKernelRun(wheelControllers, 4, minSpeedQ15);
+
+  pwmUL = wheelControllers[0].pwm;
+  pwmUR = wheelControllers[1].pwm;
+  pwmLL = wheelControllers[2].pwm;
+  pwmLR = wheelControllers[3].pwm;
+#else
   //--------------------------------------------------
   //   For each motor, check if velocity command is
   // larger than minimum speed and compute PID output
@@ -412,6 +732,7 @@ void computeMotorInputs(){
     if (LRspeed > 0) pwmLR = constrain( pwmLR, min_cmd_LR, 245 );
     else             pwmLR = constrain( pwmLR, -245, -min_cmd_LR );
   }       
+#endif
 }
 
 
@@ -428,22 +749,121 @@ void applyMotorInputs(){
 
 
 /************ Encoders interrupt functions ************/
+// Channel A edges: the count direction is given by whether both channels
+// are at the same level
 void encoderLL(){
-  if (digitalRead(MOTOR1_ENC_A) == digitalRead(MOTOR1_ENC_B)) --intCount1;
+  if (!(MOTOR1_ENC_A_PORT & MOTOR1_ENC_A_BIT) == !(MOTOR1_ENC_B_PORT & MOTOR1_ENC_B_BIT)) --intCount1;
   else ++intCount1;
+#if ENCODER_EDGE_TIMING
+  edgeMicros1 = micros();
+#endif
 }
 
 void encoderUL(){
-  if (digitalRead(MOTOR2_ENC_A) == digitalRead(MOTOR2_ENC_B)) --intCount2;
+  if (!(MOTOR2_ENC_A_PORT & MOTOR2_ENC_A_BIT) == !(MOTOR2_ENC_B_PORT & MOTOR2_ENC_B_BIT)) --intCount2;
   else ++intCount2;
+#if ENCODER_EDGE_TIMING
+  edgeMicros2 = micros();
+#endif
 }
 
 void encoderUR(){
-  if (digitalRead(MOTOR3_ENC_A) == digitalRead(MOTOR3_ENC_B)) ++intCount3;
+  if (!(MOTOR3_ENC_A_PORT & MOTOR3_ENC_A_BIT) == !(MOTOR3_ENC_B_PORT & MOTOR3_ENC_B_BIT)) ++intCount3;
   else --intCount3;
+#if ENCODER_EDGE_TIMING
+  edgeMicros3 = micros();
+#endif
 }
 
 void encoderLR(){
-  if (digitalRead(MOTOR4_ENC_A) == digitalRead(MOTOR4_ENC_B)) ++intCount4;
-  else --intCount4;
+  if (!(MOTOR4_ENC_A_PORT & MOTOR4_ENC_A_BIT) == !(MOTOR4_ENC_B_PORT & MOTOR4_ENC_B_BIT)) intCount4 += ENCODER_LR_STEP;
+  else intCount4 -= ENCODER_LR_STEP;
+#if ENCODER_EDGE_TIMING
+  edgeMicros4 = micros();
+#endif
+}
+
+#if ENCODER_QUADRATURE_4X
+// Channel B edges count the other way round
+void encoderLLB(){
+  if (!(MOTOR1_ENC_A_PORT & MOTOR1_ENC_A_BIT) == !(MOTOR1_ENC_B_PORT & MOTOR1_ENC_B_BIT)) ++intCount1;
+  else --intCount1;
+#if ENCODER_EDGE_TIMING
+  edgeMicros1 = micros();
+#endif
+}
+
+void encoderULB(){
+  if (!(MOTOR2_ENC_A_PORT & MOTOR2_ENC_A_BIT) == !(MOTOR2_ENC_B_PORT & MOTOR2_ENC_B_BIT)) ++intCount2;
+  else --intCount2;
+#if ENCODER_EDGE_TIMING
+  edgeMicros2 = micros();
+#endif
+}
+
+void encoderURB(){
+  if (!(MOTOR3_ENC_A_PORT & MOTOR3_ENC_A_BIT) == !(MOTOR3_ENC_B_PORT & MOTOR3_ENC_B_BIT)) --intCount3;
+  else ++intCount3;
+#if ENCODER_EDGE_TIMING
+  edgeMicros3 = micros();
+#endif
+}
+
+/************ Pin change interrupts on channel B of the LL, UL and UR encoders ************/
+void setupEncoderChannelB(){
+  prevEncoderLevelsK = PINK;
+  PCMSK0 |= (1 << PCINT7);                    //Pin 13, LL channel B
+  PCMSK2 |= (1 << PCINT20) | (1 << PCINT22);  //A12 and A14, UL and UR channel B
+  PCIFR = (1 << PCIF0) | (1 << PCIF2);
+  PCICR |= (1 << PCIE0) | (1 << PCIE2);
+}
+
+//Only pin 13 is enabled in the PCINT0 group
+ISR(PCINT0_vect){
+  encoderLLB();
+}
+
+//A12 and A14 share the PCINT2 group, find which one changed
+ISR(PCINT2_vect){
+  uint8_t levels = PINK;
+  uint8_t changed = levels ^ prevEncoderLevelsK;
+  prevEncoderLevelsK = levels;
+  if (changed & MOTOR2_ENC_B_BIT) encoderULB();
+  if (changed & MOTOR3_ENC_B_BIT) encoderURB();
+}
+#endif
+
+/************ CPU cycles of one encoder handler, timed on Timer5 before the control tick starts ************/
+unsigned long measureEncoderHandler(void (*handler)()){
+  const uint8_t calls = 64;
+  uint16_t start = TCNT5;
+  for (uint8_t i = 0; i < calls; i++) handler();
+  uint16_t stop = TCNT5;
+  return (uint16_t)(stop - start) / calls;
+}
+
+void measureEncoderHandlers(){
+  void (*handlers[])() = {
+    encoderLL, encoderUL, encoderUR, encoderLR,
+#if ENCODER_QUADRATURE_4X
+    encoderLLB, encoderULB, encoderURB,
+#endif
+  };
+
+  noInterrupts();
+  TCCR5A = 0;
+  TCCR5B = (1 << CS50);  //Normal mode, no prescaler: one count per CPU cycle
+  TCNT5 = 0;
+  encoderHandlerCycles = 0;
+  for (uint8_t i = 0; i < sizeof(handlers) / sizeof(handlers[0]); i++){
+    unsigned long cycles = measureEncoderHandler(handlers[i]);
+    if (cycles > encoderHandlerCycles) encoderHandlerCycles = cycles;
+  }
+  TCCR5B = 0;
+  TCNT5 = 0;
+  intCount1 = 0;
+  intCount2 = 0;
+  intCount3 = 0;
+  intCount4 = 0;
+  interrupts();
 }
@@ -0,0 +1,148 @@
+/*
+Fixed-point feedforward and PID kernel for the four wheel controllers.
+
+Replaces the float feedforward polynomial, evaluated with pow() for every
+term, and the PID_v1 objects, which are soft-float on the ATmega2560.
+
+  * Wheel speeds are Q15 (m/s, 1.0 = 32768), so |speed| < 1 m/s
+  * Feedforward, PID terms and gains are Q16 PWM units (1.0 = 65536)
+  * The polynomial is evaluated in Horner form, all 32-bit integer math
+
+The PID follows PID_v1 semantics for a fixed sample period: proportional
+on error, integral clamped to the output limits, derivative on measurement,
+output clamped to the output limits.
+
+All four wheels are kept in one array of wheelController and computed in
+one pass. Only depends on stdint.h and can be compiled on the host (see
+Arduino/host).
+*/
+
+#ifndef SML_NEXUS_CONTROL_KERNEL_H
+#define SML_NEXUS_CONTROL_KERNEL_H
+
+#include <stdint.h>
+
+#define KERNEL_Q15_ONE 32768L
+#define KERNEL_Q16_ONE 65536L
+#define KERNEL_PID_LIMIT (200 * KERNEL_Q16_ONE)  //Q16, PID output limits
+#define KERNEL_PWM_MAX 245                       //Largest PWM command
+
+//-------------------------------
+// Controller state of one wheel
+//-------------------------------
+struct wheelController
+{
+  //Configuration
+  int32_t feedforward[5];  //Q16, polynomial coefficients of |speed|, constant term first
+  int32_t kp;              //Q16, PWM per m/s
+  int32_t ki;              //Q16, PWM per m/s, integrated over one period
+  int32_t kd;              //Q16, PWM per m/s, divided by one period
+  int16_t minCmd;          //Smallest PWM command that moves the wheel
+
+  //Inputs
+  int16_t setpoint;        //Q15, m/s
+  int16_t measured;        //Q15, m/s
+
+  //State
+  int32_t integral;        //Q16
+  int16_t lastMeasured;    //Q15
+
+  //Outputs
+  int32_t feedforwardCmd;  //Q16
+  int32_t pidCmd;          //Q16
+  int16_t pwm;
+};
+
+/************ Float to fixed-point conversions ************/
+static inline int32_t toQ16(float value){
+  return (int32_t)(value * KERNEL_Q16_ONE + (value >= 0 ? 0.5f : -0.5f));
+}
+
+static inline int16_t toQ15(float value){
+  if (value >= 0.99997f) return 32767;
+  if (value <= -1.0f) return -32768;
+  return (int16_t)(value * KERNEL_Q15_ONE + (value >= 0 ? 0.5f : -0.5f));
+}
+
+/************ a * b of a Q16 and a Q15 value, rounded to Q16, with 32-bit products only ************/
+static inline int32_t mulQ16Q15(int32_t a, int16_t b){
+  //a = high * 2^16 + low, with 0 <= low < 2^16: low * b + 2^14 fits in 32 bits
+  int32_t high = a >> 16;
+  int32_t low = (int32_t)(a & 0xFFFF);
+  return high * b * 2 + ((low * b + 16384) >> 15);
+}
+
+/************ Integer part of a Q16 value, truncated toward zero like (int) ************/
+static inline int16_t truncQ16(int32_t value){
+  return value >= 0 ? (int16_t)(value >> 16) : -(int16_t)((-value) >> 16);
+}
+
+static inline int16_t saturateQ15(int32_t value){
+  if (value > 32767) return 32767;
+  if (value < -32768) return -32768;
+  return (int16_t)value;
+}
+
+static inline int32_t clampQ16(int32_t value, int32_t limit){
+  if (value > limit) return limit;
+  if (value < -limit) return -limit;
+  return value;
+}
+
+/************ Load gains, PID gains being Kp, Ki, Kd for a period of periodSeconds ************/
+static inline void controlKernelSetGains(wheelController& wheel, const float feedforward[5],
+                                         const float pid[3], int minCmd, float periodSeconds){
+  for (uint8_t i = 0; i < 5; i++) wheel.feedforward[i] = toQ16(feedforward[i]);
+  wheel.kp = toQ16(pid[0]);
+  wheel.ki = toQ16(pid[1] * periodSeconds);
+  wheel.kd = toQ16(pid[2] / periodSeconds);
+  wheel.minCmd = minCmd;
+}
+
+/************ Bumpless start, as PID_v1 SetMode(AUTOMATIC) ************/
+static inline void controlKernelStart(wheelController& wheel){
+  wheel.integral = 0;
+  wheel.lastMeasured = wheel.measured;
+}
+
+/************ Compute the PWM command of every wheel ************/
+static inline void controlKernelRun(wheelController wheels[], uint8_t count, int16_t minSpeed){
+  for (uint8_t n = 0; n < count; n++){
+    wheelController& wheel = wheels[n];
+    wheel.feedforwardCmd = 0;
+    wheel.pidCmd = 0;
+    wheel.pwm = 0;
+
+    int16_t speed = wheel.setpoint;
+    int16_t absSpeed = speed < 0 ? -speed : speed;
+    if (absSpeed <= minSpeed) continue;
+
+    //Feedforward polynomial, Horner form
+    int32_t ff = wheel.feedforward[4];
+    for (int8_t i = 3; i >= 0; i--) ff = wheel.feedforward[i] + mulQ16Q15(ff, absSpeed);
+    if (speed < 0) ff = -ff;
+
+    //PID, derivative on measurement
+    int16_t error = saturateQ15((int32_t)speed - wheel.measured);
+    int16_t dInput = saturateQ15((int32_t)wheel.measured - wheel.lastMeasured);
+    wheel.integral = clampQ16(wheel.integral + mulQ16Q15(wheel.ki, error), KERNEL_PID_LIMIT);
+    int32_t output = mulQ16Q15(wheel.kp, error) + wheel.integral - mulQ16Q15(wheel.kd, dInput);
+    wheel.pidCmd = clampQ16(output, KERNEL_PID_LIMIT);
+    wheel.lastMeasured = wheel.measured;
+    wheel.feedforwardCmd = ff;
+
+    //Constrain to minimum PWM command
+    int16_t pwm = truncQ16(ff) + truncQ16(wheel.pidCmd);
+    if (speed > 0){
+      if (pwm < wheel.minCmd) pwm = wheel.minCmd;
+      else if (pwm > KERNEL_PWM_MAX) pwm = KERNEL_PWM_MAX;
+    }
+    else{
+      if (pwm > -wheel.minCmd) pwm = -wheel.minCmd;
+      else if (pwm < -KERNEL_PWM_MAX) pwm = -KERNEL_PWM_MAX;
+    }
+    wheel.pwm = pwm;
+  }
+}
+
+#endif // SML_NEXUS_CONTROL_KERNEL_H
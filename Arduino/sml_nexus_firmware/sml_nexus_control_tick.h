@@ -0,0 +1,283 @@
+/*
+Timer-driven control tick for the nexus 4WD holonomic robot.
+
+TO BE USED ON ARDUINO MEGA
+
+The wheel controllers run from the Timer5 compare interrupt at a fixed
+rate: encoders are sampled and the four PIDs computed at a deterministic
+period, whatever the sensor communication and rosserial are doing in the
+background loop. Timer5 only drives PWM on pins 44 to 46, which are not
+used by the robot.
+
+The tick measures its own period and execution time, published on the
+control_tick_stats topic as
+[mean rate (Hz), mean period (us), min period (us), max period (us), max execution time (us), overruns,
+ max motor input computation (CPU cycles), slowest encoder handler (CPU cycles)]
+The motor input computation is timed on Timer5 itself, to 64 cycles. The
+encoder handlers are timed once at startup, see measureEncoderHandlers().
+
+The tick rate and feedback decimation are configured in sml_nexus_common.h.
+*/
+
+#include "Arduino.h"
+#include <std_msgs/Float32MultiArray.h>
+
+/******************** Variables ****************/
+//Wheel feedback accumulated over FEEDBACK_DECIMATION ticks
+volatile boolean feedbackReady = false;
+volatile int16_t feedbackTicks[4] = {0, 0, 0, 0};  //UL, UR, LL, LR
+volatile int16_t feedbackSpeeds[4] = {0, 0, 0, 0}; //0.1 mm/s, at the last latch
+volatile unsigned long feedbackInterval = 0;       //us
+volatile unsigned long feedbackLatchMicros = 0;
+volatile byte feedbackSamples = 0;
+
+//Tick statistics
+volatile unsigned long prevTickMicros = 0;
+volatile unsigned long tickCount = 0;
+volatile unsigned long tickPeriodSum = 0;
+volatile unsigned long tickPeriodMin = 0xFFFFFFFF;
+volatile unsigned long tickPeriodMax = 0;
+volatile unsigned long tickExecMax = 0;
+volatile unsigned long tickOverruns = 0;
+volatile unsigned long controllerCyclesMax = 0;
+unsigned long prevTickStatsTime = 0;
+
+std_msgs::Float32MultiArray tick_stats_msg;
+ros::Publisher tickStatsPub("control_tick_stats", &tick_stats_msg);
+
+/******************** Functions ****************/
+void setupControlTick();
+void controlTick();
+void publishWheelFeedback();
+void publishTickStats();
+
+/************ Configure Timer5 to interrupt at the control rate ************/
+void setupControlTick(){
+  tick_stats_msg.data_length = 8;
+  tick_stats_msg.data = (float*)malloc(sizeof(float)*8);
+  nh.advertise(tickStatsPub);
+
+  noInterrupts();
+  TCCR5A = 0;
+  TCCR5B = (1 << WGM52) | (1 << CS51) | (1 << CS50);   // CTC mode, prescaler 64 (250 kHz)
+  TCNT5  = 0;
+  OCR5A  = (F_CPU / 64 / CONTROL_TICK_RATE_HZ) - 1;
+  prevTickMicros = micros();
+  TIMSK5 |= (1 << OCIE5A);
+  interrupts();
+}
+
+/************ Control tick interrupt ************/
+ISR(TIMER5_COMPA_vect){
+  //Let encoder, serial and millis interrupts through while the
+  //controllers run, but never re-enter the tick itself
+  TIMSK5 &= ~(1 << OCIE5A);
+  sei();
+  controlTick();
+  cli();
+  //If the next compare match already happened, the tick overran its period
+  if (TIFR5 & (1 << OCF5A)) tickOverruns++;
+  TIMSK5 |= (1 << OCIE5A);
+}
+
+/************ One period of the wheel controllers ************/
+void controlTick(){
+  unsigned long tickStart = micros();
+  unsigned long tickPeriod = tickStart - prevTickMicros;
+  prevTickMicros = tickStart;
+
+  //Period statistics
+  tickCount++;
+  tickPeriodSum += tickPeriod;
+  if (tickPeriod < tickPeriodMin) tickPeriodMin = tickPeriod;
+  if (tickPeriod > tickPeriodMax) tickPeriodMax = tickPeriod;
+
+  //Time since last encoder sample, in ms
+  updateOldness = tickPeriod * 0.001;
+
+  //--------------------------
+  // Reset PWM command values
+  //--------------------------
+  pwmUL = 0;
+  pwmUR = 0;
+  pwmLL = 0;
+  pwmLR = 0;
+  outputPIDUL = 0;
+  outputPIDUR = 0;
+  outputPIDLL = 0;
+  outputPIDLR = 0;
+
+#if SETPOINT_STREAMING
+  //===========================================
+  // Sample the setpoints streamed by the host
+  //===========================================
+  bool streaming = sampleStreamedSetpoints(tickStart);
+#endif
+
+  //===================================
+  // Map vx, vy, w to each wheel speed
+  //===================================
+  computeWheelVelCmd();
+
+  //=====================================
+  // Measure current speed of each wheel
+  //=====================================
+  getWheelVel();
+
+  //==========================================
+  // If command received recently, or setpoints
+  //          streamed, run motors
+  //==========================================
+#if SETPOINT_STREAMING
+  if (millis() < lastReceivedCommTimeout || streaming)
+#else
+  if (millis() < lastReceivedCommTimeout)
+#endif
+  {
+    //Timer5 counts every 64 CPU cycles and wraps at OCR5A
+    uint16_t startCount = TCNT5;
+    computeMotorInputs();
+    uint16_t stopCount = TCNT5;
+    unsigned long cycles = (stopCount >= startCount ? stopCount - startCount : stopCount + OCR5A + 1 - startCount) * 64UL;
+    if (cycles > controllerCyclesMax) controllerCyclesMax = cycles;
+  }
+#if OPEN_LOOP_PWM_COMMAND
+  //=============================================
+  // Else, if PWM received recently, run open loop
+  //=============================================
+  else if (millis() < lastReceivedPwmTimeout)
+  {
+    pwmUL = pwmCmd[0];
+    pwmUR = pwmCmd[1];
+    pwmLL = pwmCmd[2];
+    pwmLR = pwmCmd[3];
+  }
+#endif
+
+  //=====================
+  // Apply motor command
+  //=====================
+  applyMotorInputs();
+
+  //============================================
+  // Accumulate wheel feedback for the main loop
+  //============================================
+  for (int i = 0; i < 4; i++) feedbackTicks[i] += encoderTicks[i];
+  feedbackSpeeds[0] = constrain(measUL * 10000, -32767, 32767);
+  feedbackSpeeds[1] = constrain(measUR * 10000, -32767, 32767);
+  feedbackSpeeds[2] = constrain(measLL * 10000, -32767, 32767);
+  feedbackSpeeds[3] = constrain(measLR * 10000, -32767, 32767);
+  feedbackInterval += tickPeriod;
+  feedbackLatchMicros = encoderLatchMicros;
+  if (++feedbackSamples >= FEEDBACK_DECIMATION) feedbackReady = true;
+
+  unsigned long tickExec = micros() - tickStart;
+  if (tickExec > tickExecMax) tickExecMax = tickExec;
+}
+
+/************ Populate and publish wheel feedback, from the main loop ************/
+void publishWheelFeedback(){
+  int16_t ticks[4], speeds[4];
+  unsigned long interval;
+#if PUBLISH_WHEEL_VELOCITY
+  unsigned long latchMicros;
+  byte samples;
+#endif
+
+  //Take the accumulated feedback atomically
+  noInterrupts();
+  if (!feedbackReady){
+    interrupts();
+    return;
+  }
+  for (int i = 0; i < 4; i++){
+    ticks[i] = feedbackTicks[i];
+    speeds[i] = feedbackSpeeds[i];
+    feedbackTicks[i] = 0;
+  }
+  interval = feedbackInterval;
+#if PUBLISH_WHEEL_VELOCITY
+  latchMicros = feedbackLatchMicros;
+  samples = feedbackSamples;
+#endif
+  feedbackInterval = 0;
+  feedbackSamples = 0;
+  feedbackReady = false;
+  interrupts();
+
+#if COMPACT_SERIAL_MESSAGES
+  wheel_feedback_msg.seq++;
+  wheel_feedback_msg.dt = interval > 65535 ? 65535 : interval;
+  for (int i = 0; i < 4; i++){
+    wheel_feedback_msg.ticks[i] = ticks[i];
+    wheel_feedback_msg.speed[i] = speeds[i];
+  }
+
+  // Publish message
+  wheelFeedbackPub.publish(&wheel_feedback_msg);
+#endif
+
+#if PUBLISH_WHEEL_VELOCITY
+  //Device time of the last encoder latch
+  encoderLatchTime = nh.now();
+  encoderLatchTime -= ros::Duration(0, (micros() - latchMicros) * 1000);
+
+  //Mean wheel speeds over the accumulated ticks. They span FEEDBACK_DECIMATION
+  //periods of the timer, more only when the loop fell behind
+  float ticksToSpeed = samples == FEEDBACK_DECIMATION ? FEEDBACK_RATE_HZ : 1000000.0 / interval;
+  meas_stamped_msg.header.stamp = encoderLatchTime;
+  meas_stamped_msg.UL = ticks[0] * kinematics.tickToMeters[0] * ticksToSpeed;
+  meas_stamped_msg.UR = ticks[1] * kinematics.tickToMeters[1] * ticksToSpeed;
+  meas_stamped_msg.LL = ticks[2] * kinematics.tickToMeters[2] * ticksToSpeed;
+  meas_stamped_msg.LR = ticks[3] * kinematics.tickToMeters[3] * ticksToSpeed;
+  meas_stamped_msg.dt = interval * 0.001;
+#if PUBLISH_LEGACY_WHEEL_VELOCITY
+  meas_msg.data[0] = meas_stamped_msg.UL;
+  meas_msg.data[1] = meas_stamped_msg.UR;
+  meas_msg.data[2] = meas_stamped_msg.LL;
+  meas_msg.data[3] = meas_stamped_msg.LR;
+  meas_msg.data[4] = meas_stamped_msg.dt;
+#endif
+
+  // Publish message
+  measuredVelStampedPub.publish(&meas_stamped_msg);
+#if PUBLISH_LEGACY_WHEEL_VELOCITY
+  measuredVelPub.publish(&meas_msg);
+#endif
+#endif
+}
+
+/************ Publish control tick period and jitter statistics ************/
+void publishTickStats(){
+  if (millis() - prevTickStatsTime < TICK_STATS_PERIOD) return;
+  prevTickStatsTime = millis();
+
+  unsigned long count, periodSum, periodMin, periodMax, execMax, overruns, controllerCycles;
+  noInterrupts();
+  count = tickCount;
+  periodSum = tickPeriodSum;
+  periodMin = tickPeriodMin;
+  periodMax = tickPeriodMax;
+  execMax = tickExecMax;
+  overruns = tickOverruns;
+  controllerCycles = controllerCyclesMax;
+  tickCount = 0;
+  tickPeriodSum = 0;
+  tickPeriodMin = 0xFFFFFFFF;
+  tickPeriodMax = 0;
+  tickExecMax = 0;
+  controllerCyclesMax = 0;
+  interrupts();
+
+  if (count == 0) return;
+  float meanPeriod = (float)periodSum / count;
+  tick_stats_msg.data[0] = 1000000.0 / meanPeriod;
+  tick_stats_msg.data[1] = meanPeriod;
+  tick_stats_msg.data[2] = periodMin;
+  tick_stats_msg.data[3] = periodMax;
+  tick_stats_msg.data[4] = execMax;
+  tick_stats_msg.data[5] = overruns;
+  tick_stats_msg.data[6] = controllerCycles;
+  tick_stats_msg.data[7] = encoderHandlerCycles;
+  tickStatsPub.publish(&tick_stats_msg);
+}
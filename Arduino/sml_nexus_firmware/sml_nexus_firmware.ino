@@ -36,14 +36,15 @@
 ros::NodeHandle  nh;
 
 #include "sml_nexus_common.h"
+#include "sml_nexus_control_tick.h"
 #include "sml_nexus_ultrasonic_sensors.h"
 
 void setup() {
-  TCCR1B = TCCR1B & B11111000 | B00000001;    // set PWM frequency of 31372.55 Hz for D11 & D12
-  TCCR2B = TCCR2B & B11111000 | B00000001;    // set PWM frequency of 31372.55 Hz for D9 & D10
-  TCCR3B = TCCR3B & B11111000 | B00000001;    // set PWM frequency of 31372.55 Hz for D2, D3 & D5
-  TCCR4B = TCCR4B & B11111000 | B00000001;    // set PWM frequency of 31372.55 Hz for D6, D7 & D8
-  TCCR5B = TCCR5B & B11111000 | B00000001;    // set PWM frequency of 31372.55 Hz for D44, D45 & D46
+  TCCR1B = (TCCR1B & B11111000) | B00000001;    // set PWM frequency of 31372.55 Hz for D11 & D12
+  TCCR2B = (TCCR2B & B11111000) | B00000001;    // set PWM frequency of 31372.55 Hz for D9 & D10
+  TCCR3B = (TCCR3B & B11111000) | B00000001;    // set PWM frequency of 31372.55 Hz for D2, D3 & D5
+  TCCR4B = (TCCR4B & B11111000) | B00000001;    // set PWM frequency of 31372.55 Hz for D6, D7 & D8
+  // Timer5 (D44, D45 & D46) is reserved for the control tick, see setupControlTick()
   
   vx = 0;
   vy = 0;
@@ -68,13 +69,19 @@ void setup() {
   attachInterrupt(digitalPinToInterrupt(MOTOR2_ENC_A), encoderUL, CHANGE);
   attachInterrupt(digitalPinToInterrupt(MOTOR3_ENC_A), encoderUR, CHANGE);
   attachInterrupt(digitalPinToInterrupt(MOTOR4_ENC_A), encoderLR, CHANGE);
+#if ENCODER_QUADRATURE_4X
+  setupEncoderChannelB();
+#endif
 
   //-----------------------------------------
   // Start ROS node, publishers & subscribers
   //------------------------------------------
   //Init measured speed message
+#if PUBLISH_LEGACY_WHEEL_VELOCITY
   meas_msg.data_length = 5;
   meas_msg.data = (float*)malloc(sizeof(float)*5);
+#endif
+  meas_stamped_msg.header.frame_id = "";
   //output_msg.data_length = 4;
   //output_msg.data = (float*)malloc(sizeof(float)*4);
   //pwm_msg.data_length = 4;
@@ -110,12 +117,25 @@ void setup() {
 //  }
 
   
-  prevUpdateTime = 0;
   lastReceivedCommTimeout = - commTimeout; //Ensure timeout at initialization
+#if OPEN_LOOP_PWM_COMMAND
+  lastReceivedPwmTimeout = - commTimeout;
+#endif
   
   //Setup the wheel velocity PIDs
   setupPIDParams();
 
+  //Get the calibrated wheelbase and wheel radius scales
+  setupGeometryParams();
+
+  //Get the sonar scheduling mode
+  setupSensorParams();
+
+  //Time the encoder handlers on Timer5 while it is still free
+  measureEncoderHandlers();
+
+  //Start running the wheel controllers from the timer interrupt
+  setupControlTick();
 }
 
 void loop() {
@@ -132,75 +152,13 @@ void loop() {
 
   //#################################
   //
-  //            Main loop
+  //     Wheel feedback and diagnostics
   //
   //#################################
-  now = millis();
-  updateOldness = now - prevUpdateTime;
-  if (updateOldness >= updateRate)
-  {
-    
-    //--------------------------
-    // Reset PWM command values 
-    //--------------------------
-    pwmUL = 0;
-    pwmUR = 0;
-    pwmLL = 0;
-    pwmLR = 0;
-    outputPIDUL = 0;
-    outputPIDUR = 0;
-    outputPIDLL = 0;
-    outputPIDLR = 0;
-    
-    //===================================
-    // Map vx, vy, w to each wheel speed 
-    //===================================
-    computeWheelVelCmd();
-
-    //=====================================
-    // Measure current speed of each wheel
-    //=====================================
-    getWheelVel();
-
-    //==========================================
-    // If command received recently, run motors
-    //==========================================
-    if (now < lastReceivedCommTimeout)
-    { 
-      computeMotorInputs();
-    }
-    
-    //=====================
-    // Apply motor command
-    //=====================
-    applyMotorInputs();
-      
-    // reset vars
-    prevUpdateTime = now;  
-
-    //===============================
-    // Populate and publish messages
-    //===============================
-    // Populate messages
-    //pwm_msg.data[0] = pwmUL;
-    //pwm_msg.data[1] = pwmUR;
-    //pwm_msg.data[2] = pwmLL;
-    //pwm_msg.data[3] = pwmLR;
-    // output_msg.data[0] = polyCmdUL;
-    // output_msg.data[1] = polyCmdUR;
-    // output_msg.data[2] = polyCmdLL;
-    // output_msg.data[3] = polyCmdLR;
-    meas_msg.data[0] = measUL;
-    meas_msg.data[1] = measUR;
-    meas_msg.data[2] = measLL;
-    meas_msg.data[3] = measLR;
-    meas_msg.data[4] = updateOldness;
-    
-    // Publish message
-    measuredVelPub.publish(&meas_msg);
-//    // output_pub.publish(&output_msg);
-//    // pwm_pub.publish(&pwm_msg);
-//
-  } 
+  // The wheel controllers run in the control tick interrupt,
+  // the main loop only publishes what they measured
+  publishWheelFeedback();
+  publishTickStats();
+
   nh.spinOnce();
 }
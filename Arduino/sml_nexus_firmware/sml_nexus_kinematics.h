@@ -0,0 +1,137 @@
+/*
+Mecanum kinematics of the Nexus robots, the one place their geometry is set.
+
+Used by the firmware and, through the include path of sml_nexus_robot, by the
+odometry broadcaster, so that twists, wheel speeds and encoder ticks are
+mapped from the same constants on both ends of the serial link. Wheels are
+UL, UR, LL, LR, their speeds those of the wheel surface (m/s):
+
+  UL = vx - vy - L w      UR = vx + vy + L w
+  LL = vx + vy - L w      LR = vx - vy + L w
+
+with L the lever arm of the rollers: L1 + L2 in the firmware, twice the
+wheelbase of the calibration file. The columns are orthogonal, so the forward
+map is the least-squares twist of the four speeds:
+
+  vx = (UL + UR + LL + LR)/4      vy = (-UL + UR + LL - LR)/4
+  w  = (-UL + UR - LL + LR)/(4 L)
+
+A robot variant is a type with its nominal geometry; nexusGeometry<Variant>
+derives the lever arm and the travel per tick at compile time. The calibrated
+wheelbase and wheel radius scales are only known at startup: they are loaded
+into a mecanumKinematics, which keeps the reciprocals so that the maps are
+multiplications only.
+
+Only depends on stdint.h (C++11 constexpr, no standard library), so it builds
+with avr-gcc and on the host (see Arduino/host).
+*/
+
+#ifndef SML_NEXUS_KINEMATICS_H
+#define SML_NEXUS_KINEMATICS_H
+
+#include <stdint.h>
+
+#define KINEMATICS_PI 3.14159265358979323846
+
+//-------------------------------------------
+// Nominal geometry of the robot variants
+//-------------------------------------------
+//Nexus 4WD mecanum base, encoders decoded on the edges of channel A
+struct nexusMecanum2x
+{
+  static constexpr double wheelRadius(){ return 0.05; }   //m
+  static constexpr double wheelbase(){ return 0.15; }     //m, (L1 + L2)/2
+  static constexpr int32_t encoderCPR(){ return 1536; }   //counts per wheel revolution
+};
+
+//Same base, both encoder channels decoded (ENCODER_QUADRATURE_4X)
+struct nexusMecanum4x : nexusMecanum2x
+{
+  static constexpr int32_t encoderCPR(){ return 3072; }
+};
+
+/************ Wheel travel per encoder tick, in m ************/
+static constexpr double kinematicsTickToMeters(double wheelRadius, int32_t encoderCPR){
+  return 2 * KINEMATICS_PI * wheelRadius / encoderCPR;
+}
+
+//Signs of vy and of L w in the speed of each wheel, UL, UR, LL, LR
+static constexpr int8_t mecanumSignY(uint8_t wheel){ return (wheel == 0 || wheel == 3) ? -1 : 1; }
+static constexpr int8_t mecanumSignW(uint8_t wheel){ return (wheel & 1) ? 1 : -1; }
+
+//-------------------------------------------
+// Compile-time factors and maps of a variant
+//-------------------------------------------
+template <typename Variant>
+struct nexusGeometry
+{
+  static constexpr double wheelbase(){ return Variant::wheelbase(); }
+  static constexpr double leverArm(){ return 2 * Variant::wheelbase(); }              //m, L1 + L2
+  static constexpr double invFourLeverArm(){ return 1 / (4 * leverArm()); }          //1/m
+  static constexpr double tickToMeters(){ return kinematicsTickToMeters(Variant::wheelRadius(), Variant::encoderCPR()); }
+
+  //Speed of a wheel for a twist
+  static constexpr double wheelSpeed(uint8_t wheel, double vx, double vy, double w){
+    return vx + mecanumSignY(wheel) * vy + mecanumSignW(wheel) * leverArm() * w;
+  }
+  //Twist of four wheel speeds
+  static constexpr double forwardX(double ul, double ur, double ll, double lr){ return 0.25 * (ul + ur + ll + lr); }
+  static constexpr double forwardY(double ul, double ur, double ll, double lr){ return 0.25 * (-ul + ur + ll - lr); }
+  static constexpr double forwardW(double ul, double ur, double ll, double lr){ return invFourLeverArm() * (-ul + ur - ll + lr); }
+
+  //vx (0), vy (1) or w (2) of the wheel speeds of a twist
+  static constexpr double roundTrip(uint8_t k, double vx, double vy, double w){
+    return (k == 0 ? forwardX : k == 1 ? forwardY : forwardW)(wheelSpeed(0, vx, vy, w), wheelSpeed(1, vx, vy, w),
+                                                             wheelSpeed(2, vx, vy, w), wheelSpeed(3, vx, vy, w));
+  }
+};
+
+//Compile-time checks: the forward map undoes the inverse one, on a twist turning all wheels differently
+static constexpr bool kinematicsClose(double a, double b){ return (a - b) * (a - b) < 1e-10; }
+static_assert(kinematicsClose(nexusGeometry<nexusMecanum2x>::roundTrip(0, 0.1, -0.2, 0.7), 0.1)
+              && kinematicsClose(nexusGeometry<nexusMecanum2x>::roundTrip(1, 0.1, -0.2, 0.7), -0.2)
+              && kinematicsClose(nexusGeometry<nexusMecanum2x>::roundTrip(2, 0.1, -0.2, 0.7), 0.7),
+              "Forward and inverse mecanum maps disagree");
+static_assert(nexusGeometry<nexusMecanum2x>::leverArm() == 0.3, "Nexus lever arm L1 + L2 is 0.3 m");
+static_assert(nexusGeometry<nexusMecanum4x>::tickToMeters() * 2 == nexusGeometry<nexusMecanum2x>::tickToMeters(),
+              "4x decoding halves the travel per tick");
+
+//-------------------------------------------
+// Kinematics with the calibrated geometry
+//-------------------------------------------
+template <typename Scalar>
+struct mecanumKinematics
+{
+  Scalar leverArm;          //m, L1 + L2
+  Scalar invFourLeverArm;   //1/m, 1/(4 (L1 + L2))
+  Scalar tickToMeters[4];   //m, calibrated wheel travel per tick, UL, UR, LL, LR
+};
+
+/************ Calibrated kinematics, from the wheelbase (L1 + L2)/2 and the wheel radius scales ************/
+template <typename Scalar>
+static inline void mecanumKinematicsSetup(mecanumKinematics<Scalar>& kinematics, Scalar wheelbase,
+                                          Scalar tickToMeters, const Scalar wheelScale[4]){
+  kinematics.leverArm = 2 * wheelbase;
+  kinematics.invFourLeverArm = 1 / (4 * kinematics.leverArm);
+  for (uint8_t i = 0; i < 4; i++) kinematics.tickToMeters[i] = tickToMeters * wheelScale[i];
+}
+
+/************ Wheel speeds UL, UR, LL, LR of vx, vy (m/s) and w (rad/s) ************/
+template <typename Scalar>
+static inline void mecanumInverse(const mecanumKinematics<Scalar>& kinematics, Scalar vx, Scalar vy, Scalar w, Scalar wheels[4]){
+  const Scalar l = kinematics.leverArm * w;
+  wheels[0] = vx - vy - l;
+  wheels[1] = vx + vy + l;
+  wheels[2] = vx + vy - l;
+  wheels[3] = vx - vy + l;
+}
+
+/************ vx, vy (m/s) and w (rad/s) of the wheel speeds UL, UR, LL, LR ************/
+template <typename Scalar>
+static inline void mecanumForward(const mecanumKinematics<Scalar>& kinematics, const Scalar wheels[4], Scalar twist[3]){
+  twist[0] = Scalar(0.25) * (wheels[0] + wheels[1] + wheels[2] + wheels[3]);
+  twist[1] = Scalar(0.25) * (-wheels[0] + wheels[1] + wheels[2] - wheels[3]);
+  twist[2] = kinematics.invFourLeverArm * (-wheels[0] + wheels[1] - wheels[2] + wheels[3]);
+}
+
+#endif // SML_NEXUS_KINEMATICS_H
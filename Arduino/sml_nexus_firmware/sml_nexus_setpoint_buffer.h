@@ -0,0 +1,110 @@
+/*
+Buffer of velocity setpoints streamed ahead by the host, for the control tick.
+
+The host sends short batches of future vx, vy, w setpoints with their times
+(sml_nexus_msgs/VelocityTrajectory on cmd_vel_trajectory). Each batch replaces
+the previous one. At every control tick the setpoint is linearly interpolated
+between the two setpoints around the tick time. A late batch therefore does
+not show up in the wheel speeds, as long as the previous one reaches far enough
+ahead. After the last setpoint, the velocity is scaled down linearly to a stop,
+with the fastest wheel decelerating at the stop deceleration. The direction of
+the motion is kept while the robot stops.
+
+Times are in micros() of the device, offsets in us from the start of the batch.
+The segment durations are inverted when the batch is loaded, in the main loop,
+so that sampling in the control tick interrupt is a few float multiplications.
+
+Only depends on stdint.h and can be compiled on the host (see Arduino/host).
+*/
+
+#ifndef SML_NEXUS_SETPOINT_BUFFER_H
+#define SML_NEXUS_SETPOINT_BUFFER_H
+
+#include <stdint.h>
+
+#define SETPOINT_BUFFER_SIZE 12   //Setpoints per batch, later ones are dropped
+
+struct setpointBuffer
+{
+  uint32_t startMicros;                       //Device time the offsets count from
+  int32_t offset[SETPOINT_BUFFER_SIZE];       //us after startMicros, increasing
+  int16_t cmd[SETPOINT_BUFFER_SIZE][3];       //vx, vy in mm/s, w in mrad/s
+  float invDuration[SETPOINT_BUFFER_SIZE];    //1/us, to the next setpoint
+  float invStopDuration;                      //1/us, of the stop ramp after the last setpoint
+  uint8_t count;
+  uint8_t index;                              //Segment of the last sample
+};
+
+static inline void setpointBufferClear(setpointBuffer& buffer, uint32_t startMicros){
+  buffer.startMicros = startMicros;
+  buffer.count = 0;
+  buffer.index = 0;
+}
+
+/************ Add a setpoint, false if the buffer is full or it is not after the previous one ************/
+static inline bool setpointBufferAppend(setpointBuffer& buffer, int32_t offsetMicros, int16_t vx, int16_t vy, int16_t w){
+  if (buffer.count >= SETPOINT_BUFFER_SIZE) return false;
+  if (buffer.count > 0 && offsetMicros <= buffer.offset[buffer.count - 1]) return false;
+  buffer.offset[buffer.count] = offsetMicros;
+  buffer.cmd[buffer.count][0] = vx;
+  buffer.cmd[buffer.count][1] = vy;
+  buffer.cmd[buffer.count][2] = w;
+  buffer.count++;
+  return true;
+}
+
+/************ Segment slopes and stop ramp, deceleration in m/s^2 of the fastest wheel ************/
+static inline void setpointBufferFinish(setpointBuffer& buffer, float deceleration, float turnRadius){
+  for (uint8_t i = 0; i + 1 < buffer.count; i++){
+    buffer.invDuration[i] = 1.0f / (float)(buffer.offset[i + 1] - buffer.offset[i]);
+  }
+  buffer.index = 0;
+  buffer.invStopDuration = 1.0f;  //Stop at once from a standstill
+  if (buffer.count == 0) return;
+
+  //Fastest wheel at the last setpoint, as computeWheelVelCmd() maps it
+  const int16_t* last = buffer.cmd[buffer.count - 1];
+  float wheelSpeed = 0.001f * ((last[0] < 0 ? -last[0] : last[0]) + (last[1] < 0 ? -last[1] : last[1])
+                               + turnRadius * (last[2] < 0 ? -last[2] : last[2]));
+  if (wheelSpeed > 0 && deceleration > 0) buffer.invStopDuration = deceleration / (wheelSpeed * 1e6f);
+}
+
+/************ vx, vy (m/s) and w (rad/s) at nowMicros, false once stopped after the last setpoint ************/
+static inline bool setpointBufferSample(setpointBuffer& buffer, uint32_t nowMicros, float setpoint[3]){
+  if (buffer.count == 0){
+    for (uint8_t k = 0; k < 3; k++) setpoint[k] = 0;
+    return false;
+  }
+  const int32_t elapsed = (int32_t)(nowMicros - buffer.startMicros);
+
+  //Before the first setpoint, hold it
+  if (elapsed <= buffer.offset[0]){
+    for (uint8_t k = 0; k < 3; k++) setpoint[k] = 0.001f * buffer.cmd[0][k];
+    return true;
+  }
+
+  //Segment around now, the ticks only go forward
+  uint8_t i = buffer.index;
+  while (i + 1 < buffer.count && elapsed >= buffer.offset[i + 1]) i++;
+  buffer.index = i;
+
+  if (i + 1 < buffer.count){
+    const float fraction = (elapsed - buffer.offset[i]) * buffer.invDuration[i];
+    for (uint8_t k = 0; k < 3; k++){
+      setpoint[k] = 0.001f * (buffer.cmd[i][k] + fraction * (buffer.cmd[i + 1][k] - buffer.cmd[i][k]));
+    }
+    return true;
+  }
+
+  //Past the last setpoint: ramp down to a stop
+  const float scale = 1.0f - (elapsed - buffer.offset[i]) * buffer.invStopDuration;
+  if (scale <= 0){
+    for (uint8_t k = 0; k < 3; k++) setpoint[k] = 0;
+    buffer.count = 0;
+    return false;
+  }
+  for (uint8_t k = 0; k < 3; k++) setpoint[k] = 0.001f * scale * buffer.cmd[i][k];
+  return true;
+}
+
+#endif // SML_NEXUS_SETPOINT_BUFFER_H
@@ -0,0 +1,79 @@
+/*
+Wheel speed estimation from encoder edge timing.
+
+Counting encoder ticks over one control period quantizes the speed to one
+tick per period: 20 mm/s at 100 Hz and 1536 counts per revolution. The
+encoder interrupts also record the time of the last edge, so the ticks of
+a period can be divided by the time between the last edge of the previous
+period and the last edge of this one instead (period measurement), which
+is only limited by the timestamp jitter.
+
+  * Both estimates are blended with inverse-variance weights: tick
+    quantization of the count estimate against timestamp jitter of the
+    edge estimate, the latter growing with the number of ticks
+  * Without any edge during a period, the speed is bounded by one tick
+    since the last edge, and drops to zero after a timeout
+  * After a stop, the first period with ticks uses the count estimate,
+    the previous edge being too old to time from
+
+Only depends on stdint.h and can be compiled on the host (see Arduino/host).
+*/
+
+#ifndef SML_NEXUS_SPEED_ESTIMATOR_H
+#define SML_NEXUS_SPEED_ESTIMATOR_H
+
+#include <stdint.h>
+
+#define SPEED_EDGE_JITTER_US 8.0f      //us, standard deviation of the edge timestamps
+#define SPEED_EDGE_TIMEOUT_US 100000UL //us, without edges for longer the wheel is stopped
+
+//------------------------------------
+// Estimator state of one wheel
+//------------------------------------
+struct edgeSpeedEstimator
+{
+  float speed;                 //m/s, last estimate
+  unsigned long lastEdgeMicros; //Time of the last edge counted so far
+  bool tracking;               //lastEdgeMicros is recent enough to time from
+};
+
+static inline void edgeSpeedReset(edgeSpeedEstimator& estimator){
+  estimator.speed = 0;
+  estimator.lastEdgeMicros = 0;
+  estimator.tracking = false;
+}
+
+/************ Update with the ticks of the period ending at latchMicros, the last one at edgeMicros ************/
+static inline float edgeSpeedUpdate(edgeSpeedEstimator& estimator, int16_t ticks, unsigned long edgeMicros,
+                                    unsigned long latchMicros, unsigned long periodMicros, float tickToMeters){
+  if (ticks != 0){
+    float countSpeed = ticks * tickToMeters * 1000000.0f / periodMicros;
+    unsigned long span = edgeMicros - estimator.lastEdgeMicros;
+    if (estimator.tracking && span > 0 && span < SPEED_EDGE_TIMEOUT_US){
+      float edgeSpeed = ticks * tickToMeters * 1000000.0f / span;
+      //Ratio of the edge to the count estimate standard deviations:
+      //ticks * jitter * sqrt(24) / period
+      float ratio = ticks * SPEED_EDGE_JITTER_US * 4.899f / periodMicros;
+      float countWeight = ratio * ratio / (1.0f + ratio * ratio);
+      estimator.speed = edgeSpeed + countWeight * (countSpeed - edgeSpeed);
+    }
+    else{
+      estimator.speed = countSpeed;
+    }
+    estimator.lastEdgeMicros = edgeMicros;
+    estimator.tracking = true;
+  }
+  else if (!estimator.tracking || latchMicros - estimator.lastEdgeMicros > SPEED_EDGE_TIMEOUT_US){
+    estimator.speed = 0;
+    estimator.tracking = false;
+  }
+  else{
+    //No edge yet: at most one tick since the last one
+    float bound = tickToMeters * 1000000.0f / (latchMicros - estimator.lastEdgeMicros);
+    if (estimator.speed > bound) estimator.speed = bound;
+    else if (estimator.speed < -bound) estimator.speed = -bound;
+  }
+  return estimator.speed;
+}
+
+#endif // SML_NEXUS_SPEED_ESTIMATOR_H
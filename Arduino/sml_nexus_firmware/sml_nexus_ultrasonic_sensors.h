@@ -10,6 +10,16 @@ TO BE USED ON ARDUINO MEGA
 # Specification
     * Detecting range: 4cm-500cm
     * Resolution     : 1cm
+
+# Scheduling
+    Each range is published as soon as its distance reply is parsed.
+    Temperatures are read every sonar_temperature_period cycles (0: never).
+    With sonar_staggered_pairs set, front/rear and right/left measure as two
+    pairs of opposite sensors in a pipeline: one pair is read and triggered
+    again while the other one is measuring. Otherwise all four are triggered
+    at once and read once the measurement is done.
+    A distance is never requested before sensorTriggerDelay has passed since
+    the sensor was triggered.
 */
 
 #include "Arduino.h"
@@ -18,11 +28,26 @@ TO BE USED ON ARDUINO MEGA
 #include <std_msgs/Byte.h>
 #include <std_msgs/ByteMultiArray.h>
 #include <std_msgs/String.h>
+#include "sml_nexus_urm04_parser.h"
 
 //Serial port 2 is used communication with sensor
 #define SerialPort Serial2
 #define printByte(args) SerialPort.write(args)
-#define CommMAXRetry 40
+#define SensorTxGuard 4000      //us, bus turnaround time around each command sent to the sensors
+#define SensorRxMaxBytes 16     //Maximum number of received bytes parsed per loop pass
+#define SensorTxQueueSize 8     //Commands waiting to be sent, power of 2
+
+#define SensorScheduleSize 16    //Steps in the longest cycle
+
+//Default scheduling, overridden by the sonar_temperature_period and
+//sonar_staggered_pairs parameters
+#define SONAR_TEMPERATURE_PERIOD 10   //Cycles between temperature reads, 0 to never read them
+#define SONAR_STAGGERED_PAIRS 1       //Trigger front/rear and right/left pairs one after the other
+
+//Commands of a scheduling step
+#define SensorStepTrigger 0
+#define SensorStepDist 1
+#define SensorStepTemp 2
 
 /******************** Variables ****************/
 byte sensorReadingStep = 0;
@@ -32,6 +57,16 @@ double prevSensorTime  = 0; //ms
 byte cmdst[10];
 char buff[10];
 
+//Received frames parser, advanced a few bytes at every loop pass
+urm04Parser sensorParser;
+
+//Commands waiting for the bus to be free, sent one at a time
+byte sensorTxQueueCmd[SensorTxQueueSize];
+byte sensorTxQueueId[SensorTxQueueSize];
+byte sensorTxHead = 0;
+byte sensorTxTail = 0;
+unsigned long lastSensorTxTime = 0; //us
+
 unsigned int sensorData[8];
 
 byte sensorAddresses[]  = {0x11, 0x12, 0x13, 0x14}; //RS-485 addresses of respectively right, front, left and rear sensor
@@ -42,6 +77,17 @@ byte sensorTempCmd[]    = {0x55, 0xaa, 0xff, 0x00, 0x03, 0xff};
 int sensorCommDelay = 10;     //ms, minimum time to wait for communication with sensor
 int sensorTriggerDelay = 40;  //ms, minimum time to wait for data to be available after triggering
 
+int sensorTempPeriod = SONAR_TEMPERATURE_PERIOD;
+int sensorStaggeredPairs = SONAR_STAGGERED_PAIRS;
+unsigned int sensorCycleCount = 0;
+unsigned long sensorTriggerTime[4] = {0, 0, 0, 0}; //ms, when each sensor was last triggered on the bus
+
+//Command sequence of the current cycle, rebuilt at the start of each cycle
+byte sensorScheduleCmd[SensorScheduleSize];
+byte sensorScheduleId[SensorScheduleSize];
+int sensorScheduleDelay[SensorScheduleSize];  //ms, wait after the step
+byte sensorScheduleLength = 0;
+
 sensor_msgs::Range sensorDistMsg;
 sensor_msgs::Range leftSensorDistMsg;
 sensor_msgs::Range rearSensorDistMsg;
@@ -81,10 +127,15 @@ void runSensor();
 void triggerSensor(int id);
 void getDistSensor(int id);
 void getTempSensor(int id);
+void queueCommand(const byte cmd[], int id);
+boolean sensorTxIdle();
 void transmitCommands();
 void readSensorData();
 void analyzeSensorData(byte cmd[]);
-void publishSensorData();
+void setupSensorParams();
+void addSensorStep(byte cmd, byte id, int delayMs);
+void buildSensorSchedule();
+void publishSensorData(byte index);
 
 /********* Setup messages and publisher ************/
 void setupSensorTopics(){
@@ -137,223 +188,162 @@ void setupSensorTopics(){
   //nh.advertise(sensorCommPub);
 }
 
-//================================================
-// Main function, to call at every loop iteration
-//================================================
-void runSensor(){
-  //sensorStepMsg.data = sensorReadingStep;
-  //sensorStepPub.publish(&sensorStepMsg);
-  if (millis() - prevSensorTime >= sensorStepTimer){
-    switch(sensorReadingStep){
-      
-      //-----------------
-      // Trigger sensors
-      //-----------------
-      case 0:
-        //sensorStatusMsg.data = "Trigger";
-        //sensorStatusPub.publish(&sensorStatusMsg);
-        //Reset data
-        for (int i=0; i<8; i++) sensorData[i] = 65535; //default value is considered erronous and will be treated as such (if no data received from sensor)
-        triggerSensor(0);
-        triggerSensor(1);
-        triggerSensor(2);
-        triggerSensor(3);
-        sensorStepTimer = sensorTriggerDelay; //Wait for sensor data to be available
-        break;
+/********* Get the scheduling mode from the parameter server ************/
+void setupSensorParams(){
+  if(!nh.getParam("sonar_temperature_period", &sensorTempPeriod, 1, 300)){
+    sensorTempPeriod = SONAR_TEMPERATURE_PERIOD;
+    nh.logwarn("Sonar temperature period: loading default value;");
+  }
 
-      //--------------
-      // Get distance
-      //--------------
-      // Get distance from right sensor
-      case 1:
-        //sensorStatusMsg.data = "Dist sensor 1";
-        //sensorStatusPub.publish(&sensorStatusMsg);
-        getDistSensor(0);
-        sensorStepTimer = sensorCommDelay; //Wait for communication with sensor
-        break;
+  if(!nh.getParam("sonar_staggered_pairs", &sensorStaggeredPairs, 1, 300)){
+    sensorStaggeredPairs = SONAR_STAGGERED_PAIRS;
+    nh.logwarn("Sonar staggered pairs: loading default value;");
+  }
+}
 
-      // Get distance from front sensor
-      case 2:
-        //sensorStatusMsg.data = "Dist sensor 2";
-        //sensorStatusPub.publish(&sensorStatusMsg);
-        getDistSensor(1);
-        sensorStepTimer = sensorCommDelay; //Wait for communication with sensor
-        break;
+//================================================
+// Build the command sequence of the next cycle
+//================================================
+void addSensorStep(byte cmd, byte id, int delayMs){
+  sensorScheduleCmd[sensorScheduleLength] = cmd;
+  sensorScheduleId[sensorScheduleLength] = id;
+  sensorScheduleDelay[sensorScheduleLength] = delayMs;
+  sensorScheduleLength++;
+}
 
-      // Get distance from left sensor
-      case 3:
-        //sensorStatusMsg.data = "Dist sensor 3";
-        //sensorStatusPub.publish(&sensorStatusMsg);
-        getDistSensor(2);
-        sensorStepTimer = sensorCommDelay; //Wait for communication with sensor
-        break;
+void buildSensorSchedule(){
+  sensorScheduleLength = 0;
 
-      // Get distance from rear sensor
-      case 4:
-        //sensorStatusMsg.data = "Dist sensor 4";
-        //sensorStatusPub.publish(&sensorStatusMsg);
-        getDistSensor(3);
-        sensorStepTimer = sensorCommDelay; //Wait for communication with sensor
-        break;
+  if (sensorStaggeredPairs){
+    //Front and rear face away from each other, as do right and left: while
+    //one pair measures, the other one is read and triggered again, so each
+    //pair is busy measuring for most of the cycle
+    if (sensorCycleCount == 0){
+      for (byte id = 0; id < 4; id++) addSensorStep(SensorStepTrigger, id, 0);
+    }
+    addSensorStep(SensorStepDist, 1, sensorCommDelay);
+    addSensorStep(SensorStepDist, 3, sensorCommDelay);
+    addSensorStep(SensorStepTrigger, 1, 0);
+    addSensorStep(SensorStepTrigger, 3, 0);
+    addSensorStep(SensorStepDist, 0, sensorCommDelay);
+    addSensorStep(SensorStepDist, 2, sensorCommDelay);
+    addSensorStep(SensorStepTrigger, 0, 0);
+    addSensorStep(SensorStepTrigger, 2, 0);
+  }
+  else{
+    for (byte id = 0; id < 4; id++) addSensorStep(SensorStepTrigger, id, id < 3 ? 0 : sensorTriggerDelay);
+    for (byte id = 0; id < 4; id++) addSensorStep(SensorStepDist, id, sensorCommDelay);
+  }
 
-      case 5:
-        //sensorStatusMsg.data = "Read dist";
-        //sensorStatusPub.publish(&sensorStatusMsg);
-        readSensorData();
-        sensorStepTimer = 0;
-        break;
+  //Temperature barely changes, only read it every sensorTempPeriod cycles
+  if (sensorTempPeriod > 0 && sensorCycleCount % sensorTempPeriod == 0){
+    for (byte id = 0; id < 4; id++) addSensorStep(SensorStepTemp, id, sensorCommDelay);
+  }
+  sensorCycleCount++;
+}
 
-      //-----------------
-      // Get temperature
-      //-----------------
-      // Get temperature from right sensor
-      case 6:
-        //sensorStatusMsg.data = "Temp sensor 1";
-        //sensorStatusPub.publish(&sensorStatusMsg);
-        getTempSensor(0);
-        sensorStepTimer = sensorCommDelay; //Wait for communication with sensor
-        break;
+//================================================
+// Main function, to call at every loop iteration
+//================================================
+void runSensor(){
+  //Send queued commands and parse replies, without ever waiting on the bus
+  transmitCommands();
+  readSensorData();
 
-      // Get temperature from front sensor
-      case 7:
-        //sensorStatusMsg.data = "Temp sensor 2";
-        //sensorStatusPub.publish(&sensorStatusMsg);
-        getTempSensor(1);
-        sensorStepTimer = sensorCommDelay; //Wait for communication with sensor
-        break;
+  //Step timers run from the moment the last queued command went out
+  if (!sensorTxIdle()){
+    prevSensorTime = millis();
+    return;
+  }
 
-      // Get temperature from left sensor
-      case 8:
-        //sensorStatusMsg.data = "Temp sensor 3";
-        //sensorStatusPub.publish(&sensorStatusMsg);
-        getTempSensor(2);
-        sensorStepTimer = sensorCommDelay; //Wait for communication with sensor
-        break;
+  if (millis() - prevSensorTime >= sensorStepTimer){
+    if (sensorReadingStep >= sensorScheduleLength){
+      buildSensorSchedule();
+      sensorReadingStep = 0;
+    }
 
-      // Get temperature from rear sensor
-      case 9:
-        //sensorStatusMsg.data = "Temp sensor 4";
-        //sensorStatusPub.publish(&sensorStatusMsg);
-        getTempSensor(3);
-        sensorStepTimer = sensorCommDelay; //Wait for communication with sensor
+    //Replies are parsed and published as they arrive, the sequence
+    //only sends the commands and waits for the sensors
+    byte id = sensorScheduleId[sensorReadingStep];
+    if (sensorScheduleCmd[sensorReadingStep] == SensorStepDist && millis() - sensorTriggerTime[id] < (unsigned long)sensorTriggerDelay){
+      return;  //Still measuring
+    }
+    switch(sensorScheduleCmd[sensorReadingStep]){
+      case SensorStepTrigger:
+        triggerSensor(id);
         break;
-
-      case 10:
-        //sensorStatusMsg.data = "Read temp and pub";
-        //sensorStatusPub.publish(&sensorStatusMsg);
-        readSensorData();
-        sensorStepTimer = 0;
-      //------------------------------
-      // Publish sensor data over ROS
-      //------------------------------
-        publishSensorData();
+      case SensorStepDist:
+        getDistSensor(id);
         break;
-
-      default:
-        sensorReadingStep = 0;   // Finish reading the distance and start a new measuring for the sensor
+      case SensorStepTemp:
+        getTempSensor(id);
         break;
-      }
-    
-      if(sensorReadingStep < 10)  sensorReadingStep++;  //step manager
-      else sensorReadingStep = 0;
+    }
+    sensorStepTimer = sensorScheduleDelay[sensorReadingStep];
+    sensorReadingStep++;
 
-      prevSensorTime = millis();
-      
+    prevSensorTime = millis();
   }
 }
 
 /********************* Transmit Command via the RS485 interface ***************/
 
 void triggerSensor(int id){  // The function is used to trigger the measuring
-  cmdst[0] = sensorTriggerCmd[0];
-  cmdst[1] = sensorTriggerCmd[1];
-  cmdst[2] = sensorAddresses[id];
-  cmdst[3] = sensorTriggerCmd[3];
-  cmdst[4] = sensorTriggerCmd[4];
-  transmitCommands();
+  queueCommand(sensorTriggerCmd, id);
 }
 void getDistSensor(int id){  // The function is used to read the distance
-  cmdst[0] = sensorDistCmd[0];
-  cmdst[1] = sensorDistCmd[1];
-  cmdst[2] = sensorAddresses[id];
-  cmdst[3] = sensorDistCmd[3];
-  cmdst[4] = sensorDistCmd[4];
-  transmitCommands();
+  queueCommand(sensorDistCmd, id);
 }
 void getTempSensor(int id){  // The function is used to read the temperature
-  cmdst[0] = sensorTempCmd[0];
-  cmdst[1] = sensorTempCmd[1];
-  cmdst[2] = sensorAddresses[id];
-  cmdst[3] = sensorTempCmd[3];
-  cmdst[4] = sensorTempCmd[4];
-  transmitCommands();
+  queueCommand(sensorTempCmd, id);
+}
+
+void queueCommand(const byte cmd[], int id){  // Queue a command until the bus is free
+  byte next = (sensorTxHead + 1) & (SensorTxQueueSize - 1);
+  if (next == sensorTxTail) return;  //Queue full, drop the command
+  sensorTxQueueCmd[sensorTxHead] = cmd[4];
+  sensorTxQueueId[sensorTxHead] = id;
+  sensorTxHead = next;
 }
 
-void transmitCommands(){  // Send protocol via RS485 interface
-  cmdst[5]=cmdst[0]+cmdst[1]+cmdst[2]+cmdst[3]+cmdst[4];
-  delay(1);
+boolean sensorTxIdle(){  // True once all queued commands are sent and the bus turned around
+  return sensorTxHead == sensorTxTail && micros() - lastSensorTxTime >= SensorTxGuard;
+}
+
+void transmitCommands(){  // Send the next queued command via RS485 interface, if the bus is free
+  if (sensorTxHead == sensorTxTail || micros() - lastSensorTxTime < SensorTxGuard) return;
+
+  cmdst[0] = URM04_HEADER_1;
+  cmdst[1] = URM04_HEADER_2;
+  cmdst[2] = sensorAddresses[sensorTxQueueId[sensorTxTail]];
+  cmdst[3] = 0x00;
+  cmdst[4] = sensorTxQueueCmd[sensorTxTail];
+  cmdst[5] = urm04Checksum(cmdst, 5);
+  if (cmdst[4] == sensorTriggerCmd[4]) sensorTriggerTime[sensorTxQueueId[sensorTxTail]] = millis();
+  sensorTxTail = (sensorTxTail + 1) & (SensorTxQueueSize - 1);
+
+  //6 bytes fit in the hardware serial transmit buffer, this does not block
   for(int j = 0; j < 6; j++){
     printByte(cmdst[j]);
   }
-  delay(3);
+  lastSensorTxTime = micros();
 }
 
 /********************* Receive the data and get the distance value from the RS485 interface ***************/
 
-void readSensorData(){
-  
-  while(SerialPort.available()){
-    
-    unsigned long timerPoint = millis();
-    
-    int RetryCounter = 0;
-    byte cmdrd[10];
-    for(int i = 0 ;i < 10; i++)  cmdrd[i] = 0;
-    int i=0;
-
-    boolean flag = true;
-    boolean valid = false;
-    byte headerNo = 0;
-
-    while(RetryCounter < CommMAXRetry && flag)
-    {
-      
-      if(SerialPort.available()){
-        cmdrd[i]= SerialPort.read();
-
-        if(i > 7){
-          flag=false;
-          SerialPort.flush();
-          break;
-        }
-        if(cmdrd[i] == 0x55){
-          headerNo = i;
-          valid = true;
-        }
-        if(valid && i == 7){
-          flag = false;
-          break;
-        }
-        if(valid){
-          i ++;
-        }
-        RetryCounter = 0;
-      }
-      else{
-        RetryCounter++;
-        delayMicroseconds(15);
-      }
+void readSensorData(){  // Parse the bytes received so far, never waits for more
+  int count = 0;
+  while(SerialPort.available() && count < SensorRxMaxBytes){
+    if (sensorParser.parseByte(SerialPort.read())){
+      analyzeSensorData((byte*)sensorParser.frame());
     }
-    
-    if(valid)  analyzeSensorData(cmdrd);   
+    count++;
   }
-  
 }
 
 void analyzeSensorData(byte cmd[]){
-  byte sumCheck = 0;
+  byte sumCheck = urm04Checksum(cmd, 7);
   byte id = 255;
-  for(int h = 0;h < 7; h ++)  sumCheck += cmd[h];
 
   //If message sum check is passed
   if(sumCheck == cmd[7]){
@@ -375,70 +365,62 @@ void analyzeSensorData(byte cmd[]){
     if(id != 255){
       //If distance message
       if(sumCheck == cmd[7] && cmd[3] == 2 && cmd[4] == 2){
-        //Get distance value from message
+        //Get distance value from message and publish it right away
         sensorData[id] = cmd[5] * 256 + cmd[6];
+        publishSensorData(id);
       }
       //If temperature message
       else if (sumCheck == cmd[7] && cmd[3] == 2 && cmd[4] == 3){
-        //Get temperature value from message
+        //Get temperature value from message and publish it right away
         sensorData[id+4] = (cmd[5]*256 + cmd[6])/10;
+        publishSensorData(id+4);
       }
-      //If unknown message, leave 65535 value
     }
   }
 }
   
-void publishSensorData(){
-  //If data from the sensor is available, send message over ROS
-  //sensorData array from 0 to 3 is distance
-  if(sensorData[0] != 65535){
-  //if(true){ 
-    rightSensorDistMsg.header.stamp = nh.now();
-    rightSensorDistMsg.range = sensorData[0];
-    rightSensorDistPub.publish(&rightSensorDistMsg);
+void publishSensorData(byte index){
+  //sensorData array from 0 to 3 is distance, from 4 to 7 is temperature
+  switch(index){
+    case 0:
+      rightSensorDistMsg.header.stamp = nh.now();
+      rightSensorDistMsg.range = sensorData[0];
+      rightSensorDistPub.publish(&rightSensorDistMsg);
+      break;
+    case 1:
+      frontSensorDistMsg.header.stamp = nh.now();
+      frontSensorDistMsg.range = sensorData[1];
+      frontSensorDistPub.publish(&frontSensorDistMsg);
+      break;
+    case 2:
+      leftSensorDistMsg.header.stamp = nh.now();
+      leftSensorDistMsg.range = sensorData[2];
+      leftSensorDistPub.publish(&leftSensorDistMsg);
+      break;
+    case 3:
+      rearSensorDistMsg.header.stamp = nh.now();
+      rearSensorDistMsg.range = sensorData[3];
+      rearSensorDistPub.publish(&rearSensorDistMsg);
+      break;
+    case 4:
+      rightSensorTempMsg.header.stamp = nh.now();
+      rightSensorTempMsg.temperature = sensorData[4];
+      rightSensorTempPub.publish(&rightSensorTempMsg);
+      break;
+    case 5:
+      frontSensorTempMsg.header.stamp = nh.now();
+      frontSensorTempMsg.temperature = sensorData[5];
+      frontSensorTempPub.publish(&frontSensorTempMsg);
+      break;
+    case 6:
+      leftSensorTempMsg.header.stamp = nh.now();
+      leftSensorTempMsg.temperature = sensorData[6];
+      leftSensorTempPub.publish(&leftSensorTempMsg);
+      break;
+    case 7:
+      rearSensorTempMsg.header.stamp = nh.now();
+      rearSensorTempMsg.temperature = sensorData[7];
+      rearSensorTempPub.publish(&rearSensorTempMsg);
+      break;
   }
-  if(sensorData[1] != 65535){
-  //if(true){
-    frontSensorDistMsg.header.stamp = nh.now();
-    frontSensorDistMsg.range = sensorData[1];
-    frontSensorDistPub.publish(&frontSensorDistMsg);
-  }
-  if(sensorData[2] != 65535){
-  //if(true){
-    leftSensorDistMsg.header.stamp = nh.now();
-    leftSensorDistMsg.range = sensorData[2];
-    leftSensorDistPub.publish(&leftSensorDistMsg);
-  }
-  if(sensorData[3] != 65535){
-  //if(true){
-    rearSensorDistMsg.header.stamp = nh.now();
-    rearSensorDistMsg.range = sensorData[3];
-    rearSensorDistPub.publish(&rearSensorDistMsg);
-  }
-  //sensorData array from 4 to 7 is temperature
-  if(sensorData[4] != 65535){
-  //if(true){
-    rightSensorTempMsg.header.stamp = nh.now();
-    rightSensorTempMsg.temperature = sensorData[4];
-    rightSensorTempPub.publish(&rightSensorTempMsg);
-  }
-  if(sensorData[5] != 65535){
-  //if(true){
-    frontSensorTempMsg.header.stamp = nh.now();
-    frontSensorTempMsg.temperature = sensorData[5];
-    frontSensorTempPub.publish(&frontSensorTempMsg);
-  }
-  if(sensorData[6] != 65535){
-  //if(true){
-    leftSensorTempMsg.header.stamp = nh.now();
-    leftSensorTempMsg.temperature = sensorData[6];
-    leftSensorTempPub.publish(&leftSensorTempMsg);
-  }
-  if(sensorData[7] != 65535){
-  //if(true){
-    rearSensorTempMsg.header.stamp = nh.now();
-    rearSensorTempMsg.temperature = sensorData[7];
-    rearSensorTempPub.publish(&rearSensorTempMsg);
-  }
-  
 }
@@ -0,0 +1,93 @@
+/*
+Byte-level parser for the URM04 RS-485 protocol.
+
+Frames sent by the sensors are 8 bytes long:
+  0x55 0xAA address length command data_high data_low checksum
+the checksum being the 8-bit sum of the 7 previous bytes.
+
+The parser consumes one byte at a time and never waits for the next one,
+so it can be advanced from every loop() pass. It only depends on stdint.h
+and can be compiled on the host (see Arduino/host).
+*/
+
+#ifndef SML_NEXUS_URM04_PARSER_H
+#define SML_NEXUS_URM04_PARSER_H
+
+#include <stdint.h>
+
+#define URM04_FRAME_LENGTH 8
+#define URM04_HEADER_1 0x55
+#define URM04_HEADER_2 0xAA
+
+/************ Checksum of a URM04 frame (command or response) ************/
+static inline uint8_t urm04Checksum(const uint8_t frame[], uint8_t length){
+  uint8_t sum = 0;
+  for (uint8_t h = 0; h < length; h++) sum += frame[h];
+  return sum;
+}
+
+//--------------------
+// URM04 frame parser
+//--------------------
+class urm04Parser
+{
+  public:
+    urm04Parser();
+    void reset();
+    // Feed one received byte. Returns true when it completes a frame
+    // with a valid checksum, available from frame() until the next call.
+    bool parseByte(uint8_t data);
+    const uint8_t* frame() const { return _frame; }
+
+    unsigned long frameCount;     //Valid frames received
+    unsigned long checksumErrors; //Complete frames dropped on checksum
+
+  protected:
+    uint8_t _frame[URM04_FRAME_LENGTH];
+    uint8_t _index;
+};
+
+inline urm04Parser::urm04Parser()
+{
+  frameCount = 0;
+  checksumErrors = 0;
+  reset();
+}
+
+inline void urm04Parser::reset()
+{
+  _index = 0;
+}
+
+inline bool urm04Parser::parseByte(uint8_t data)
+{
+  switch (_index){
+    //Wait for the first header byte
+    case 0:
+      if (data == URM04_HEADER_1) _frame[_index++] = data;
+      return false;
+
+    //Second header byte, resynchronize on a repeated first header byte
+    case 1:
+      if (data == URM04_HEADER_2) _frame[_index++] = data;
+      else if (data != URM04_HEADER_1) _index = 0;
+      return false;
+
+    //Frame body
+    default:
+      _frame[_index++] = data;
+      if (_index < URM04_FRAME_LENGTH) return false;
+
+      _index = 0;
+      if (urm04Checksum(_frame, URM04_FRAME_LENGTH - 1) == _frame[URM04_FRAME_LENGTH - 1]){
+        frameCount++;
+        return true;
+      }
+      checksumErrors++;
+      //A dropped frame may hide the start of the next one
+      if (data == URM04_HEADER_1) _frame[_index++] = data;
+      return false;
+  }
+}
+
+#endif // SML_NEXUS_URM04_PARSER_H
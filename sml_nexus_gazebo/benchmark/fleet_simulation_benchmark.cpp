@@ -0,0 +1,196 @@
+//==========================================================
+//  Benchmark of the kinematic fleet simulation
+//
+//  ROS-free: steps N robots at the control rate of the
+//  firmware (100 Hz), samples their wheel feedback at 50 Hz
+//  and their four sonars at sonar_rate against a random
+//  occupancy grid. Reports, for each fleet size:
+//    - robot steps simulated per second, with the states
+//      in one array per variable (FleetSimulation) and with
+//      one MecanumWheelModel object per robot
+//    - the same with the sonars
+//    - the real-time factor that leaves for the whole fleet
+//
+//  Usage: rosrun sml_nexus_gazebo fleet_simulation_benchmark [-t seconds] [-s sonar_rate_hz]
+//==========================================================
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "sml_nexus_gazebo/fleet_simulation.h"
+#include "sml_nexus_gazebo/mecanum_wheel_model.h"
+
+using sml_nexus_gazebo::FleetSimulation;
+using sml_nexus_gazebo::MecanumWheelModel;
+using sml_nexus_gazebo::OccupancyGrid;
+using sml_nexus_gazebo::PlanarVelocity;
+
+static const double control_rate = 100.0; //Hz, CONTROL_TICK_RATE_HZ
+static const int feedback_decimation = 2; //FEEDBACK_DECIMATION
+
+typedef std::chrono::steady_clock benchmark_clock;
+
+//20 m x 20 m room with walls and random boxes
+static OccupancyGrid makeMap(std::mt19937& rng){
+    OccupancyGrid map;
+    map.resolution = 0.05;
+    map.width = map.height = 400;
+    map.origin_x = map.origin_y = -10.0;
+    map.occupied.assign(map.width * map.height, 0);
+    for (int i = 0; i < map.width; i++){
+        map.occupied[i] = map.occupied[(map.height - 1) * map.width + i] = 1;
+        map.occupied[i * map.width] = map.occupied[i * map.width + map.width - 1] = 1;
+    }
+    std::uniform_int_distribution<int> cell(10, 380);
+    for (int b = 0; b < 60; b++){
+        const int x0 = cell(rng), y0 = cell(rng);
+        for (int y = y0; y < y0 + 10; y++){
+            for (int x = x0; x < x0 + 10; x++) map.occupied[y * map.width + x] = 1;
+        }
+    }
+    return map;
+}
+
+//Commands of a planner: a new random twist every second for each robot
+struct Commands
+{
+    std::vector<double> x, y, yaw;
+    void draw(int robots, std::mt19937& rng){
+        std::uniform_real_distribution<double> linear(-0.4, 0.4), angular(-0.8, 0.8);
+        x.resize(robots);
+        y.resize(robots);
+        yaw.resize(robots);
+        for (int i = 0; i < robots; i++){
+            x[i] = linear(rng);
+            y[i] = linear(rng);
+            yaw[i] = angular(rng);
+        }
+    }
+};
+
+//Robot steps per second with FleetSimulation
+static double runFleet(int robots, double duration, double sonar_rate, const OccupancyGrid& map, double& checksum){
+    std::mt19937 rng(1);
+    FleetSimulation fleet(robots);
+    fleet.setMap(map);
+    std::uniform_real_distribution<double> position(-8.0, 8.0);
+    for (int i = 0; i < robots; i++) fleet.setPose(i, position(rng), position(rng), 0.0);
+    Commands commands;
+    std::vector<float> wheels[4];
+    double ranges[4];
+
+    const double dt = 1.0 / control_rate;
+    const long steps = static_cast<long>(duration * control_rate);
+    const long sonar_steps = sonar_rate > 0.0 ? std::max(1L, static_cast<long>(control_rate / sonar_rate)) : 0;
+    const benchmark_clock::time_point start = benchmark_clock::now();
+    for (long k = 0; k < steps; k++){
+        const double time = (k + 1) * dt;
+        if (k % static_cast<long>(control_rate) == 0){
+            commands.draw(robots, rng);
+            for (int i = 0; i < robots; i++) fleet.setCommand(i, commands.x[i], commands.y[i], commands.yaw[i], time);
+        }
+        fleet.step(time, dt);
+        if ((k + 1) % feedback_decimation == 0){
+            double interval;
+            fleet.sampleWheelVelocities(wheels, interval);
+            checksum += wheels[0][0];
+        }
+        if (sonar_steps > 0 && (k + 1) % sonar_steps == 0){
+            for (int i = 0; i < robots; i++){
+                fleet.sonarRanges(i, ranges);
+                checksum += ranges[0];
+            }
+        }
+    }
+    const double seconds = std::chrono::duration<double>(benchmark_clock::now() - start).count();
+    checksum += fleet.x(0);
+    return static_cast<double>(steps) * robots / seconds;
+}
+
+//Robot steps per second with a MecanumWheelModel object and a pose per robot
+static double runObjects(int robots, double duration, double& checksum){
+    std::mt19937 rng(1);
+    MecanumWheelModel::Parameters parameters;
+    parameters.max_wheel_speed = 0.5;
+    struct Robot
+    {
+        MecanumWheelModel model;
+        PlanarVelocity command;
+        double deadline, x, y, yaw;
+    };
+    std::vector<Robot> fleet(robots);
+    for (int i = 0; i < robots; i++){
+        fleet[i].model = MecanumWheelModel(parameters);
+        fleet[i].deadline = -1.0;
+        fleet[i].x = fleet[i].y = fleet[i].yaw = 0.0;
+    }
+    Commands commands;
+    double wheels[4], interval;
+
+    const double dt = 1.0 / control_rate;
+    const long steps = static_cast<long>(duration * control_rate);
+    const PlanarVelocity stop = {0.0, 0.0, 0.0};
+    const benchmark_clock::time_point start = benchmark_clock::now();
+    for (long k = 0; k < steps; k++){
+        const double time = (k + 1) * dt;
+        if (k % static_cast<long>(control_rate) == 0){
+            commands.draw(robots, rng);
+            for (int i = 0; i < robots; i++){
+                fleet[i].command.x = commands.x[i];
+                fleet[i].command.y = commands.y[i];
+                fleet[i].command.yaw = commands.yaw[i];
+                fleet[i].deadline = time + 0.5;
+            }
+        }
+        for (int i = 0; i < robots; i++){
+            Robot& r = fleet[i];
+            r.model.step(time < r.deadline ? r.command : stop, dt);
+            r.model.integrateEncoders(r.model.wheelSpeeds(), dt);
+            const PlanarVelocity v = r.model.wheelVelocity();
+            const double heading = r.yaw + 0.5 * v.yaw * dt;
+            const double c = std::cos(heading), s = std::sin(heading);
+            r.x += (c * v.x - s * v.y) * dt;
+            r.y += (s * v.x + c * v.y) * dt;
+            r.yaw += v.yaw * dt;
+        }
+        if ((k + 1) % feedback_decimation == 0){
+            for (int i = 0; i < robots; i++) fleet[i].model.sampleEncoders(wheels, interval);
+            checksum += wheels[0];
+        }
+    }
+    const double seconds = std::chrono::duration<double>(benchmark_clock::now() - start).count();
+    checksum += fleet[0].x;
+    return static_cast<double>(steps) * robots / seconds;
+}
+
+int main(int argc, char** argv){
+    double duration = 20.0;
+    double sonar_rate = 10.0;
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) duration = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc) sonar_rate = std::atof(argv[++i]);
+    }
+
+    std::mt19937 rng(0);
+    const OccupancyGrid map = makeMap(rng);
+    double checksum = 0.0;
+
+    std::printf("%.0f s simulated at %.0f Hz, wheel feedback at %.0f Hz, sonars at %.0f Hz, 20 m x 20 m grid at 5 cm\n",
+                duration, control_rate, control_rate / feedback_decimation, sonar_rate);
+    std::printf("%8s %18s %18s %18s %14s\n", "robots", "objects (steps/s)", "arrays (steps/s)", "+ sonars (steps/s)", "real time x");
+    const int sizes[4] = {10, 100, 1000, 10000};
+    for (int k = 0; k < 4; k++){
+        const int robots = sizes[k];
+        //Same simulated robot-time for every fleet size
+        const double fleet_duration = duration * 100.0 / robots > 1.0 ? duration * 100.0 / robots : 1.0;
+        const double objects = runObjects(robots, fleet_duration, checksum);
+        const double arrays = runFleet(robots, fleet_duration, 0.0, map, checksum);
+        const double sonars = runFleet(robots, fleet_duration, sonar_rate, map, checksum);
+        std::printf("%8d %18.3g %18.3g %18.3g %14.1f\n", robots, objects, arrays, sonars, sonars / (robots * control_rate));
+    }
+    std::printf("(checksum %g)\n", checksum);
+    return 0;
+}
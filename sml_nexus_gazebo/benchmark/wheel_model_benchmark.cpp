@@ -0,0 +1,152 @@
+//==========================================================
+//  Benchmark of the mecanum wheel model of the Gazebo plugin
+//
+//  ROS- and Gazebo-free: steps the wheel model of N robots
+//  at the physics rate, with the base moved by the forces
+//  of the plugin as a rigid body, over a sequence of
+//  velocity steps. Reports:
+//    - the cost of the model per robot and physics step,
+//      and the number of robots it allows in real time
+//    - the error of the wheel odometry integrated from the
+//      simulated encoders against the motion of the base,
+//      with and without slip (traction limits). Without
+//      limits, the error is the lag of the base behind the
+//      wheels under the P gains of sml_nexus.gazebo.
+//
+//  Usage: rosrun sml_nexus_gazebo wheel_model_benchmark [-n robots] [-r physics_rate_hz] [-t seconds]
+//==========================================================
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "sml_nexus_gazebo/mecanum_wheel_model.h"
+
+using sml_nexus_gazebo::MecanumWheelModel;
+using sml_nexus_gazebo::PlanarVelocity;
+
+static const double mass = 4.4;        //kg, base and wheels of sml_nexus.xacro
+static const double inertia = 0.08;    //kg m^2, about z
+static const double x_gain = 15.0;     //as in sml_nexus.gazebo
+static const double y_gain = 15.0;
+static const double yaw_gain = 1.0;
+
+//Velocity command at time t: one second steps through a sequence
+static PlanarVelocity command(double t){
+    static const double steps[6][3] = {{0.5, 0.0, 0.0}, {0.0, 0.5, 0.0}, {-0.5, 0.0, 0.5},
+                                       {0.3, -0.3, -0.5}, {0.0, 0.0, 0.0}, {0.6, 0.0, 0.0}};
+    const int k = static_cast<int>(t) % 6;
+    PlanarVelocity v;
+    v.x = steps[k][0];
+    v.y = steps[k][1];
+    v.yaw = steps[k][2];
+    return v;
+}
+
+struct Robot
+{
+    MecanumWheelModel model;
+    PlanarVelocity velocity;        //base frame
+    double x, y, yaw;               //true pose
+    double odom_x, odom_y, odom_yaw; //from the encoders
+    unsigned long slip_steps;
+};
+
+struct Result
+{
+    double ns_per_step;
+    double position_error; //m, at the end
+    double yaw_error;      //rad
+    double slip_fraction;
+};
+
+static Result run(int robots, double rate, double duration, double max_acceleration, double feedback_rate){
+    MecanumWheelModel::Parameters parameters;
+    parameters.max_acceleration = max_acceleration;
+    std::vector<Robot> fleet(robots);
+    for (size_t i = 0; i < fleet.size(); i++){
+        Robot& r = fleet[i];
+        r.model = MecanumWheelModel(parameters);
+        r.velocity.x = r.velocity.y = r.velocity.yaw = 0.0;
+        r.x = r.y = r.yaw = r.odom_x = r.odom_y = r.odom_yaw = 0.0;
+        r.slip_steps = 0;
+    }
+
+    const double dt = 1.0 / rate;
+    const long steps = static_cast<long>(duration * rate);
+    const long feedback_steps = std::max(1L, static_cast<long>(rate / feedback_rate));
+    double model_ns = 0.0;
+
+    for (long k = 0; k < steps; k++){
+        const PlanarVelocity cmd = command(k * dt);
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < fleet.size(); i++){
+            Robot& r = fleet[i];
+            //What the plugin does every physics step
+            r.model.step(cmd, dt);
+            const PlanarVelocity target = r.model.wheelVelocity();
+            double force_x = x_gain * (target.x - r.velocity.x);
+            double force_y = y_gain * (target.y - r.velocity.y);
+            double torque = yaw_gain * (target.yaw - r.velocity.yaw);
+            if (r.model.limitTraction(force_x, force_y, torque, mass)) r.slip_steps++;
+            r.model.integrateEncoders(r.model.wheelSpeeds(), dt);
+
+            //Rigid body, in place of the physics engine
+            r.velocity.x += force_x / mass * dt;
+            r.velocity.y += force_y / mass * dt;
+            r.velocity.yaw += torque / inertia * dt;
+            const double c = std::cos(r.yaw), s = std::sin(r.yaw);
+            r.x += (c * r.velocity.x - s * r.velocity.y) * dt;
+            r.y += (s * r.velocity.x + c * r.velocity.y) * dt;
+            r.yaw += r.velocity.yaw * dt;
+        }
+        model_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        //Wheel odometry from the published encoder speeds
+        if ((k + 1) % feedback_steps == 0){
+            for (size_t i = 0; i < fleet.size(); i++){
+                Robot& r = fleet[i];
+                double wheels[4], interval;
+                if (!r.model.sampleEncoders(wheels, interval)) continue;
+                const PlanarVelocity v = MecanumWheelModel::forward(wheels, parameters.wheelbase);
+                const double c = std::cos(r.odom_yaw), s = std::sin(r.odom_yaw);
+                r.odom_x += (c * v.x - s * v.y) * interval;
+                r.odom_y += (s * v.x + c * v.y) * interval;
+                r.odom_yaw += v.yaw * interval;
+            }
+        }
+    }
+
+    Result result;
+    result.ns_per_step = model_ns / (static_cast<double>(steps) * robots);
+    const Robot& r = fleet[0];
+    result.position_error = std::hypot(r.odom_x - r.x, r.odom_y - r.y);
+    result.yaw_error = std::fabs(r.odom_yaw - r.yaw);
+    result.slip_fraction = static_cast<double>(r.slip_steps) / steps;
+    return result;
+}
+
+int main(int argc, char** argv){
+    int robots = 100;
+    double rate = 1000.0;
+    double duration = 30.0;
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) robots = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) rate = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) duration = std::atof(argv[++i]);
+    }
+
+    std::printf("%d robots, %.0f Hz physics, %.0f s of velocity steps, 50 Hz wheel feedback\n", robots, rate, duration);
+    std::printf("%-22s %12s %16s %14s %12s %8s\n", "traction", "ns/step", "robots in RT", "odom error", "yaw error", "slip");
+    const double tractions[3] = {0.0, 4.0, 1.0};
+    const char* names[3] = {"unlimited", "4 m/s^2", "1 m/s^2"};
+    for (int k = 0; k < 3; k++){
+        const Result r = run(robots, rate, duration, tractions[k], 50.0);
+        //Model cost only, Gazebo's own physics step comes on top
+        const double realtime_robots = 1e9 / (r.ns_per_step * rate);
+        std::printf("%-22s %12.1f %16.0f %12.4f m %8.4f rad %7.1f%%\n", names[k], r.ns_per_step, realtime_robots,
+                    r.position_error, r.yaw_error, 100.0 * r.slip_fraction);
+    }
+    return 0;
+}
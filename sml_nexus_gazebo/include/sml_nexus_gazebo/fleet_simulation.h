@@ -0,0 +1,381 @@
+#ifndef SML_NEXUS_GAZEBO_FLEET_SIMULATION_H
+#define SML_NEXUS_GAZEBO_FLEET_SIMULATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "sml_nexus_kinematics.h"
+
+namespace sml_nexus_gazebo
+{
+
+//=========================================================
+//  Occupancy grid for the sonar rays, cells in row-major
+//  order from the origin, as nav_msgs/OccupancyGrid.
+//  Outside the grid is free.
+//=========================================================
+struct OccupancyGrid
+{
+    OccupancyGrid() : width(0), height(0), resolution(0.05), origin_x(0.0), origin_y(0.0) {}
+
+    int width, height;           //cells
+    double resolution;           //m per cell
+    double origin_x, origin_y;   //m, corner of cell (0, 0)
+    std::vector<uint8_t> occupied;
+    std::vector<uint8_t> free_run; //from computeFreeRuns()
+
+    bool empty() const { return occupied.empty(); }
+
+    //=============================================
+    //  For every cell, 0 if occupied, else 1 plus
+    //  the whole cells a ray starting anywhere in
+    //  it can travel without meeting an occupied
+    //  one (up to 254). From the two-pass chamfer
+    //  distance transform with steps of 1 and
+    //  sqrt(2). To be called once the cells are
+    //  set, it lets the rays jump across open
+    //  space.
+    //=============================================
+    void computeFreeRuns()
+    {
+        const float far = 1e9f, diagonal = static_cast<float>(std::sqrt(2.0));
+        std::vector<float> distance(occupied.size(), far);
+        for (size_t i = 0; i < occupied.size(); i++){
+            if (occupied[i]) distance[i] = 0.0f;
+        }
+        for (int y = 0; y < height; y++){
+            for (int x = 0; x < width; x++){
+                float& d = distance[y * width + x];
+                if (x > 0) d = std::min(d, distance[y * width + x - 1] + 1.0f);
+                if (y > 0){
+                    d = std::min(d, distance[(y - 1) * width + x] + 1.0f);
+                    if (x > 0) d = std::min(d, distance[(y - 1) * width + x - 1] + diagonal);
+                    if (x < width - 1) d = std::min(d, distance[(y - 1) * width + x + 1] + diagonal);
+                }
+            }
+        }
+        for (int y = height - 1; y >= 0; y--){
+            for (int x = width - 1; x >= 0; x--){
+                float& d = distance[y * width + x];
+                if (x < width - 1) d = std::min(d, distance[y * width + x + 1] + 1.0f);
+                if (y < height - 1){
+                    d = std::min(d, distance[(y + 1) * width + x] + 1.0f);
+                    if (x < width - 1) d = std::min(d, distance[(y + 1) * width + x + 1] + diagonal);
+                    if (x > 0) d = std::min(d, distance[(y + 1) * width + x - 1] + diagonal);
+                }
+            }
+        }
+        //Chamfer distances exceed the euclidean ones by up to 8.2%, and
+        //both the ray and the obstacle are anywhere in their cells
+        free_run.resize(occupied.size());
+        for (size_t i = 0; i < occupied.size(); i++){
+            if (occupied[i]){
+                free_run[i] = 0;
+                continue;
+            }
+            const double run = std::floor(distance[i] / 1.0824 - std::sqrt(2.0));
+            free_run[i] = static_cast<uint8_t>(1.0 + std::max(0.0, std::min(253.0, run)));
+        }
+    }
+
+    //=============================================
+    //  Distance from (x, y) along the heading to
+    //  the first occupied cell, max_range if none.
+    //  Walks the cells the ray crosses (Amanatides
+    //  and Woo), and with the free runs, jumps
+    //  over the cells that cannot be occupied.
+    //=============================================
+    double raycast(double x, double y, double heading, double max_range) const
+    {
+        if (occupied.empty()) return max_range;
+        const double dx = std::cos(heading), dy = std::sin(heading);
+        const int step_x = dx > 0.0 ? 1 : -1, step_y = dy > 0.0 ? 1 : -1;
+        //Ray length (cells) to cross one cell
+        const double delta_x = dx != 0.0 ? std::fabs(1.0 / dx) : 1e30;
+        const double delta_y = dy != 0.0 ? std::fabs(1.0 / dy) : 1e30;
+        const double max_cells = max_range / resolution;
+        const uint8_t* runs = free_run.size() == occupied.size() ? free_run.data() : 0;
+
+        double travelled = 0.0;
+        while (travelled <= max_cells){
+            //Start the walk at the current point of the ray
+            const double gx = (x - origin_x) / resolution + travelled * dx;
+            const double gy = (y - origin_y) / resolution + travelled * dy;
+            int cx = static_cast<int>(std::floor(gx)), cy = static_cast<int>(std::floor(gy));
+            double next_x = travelled + (dx != 0.0 ? (dx > 0.0 ? cx + 1 - gx : gx - cx) * delta_x : 1e30);
+            double next_y = travelled + (dy != 0.0 ? (dy > 0.0 ? cy + 1 - gy : gy - cy) * delta_y : 1e30);
+            while (travelled <= max_cells){
+                if (cx >= 0 && cy >= 0 && cx < width && cy < height){
+                    const int cell = cy * width + cx;
+                    if (runs){
+                        //Short runs are walked, restarting the walk costs more
+                        const uint8_t run = runs[cell];
+                        if (run == 0) return travelled * resolution;
+                        if (run > 8){
+                            travelled += run - 1;
+                            break;
+                        }
+                    }
+                    else if (occupied[cell]) return travelled * resolution;
+                }
+                if (next_x < next_y){
+                    travelled = next_x;
+                    next_x += delta_x;
+                    cx += step_x;
+                }
+                else{
+                    travelled = next_y;
+                    next_y += delta_y;
+                    cy += step_y;
+                }
+            }
+        }
+        return max_range;
+    }
+};
+
+//=========================================================
+//  Kinematic simulation of a fleet of nexus robots, for
+//  planner and fleet tests without the Gazebo physics.
+//
+//  Each robot runs what its low-level controller does at
+//  every control tick:
+//    - the command times out command_timeout seconds after
+//      it was received, and the wheels stop
+//    - the wheel setpoints are those of computeWheelVelCmd
+//      of the firmware, from the mecanumInverse map of
+//      sml_nexus_kinematics.h, constrained to max_wheel_speed
+//    - the closed-loop wheels follow them with a first-order
+//      lag of time_constant
+//    - the encoders count the wheel travel in whole ticks
+//  and the base moves with the twist of its wheels, which
+//  do not slip. The sonars are rays against an occupancy
+//  grid.
+//
+//  The states are kept as one array per variable over all
+//  the robots, and step() goes through each array in turn
+//  without branches, so that the compiler vectorizes it.
+//
+//  Plain data only, shared by the fleet_simulator node and
+//  ROS-free benchmarks.
+//=========================================================
+class FleetSimulation
+{
+public:
+    enum Sonar {RIGHT_SONAR, FRONT_SONAR, LEFT_SONAR, REAR_SONAR}; //Order of the firmware sensor ids
+
+    struct Parameters
+    {
+        Parameters()
+            : wheelbase(0.15), max_wheel_speed(0.5), time_constant(0.05), wheel_radius(0.05),
+              encoder_cpr(1536), command_timeout(0.5), sonar_field_of_view(M_PI / 3.0), sonar_rays(5),
+              sonar_min_range(0.04), sonar_max_range(5.0) {}
+
+        double wheelbase;           //m, (L1 + L2)/2
+        double max_wheel_speed;     //m/s, max_speed of the firmware
+        double time_constant;       //s, wheel speed response
+        double wheel_radius;        //m
+        int encoder_cpr;            //counts per wheel revolution, 0 for no quantization
+        double command_timeout;     //s, commTimeout of the firmware
+        double sonar_field_of_view; //rad, cone of the URM04
+        int sonar_rays;             //rays across the cone
+        double sonar_min_range;     //m
+        double sonar_max_range;     //m
+    };
+
+    explicit FleetSimulation(int robots = 0, const Parameters& parameters = Parameters())
+        : parameters_(parameters), interval_(0.0)
+    {
+        tick_length_ = parameters.encoder_cpr > 0 ? kinematicsTickToMeters(parameters.wheel_radius, parameters.encoder_cpr) : 0.0;
+        const double wheel_scale[4] = {1.0, 1.0, 1.0, 1.0};
+        mecanumKinematicsSetup(kinematics_, parameters.wheelbase, tick_length_, wheel_scale);
+        resize(robots);
+    }
+
+    //Robots are added at the origin, without command
+    void resize(int robots)
+    {
+        const size_t n = static_cast<size_t>(robots);
+        x_.resize(n, 0.0);
+        y_.resize(n, 0.0);
+        yaw_.resize(n, 0.0);
+        command_x_.resize(n, 0.0);
+        command_y_.resize(n, 0.0);
+        command_yaw_.resize(n, 0.0);
+        command_deadline_.resize(n, -1.0);
+        for (int i = 0; i < 4; i++){
+            speed_[i].resize(n, 0.0);
+            travel_[i].resize(n, 0.0);
+        }
+    }
+
+    int size() const { return static_cast<int>(x_.size()); }
+
+    void setPose(int robot, double x, double y, double yaw)
+    {
+        x_[robot] = x;
+        y_[robot] = y;
+        yaw_[robot] = yaw;
+    }
+
+    //Velocity command received at time (s), as messageCb of the firmware
+    void setCommand(int robot, double x, double y, double yaw, double time)
+    {
+        command_x_[robot] = x;
+        command_y_[robot] = y;
+        command_yaw_[robot] = yaw;
+        command_deadline_[robot] = time + parameters_.command_timeout;
+    }
+
+    void setMap(const OccupancyGrid& map)
+    {
+        map_ = map;
+        map_.computeFreeRuns();
+    }
+    const OccupancyGrid& map() const { return map_; }
+
+    //=============================================
+    //  All the robots over dt seconds, ending at
+    //  time (s)
+    //=============================================
+    void step(double time, double dt)
+    {
+        const size_t n = x_.size();
+        const double alpha = parameters_.time_constant > 0.0 ? 1.0 - std::exp(-dt / parameters_.time_constant) : 1.0;
+        const double max_speed = parameters_.max_wheel_speed;
+        const mecanumKinematics<double> kinematics = kinematics_;
+        double* ul = speed_[0].data();
+        double* ur = speed_[1].data();
+        double* ll = speed_[2].data();
+        double* lr = speed_[3].data();
+
+        //Wheel setpoints of computeWheelVelCmd and motor lag
+        for (size_t i = 0; i < n; i++){
+            const double active = time < command_deadline_[i] ? 1.0 : 0.0;
+            double setpoint[4];
+            mecanumInverse(kinematics, active * command_x_[i], active * command_y_[i], active * command_yaw_[i], setpoint);
+            ul[i] += alpha * (std::max(-max_speed, std::min(max_speed, setpoint[0])) - ul[i]);
+            ur[i] += alpha * (std::max(-max_speed, std::min(max_speed, setpoint[1])) - ur[i]);
+            ll[i] += alpha * (std::max(-max_speed, std::min(max_speed, setpoint[2])) - ll[i]);
+            lr[i] += alpha * (std::max(-max_speed, std::min(max_speed, setpoint[3])) - lr[i]);
+        }
+
+        //Encoder travel
+        for (int k = 0; k < 4; k++){
+            const double* speed = speed_[k].data();
+            double* travel = travel_[k].data();
+            for (size_t i = 0; i < n; i++) travel[i] += speed[i] * dt;
+        }
+        interval_ += dt;
+
+        //Base motion with the twist of the wheels, midpoint heading
+        for (size_t i = 0; i < n; i++){
+            const double wheels[4] = {ul[i], ur[i], ll[i], lr[i]};
+            double twist[3];
+            mecanumForward(kinematics, wheels, twist);
+            const double heading = yaw_[i] + 0.5 * twist[2] * dt;
+            const double c = std::cos(heading), s = std::sin(heading);
+            x_[i] += (c * twist[0] - s * twist[1]) * dt;
+            y_[i] += (s * twist[0] + c * twist[1]) * dt;
+            yaw_[i] += twist[2] * dt;
+        }
+    }
+
+    //=============================================
+    //  Mean wheel speeds UL, UR, LL, LR (m/s) of
+    //  every robot over the interval since the
+    //  last sample, from whole encoder ticks, as
+    //  the wheel feedback of the firmware. The
+    //  fraction of a tick is kept for the next
+    //  sample. False if no time went by.
+    //=============================================
+    bool sampleWheelVelocities(std::vector<float> wheels[4], double& interval)
+    {
+        if (interval_ <= 0.0) return false;
+        interval = interval_;
+        const size_t n = x_.size();
+        const double inverse_interval = 1.0 / interval_;
+        for (int k = 0; k < 4; k++){
+            wheels[k].resize(n);
+            double* travel = travel_[k].data();
+            float* speed = wheels[k].data();
+            if (tick_length_ > 0.0){
+                const double inverse_tick = 1.0 / tick_length_;
+                for (size_t i = 0; i < n; i++){
+                    const double ticks = std::trunc(travel[i] * inverse_tick) * tick_length_;
+                    travel[i] -= ticks;
+                    speed[i] = static_cast<float>(ticks * inverse_interval);
+                }
+            }
+            else{
+                for (size_t i = 0; i < n; i++){
+                    speed[i] = static_cast<float>(travel[i] * inverse_interval);
+                    travel[i] = 0.0;
+                }
+            }
+        }
+        interval_ = 0.0;
+        return true;
+    }
+
+    //=============================================
+    //  Ranges (m) of the four sonars of a robot,
+    //  indexed by Sonar: the nearest hit of the
+    //  rays across each cone, within the limits
+    //  of the sensor
+    //=============================================
+    void sonarRanges(int robot, double ranges[4]) const
+    {
+        //Sensors of sml_nexus.xacro: position in the base frame and heading
+        static const double mount[4][3] = {{0.0, -0.108, -M_PI / 2.0}, {0.201, 0.0, 0.0},
+                                           {0.0, 0.108, M_PI / 2.0}, {-0.205, 0.0, M_PI}};
+        const double c = std::cos(yaw_[robot]), s = std::sin(yaw_[robot]);
+        const int rays = std::max(1, parameters_.sonar_rays);
+        const double spread = rays > 1 ? parameters_.sonar_field_of_view / (rays - 1) : 0.0;
+        for (int k = 0; k < 4; k++){
+            const double sx = x_[robot] + c * mount[k][0] - s * mount[k][1];
+            const double sy = y_[robot] + s * mount[k][0] + c * mount[k][1];
+            const double heading = yaw_[robot] + mount[k][2] - 0.5 * spread * (rays - 1);
+            double range = parameters_.sonar_max_range;
+            for (int r = 0; r < rays; r++){
+                range = std::min(range, map_.raycast(sx, sy, heading + r * spread, range));
+            }
+            ranges[k] = std::max(parameters_.sonar_min_range, range);
+        }
+    }
+
+    double x(int robot) const { return x_[robot]; }
+    double y(int robot) const { return y_[robot]; }
+    double yaw(int robot) const { return yaw_[robot]; }
+    //Base twist of the wheel speeds
+    void velocity(int robot, double& vx, double& vy, double& w) const
+    {
+        const double wheels[4] = {speed_[0][robot], speed_[1][robot], speed_[2][robot], speed_[3][robot]};
+        double twist[3];
+        mecanumForward(kinematics_, wheels, twist);
+        vx = twist[0];
+        vy = twist[1];
+        w = twist[2];
+    }
+
+    const Parameters& parameters() const { return parameters_; }
+
+private:
+    Parameters parameters_;
+    double tick_length_; //m per encoder tick, 0 for no quantization
+    mecanumKinematics<double> kinematics_; //firmware maps with the simulated wheelbase
+    double interval_;    //s, since the last wheel sample, the same for all the robots
+    OccupancyGrid map_;
+
+    //One entry per robot
+    std::vector<double> x_, y_, yaw_;
+    std::vector<double> command_x_, command_y_, command_yaw_;
+    std::vector<double> command_deadline_; //s
+    std::vector<double> speed_[4];         //m/s, UL, UR, LL, LR
+    std::vector<double> travel_[4];        //m, not yet sampled
+};
+
+} // namespace sml_nexus_gazebo
+
+#endif // SML_NEXUS_GAZEBO_FLEET_SIMULATION_H
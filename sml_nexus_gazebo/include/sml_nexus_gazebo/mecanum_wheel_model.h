@@ -0,0 +1,200 @@
+#ifndef SML_NEXUS_GAZEBO_MECANUM_WHEEL_MODEL_H
+#define SML_NEXUS_GAZEBO_MECANUM_WHEEL_MODEL_H
+
+#include <algorithm>
+#include <cmath>
+#include "sml_nexus_kinematics.h"
+
+namespace sml_nexus_gazebo
+{
+
+//Base velocity in the base frame
+struct PlanarVelocity
+{
+    double x;   //m/s
+    double y;   //m/s
+    double yaw; //rad/s
+};
+
+//=========================================================
+//  Wheel-level model of the nexus mecanum base
+//
+//  Wheels are UL, UR, LL, LR, their speeds those of the
+//  wheel surface (m/s). The 45 degree rollers only pass
+//  the component of the motion across them, which gives
+//  the kinematics of the low-level controller:
+//    UL = vx - vy - 2 b wz      UR = vx + vy + 2 b wz
+//    LL = vx + vy - 2 b wz      LR = vx - vy + 2 b wz
+//  with b the wheelbase, (L1 + L2)/2. The maps are those
+//  of sml_nexus_kinematics.h, shared with the firmware.
+//
+//  - Each wheel follows the speed its setpoint asks for
+//    with a first-order lag, as the closed-loop motors do.
+//  - The base is pushed towards the twist of the wheels,
+//    within what the traction of the wheels can give: a
+//    force beyond it means the wheels slip on the ground.
+//  - The encoders count the travel of the wheels, slipping
+//    or not, in whole ticks as the firmware does.
+//
+//  Plain data only, no Gazebo or ROS types, so it is shared
+//  by the plugin and by ROS-free benchmarks.
+//=========================================================
+class MecanumWheelModel
+{
+public:
+    struct Parameters
+    {
+        Parameters()
+            : wheelbase(0.15), time_constant(0.05), max_wheel_speed(0.7),
+              max_acceleration(4.0), wheel_radius(0.05), encoder_cpr(1536) {}
+
+        double wheelbase;        //m, (L1 + L2)/2
+        double time_constant;    //s, wheel speed response
+        double max_wheel_speed;  //m/s
+        double max_acceleration; //m/s^2, traction limit (friction coefficient times g)
+        double wheel_radius;     //m
+        int encoder_cpr;         //counts per wheel revolution, 0 for no quantization
+    };
+
+    explicit MecanumWheelModel(const Parameters& parameters = Parameters())
+        : parameters_(parameters)
+    {
+        tick_length_ = parameters.encoder_cpr > 0 ? kinematicsTickToMeters(parameters.wheel_radius, parameters.encoder_cpr) : 0.0;
+        kinematics_ = kinematics(parameters.wheelbase);
+        reset();
+    }
+
+    void reset()
+    {
+        for (int i = 0; i < 4; i++){
+            speed_[i] = 0.0;
+            travel_[i] = 0.0;
+        }
+        interval_ = 0.0;
+        slipping_ = false;
+    }
+
+    //Wheel speeds UL, UR, LL, LR of a base velocity
+    static void inverse(const PlanarVelocity& velocity, double wheelbase, double wheels[4])
+    {
+        inverse(kinematics(wheelbase), velocity, wheels);
+    }
+
+    //Base velocity of wheel speeds UL, UR, LL, LR, least squares over the four
+    static PlanarVelocity forward(const double wheels[4], double wheelbase)
+    {
+        return forward(kinematics(wheelbase), wheels);
+    }
+
+    //=============================================
+    //  Wheel speeds over dt seconds towards the
+    //  wheel setpoints of a commanded base velocity
+    //=============================================
+    void step(const PlanarVelocity& command, double dt)
+    {
+        double setpoint[4];
+        inverse(kinematics_, command, setpoint);
+        const double alpha = parameters_.time_constant > 0.0 ? 1.0 - std::exp(-dt / parameters_.time_constant) : 1.0;
+        const double max_speed = parameters_.max_wheel_speed;
+        for (int i = 0; i < 4; i++){
+            const double target = std::max(-max_speed, std::min(max_speed, setpoint[i]));
+            speed_[i] += alpha * (target - speed_[i]);
+        }
+    }
+
+    //Base velocity the wheels drive at, without slip
+    PlanarVelocity wheelVelocity() const { return forward(kinematics_, speed_); }
+    const double* wheelSpeeds() const { return speed_; }
+
+    //=============================================
+    //  Limit the force (N) and yaw torque (N m) on
+    //  a base of mass kg to what the wheels can
+    //  transmit, true if they had to be reduced
+    //=============================================
+    bool limitTraction(double& force_x, double& force_y, double& torque, double mass)
+    {
+        const double max_force = mass * parameters_.max_acceleration;
+        slipping_ = false;
+        if (max_force <= 0.0) return false; //no limit
+        //Wheels at (+-b, +-b) from the center
+        const double max_torque = max_force * std::sqrt(2.0) * parameters_.wheelbase;
+        const double force = std::hypot(force_x, force_y);
+        const double usage = std::max(force / max_force, std::fabs(torque) / max_torque);
+        slipping_ = usage > 1.0;
+        if (slipping_){
+            force_x /= usage;
+            force_y /= usage;
+            torque /= usage;
+        }
+        return slipping_;
+    }
+
+    bool slipping() const { return slipping_; }
+
+    //Encoders: wheel travel at speeds (m/s) over dt seconds
+    void integrateEncoders(const double wheels[4], double dt)
+    {
+        for (int i = 0; i < 4; i++) travel_[i] += wheels[i] * dt;
+        interval_ += dt;
+    }
+
+    //=============================================
+    //  Mean wheel speeds over the interval since
+    //  the last sample, from whole encoder ticks.
+    //  The fraction of a tick is kept for the next
+    //  sample. False if no time went by.
+    //=============================================
+    bool sampleEncoders(double wheels[4], double& interval)
+    {
+        if (interval_ <= 0.0) return false;
+        interval = interval_;
+        for (int i = 0; i < 4; i++){
+            double travel = travel_[i];
+            if (tick_length_ > 0.0) travel = std::trunc(travel / tick_length_) * tick_length_;
+            travel_[i] -= travel;
+            wheels[i] = travel / interval;
+        }
+        interval_ = 0.0;
+        return true;
+    }
+
+    const Parameters& parameters() const { return parameters_; }
+
+private:
+    //Uncalibrated kinematics of a wheelbase, the travel per tick is kept apart
+    static mecanumKinematics<double> kinematics(double wheelbase)
+    {
+        const double wheel_scale[4] = {1.0, 1.0, 1.0, 1.0};
+        mecanumKinematics<double> kinematics;
+        mecanumKinematicsSetup(kinematics, wheelbase, 0.0, wheel_scale);
+        return kinematics;
+    }
+
+    static void inverse(const mecanumKinematics<double>& kinematics, const PlanarVelocity& velocity, double wheels[4])
+    {
+        mecanumInverse(kinematics, velocity.x, velocity.y, velocity.yaw, wheels);
+    }
+
+    static PlanarVelocity forward(const mecanumKinematics<double>& kinematics, const double wheels[4])
+    {
+        double twist[3];
+        mecanumForward(kinematics, wheels, twist);
+        PlanarVelocity velocity;
+        velocity.x = twist[0];
+        velocity.y = twist[1];
+        velocity.yaw = twist[2];
+        return velocity;
+    }
+
+    Parameters parameters_;
+    mecanumKinematics<double> kinematics_; //of the model wheelbase
+    double tick_length_;  //m per encoder tick
+    double speed_[4];     //m/s
+    double travel_[4];    //m, not yet sampled
+    double interval_;     //s, since the last sample
+    bool slipping_;
+};
+
+} // namespace sml_nexus_gazebo
+
+#endif // SML_NEXUS_GAZEBO_MECANUM_WHEEL_MODEL_H
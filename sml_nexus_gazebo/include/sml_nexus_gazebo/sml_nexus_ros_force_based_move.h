@@ -0,0 +1,100 @@
+#ifndef SML_NEXUS_GAZEBO_SML_NEXUS_ROS_FORCE_BASED_MOVE_H
+#define SML_NEXUS_GAZEBO_SML_NEXUS_ROS_FORCE_BASED_MOVE_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <gazebo/common/Plugin.hh>
+#include <gazebo/common/Time.hh>
+#include <gazebo/physics/physics.hh>
+#include <ignition/math/Pose3.hh>
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <geometry_msgs/Twist.h>
+#include <nav_msgs/Odometry.h>
+#include <std_msgs/Float32MultiArray.h>
+#include <tf2_ros/transform_broadcaster.h>
+#include "sml_nexus_gazebo/mecanum_wheel_model.h"
+
+namespace sml_nexus_gazebo
+{
+
+//=========================================================
+//  Gazebo model plugin moving the nexus from cmd_vel with
+//  forces on the base, the wheels having no friction
+//
+//  The force (torque) is the P gain times the error between
+//  the target and the current base velocity. The target is
+//  the command, or with wheelModel, the velocity of the
+//  wheels of MecanumWheelModel following the command, the
+//  forces being limited by their traction.
+//
+//  Publishes, in the model namespace:
+//    - odometryTopic at odometryRate: the pose since spawn
+//      and the base velocity, and optionally the TF
+//    - wheelVelocityTopic at wheelVelocityRate: the encoder
+//      wheel speeds in the layout of the firmware, UL, UR,
+//      LL, LR in m/s and dt in ms
+//  Nothing is done between publications but applying the
+//  forces, so that many robots run faster than real time.
+//=========================================================
+class SmlNexusRosForceBasedMove : public gazebo::ModelPlugin
+{
+public:
+    SmlNexusRosForceBasedMove();
+    ~SmlNexusRosForceBasedMove();
+
+    void Load(gazebo::physics::ModelPtr model, sdf::ElementPtr sdf) override;
+    void Reset() override;
+
+private:
+    void update();
+    void publishOdometry(const gazebo::common::Time& now);
+    void publishWheelVelocity();
+    void cmdVelCallback(const geometry_msgs::Twist::ConstPtr& msg);
+    void queueThread();
+
+    gazebo::physics::ModelPtr model_;
+    gazebo::physics::LinkPtr link_;
+    gazebo::physics::JointPtr wheel_joints_[4]; //UL, UR, LL, LR
+    gazebo::event::ConnectionPtr update_connection_;
+
+    std::unique_ptr<ros::NodeHandle> nh_;
+    ros::CallbackQueue queue_;
+    std::thread queue_thread_;
+    ros::Subscriber cmd_vel_sub_;
+    ros::Publisher odometry_pub_;
+    ros::Publisher wheel_velocity_pub_;
+    std::unique_ptr<tf2_ros::TransformBroadcaster> transform_broadcaster_;
+
+    std::string odometry_frame_;
+    std::string base_frame_;
+    bool publish_tf_;
+    double cmd_vel_timeout_;
+    double x_gain_, y_gain_, yaw_gain_;
+    double max_x_velocity_, max_y_velocity_, max_yaw_velocity_;
+    double odometry_period_;
+    double wheel_velocity_period_;
+
+    //Wheel model
+    bool wheel_model_enabled_;
+    MecanumWheelModel wheel_model_;
+    double mass_;
+
+    //Command, from the ROS queue thread
+    std::mutex command_mutex_;
+    PlanarVelocity command_;
+    gazebo::common::Time command_time_;
+
+    gazebo::common::Time last_update_;
+    gazebo::common::Time last_odometry_;
+    gazebo::common::Time last_wheel_velocity_;
+    ignition::math::Pose3d spawn_pose_;
+    nav_msgs::Odometry odometry_msg_;
+    std_msgs::Float32MultiArray wheel_velocity_msg_;
+};
+
+} // namespace sml_nexus_gazebo
+
+#endif // SML_NEXUS_GAZEBO_SML_NEXUS_ROS_FORCE_BASED_MOVE_H
@@ -0,0 +1,259 @@
+#include <ros/ros.h>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <rosgraph_msgs/Clock.h>
+#include <geometry_msgs/Twist.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include <nav_msgs/Odometry.h>
+#include <sensor_msgs/Range.h>
+#include <std_msgs/Float32MultiArray.h>
+#include "sml_nexus_gazebo/fleet_simulation.h"
+
+//==========================================================
+//  Headless kinematic simulation of a fleet of nexus
+//  robots, in place of Gazebo for planner and fleet tests.
+//
+//  Each robot in ~robots (or nexus0 to nexus<robot_count-1>
+//  when the list is empty) talks as its low-level
+//  controller over rosserial:
+//    - <robot>/cmd_vel in
+//    - <robot>/wheel_velocity out, every feedback_decimation
+//      control ticks, UL, UR, LL, LR in m/s and dt in ms
+//    - <robot>/{right,front,left,rear}_range out at
+//      sonar_rate, in cm as the URM04 replies, against the
+//      occupancy grid of the map topic
+//  and, when publish_mocap is set, its true pose as the
+//  motion capture on /qualisys/<robot>/odom.
+//
+//  The simulation time steps at control_rate and goes out
+//  on /clock at real_time_factor times the wall clock, or
+//  as fast as possible with real_time_factor 0. Run the
+//  other nodes with /use_sim_time.
+//==========================================================
+class SmlNexusFleetSimulator
+{
+public:
+    SmlNexusFleetSimulator(ros::NodeHandle& nh, ros::NodeHandle& private_nh)
+        : nh(nh), private_nh(private_nh){
+        control_rate = private_nh.param("control_rate", 100.0);
+        feedback_decimation = std::max(1, private_nh.param("feedback_decimation", 2));
+        const double sonar_rate = private_nh.param("sonar_rate", 10.0);
+        real_time_factor = private_nh.param("real_time_factor", 1.0);
+        publish_mocap = private_nh.param("publish_mocap", true);
+        occupied_threshold = private_nh.param("occupied_threshold", 65);
+        sonar_decimation = sonar_rate > 0.0 ? std::max(1, static_cast<int>(std::lround(control_rate / sonar_rate))) : 0;
+
+        sml_nexus_gazebo::FleetSimulation::Parameters parameters;
+        parameters.wheelbase = private_nh.param("wheelbase", parameters.wheelbase);
+        parameters.max_wheel_speed = private_nh.param("max_wheel_speed", parameters.max_wheel_speed);
+        parameters.time_constant = private_nh.param("wheel_time_constant", parameters.time_constant);
+        parameters.wheel_radius = private_nh.param("wheel_radius", parameters.wheel_radius);
+        parameters.encoder_cpr = private_nh.param("encoder_cpr", parameters.encoder_cpr);
+        parameters.command_timeout = private_nh.param("command_timeout", parameters.command_timeout);
+        parameters.sonar_rays = private_nh.param("sonar_rays", parameters.sonar_rays);
+
+        std::vector<std::string> robot_names;
+        private_nh.getParam("robots", robot_names);
+        if (robot_names.empty()){
+            const int robot_count = private_nh.param("robot_count", 1);
+            for (int i = 0; i < robot_count; i++) robot_names.push_back("nexus" + std::to_string(i));
+        }
+        simulation = sml_nexus_gazebo::FleetSimulation(static_cast<int>(robot_names.size()), parameters);
+        robots.resize(robot_names.size());
+
+        //Robots on a grid spacing m apart unless ~<robot>/x, y, yaw are set
+        const double spacing = private_nh.param("spacing", 1.0);
+        const int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(robot_names.size()))));
+        for (size_t i = 0; i < robot_names.size(); i++){
+            const std::string robot_param = robot_names[i] + "/";
+            simulation.setPose(i, private_nh.param(robot_param + "x", spacing * (i % columns)),
+                               private_nh.param(robot_param + "y", spacing * (i / columns)),
+                               private_nh.param(robot_param + "yaw", 0.0));
+            addRobot(i, robot_names[i]);
+        }
+
+        clock_pub = nh.advertise<rosgraph_msgs::Clock>("/clock", 10);
+        map_sub = nh.subscribe("map", 1, &SmlNexusFleetSimulator::mapCallback, this);
+
+        ROS_INFO_STREAM("Fleet simulator: " << robots.size() << " robots at " << control_rate << " Hz, wheel feedback every "
+                        << feedback_decimation << " ticks, sonars at " << sonar_rate << " Hz");
+        if (real_time_factor > 0.0) ROS_INFO_STREAM("Fleet simulator: running at " << real_time_factor << "x real time");
+        else ROS_INFO_STREAM("Fleet simulator: running as fast as possible");
+    }
+
+    //==========================================
+    //  Step the fleet until shutdown, pacing the
+    //  simulation time against the wall clock
+    //==========================================
+    void run(){
+        const double dt = 1.0 / control_rate;
+        ros::WallTime start = ros::WallTime::now();
+        ros::WallTime report_start = start;
+        double start_time = 0.0;
+        long report_steps = 0;
+        for (long step = 1; ros::ok(); step++){
+            ros::spinOnce();
+            time = step * dt;
+            simulation.step(time, dt);
+            stamp.fromSec(time);
+
+            rosgraph_msgs::Clock clock;
+            clock.clock = stamp;
+            clock_pub.publish(clock);
+
+            if (step % feedback_decimation == 0) publishWheelVelocity();
+            if (sonar_decimation > 0 && step % sonar_decimation == 0) publishSonars();
+
+            //Hold the simulation time at real_time_factor times the wall time
+            const ros::WallTime now = ros::WallTime::now();
+            if (real_time_factor > 0.0){
+                const double ahead = (time - start_time) / real_time_factor - (now - start).toSec();
+                if (ahead > 0.0) ros::WallDuration(ahead).sleep();
+                //Too far behind to catch up: restart the pacing from here
+                else if (ahead < -1.0){
+                    start = now;
+                    start_time = time;
+                }
+            }
+            report_steps++;
+            const double report_elapsed = (now - report_start).toSec();
+            if (report_elapsed >= 10.0){
+                ROS_INFO_STREAM("Fleet simulator: " << report_steps * dt / report_elapsed << "x real time, "
+                                << report_steps * robots.size() / report_elapsed << " robot steps/s");
+                report_start = now;
+                report_steps = 0;
+            }
+        }
+    }
+
+private:
+    //Topics of one robot
+    struct Robot
+    {
+        std::string ns;
+        ros::Subscriber cmd_vel_sub;
+        ros::Publisher wheel_velocity_pub;
+        ros::Publisher range_pub[4];     //FleetSimulation::Sonar order
+        ros::Publisher mocap_pub;
+        std_msgs::Float32MultiArray wheel_velocity_msg;
+        sensor_msgs::Range range_msg[4];
+        nav_msgs::Odometry mocap_msg;
+    };
+
+    void addRobot(size_t index, const std::string& name){
+        Robot& robot = robots[index];
+        ros::NodeHandle robot_nh(nh, name);
+        robot.ns = robot_nh.getNamespace() + "/";
+        if (robot.ns == "//") robot.ns = "";
+
+        robot.cmd_vel_sub = robot_nh.subscribe<geometry_msgs::Twist>("cmd_vel", 10,
+            boost::bind(&SmlNexusFleetSimulator::cmdVelCallback, this, _1, index));
+        robot.wheel_velocity_pub = robot_nh.advertise<std_msgs::Float32MultiArray>("wheel_velocity", 100);
+        robot.wheel_velocity_msg.data.resize(5);
+
+        //Sensors as setupSensorTopics of the firmware
+        const char* sides[4] = {"right", "front", "left", "rear"};
+        for (int k = 0; k < 4; k++){
+            robot.range_pub[k] = robot_nh.advertise<sensor_msgs::Range>(std::string(sides[k]) + "_range", 10);
+            sensor_msgs::Range& range = robot.range_msg[k];
+            range.header.frame_id = robot.ns + sides[k] + "_sonar";
+            range.radiation_type = sensor_msgs::Range::ULTRASOUND;
+            range.field_of_view = 60;
+            range.min_range = 0.04;
+            range.max_range = 5.0;
+        }
+
+        if (publish_mocap){
+            robot.mocap_pub = nh.advertise<nav_msgs::Odometry>("/qualisys/" + name + "/odom", 10);
+            robot.mocap_msg.header.frame_id = "mocap";
+            robot.mocap_msg.child_frame_id = name;
+        }
+    }
+
+    void cmdVelCallback(const geometry_msgs::Twist::ConstPtr& msg, size_t index){
+        simulation.setCommand(index, msg->linear.x, msg->linear.y, msg->angular.z, time);
+    }
+
+    void mapCallback(const nav_msgs::OccupancyGrid::ConstPtr& msg){
+        sml_nexus_gazebo::OccupancyGrid map;
+        map.width = msg->info.width;
+        map.height = msg->info.height;
+        map.resolution = msg->info.resolution;
+        map.origin_x = msg->info.origin.position.x;
+        map.origin_y = msg->info.origin.position.y;
+        map.occupied.resize(msg->data.size());
+        for (size_t i = 0; i < msg->data.size(); i++) map.occupied[i] = msg->data[i] >= occupied_threshold; //unknown (-1) is free
+        simulation.setMap(map);
+        ROS_INFO_STREAM("Fleet simulator: sonars against a " << map.width << "x" << map.height << " map at " << map.resolution << " m");
+    }
+
+    //Encoder speeds of every robot over the last feedback_decimation ticks, and the mocap poses
+    void publishWheelVelocity(){
+        double interval;
+        if (!simulation.sampleWheelVelocities(wheels, interval)) return;
+        for (size_t i = 0; i < robots.size(); i++){
+            Robot& robot = robots[i];
+            std::vector<float>& data = robot.wheel_velocity_msg.data;
+            for (int k = 0; k < 4; k++) data[k] = wheels[k][i];
+            data[4] = static_cast<float>(1000.0 * interval);
+            robot.wheel_velocity_pub.publish(robot.wheel_velocity_msg);
+
+            if (publish_mocap){
+                nav_msgs::Odometry& mocap = robot.mocap_msg;
+                const double yaw = simulation.yaw(i);
+                mocap.header.stamp = stamp;
+                mocap.pose.pose.position.x = simulation.x(i);
+                mocap.pose.pose.position.y = simulation.y(i);
+                mocap.pose.pose.orientation.z = std::sin(0.5 * yaw);
+                mocap.pose.pose.orientation.w = std::cos(0.5 * yaw);
+                simulation.velocity(i, mocap.twist.twist.linear.x, mocap.twist.twist.linear.y, mocap.twist.twist.angular.z);
+                robot.mocap_pub.publish(mocap);
+            }
+        }
+    }
+
+    void publishSonars(){
+        double ranges[4];
+        for (size_t i = 0; i < robots.size(); i++){
+            Robot& robot = robots[i];
+            simulation.sonarRanges(i, ranges);
+            for (int k = 0; k < 4; k++){
+                robot.range_msg[k].header.stamp = stamp;
+                robot.range_msg[k].range = std::round(100.0 * ranges[k]); //cm
+                robot.range_pub[k].publish(robot.range_msg[k]);
+            }
+        }
+    }
+
+    ros::NodeHandle nh;
+    ros::NodeHandle private_nh;
+    ros::Publisher clock_pub;
+    ros::Subscriber map_sub;
+
+    double control_rate;
+    int feedback_decimation;
+    int sonar_decimation;       //control ticks per sonar sample, 0 for no sonars
+    double real_time_factor;
+    bool publish_mocap;
+    int occupied_threshold;
+
+    sml_nexus_gazebo::FleetSimulation simulation;
+    std::vector<Robot> robots;
+    std::vector<float> wheels[4];  //wheel feedback of all the robots, reused
+    double time = 0.0;             //s, simulation time
+    ros::Time stamp;
+};
+
+//==============================
+//             Main
+//==============================
+int main(int argc, char** argv){
+    ros::init(argc, argv, "fleet_simulator");
+    ros::NodeHandle nh;
+    ros::NodeHandle private_nh("~");
+    SmlNexusFleetSimulator simulator(nh, private_nh);
+    simulator.run();
+    return 0;
+}
@@ -0,0 +1,245 @@
+#include "sml_nexus_gazebo/sml_nexus_ros_force_based_move.h"
+#include <algorithm>
+#include <geometry_msgs/TransformStamped.h>
+
+namespace sml_nexus_gazebo
+{
+
+//Element of the plugin SDF, or its default value
+template <typename T>
+static T sdfParam(const sdf::ElementPtr& sdf, const std::string& name, const T& default_value)
+{
+    return sdf->HasElement(name) ? sdf->Get<T>(name) : default_value;
+}
+
+static double clampVelocity(double value, double max_value)
+{
+    return std::max(-max_value, std::min(max_value, value));
+}
+
+SmlNexusRosForceBasedMove::SmlNexusRosForceBasedMove()
+    : publish_tf_(false), cmd_vel_timeout_(0.25), x_gain_(15.0), y_gain_(15.0), yaw_gain_(1.0),
+      max_x_velocity_(0.7), max_y_velocity_(0.7), max_yaw_velocity_(0.5),
+      odometry_period_(0.04), wheel_velocity_period_(0.02), wheel_model_enabled_(false), mass_(0.0)
+{
+    command_.x = command_.y = command_.yaw = 0.0;
+}
+
+SmlNexusRosForceBasedMove::~SmlNexusRosForceBasedMove()
+{
+    update_connection_.reset();
+    if (nh_){
+        queue_.clear();
+        queue_.disable();
+        nh_->shutdown();
+    }
+    if (queue_thread_.joinable()) queue_thread_.join();
+}
+
+void SmlNexusRosForceBasedMove::Load(gazebo::physics::ModelPtr model, sdf::ElementPtr sdf)
+{
+    model_ = model;
+    link_ = model->GetLink();
+    if (!ros::isInitialized()){
+        ROS_FATAL_STREAM("sml_nexus_ros_force_based_move: ROS is not initialized, load gazebo with the gazebo_ros system plugins");
+        return;
+    }
+
+    const std::string robot_namespace = sdfParam<std::string>(sdf, "robotNamespace", "");
+    const std::string command_topic = sdfParam<std::string>(sdf, "commandTopic", "cmd_vel");
+    const std::string odometry_topic = sdfParam<std::string>(sdf, "odometryTopic", "odom");
+    const std::string wheel_velocity_topic = sdfParam<std::string>(sdf, "wheelVelocityTopic", "wheel_velocity");
+    const double odometry_rate = sdfParam<double>(sdf, "odometryRate", 25.0);
+    const double wheel_velocity_rate = sdfParam<double>(sdf, "wheelVelocityRate", 50.0);
+    publish_tf_ = sdfParam<bool>(sdf, "publishOdometryTf", false);
+    cmd_vel_timeout_ = sdfParam<double>(sdf, "cmdVelTimeOut", 0.25);
+    x_gain_ = sdfParam<double>(sdf, "x_velocity_p_gain", 15.0);
+    y_gain_ = sdfParam<double>(sdf, "y_velocity_p_gain", 15.0);
+    yaw_gain_ = sdfParam<double>(sdf, "yaw_velocity_p_gain", 1.0);
+    max_x_velocity_ = sdfParam<double>(sdf, "max_x_velocity", 0.7);
+    max_y_velocity_ = sdfParam<double>(sdf, "max_y_velocity", 0.7);
+    max_yaw_velocity_ = sdfParam<double>(sdf, "max_yaw_velocity", 0.5);
+    odometry_period_ = odometry_rate > 0.0 ? 1.0 / odometry_rate : 0.0;
+    wheel_velocity_period_ = wheel_velocity_rate > 0.0 ? 1.0 / wheel_velocity_rate : 0.0;
+
+    //Wheel model
+    MecanumWheelModel::Parameters parameters;
+    parameters.wheelbase = sdfParam<double>(sdf, "wheelbase", parameters.wheelbase);
+    parameters.time_constant = sdfParam<double>(sdf, "wheelTimeConstant", parameters.time_constant);
+    parameters.max_wheel_speed = sdfParam<double>(sdf, "maxWheelSpeed", parameters.max_wheel_speed);
+    parameters.max_acceleration = sdfParam<double>(sdf, "maxAcceleration", parameters.max_acceleration);
+    parameters.wheel_radius = sdfParam<double>(sdf, "wheelRadius", parameters.wheel_radius);
+    parameters.encoder_cpr = sdfParam<int>(sdf, "encoderCpr", parameters.encoder_cpr);
+    wheel_model_ = MecanumWheelModel(parameters);
+    wheel_model_enabled_ = sdfParam<bool>(sdf, "wheelModel", false);
+    for (const gazebo::physics::LinkPtr& link : model->GetLinks()) mass_ += link->GetInertial()->Mass();
+
+    //Spin the wheel joints for display, off for headless runs
+    if (sdfParam<bool>(sdf, "spinWheels", false)){
+        const char* joint_elements[4] = {"upperLeftWheelJoint", "upperRightWheelJoint", "lowerLeftWheelJoint", "lowerRightWheelJoint"};
+        const char* joint_defaults[4] = {"upper_left_wheel_joint", "upper_right_wheel_joint", "lower_left_wheel_joint", "lower_right_wheel_joint"};
+        for (int i = 0; i < 4; i++){
+            const std::string joint_name = sdfParam<std::string>(sdf, joint_elements[i], joint_defaults[i]);
+            wheel_joints_[i] = model->GetJoint(joint_name);
+            if (!wheel_joints_[i]) ROS_WARN_STREAM("sml_nexus_ros_force_based_move: no wheel joint " << joint_name << " in " << model->GetName());
+        }
+    }
+
+    nh_.reset(new ros::NodeHandle(robot_namespace));
+    nh_->setCallbackQueue(&queue_);
+    std::string ns = nh_->getNamespace()+"/";
+    if (ns == "//") ns = "";
+    odometry_frame_ = ns + sdfParam<std::string>(sdf, "odometryFrame", "odom");
+    base_frame_ = ns + sdfParam<std::string>(sdf, "robotBaseFrame", "base_link");
+
+    cmd_vel_sub_ = nh_->subscribe(command_topic, 1, &SmlNexusRosForceBasedMove::cmdVelCallback, this);
+    if (odometry_period_ > 0.0) odometry_pub_ = nh_->advertise<nav_msgs::Odometry>(odometry_topic, 10);
+    if (wheel_velocity_period_ > 0.0) wheel_velocity_pub_ = nh_->advertise<std_msgs::Float32MultiArray>(wheel_velocity_topic, 10);
+    if (publish_tf_) transform_broadcaster_.reset(new tf2_ros::TransformBroadcaster());
+
+    odometry_msg_.header.frame_id = odometry_frame_;
+    odometry_msg_.child_frame_id = base_frame_;
+    wheel_velocity_msg_.data.resize(5);
+
+    spawn_pose_ = model->WorldPose();
+    Reset();
+    queue_thread_ = std::thread(&SmlNexusRosForceBasedMove::queueThread, this);
+    update_connection_ = gazebo::event::Events::ConnectWorldUpdateBegin(std::bind(&SmlNexusRosForceBasedMove::update, this));
+
+    ROS_INFO_STREAM(ns << "sml_nexus_ros_force_based_move: " << command_topic << " to base forces"
+                    << (wheel_model_enabled_ ? " through the wheel model" : "") << ", odometry at " << odometry_rate
+                    << " Hz, wheel velocity at " << wheel_velocity_rate << " Hz");
+}
+
+void SmlNexusRosForceBasedMove::Reset()
+{
+    const gazebo::common::Time now = model_->GetWorld()->SimTime();
+    last_update_ = now;
+    last_odometry_ = now;
+    last_wheel_velocity_ = now;
+    wheel_model_.reset();
+    std::lock_guard<std::mutex> lock(command_mutex_);
+    command_.x = command_.y = command_.yaw = 0.0;
+    command_time_ = now;
+}
+
+void SmlNexusRosForceBasedMove::cmdVelCallback(const geometry_msgs::Twist::ConstPtr& msg)
+{
+    std::lock_guard<std::mutex> lock(command_mutex_);
+    command_.x = clampVelocity(msg->linear.x, max_x_velocity_);
+    command_.y = clampVelocity(msg->linear.y, max_y_velocity_);
+    command_.yaw = clampVelocity(msg->angular.z, max_yaw_velocity_);
+    command_time_ = model_->GetWorld()->SimTime();
+}
+
+void SmlNexusRosForceBasedMove::queueThread()
+{
+    while (nh_->ok()) queue_.callAvailable(ros::WallDuration(0.01));
+}
+
+//==========================================================
+//  Every physics step: forces towards the target velocity,
+//  wheel travel, and the publications that are due
+//==========================================================
+void SmlNexusRosForceBasedMove::update()
+{
+    const gazebo::common::Time now = model_->GetWorld()->SimTime();
+    const double dt = (now - last_update_).Double();
+    last_update_ = now;
+    if (dt <= 0.0) return;
+
+    PlanarVelocity command;
+    {
+        std::lock_guard<std::mutex> lock(command_mutex_);
+        command = command_;
+        if ((now - command_time_).Double() > cmd_vel_timeout_) command.x = command.y = command.yaw = 0.0;
+    }
+
+    const ignition::math::Vector3d linear = model_->RelativeLinearVel();
+    const ignition::math::Vector3d angular = model_->RelativeAngularVel();
+    const double wheelbase = wheel_model_.parameters().wheelbase;
+
+    //Wheel speeds: the modelled wheels, or those of the base velocity
+    PlanarVelocity target = command;
+    double wheels[4];
+    if (wheel_model_enabled_){
+        wheel_model_.step(command, dt);
+        target = wheel_model_.wheelVelocity();
+        std::copy(wheel_model_.wheelSpeeds(), wheel_model_.wheelSpeeds() + 4, wheels);
+    }
+    else{
+        PlanarVelocity velocity;
+        velocity.x = linear.X();
+        velocity.y = linear.Y();
+        velocity.yaw = angular.Z();
+        MecanumWheelModel::inverse(velocity, wheelbase, wheels);
+    }
+
+    double force_x = x_gain_ * (target.x - linear.X());
+    double force_y = y_gain_ * (target.y - linear.Y());
+    double torque = yaw_gain_ * (target.yaw - angular.Z());
+    if (wheel_model_enabled_) wheel_model_.limitTraction(force_x, force_y, torque, mass_);
+    link_->AddRelativeForce(ignition::math::Vector3d(force_x, force_y, 0.0));
+    link_->AddRelativeTorque(ignition::math::Vector3d(0.0, 0.0, torque));
+
+    const double wheel_radius = wheel_model_.parameters().wheel_radius;
+    for (int i = 0; i < 4; i++){
+        if (wheel_joints_[i]) wheel_joints_[i]->SetVelocity(0, wheels[i] / wheel_radius);
+    }
+    wheel_model_.integrateEncoders(wheels, dt);
+
+    if (wheel_velocity_period_ > 0.0 && (now - last_wheel_velocity_).Double() >= wheel_velocity_period_){
+        last_wheel_velocity_ = now;
+        publishWheelVelocity();
+    }
+    if (odometry_period_ > 0.0 && (now - last_odometry_).Double() >= odometry_period_){
+        last_odometry_ = now;
+        publishOdometry(now);
+    }
+}
+
+//Pose in the frame of the spawn pose, velocity in the base frame
+void SmlNexusRosForceBasedMove::publishOdometry(const gazebo::common::Time& now)
+{
+    const ignition::math::Pose3d pose = model_->WorldPose() - spawn_pose_;
+    const ignition::math::Vector3d linear = model_->RelativeLinearVel();
+    const ignition::math::Vector3d angular = model_->RelativeAngularVel();
+
+    odometry_msg_.header.stamp = ros::Time(now.sec, now.nsec);
+    odometry_msg_.pose.pose.position.x = pose.Pos().X();
+    odometry_msg_.pose.pose.position.y = pose.Pos().Y();
+    odometry_msg_.pose.pose.position.z = pose.Pos().Z();
+    odometry_msg_.pose.pose.orientation.x = pose.Rot().X();
+    odometry_msg_.pose.pose.orientation.y = pose.Rot().Y();
+    odometry_msg_.pose.pose.orientation.z = pose.Rot().Z();
+    odometry_msg_.pose.pose.orientation.w = pose.Rot().W();
+    odometry_msg_.twist.twist.linear.x = linear.X();
+    odometry_msg_.twist.twist.linear.y = linear.Y();
+    odometry_msg_.twist.twist.angular.z = angular.Z();
+    odometry_pub_.publish(odometry_msg_);
+
+    if (transform_broadcaster_){
+        geometry_msgs::TransformStamped transform;
+        transform.header = odometry_msg_.header;
+        transform.child_frame_id = base_frame_;
+        transform.transform.translation.x = pose.Pos().X();
+        transform.transform.translation.y = pose.Pos().Y();
+        transform.transform.translation.z = pose.Pos().Z();
+        transform.transform.rotation = odometry_msg_.pose.pose.orientation;
+        transform_broadcaster_->sendTransform(transform);
+    }
+}
+
+//Encoder speeds in the layout of the firmware: UL, UR, LL, LR in m/s, dt in ms
+void SmlNexusRosForceBasedMove::publishWheelVelocity()
+{
+    double wheels[4], interval;
+    if (!wheel_model_.sampleEncoders(wheels, interval)) return;
+    for (int i = 0; i < 4; i++) wheel_velocity_msg_.data[i] = static_cast<float>(wheels[i]);
+    wheel_velocity_msg_.data[4] = static_cast<float>(1000.0 * interval);
+    wheel_velocity_pub_.publish(wheel_velocity_msg_);
+}
+
+GZ_REGISTER_MODEL_PLUGIN(SmlNexusRosForceBasedMove)
+
+} // namespace sml_nexus_gazebo
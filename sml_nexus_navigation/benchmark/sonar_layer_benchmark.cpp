@@ -0,0 +1,185 @@
+//==========================================================
+//  Benchmark of the sonar costmap layer update
+//
+//  ROS-free: drives the robot around a walled room in the
+//  default local costmap (10 m x 10 m, 0.05 m cells) with
+//  the four sonars reading at 40 Hz each, and applies
+//  every reading to the grid
+//    - through the precomputed SonarConeTable, as the
+//      SonarLayer does
+//    - by raytracing the cone again for every reading
+//  and reports the cost per reading, the share of one
+//  core spent at 4 x 40 Hz, and how many cells the two
+//  resulting grids disagree on.
+//
+//  Usage: rosrun sml_nexus_navigation sonar_layer_benchmark [-s seconds]
+//==========================================================
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "sml_nexus_navigation/sonar_cone_table.h"
+
+using sml_nexus_navigation::ConeBounds;
+using sml_nexus_navigation::SensorPose;
+using sml_nexus_navigation::SonarConeTable;
+
+static const unsigned char FREE_SPACE = 0;
+static const unsigned char LETHAL_OBSTACLE = 254;
+static const unsigned char NO_INFORMATION = 255;
+
+//-------------------------------------------
+// Same interface as costmap_2d::Costmap2D
+//-------------------------------------------
+struct Grid
+{
+    Grid(double size, double resolution, double origin)
+        : cells(static_cast<unsigned int>(size / resolution)), resolution(resolution), origin(origin),
+          data(cells * cells, NO_INFORMATION) {}
+
+    bool worldToMap(double wx, double wy, unsigned int& mx, unsigned int& my) const
+    {
+        if (wx < origin || wy < origin) return false;
+        mx = static_cast<unsigned int>((wx - origin) / resolution);
+        my = static_cast<unsigned int>((wy - origin) / resolution);
+        return mx < cells && my < cells;
+    }
+
+    void setCost(unsigned int mx, unsigned int my, unsigned char cost) { data[my * cells + mx] = cost; }
+
+    unsigned int cells;
+    double resolution;
+    double origin;
+    std::vector<unsigned char> data;
+};
+
+struct Reading
+{
+    SensorPose pose;
+    double range;
+};
+
+//Sonar mounting on the base, from sml_nexus_description
+static const SensorPose sonar_mounts[4] = {
+    {0.201, 0.0, 0.0},          //front
+    {-0.205, 0.0, M_PI},        //rear
+    {0.0, 0.108, 0.5 * M_PI},   //left
+    {0.0, -0.108, -0.5 * M_PI}  //right
+};
+
+//============================================
+//  Range to the walls of a square room along
+//  the sensor axis, capped to the max range
+//============================================
+static double roomRange(const SensorPose& s, double half_size, double max_range){
+    const double c = std::cos(s.yaw);
+    const double sn = std::sin(s.yaw);
+    double range = max_range;
+    if (c > 1e-9) range = std::min(range, (half_size - s.x) / c);
+    if (c < -1e-9) range = std::min(range, (-half_size - s.x) / c);
+    if (sn > 1e-9) range = std::min(range, (half_size - s.y) / sn);
+    if (sn < -1e-9) range = std::min(range, (-half_size - s.y) / sn);
+    return range;
+}
+
+//================================================
+//  Readings of a lap around the room, 40 Hz each
+//================================================
+static std::vector<Reading> makeReadings(double seconds, double half_room, double max_range){
+    std::vector<Reading> readings;
+    const double rate = 40.0;
+    const int steps = static_cast<int>(seconds * rate);
+    for (int k = 0; k < steps; k++){
+        const double t = k / rate;
+        //Robot on a 1.5 m circle, turning slowly on itself
+        const double rx = 1.5 * std::cos(0.2 * t);
+        const double ry = 1.5 * std::sin(0.2 * t);
+        const double ryaw = 0.5 * t;
+        for (int i = 0; i < 4; i++){
+            Reading r;
+            r.pose.x = rx + std::cos(ryaw) * sonar_mounts[i].x - std::sin(ryaw) * sonar_mounts[i].y;
+            r.pose.y = ry + std::sin(ryaw) * sonar_mounts[i].x + std::cos(ryaw) * sonar_mounts[i].y;
+            r.pose.yaw = ryaw + sonar_mounts[i].yaw;
+            r.range = roomRange(r.pose, half_room, max_range);
+            readings.push_back(r);
+        }
+    }
+    return readings;
+}
+
+//=================================================
+//  Baseline: raytrace the cone at every reading,
+//  with the same sampling as the cone table
+//=================================================
+static void raytraceCone(Grid& grid, const SensorPose& s, double range,
+                         double field_of_view, double max_range, double step){
+    const bool obstacle = range < max_range;
+    const int hit = static_cast<int>(std::floor(std::min(range, max_range) / step + 0.5));
+    unsigned int mx, my;
+    for (int k = 1; k <= hit; k++){
+        const double r = k * step;
+        const unsigned char cost = (obstacle && k == hit) ? LETHAL_OBSTACLE : FREE_SPACE;
+        const int samples = std::max(1, static_cast<int>(std::ceil(r * field_of_view / step)));
+        for (int j = 0; j <= samples; j++){
+            const double angle = s.yaw - 0.5 * field_of_view + field_of_view * j / samples;
+            if (grid.worldToMap(s.x + r * std::cos(angle), s.y + r * std::sin(angle), mx, my)){
+                grid.setCost(mx, my, cost);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv){
+    double seconds = 60.0;
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc) seconds = std::atof(argv[++i]);
+    }
+
+    const double resolution = 0.05;
+    const double field_of_view = 1.047;
+    const double max_range = 5.0;
+    const std::vector<Reading> readings = makeReadings(seconds, 3.0, max_range);
+
+    //Cone table
+    SonarConeTable table;
+    auto start = std::chrono::steady_clock::now();
+    table.build(field_of_view, max_range, resolution);
+    const double build_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    Grid table_grid(10.0, resolution, -5.0);
+    double checksum = 0.0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < readings.size(); i++){
+        const ConeBounds b = table.apply(table_grid, readings[i].pose, readings[i].range, FREE_SPACE, LETHAL_OBSTACLE);
+        checksum += b.max_x - b.min_x;
+    }
+    const double table_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count()
+                            / readings.size();
+
+    //Raytracing baseline
+    Grid ray_grid(10.0, resolution, -5.0);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < readings.size(); i++){
+        raytraceCone(ray_grid, readings[i].pose, readings[i].range, field_of_view, max_range, table.step());
+    }
+    const double ray_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count()
+                          / readings.size();
+
+    size_t differing = 0, known = 0;
+    for (size_t c = 0; c < table_grid.data.size(); c++){
+        if (table_grid.data[c] != ray_grid.data[c]) differing++;
+        if (table_grid.data[c] != NO_INFORMATION) known++;
+    }
+
+    //4 sonars at 40 Hz
+    const double readings_per_second = 160.0;
+    std::printf("readings: %zu, cone points: %zu, table built in %.1f us (checksum %.1f)\n",
+                readings.size(), table.size(), build_us, checksum);
+    std::printf("%-10s %12s %14s\n", "method", "us/reading", "core @160Hz");
+    std::printf("%-10s %12.2f %13.3f%%\n", "table", table_us, table_us * readings_per_second * 1e-4);
+    std::printf("%-10s %12.2f %13.3f%%\n", "raytrace", ray_us, ray_us * readings_per_second * 1e-4);
+    std::printf("cells known: %zu, differing between methods: %zu\n", known, differing);
+    return 0;
+}
@@ -0,0 +1,134 @@
+#ifndef SML_NEXUS_NAVIGATION_SONAR_CONE_TABLE_H
+#define SML_NEXUS_NAVIGATION_SONAR_CONE_TABLE_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace sml_nexus_navigation
+{
+
+//Point of the cone, in the sensor frame
+struct ConePoint
+{
+    float x; //m, along the sensor axis
+    float y; //m
+};
+
+//Sensor pose in the costmap frame
+struct SensorPose
+{
+    double x;   //m
+    double y;   //m
+    double yaw; //rad
+};
+
+//Area touched by a cone update, in the costmap frame
+struct ConeBounds
+{
+    double min_x, min_y, max_x, max_y;
+};
+
+//=========================================================
+//  Precomputed sampling of a sonar cone
+//
+//  The cone is sampled once, in the sensor frame, on arcs
+//  spaced by half a costmap cell and ordered by range.
+//  A measurement then only needs the points of the arcs
+//  up to the measured range: the ones before it are free,
+//  the ones on its arc are the obstacle. Applying them
+//  costs one rotation per point and no trigonometry.
+//
+//  Plain data only, no ROS types, so it is shared by the
+//  costmap layer and by ROS-free benchmarks.
+//=========================================================
+class SonarConeTable
+{
+public:
+    SonarConeTable() : step_(0.0), max_range_(0.0) {}
+
+    //==============================================
+    //  Sample a cone of field_of_view radians up to
+    //  max_range meters, for cells of resolution m
+    //==============================================
+    void build(double field_of_view, double max_range, double resolution)
+    {
+        points_.clear();
+        arc_start_.clear();
+        step_ = 0.5 * resolution;
+        max_range_ = max_range;
+
+        const int arcs = static_cast<int>(std::ceil(max_range / step_));
+        for (int k = 1; k <= arcs; k++){
+            const double r = k * step_;
+            //Keep neighbouring points on the arc less than step_ apart
+            const int samples = std::max(1, static_cast<int>(std::ceil(r * field_of_view / step_)));
+            arc_start_.push_back(points_.size());
+            for (int j = 0; j <= samples; j++){
+                const double angle = -0.5 * field_of_view + field_of_view * j / samples;
+                ConePoint p;
+                p.x = static_cast<float>(r * std::cos(angle));
+                p.y = static_cast<float>(r * std::sin(angle));
+                points_.push_back(p);
+            }
+        }
+        arc_start_.push_back(points_.size());
+    }
+
+    //Number of arcs, arc k being at (k + 1) * step() from the sensor
+    size_t arcs() const { return arc_start_.empty() ? 0 : arc_start_.size() - 1; }
+    size_t size() const { return points_.size(); }
+    double step() const { return step_; }
+    double maxRange() const { return max_range_; }
+
+    //==================================================
+    //  Clear the cone up to range and mark its arc as
+    //  an obstacle. Ranges at or beyond the table's
+    //  maximum range only clear. Grid provides
+    //    bool worldToMap(double, double, unsigned int&, unsigned int&)
+    //    void setCost(unsigned int, unsigned int, unsigned char)
+    //  as costmap_2d::Costmap2D does.
+    //==================================================
+    template <class Grid>
+    ConeBounds apply(Grid& grid, const SensorPose& sensor, double range,
+                     unsigned char free_cost, unsigned char obstacle_cost) const
+    {
+        ConeBounds bounds;
+        bounds.min_x = bounds.max_x = sensor.x;
+        bounds.min_y = bounds.max_y = sensor.y;
+        if (points_.empty() || !(range > 0.0)) return bounds;
+
+        const bool obstacle = range < max_range_;
+        //Arc holding the obstacle, every arc before it is free
+        size_t hit = static_cast<size_t>(std::floor(std::min(range, max_range_) / step_ + 0.5));
+        if (hit > arcs()) hit = arcs();
+        const size_t hit_end = arc_start_[hit];
+        const size_t free_end = obstacle && hit > 0 ? arc_start_[hit - 1] : hit_end;
+
+        const double c = std::cos(sensor.yaw);
+        const double s = std::sin(sensor.yaw);
+        unsigned int mx, my;
+        for (size_t i = 0; i < hit_end; i++){
+            const double wx = sensor.x + c * points_[i].x - s * points_[i].y;
+            const double wy = sensor.y + s * points_[i].x + c * points_[i].y;
+            if (!grid.worldToMap(wx, wy, mx, my)) continue;
+            grid.setCost(mx, my, i < free_end ? free_cost : obstacle_cost);
+
+            if (wx < bounds.min_x) bounds.min_x = wx;
+            if (wx > bounds.max_x) bounds.max_x = wx;
+            if (wy < bounds.min_y) bounds.min_y = wy;
+            if (wy > bounds.max_y) bounds.max_y = wy;
+        }
+        return bounds;
+    }
+
+private:
+    std::vector<ConePoint> points_;
+    std::vector<size_t> arc_start_; //index of the first point of each arc, plus the end
+    double step_;      //m, spacing of the arcs
+    double max_range_; //m
+};
+
+} // namespace sml_nexus_navigation
+
+#endif // SML_NEXUS_NAVIGATION_SONAR_CONE_TABLE_H
@@ -0,0 +1,73 @@
+#ifndef SML_NEXUS_NAVIGATION_SONAR_LAYER_H
+#define SML_NEXUS_NAVIGATION_SONAR_LAYER_H
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <ros/ros.h>
+#include <costmap_2d/costmap_layer.h>
+#include <message_filters/subscriber.h>
+#include <tf2_ros/message_filter.h>
+#include <sensor_msgs/Range.h>
+#include "sml_nexus_navigation/sonar_cone_table.h"
+
+namespace sml_nexus_navigation
+{
+
+//==========================================================
+//  Costmap layer marking the readings of the four URM04
+//  sonars. Every range is converted to meters, transformed
+//  once to the costmap frame and queued; the queued
+//  readings are applied together at the next costmap
+//  update through a precomputed cone table, instead of
+//  raytracing every cone.
+//==========================================================
+class SonarLayer : public costmap_2d::CostmapLayer
+{
+public:
+    SonarLayer();
+    virtual ~SonarLayer();
+
+    virtual void onInitialize();
+    virtual void updateBounds(double robot_x, double robot_y, double robot_yaw,
+                              double* min_x, double* min_y, double* max_x, double* max_y);
+    virtual void updateCosts(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j);
+    virtual void reset();
+    virtual void activate();
+    virtual void deactivate();
+    virtual void matchSize();
+
+private:
+    void rangeCallback(const sensor_msgs::RangeConstPtr& msg);
+
+    //Reading waiting for the next costmap update
+    struct SonarReading
+    {
+        SensorPose pose; //in the costmap frame
+        double range;    //m
+    };
+
+    typedef message_filters::Subscriber<sensor_msgs::Range> RangeSubscriber;
+    typedef tf2_ros::MessageFilter<sensor_msgs::Range> RangeFilter;
+    std::vector<boost::shared_ptr<RangeSubscriber> > range_subs;
+    std::vector<boost::shared_ptr<RangeFilter> > range_filters;
+
+    SonarConeTable cone_table;
+    std::string global_frame;
+    double range_scale;   //range message units to meters
+    double field_of_view; //rad
+    double min_range;     //m
+    double max_range;     //m
+    bool rolling_window;
+
+    boost::mutex readings_mutex;
+    std::vector<SonarReading> readings;
+    std::vector<SonarReading> applied_readings; //swapped with readings at each update
+    size_t max_queued_readings;
+    unsigned long dropped_readings;
+};
+
+} // namespace sml_nexus_navigation
+
+#endif // SML_NEXUS_NAVIGATION_SONAR_LAYER_H
@@ -0,0 +1,149 @@
+#include <boost/bind.hpp>
+#include <pluginlib/class_list_macros.h>
+#include <costmap_2d/cost_values.h>
+#include <tf2/utils.h>
+#include "sml_nexus_navigation/sonar_layer.h"
+
+PLUGINLIB_EXPORT_CLASS(sml_nexus_navigation::SonarLayer, costmap_2d::Layer)
+
+namespace sml_nexus_navigation
+{
+
+//=====================
+//        constructor
+//=====================
+SonarLayer::SonarLayer()
+    : range_scale(0.01), field_of_view(1.047), min_range(0.04), max_range(5.0),
+      rolling_window(false), max_queued_readings(64), dropped_readings(0)
+{
+}
+
+SonarLayer::~SonarLayer(){}
+
+//=======================================
+//  Get parameters and subscribe to the
+//           range topics
+//=======================================
+void SonarLayer::onInitialize(){
+    ros::NodeHandle nh("~/" + name_);
+    ros::NodeHandle g_nh;
+    current_ = true;
+    default_value_ = costmap_2d::NO_INFORMATION;
+    global_frame = layered_costmap_->getGlobalFrameID();
+    rolling_window = layered_costmap_->isRolling();
+
+    //The firmware publishes ranges in centimeters, the Gazebo sonars in meters
+    range_scale = nh.param("range_scale", 0.01);
+    //The field_of_view of the firmware messages is in degrees, use our own
+    field_of_view = nh.param("field_of_view", 1.047);
+    min_range = nh.param("min_range", 0.04);
+    max_range = nh.param("max_range", 5.0);
+    max_queued_readings = nh.param("max_queued_readings", 64);
+
+    std::vector<std::string> topics;
+    if (!nh.getParam("topics", topics)){
+        topics.push_back("front_range");
+        topics.push_back("rear_range");
+        topics.push_back("left_range");
+        topics.push_back("right_range");
+    }
+
+    matchSize();
+
+    //Every sonar only publishes once its transform is available
+    for (size_t i = 0; i < topics.size(); i++){
+        boost::shared_ptr<RangeSubscriber> sub(new RangeSubscriber(g_nh, topics[i], 10));
+        boost::shared_ptr<RangeFilter> filter(new RangeFilter(*sub, *tf_, global_frame, 10, g_nh));
+        filter->registerCallback(boost::bind(&SonarLayer::rangeCallback, this, _1));
+        range_subs.push_back(sub);
+        range_filters.push_back(filter);
+        ROS_INFO_STREAM("SonarLayer " << name_ << ": subscribed to " << g_nh.resolveName(topics[i]));
+    }
+}
+
+//=======================================
+//  Resize with the master costmap and
+//     sample the cone at its resolution
+//=======================================
+void SonarLayer::matchSize(){
+    CostmapLayer::matchSize();
+    cone_table.build(field_of_view, max_range, layered_costmap_->getCostmap()->getResolution());
+}
+
+//=======================================
+//  Queue a reading in the costmap frame
+//=======================================
+void SonarLayer::rangeCallback(const sensor_msgs::RangeConstPtr& msg){
+    const double range = msg->range * range_scale;
+    if (!(range >= min_range)) return;
+
+    geometry_msgs::TransformStamped sensor_transform;
+    try{
+        sensor_transform = tf_->lookupTransform(global_frame, msg->header.frame_id, msg->header.stamp);
+    }
+    catch (tf2::TransformException& ex){
+        ROS_WARN_THROTTLE(1.0, "SonarLayer %s: %s", name_.c_str(), ex.what());
+        return;
+    }
+
+    SonarReading reading;
+    reading.pose.x = sensor_transform.transform.translation.x;
+    reading.pose.y = sensor_transform.transform.translation.y;
+    reading.pose.yaw = tf2::getYaw(sensor_transform.transform.rotation);
+    reading.range = range;
+
+    boost::mutex::scoped_lock lock(readings_mutex);
+    if (readings.size() >= max_queued_readings){
+        dropped_readings++;
+        ROS_WARN_THROTTLE(1.0, "SonarLayer %s: costmap too slow, %lu readings dropped", name_.c_str(), dropped_readings);
+        return;
+    }
+    readings.push_back(reading);
+}
+
+//=======================================
+//  Apply the queued readings and report
+//         the area they touched
+//=======================================
+void SonarLayer::updateBounds(double robot_x, double robot_y, double robot_yaw,
+                              double* min_x, double* min_y, double* max_x, double* max_y){
+    if (rolling_window) updateOrigin(robot_x - getSizeInMetersX() / 2, robot_y - getSizeInMetersY() / 2);
+    if (!enabled_) return;
+
+    {
+        boost::mutex::scoped_lock lock(readings_mutex);
+        applied_readings.swap(readings);
+    }
+
+    for (size_t i = 0; i < applied_readings.size(); i++){
+        const ConeBounds bounds = cone_table.apply(*this, applied_readings[i].pose, applied_readings[i].range,
+                                                   costmap_2d::FREE_SPACE, costmap_2d::LETHAL_OBSTACLE);
+        touch(bounds.min_x, bounds.min_y, min_x, min_y, max_x, max_y);
+        touch(bounds.max_x, bounds.max_y, min_x, min_y, max_x, max_y);
+    }
+    applied_readings.clear();
+}
+
+void SonarLayer::updateCosts(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j){
+    if (!enabled_) return;
+    updateWithMax(master_grid, min_i, min_j, max_i, max_j);
+}
+
+void SonarLayer::reset(){
+    deactivate();
+    resetMaps();
+    current_ = true;
+    activate();
+}
+
+void SonarLayer::activate(){
+    for (size_t i = 0; i < range_subs.size(); i++) range_subs[i]->subscribe();
+}
+
+void SonarLayer::deactivate(){
+    for (size_t i = 0; i < range_subs.size(); i++) range_subs[i]->unsubscribe();
+    boost::mutex::scoped_lock lock(readings_mutex);
+    readings.clear();
+}
+
+} // namespace sml_nexus_navigation
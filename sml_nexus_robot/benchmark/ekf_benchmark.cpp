@@ -0,0 +1,250 @@
+//==========================================================
+//  Benchmark of the odometry EKF
+//
+//  ROS-free: drives the mecanum base along a figure eight,
+//  generates noisy wheel speeds at 200 Hz (with a small
+//  wheel radius error, as a worn wheel would give), IMU yaw
+//  rates at 200 Hz and motion capture poses at 100 Hz, and
+//  runs PlanarEkf the same way the odometry_ekf node does.
+//  Reports for each set of fused sensors:
+//    - the cost per predict + update (ns/update)
+//    - the number of heap allocations per update
+//    - the RMS position and yaw errors against the truth,
+//      and the RMS standard deviations the filter reports
+//    - the mean normalized estimation error squared (NEES)
+//      of the position and of the yaw, 2 and 1 for a
+//      consistent filter
+//  and the share of one core spent at the sensor rates.
+//  Fails when a filter is inconsistent: its RMS error is
+//  more than twice, or less than half, the standard
+//  deviation it reports.
+//
+//  Usage: rosrun sml_nexus_robot ekf_benchmark [-s seconds]
+//==========================================================
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <vector>
+#include "sml_nexus_robot/planar_ekf.h"
+#include "sml_nexus_robot/planar_odometry.h"
+
+using sml_nexus_robot::PlanarEkf;
+using sml_nexus_robot::PlanarOdometry;
+
+//-----------------------------------
+// Count every heap allocation made
+//-----------------------------------
+static unsigned long allocation_count = 0;
+
+void* operator new(std::size_t size){
+    ++allocation_count;
+    void* p = std::malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept{
+    std::free(p);
+}
+
+static const double wheel_rate = 200.0;  //Hz, wheel feedback and IMU
+static const int mocap_decimation = 2;   //mocap at 100 Hz
+static const double wheelbase = 0.15;
+
+//One step of the simulated run
+struct Sample
+{
+    double t;
+    double x, y, yaw;         //true pose
+    double wheels[4];         //measured wheel speeds, UL, UR, LL, LR
+    double yaw_rate;          //measured by the IMU
+    bool mocap;
+    double mocap_pose[3];
+};
+
+struct Result
+{
+    const char* name;
+    double ns_per_update;
+    double allocations_per_update;
+    double position_rms;    //m
+    double yaw_rms;         //rad
+    double position_std;    //m, RMS of what the filter reports
+    double yaw_std;         //rad
+    double position_nees;   //mean, 2 when consistent
+    double yaw_nees;        //mean, 1 when consistent
+};
+
+//=====================================================
+//  Figure eight at up to 0.4 m/s, the base turning
+//  slowly on itself as it goes
+//=====================================================
+static std::vector<Sample> makeRun(double seconds){
+    std::mt19937 rng(3);
+    std::normal_distribution<double> wheel_noise(0.0, 0.01);
+    std::normal_distribution<double> gyro_noise(0.0, 0.02);
+    std::normal_distribution<double> mocap_position_noise(0.0, 0.002);
+    std::normal_distribution<double> mocap_yaw_noise(0.0, 0.01);
+    const double wheel_scale[4] = {1.0, 1.02, 1.0, 0.99}; //wheel radius errors
+
+    std::vector<Sample> run;
+    const double dt = 1.0 / wheel_rate;
+    double x = 0, y = 0, yaw = 0;
+    for (int k = 0; k < static_cast<int>(seconds * wheel_rate); k++){
+        const double t = k * dt;
+        //World frame velocity of the figure eight, body frame twist
+        const double a = 0.2;
+        const double vwx = 0.4 * std::cos(a * t);
+        const double vwy = 0.3 * std::cos(2 * a * t);
+        const double wz = 0.3 * std::sin(0.1 * t);
+        const double vx = std::cos(yaw) * vwx + std::sin(yaw) * vwy;
+        const double vy = -std::sin(yaw) * vwx + std::cos(yaw) * vwy;
+
+        Sample s;
+        s.t = t;
+        x += vwx * dt;
+        y += vwy * dt;
+        yaw = PlanarOdometry::wrapAngle(yaw + wz * dt);
+        s.x = x;
+        s.y = y;
+        s.yaw = yaw;
+
+        //Inverse mecanum kinematics
+        const double l = 2 * wheelbase;
+        const double ideal[4] = {vx - vy - l * wz, vx + vy + l * wz, vx + vy - l * wz, vx - vy + l * wz};
+        for (int i = 0; i < 4; i++) s.wheels[i] = wheel_scale[i] * ideal[i] + wheel_noise(rng);
+        s.yaw_rate = wz + gyro_noise(rng);
+
+        s.mocap = (k % mocap_decimation) == 0;
+        s.mocap_pose[0] = x + mocap_position_noise(rng);
+        s.mocap_pose[1] = y + mocap_position_noise(rng);
+        s.mocap_pose[2] = PlanarOdometry::wrapAngle(yaw + mocap_yaw_noise(rng));
+        run.push_back(s);
+    }
+    return run;
+}
+
+//=====================================================
+//  Run the filter over the samples with some sensors
+//=====================================================
+static Result runFilter(const char* name, const std::vector<Sample>& run, bool imu, bool mocap){
+    Result r;
+    r.name = name;
+    PlanarEkf ekf(wheelbase);
+    ekf.noise.wheel_speed = 0.01;
+    PlanarEkf::Matrix3 mocap_R = PlanarEkf::Matrix3::Zero();
+    mocap_R(0, 0) = mocap_R(1, 1) = 0.002 * 0.002;
+    mocap_R(2, 2) = 0.01 * 0.01;
+
+    const double dt = 1.0 / wheel_rate;
+    double position_error = 0, yaw_error = 0, position_variance = 0, yaw_variance = 0;
+    double position_nees = 0, yaw_nees = 0;
+    unsigned long updates = 0;
+    const unsigned long allocations_before = allocation_count;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < run.size(); k++){
+        const Sample& s = run[k];
+        ekf.predict(dt);
+        ekf.updateWheels(s.wheels[0], s.wheels[1], s.wheels[2], s.wheels[3]);
+        updates++;
+        if (imu){
+            ekf.updateYawRate(s.yaw_rate, 0.02 * 0.02);
+            updates++;
+        }
+        if (mocap && s.mocap){
+            ekf.updatePose(PlanarEkf::Vector3(s.mocap_pose[0], s.mocap_pose[1], s.mocap_pose[2]), mocap_R);
+            updates++;
+        }
+
+        const PlanarEkf::State& x = ekf.state();
+        const PlanarEkf::Covariance& P = ekf.covariance();
+        const Eigen::Vector2d position(x(0) - s.x, x(1) - s.y);
+        const double yaw = PlanarOdometry::wrapAngle(x(2) - s.yaw);
+        position_error += position.squaredNorm();
+        yaw_error += yaw * yaw;
+        position_variance += P(0, 0) + P(1, 1);
+        yaw_variance += P(2, 2);
+        position_nees += position.dot(P.topLeftCorner<2, 2>().ldlt().solve(position));
+        yaw_nees += yaw * yaw / P(2, 2);
+    }
+    const double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    r.ns_per_update = elapsed_ns / updates;
+    r.allocations_per_update = static_cast<double>(allocation_count - allocations_before) / updates;
+    r.position_rms = std::sqrt(position_error / run.size());
+    r.yaw_rms = std::sqrt(yaw_error / run.size());
+    r.position_std = std::sqrt(position_variance / run.size());
+    r.yaw_std = std::sqrt(yaw_variance / run.size());
+    r.position_nees = position_nees / run.size();
+    r.yaw_nees = yaw_nees / run.size();
+    return r;
+}
+
+//Dead reckoning of the odometry broadcaster, for reference
+static Result runDeadReckoning(const std::vector<Sample>& run){
+    Result r;
+    r.name = "dead reckoning";
+    PlanarOdometry odometry(wheelbase);
+    double position_error = 0, yaw_error = 0;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < run.size(); k++){
+        const Sample& s = run[k];
+        odometry.computeOdometry(s.wheels[0], s.wheels[1], s.wheels[2], s.wheels[3], 1000.0 / wheel_rate);
+        position_error += std::pow(odometry.pose().x - s.x, 2) + std::pow(odometry.pose().y - s.y, 2);
+        yaw_error += std::pow(PlanarOdometry::wrapAngle(odometry.pose().yaw - s.yaw), 2);
+    }
+    r.ns_per_update = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / run.size();
+    r.allocations_per_update = 0;
+    r.position_rms = std::sqrt(position_error / run.size());
+    r.yaw_rms = std::sqrt(yaw_error / run.size());
+    r.position_std = NAN;
+    r.yaw_std = NAN;
+    r.position_nees = NAN;
+    r.yaw_nees = NAN;
+    return r;
+}
+
+int main(int argc, char** argv){
+    double seconds = 300.0;
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc) seconds = std::atof(argv[++i]);
+    }
+
+    const std::vector<Sample> run = makeRun(seconds);
+    std::vector<Result> results;
+    results.push_back(runDeadReckoning(run));
+    results.push_back(runFilter("ekf wheels", run, false, false));
+    results.push_back(runFilter("ekf wheels+imu", run, true, false));
+    results.push_back(runFilter("ekf wheels+imu+mocap", run, true, true));
+
+    std::printf("%.0f s at %.0f Hz wheels and IMU, %.0f Hz mocap\n", seconds, wheel_rate, wheel_rate / mocap_decimation);
+    std::printf("%-22s %10s %10s %12s %10s %10s %12s %10s %10s\n", "", "ns/update", "allocs", "pos rms [m]",
+                "pos std", "pos nees", "yaw rms", "yaw std", "yaw nees");
+    bool consistent = true;
+    for (size_t i = 0; i < results.size(); i++){
+        const Result& r = results[i];
+        std::printf("%-22s %10.1f %10.3f %12.4f %10.4f %10.2f %12.4f %10.4f %10.2f\n", r.name, r.ns_per_update,
+                    r.allocations_per_update, r.position_rms, r.position_std, r.position_nees, r.yaw_rms, r.yaw_std,
+                    r.yaw_nees);
+        //Dead reckoning reports no covariance
+        if (std::isnan(r.position_std)) continue;
+        const double position_ratio = r.position_rms / r.position_std, yaw_ratio = r.yaw_rms / r.yaw_std;
+        if (position_ratio > 2.0 || position_ratio < 0.5 || yaw_ratio > 2.0 || yaw_ratio < 0.5){
+            std::printf("%s is inconsistent: RMS error %.2f times the position std, %.2f times the yaw std\n",
+                        r.name, position_ratio, yaw_ratio);
+            consistent = false;
+        }
+    }
+    //Wheels and IMU at 200 Hz, mocap at 100 Hz
+    const double updates_per_second = wheel_rate * 2 + wheel_rate / mocap_decimation;
+    std::printf("one core at %.0f updates/s: %.3f%%\n", updates_per_second,
+                results.back().ns_per_update * updates_per_second * 1e-7);
+    return consistent ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+//==========================================================
+//  Benchmark of the odometry pose integrators
+//
+//  ROS-free: samples the wheel speeds of a smooth synthetic
+//  trajectory 10 km long at the feedback rate and integrates
+//  them with each PoseIntegrator, in float and in double.
+//  The reference pose is the same trajectory integrated in
+//  long double with 4 RK4 substeps per sample. Reports:
+//    - the cost per integration step (ns/step)
+//    - the final and maximum position drift, and the final
+//      yaw drift, against the reference
+//
+//  Usage: rosrun sml_nexus_robot integrator_benchmark [-f rate_hz] [-d distance_m]
+//==========================================================
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "sml_nexus_robot/planar_odometry.h"
+
+using sml_nexus_robot::BasicPlanarOdometry;
+using sml_nexus_robot::PoseIntegrator;
+
+static const long double wheelbase = 0.15L;
+
+//Twist of the synthetic trajectory at time t. The yaw rate keeps
+//crossing zero, slowly, to exercise the small rotation cases
+static void trajectoryTwist(long double t, long double& vx, long double& vy, long double& wz){
+    vx = 0.5L + 0.3L * std::sin(0.11L * t);
+    vy = 0.2L * std::sin(0.07L * t + 1.0L);
+    wz = 0.3L * std::sin(0.013L * t) + 0.05L * std::sin(0.29L * t);
+}
+
+struct Sample
+{
+    float wheels[4]; //UL, UR, LL, LR in m/s, at the end of the interval
+    float dt_ms;
+};
+
+struct Reference
+{
+    double x, y, yaw;
+};
+
+struct Result
+{
+    double ns_per_step;
+    double final_drift;  //m
+    double max_drift;    //m
+    double yaw_drift;    //rad
+};
+
+//=====================================================
+//  Sample the wheels and integrate the reference pose
+//=====================================================
+static void makeTrajectory(double rate, double distance, std::vector<Sample>& samples, std::vector<Reference>& reference){
+    const long double h = 1.0L / rate;
+    const int substeps = 4;
+    const long double hs = h / substeps;
+    long double x = 0, y = 0, yaw = 0, t = 0, travelled = 0;
+    while (travelled < distance){
+        for (int k = 0; k < substeps; k++){
+            //RK4 of x, y, yaw under the time-varying twist
+            long double vx[3], vy[3], wz[3];
+            trajectoryTwist(t, vx[0], vy[0], wz[0]);
+            trajectoryTwist(t + 0.5L * hs, vx[1], vy[1], wz[1]);
+            trajectoryTwist(t + hs, vx[2], vy[2], wz[2]);
+            long double kx[4], ky[4], kyaw[4];
+            const int stage_twist[4] = {0, 1, 1, 2};
+            const long double stage_step[4] = {0, 0.5L * hs, 0.5L * hs, hs};
+            for (int s = 0; s < 4; s++){
+                const int j = stage_twist[s];
+                const long double stage_yaw = yaw + (s == 0 ? 0 : stage_step[s] * kyaw[s - 1]);
+                kx[s] = std::cos(stage_yaw) * vx[j] - std::sin(stage_yaw) * vy[j];
+                ky[s] = std::sin(stage_yaw) * vx[j] + std::cos(stage_yaw) * vy[j];
+                kyaw[s] = wz[j];
+            }
+            x += hs / 6 * (kx[0] + 2 * kx[1] + 2 * kx[2] + kx[3]);
+            y += hs / 6 * (ky[0] + 2 * ky[1] + 2 * ky[2] + ky[3]);
+            yaw += hs / 6 * (kyaw[0] + 2 * kyaw[1] + 2 * kyaw[2] + kyaw[3]);
+            travelled += hs * std::sqrt(vx[1] * vx[1] + vy[1] * vy[1]);
+            t += hs;
+        }
+
+        //Inverse mecanum kinematics at the end of the interval
+        long double vx, vy, wz;
+        trajectoryTwist(t, vx, vy, wz);
+        const long double l = 2 * wheelbase * wz;
+        Sample sample;
+        sample.wheels[0] = static_cast<float>(vx - vy - l);
+        sample.wheels[1] = static_cast<float>(vx + vy + l);
+        sample.wheels[2] = static_cast<float>(vx + vy - l);
+        sample.wheels[3] = static_cast<float>(vx - vy + l);
+        sample.dt_ms = static_cast<float>(1000.0L * h);
+        samples.push_back(sample);
+
+        Reference pose;
+        pose.x = static_cast<double>(x);
+        pose.y = static_cast<double>(y);
+        pose.yaw = static_cast<double>(yaw);
+        reference.push_back(pose);
+    }
+}
+
+template <typename Scalar>
+static Result runIntegrator(PoseIntegrator integrator, const std::vector<Sample>& samples, const std::vector<Reference>& reference){
+    Result result;
+
+    //Timing pass
+    BasicPlanarOdometry<Scalar> timed(static_cast<Scalar>(wheelbase), integrator);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < samples.size(); i++){
+        const Sample& s = samples[i];
+        timed.computeOdometry(s.wheels[0], s.wheels[1], s.wheels[2], s.wheels[3], s.dt_ms);
+    }
+    const double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    result.ns_per_step = elapsed_ns / samples.size();
+    volatile double sink = timed.pose().x; //keep the timing pass from being optimized away
+    (void)sink;
+
+    //Drift pass
+    BasicPlanarOdometry<Scalar> odometry(static_cast<Scalar>(wheelbase), integrator);
+    result.max_drift = 0;
+    for (size_t i = 0; i < samples.size(); i++){
+        const Sample& s = samples[i];
+        odometry.computeOdometry(s.wheels[0], s.wheels[1], s.wheels[2], s.wheels[3], s.dt_ms);
+        const double drift = std::hypot(odometry.pose().x - reference[i].x, odometry.pose().y - reference[i].y);
+        result.max_drift = std::max(result.max_drift, drift);
+        result.final_drift = drift;
+    }
+    const double yaw_error = std::fmod(static_cast<double>(odometry.pose().yaw) - reference.back().yaw, 2.0 * M_PI);
+    result.yaw_drift = std::fabs(sml_nexus_robot::PlanarOdometry::wrapAngle(yaw_error));
+    return result;
+}
+
+int main(int argc, char** argv){
+    double rate = 50.0;
+    double distance = 10000.0;
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp(argv[i], "-f") == 0 && i + 1 < argc) rate = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "-d") == 0 && i + 1 < argc) distance = std::atof(argv[++i]);
+    }
+
+    std::vector<Sample> samples;
+    std::vector<Reference> reference;
+    makeTrajectory(rate, distance, samples, reference);
+    std::printf("%.0f m at %.0f Hz, %zu steps\n", distance, rate, samples.size());
+    std::printf("%-14s %10s %14s %12s %12s\n", "", "ns/step", "final drift", "max drift", "yaw drift");
+
+    const PoseIntegrator integrators[3] = {PoseIntegrator::ARC, PoseIntegrator::EXACT, PoseIntegrator::RK4};
+    const char* names[3] = {"arc", "exact", "rk4"};
+    for (int k = 0; k < 3; k++){
+        for (int d = 0; d < 2; d++){
+            const Result r = d == 0 ? runIntegrator<float>(integrators[k], samples, reference)
+                                    : runIntegrator<double>(integrators[k], samples, reference);
+            char name[32];
+            std::snprintf(name, sizeof(name), "%s %s", names[k], d == 0 ? "float" : "double");
+            std::printf("%-14s %10.1f %12.4f m %10.4f m %8.5f rad\n", name, r.ns_per_step, r.final_drift, r.max_drift, r.yaw_drift);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,327 @@
+//==========================================================
+//  Benchmark of the odometry broadcaster pipeline
+//
+//  No node is started: replays wheel_velocity traces (5 floats per
+//  frame: UL, UR, LL, LR in m/s and dt in ms) through
+//  PlanarOdometry the same way wheelVelCallback does, and
+//  reports for each trace:
+//    - the cost per update (ns/update)
+//    - the number of heap allocations per update
+//    - the pose drift against a reference integrator
+//  then fills and publishes a nav_msgs/Odometry per frame
+//  the way publishOdometry does, and reports the cost and
+//  allocations per publish for a fresh message every time
+//  and for the reused preallocated one, with serializing
+//  and intra-process subscribers
+//
+//  Usage: rosrun sml_nexus_robot odometry_benchmark [-r repeats] [trace.csv ...]
+//  Without trace arguments the synthetic traces shipped in
+//  benchmark/traces are replayed.
+//==========================================================
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <boost/make_shared.hpp>
+#include <nav_msgs/Odometry.h>
+#include "sml_nexus_robot/planar_odometry.h"
+
+#ifndef SML_NEXUS_TRACE_DIR
+#define SML_NEXUS_TRACE_DIR "benchmark/traces"
+#endif
+
+//-----------------------------------
+// Count every heap allocation made
+//-----------------------------------
+static unsigned long allocation_count = 0;
+
+void* operator new(std::size_t size){
+    ++allocation_count;
+    void* p = std::malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept{
+    std::free(p);
+}
+
+//Same layout as the wheel_velocity Float32MultiArray
+struct WheelFrame
+{
+    float data[5];
+};
+
+//Stand-in for the preallocated odom message and transform
+struct OdometryOutput
+{
+    double x, y, qz, qw;
+    double vx, vy, wz;
+};
+
+struct TraceResult
+{
+    double ns_per_update;
+    double allocations_per_update;
+    double position_drift; //m
+    double yaw_drift;      //rad
+    double distance;       //m, reference path length
+    sml_nexus_robot::PlanarPose pose;
+};
+
+//=====================================
+//  Load a trace, one frame per line
+//=====================================
+static bool loadTrace(const std::string& path, std::vector<WheelFrame>& frames){
+    FILE* file = std::fopen(path.c_str(), "r");
+    if (!file) return false;
+
+    char line[256];
+    while (std::fgets(line, sizeof(line), file)){
+        if (line[0] == '#' || line[0] == '\n') continue;
+        WheelFrame frame;
+        if (std::sscanf(line, "%f , %f , %f , %f , %f", &frame.data[0], &frame.data[1],
+                        &frame.data[2], &frame.data[3], &frame.data[4]) == 5){
+            frames.push_back(frame);
+        }
+    }
+    std::fclose(file);
+    return !frames.empty();
+}
+
+//==================================================
+//  Reference integrator: exact SE(2) exponential
+//  map of the same body twist, in long double
+//==================================================
+static void referencePose(const std::vector<WheelFrame>& frames, double wheelbase,
+                          long double& x, long double& y, long double& yaw, long double& distance){
+    x = y = yaw = distance = 0.0L;
+    for (size_t i = 0; i < frames.size(); i++){
+        const float* d = frames[i].data;
+        const long double vx = ((long double)d[0] + d[1] + d[2] + d[3]) / 4.0L;
+        const long double vy = (-(long double)d[0] + d[1] + d[2] - d[3]) / 4.0L;
+        const long double wz = (-(long double)d[0] + d[1] - d[2] + d[3]) / (8.0L * wheelbase);
+        const long double dt = d[4] / 1000.0L;
+        const long double th = wz * dt;
+
+        long double a, b;
+        if (std::fabs(th) < 1e-6L){
+            a = 1.0L - th * th / 6.0L;
+            b = th / 2.0L - th * th * th / 24.0L;
+        }
+        else{
+            a = std::sin(th) / th;
+            b = (1.0L - std::cos(th)) / th;
+        }
+        const long double dx = (a * vx - b * vy) * dt;
+        const long double dy = (b * vx + a * vy) * dt;
+        x += std::cos(yaw) * dx - std::sin(yaw) * dy;
+        y += std::sin(yaw) * dx + std::cos(yaw) * dy;
+        yaw += th;
+        distance += std::sqrt(vx * vx + vy * vy) * dt;
+    }
+}
+
+//=====================================
+//  Replay a trace through the pipeline
+//=====================================
+static TraceResult runTrace(const std::vector<WheelFrame>& frames, int repeats){
+    TraceResult result;
+    sml_nexus_robot::PlanarOdometry odometry(0.15);
+    OdometryOutput out = OdometryOutput();
+
+    const unsigned long allocations_before = allocation_count;
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++){
+        odometry.reset();
+        for (size_t i = 0; i < frames.size(); i++){
+            const float* d = frames[i].data;
+            odometry.computeOdometry(d[0], d[1], d[2], d[3], d[4]);
+
+            const sml_nexus_robot::PlanarPose& pose = odometry.pose();
+            const sml_nexus_robot::PlanarTwist& twist = odometry.twist();
+            out.x = pose.x;
+            out.y = pose.y;
+            out.qz = odometry.quaternionZ();
+            out.qw = odometry.quaternionW();
+            out.vx = twist.vx;
+            out.vy = twist.vy;
+            out.wz = twist.wz;
+        }
+    }
+    const auto stop = std::chrono::steady_clock::now();
+    const double updates = static_cast<double>(frames.size()) * repeats;
+
+    result.ns_per_update = std::chrono::duration<double, std::nano>(stop - start).count() / updates;
+    result.allocations_per_update = (allocation_count - allocations_before) / updates;
+    result.pose = odometry.pose();
+
+    long double ref_x, ref_y, ref_yaw, distance;
+    referencePose(frames, odometry.wheelbase(), ref_x, ref_y, ref_yaw, distance);
+    result.position_drift = std::hypot(static_cast<double>(ref_x) - out.x, static_cast<double>(ref_y) - out.y);
+    result.yaw_drift = std::fabs(sml_nexus_robot::PlanarOdometry::wrapAngle(
+        std::remainder(static_cast<double>(ref_yaw), 2.0 * M_PI) - result.pose.yaw));
+    result.distance = static_cast<double>(distance);
+    return result;
+}
+
+//-----------------------------------------------------------
+// Stand-in for ros::Publisher::publish of a shared message.
+// Without intra-process subscribers roscpp serializes it and
+// drops its reference, otherwise the subscriber queue holds
+// it until the next one. The serialization buffer is reused
+// so that only the message allocations are counted
+//-----------------------------------------------------------
+struct PublisherStandIn
+{
+    bool intra_process;
+    nav_msgs::OdometryConstPtr held;
+    std::vector<uint8_t> buffer;
+
+    void publish(const nav_msgs::OdometryConstPtr& msg){
+        if (intra_process){
+            held = msg;
+            return;
+        }
+        const uint32_t length = ros::serialization::serializationLength(*msg);
+        if (buffer.size() < length) buffer.resize(length);
+        ros::serialization::OStream stream(buffer.data(), length);
+        ros::serialization::serialize(stream, *msg);
+    }
+};
+
+struct PublishResult
+{
+    double ns_per_publish;
+    double allocations_per_publish;
+};
+
+//==================================================
+//  Fill and publish the odometry of every frame,
+//  with a fresh message or the preallocated one
+//==================================================
+static PublishResult runPublish(const std::vector<WheelFrame>& frames, int repeats, bool preallocated, bool intra_process){
+    sml_nexus_robot::PlanarOdometry odometry(0.15);
+    PublisherStandIn publisher;
+    publisher.intra_process = intra_process;
+
+    nav_msgs::Odometry odom_msg;
+    odom_msg.header.frame_id = "nexus1/odom";
+    odom_msg.child_frame_id = "nexus1/base_link";
+    odom_msg.pose.pose.orientation.w = 1;
+    for (int k = 2; k < 5; k++){
+        odom_msg.pose.covariance[k * 6 + k] = 1e6;
+        odom_msg.twist.covariance[k * 6 + k] = 1e6;
+    }
+    nav_msgs::OdometryPtr odom_out = boost::make_shared<nav_msgs::Odometry>(odom_msg);
+    const int planar[3] = {0, 7, 35};
+    const double variance[3] = {1e-4, 1e-4, 1e-3};
+
+    //Size the serialization buffer before counting
+    publisher.publish(odom_out);
+    publisher.held.reset();
+
+    const unsigned long allocations_before = allocation_count;
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++){
+        odometry.reset();
+        for (size_t i = 0; i < frames.size(); i++){
+            const float* d = frames[i].data;
+            odometry.computeOdometry(d[0], d[1], d[2], d[3], d[4]);
+
+            if (!preallocated) odom_out = boost::make_shared<nav_msgs::Odometry>(odom_msg);
+            const sml_nexus_robot::PlanarPose& pose = odometry.pose();
+            const sml_nexus_robot::PlanarTwist& twist = odometry.twist();
+            odom_out->header.stamp.fromNSec(static_cast<uint64_t>(i) * 10000000ULL);
+            odom_out->pose.pose.position.x = pose.x;
+            odom_out->pose.pose.position.y = pose.y;
+            odom_out->pose.pose.orientation.z = odometry.quaternionZ();
+            odom_out->pose.pose.orientation.w = odometry.quaternionW();
+            odom_out->twist.twist.linear.x = twist.vx;
+            odom_out->twist.twist.linear.y = twist.vy;
+            odom_out->twist.twist.angular.z = twist.wz;
+            for (int k = 0; k < 3; k++){
+                odom_out->pose.covariance[planar[k]] = variance[k];
+                odom_out->twist.covariance[planar[k]] = variance[k];
+            }
+            publisher.publish(nav_msgs::OdometryConstPtr(odom_out));
+            if (preallocated && !odom_out.unique()) odom_out = boost::make_shared<nav_msgs::Odometry>(odom_msg);
+        }
+    }
+    const auto stop = std::chrono::steady_clock::now();
+    const double publishes = static_cast<double>(frames.size()) * repeats;
+
+    PublishResult result;
+    result.ns_per_publish = std::chrono::duration<double, std::nano>(stop - start).count() / publishes;
+    result.allocations_per_publish = (allocation_count - allocations_before) / publishes;
+    return result;
+}
+
+int main(int argc, char** argv){
+    int repeats = 2000;
+    std::vector<std::string> traces;
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) repeats = std::atoi(argv[++i]);
+        else traces.push_back(argv[i]);
+    }
+    if (traces.empty()){
+        const char* shipped[] = {"straight", "strafe", "spin", "arc"};
+        for (const char* name : shipped){
+            traces.push_back(std::string(SML_NEXUS_TRACE_DIR) + "/" + name + ".csv");
+        }
+    }
+
+    std::printf("%-12s %8s %10s %12s %10s %12s %12s\n",
+                "trace", "frames", "ns/update", "allocs/upd", "dist [m]", "drift [m]", "drift [rad]");
+    bool ok = true;
+    std::vector<WheelFrame> publish_frames;
+    for (size_t t = 0; t < traces.size(); t++){
+        std::vector<WheelFrame> frames;
+        if (!loadTrace(traces[t], frames)){
+            std::fprintf(stderr, "Could not load trace %s\n", traces[t].c_str());
+            ok = false;
+            continue;
+        }
+        const TraceResult r = runTrace(frames, repeats);
+
+        std::string name = traces[t].substr(traces[t].find_last_of('/') + 1);
+        name = name.substr(0, name.find_last_of('.'));
+        std::printf("%-12s %8zu %10.2f %12.4f %10.2f %12.3e %12.3e\n",
+                    name.c_str(), frames.size(), r.ns_per_update, r.allocations_per_update,
+                    r.distance, r.position_drift, r.yaw_drift);
+        if (r.allocations_per_update > 0.0) ok = false;
+        publish_frames.insert(publish_frames.end(), frames.begin(), frames.end());
+    }
+    if (publish_frames.empty()) return 1;
+
+    //Publish path over all the traces
+    struct PublishCase
+    {
+        const char* message;
+        const char* subscribers;
+        bool preallocated;
+        bool intra_process;
+    };
+    const PublishCase cases[] = {
+        {"fresh", "serialized", false, false},
+        {"preallocated", "serialized", true, false},
+        {"fresh", "intra-process", false, true},
+        {"preallocated", "intra-process", true, true},
+    };
+    std::printf("\n%-14s %-14s %12s %14s\n", "message", "subscribers", "ns/publish", "allocs/publish");
+    for (const PublishCase& c : cases){
+        const PublishResult p = runPublish(publish_frames, repeats / 10 + 1, c.preallocated, c.intra_process);
+        std::printf("%-14s %-14s %12.2f %14.4f\n", c.message, c.subscribers, p.ns_per_publish, p.allocations_per_publish);
+        //Reused message: no allocation unless a subscriber holds it
+        if (c.preallocated && !c.intra_process && p.allocations_per_publish > 0.0) ok = false;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,209 @@
+//==========================================================
+//  Benchmark of the rosserial bridge transport
+//
+//  ROS-free, on the protocol and serial link of the
+//  rosserial_bridge:
+//    - frame parsing throughput on a stream of wheel
+//      feedback frames, clean and with one corrupted byte in
+//      1% of the frames, with the frames recovered
+//    - round trip of a command frame and its 28-byte
+//      feedback frame over a pty, to an echo thread, with
+//      the epoll wait of the bridge and with the 1 ms polling
+//      of rosserial_python's SerialClient.run, as median,
+//      p90, p99 and max
+//  The pty has no baud rate: on the robot, the 57600 baud
+//  wire time of the two frames comes on top of both.
+//
+//  The full bridge against serial_node.py, through ROS, is
+//  measured with launch/rosserial_bridge_latency.launch.
+//
+//  Usage: rosrun sml_nexus_robot rosserial_bridge_benchmark [-n round_trips]
+//==========================================================
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include "sml_nexus_robot/rosserial_protocol.h"
+#include "sml_nexus_robot/serial_link.h"
+
+namespace rosserial = sml_nexus_robot::rosserial;
+using Clock = std::chrono::steady_clock;
+
+static const uint16_t COMMAND_TOPIC = 100;
+static const uint16_t FEEDBACK_TOPIC = 125;
+
+//sml_nexus_msgs/WheelFeedback payload
+static void feedbackPayload(uint16_t seq, std::vector<uint8_t>& out){
+    out.clear();
+    rosserial::Writer writer(out);
+    writer.write<uint16_t>(seq);
+    writer.write<uint16_t>(20000);
+    for (int k = 0; k < 8; k++) writer.write<int16_t>(static_cast<int16_t>(seq * (k + 1)));
+}
+
+//=====================================================
+//  Frames/s and MB/s of the parser over the stream,
+//  fed in chunks as the reads of the bridge
+//=====================================================
+static void parseStream(const char* name, const std::vector<uint8_t>& stream, size_t frames, size_t chunk){
+    const int repeats = 20;
+    unsigned long parsed = 0, checksum_errors = 0, skipped = 0;
+    unsigned long payload_sum = 0;
+    const Clock::time_point start = Clock::now();
+    for (int r = 0; r < repeats; r++){
+        rosserial::FrameParser parser;
+        for (size_t i = 0; i < stream.size(); i += chunk){
+            parser.feed(&stream[i], std::min(chunk, stream.size() - i), [&](uint16_t, const uint8_t* data, size_t length){
+                payload_sum += data[0] + length;
+            });
+        }
+        parsed = parser.frames();
+        checksum_errors = parser.checksumErrors() + parser.lengthErrors();
+        skipped = parser.skippedBytes();
+    }
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count() / repeats;
+    volatile unsigned long sink = payload_sum; //keep the handler from being optimized away
+    (void)sink;
+    std::printf("%-22s %12.3g %10.1f %9lu/%-9zu %10lu %10lu\n", name, parsed / elapsed, stream.size() / elapsed / 1e6,
+                parsed, frames, checksum_errors, skipped);
+}
+
+static void benchmarkParser(){
+    const size_t frames = 200000;
+    std::vector<uint8_t> stream, payload;
+    for (size_t i = 0; i < frames; i++){
+        feedbackPayload(static_cast<uint16_t>(i), payload);
+        rosserial::encodeFrame(FEEDBACK_TOPIC, payload.data(), payload.size(), stream);
+    }
+    const size_t frame_size = stream.size() / frames;
+
+    //One random byte of 1% of the frames flipped
+    std::vector<uint8_t> corrupted = stream;
+    std::mt19937 random(1);
+    for (size_t i = 0; i < frames; i++){
+        if (random() % 100 == 0) corrupted[i * frame_size + random() % frame_size] ^= 1 + random() % 255;
+    }
+
+    std::printf("Parser, %zu-byte wheel feedback frames\n", frame_size);
+    std::printf("%-22s %12s %10s %19s %10s %10s\n", "", "frames/s", "MB/s", "frames", "checksum", "skipped");
+    parseStream("clean, 64 B reads", stream, frames, 64);
+    parseStream("clean, 1 B reads", stream, frames, 1);
+    parseStream("1% corrupted", corrupted, frames, 64);
+}
+
+//=====================================================
+//  Echo of the device: every command frame answered
+//  with a feedback frame carrying its seq
+//=====================================================
+static void echoLoop(sml_nexus_robot::SerialLink& link, std::atomic<bool>& running){
+    rosserial::FrameParser parser;
+    std::vector<uint8_t> payload, frame;
+    uint8_t buffer[1024];
+    while (running){
+        if (!link.wait(50)) continue;
+        const ssize_t count = link.read(buffer, sizeof(buffer));
+        if (count <= 0) continue;
+        parser.feed(buffer, count, [&](uint16_t topic, const uint8_t* data, size_t length){
+            if (topic != COMMAND_TOPIC || length < 2) return;
+            uint16_t seq;
+            std::memcpy(&seq, data, sizeof(seq));
+            feedbackPayload(seq, payload);
+            frame.clear();
+            rosserial::encodeFrame(FEEDBACK_TOPIC, payload.data(), payload.size(), frame);
+            link.write(frame.data(), frame.size());
+        });
+    }
+}
+
+//Round trips in us, waiting for bytes with epoll or by polling every 1 ms
+static std::vector<double> roundTrips(sml_nexus_robot::SerialLink& link, int count, bool polling){
+    rosserial::FrameParser parser;
+    std::vector<uint8_t> frame;
+    std::vector<double> round_trips;
+    uint8_t buffer[1024];
+    for (int i = 0; i < count; i++){
+        const uint16_t seq = static_cast<uint16_t>(i);
+        const int16_t command[3] = {static_cast<int16_t>(seq), 0, 0};
+        frame.clear();
+        rosserial::encodeFrame(COMMAND_TOPIC, reinterpret_cast<const uint8_t*>(command), sizeof(command), frame);
+
+        const Clock::time_point start = Clock::now();
+        link.write(frame.data(), frame.size());
+        bool received = false;
+        while (!received){
+            if (polling){
+                //SerialClient.run: sleep 1 ms while nothing is waiting
+                int waiting = 0;
+                ioctl(link.fd(), FIONREAD, &waiting);
+                if (waiting < 1){
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    continue;
+                }
+            }
+            else if (!link.wait(1000)) break;
+            const ssize_t bytes = link.read(buffer, sizeof(buffer));
+            if (bytes <= 0) continue;
+            parser.feed(buffer, bytes, [&](uint16_t topic, const uint8_t* data, size_t){
+                uint16_t echoed;
+                std::memcpy(&echoed, data, sizeof(echoed));
+                if (topic == FEEDBACK_TOPIC && echoed == seq) received = true;
+            });
+        }
+        if (received) round_trips.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+    return round_trips;
+}
+
+static void printRoundTrips(const char* name, std::vector<double> round_trips, int count){
+    if (round_trips.empty()){
+        std::printf("%-22s no echo\n", name);
+        return;
+    }
+    std::sort(round_trips.begin(), round_trips.end());
+    const size_t n = round_trips.size();
+    std::printf("%-22s %6zu/%-6d %10.1f %10.1f %10.1f %10.1f\n", name, n, count, round_trips[n / 2],
+                round_trips[n * 9 / 10], round_trips[n * 99 / 100], round_trips.back());
+}
+
+static bool benchmarkRoundTrip(int count){
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0){
+        std::perror("posix_openpt");
+        return false;
+    }
+    sml_nexus_robot::SerialLink device, host;
+    if (!device.attach(master, 0) || !host.open(ptsname(master), 0)){
+        std::fprintf(stderr, "pty: %s%s\n", device.error().c_str(), host.error().c_str());
+        return false;
+    }
+    std::atomic<bool> running(true);
+    std::thread echo(echoLoop, std::ref(device), std::ref(running));
+
+    std::printf("\nRound trip over a pty, 14-byte command and 28-byte feedback frames (57600 baud wire time %.1f ms)\n",
+                (14 + 28) * 10 / 57.6);
+    std::printf("%-22s %13s %10s %10s %10s %10s\n", "", "echoes", "median us", "p90 us", "p99 us", "max us");
+    roundTrips(host, 100, false); //warm up
+    printRoundTrips("epoll (bridge)", roundTrips(host, count, false), count);
+    printRoundTrips("1 ms polling (python)", roundTrips(host, count, true), count);
+
+    running = false;
+    device.wake();
+    echo.join();
+    return true;
+}
+
+int main(int argc, char** argv){
+    int round_trips = 5000;
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) round_trips = std::atoi(argv[++i]);
+    }
+    benchmarkParser();
+    return benchmarkRoundTrip(std::max(1, round_trips)) ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+#ifndef SML_NEXUS_ROBOT_FEEDFORWARD_IDENTIFICATION_H
+#define SML_NEXUS_ROBOT_FEEDFORWARD_IDENTIFICATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <Eigen/Dense>
+
+namespace sml_nexus_robot
+{
+
+//=======================================================
+//   Identification of the wheel controller feedforward
+//   from an open-loop PWM sweep
+//
+//  For a wheel speed setpoint v, the firmware commands
+//  the polynomial sum_i c_i |v|^i (i = 0..4, constant
+//  term first, feedforward_XX) and never less than
+//  min_cmd_XX. Each step of the sweep gives the steady
+//  speed of the four wheels (UL, UR, LL, LR) at one PWM
+//  command. Per wheel:
+//    - min_cmd is halfway between the last command at
+//      which the wheel stood still and the first one at
+//      which it moved, rounded up
+//    - the polynomial is the least squares fit of the PWM
+//      commands against the speeds of the moving steps,
+//      solved with a Householder QR of their Vandermonde
+//      matrix
+//=======================================================
+class FeedforwardIdentification
+{
+public:
+    enum { TERMS = 5 };
+
+    struct WheelFit
+    {
+        double coefficients[TERMS]; //constant term first
+        int min_cmd;
+        double rms_error;           //PWM, over the fitted steps
+        int steps;                  //moving steps fitted
+        bool valid;
+    };
+
+    //Speeds below moving_speed (m/s) count as standing still
+    explicit FeedforwardIdentification(double moving_speed = 0.005)
+        : moving_speed_(moving_speed)
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        steps_.clear();
+        for (int i = 0; i < 4; i++){
+            fits_[i] = WheelFit();
+            fits_[i].valid = false;
+        }
+    }
+
+    //Steady wheel speeds UL, UR, LL, LR in m/s at one PWM command,
+    //either direction
+    void addStep(double pwm, const double speed[4])
+    {
+        Step step;
+        step.pwm = std::abs(pwm);
+        for (int i = 0; i < 4; i++) step.speed[i] = std::abs(speed[i]);
+        steps_.push_back(step);
+    }
+
+    size_t steps() const { return steps_.size(); }
+    const WheelFit& wheel(int i) const { return fits_[i]; }
+
+    //Fit the four wheels, true if all of them could be fitted
+    bool fit()
+    {
+        std::stable_sort(steps_.begin(), steps_.end(), [](const Step& a, const Step& b){ return a.pwm < b.pwm; });
+        bool valid = true;
+        for (int i = 0; i < 4; i++) valid = fitWheel(i) && valid;
+        return valid;
+    }
+
+private:
+    struct Step
+    {
+        double pwm;
+        double speed[4];
+    };
+
+    bool fitWheel(int wheel)
+    {
+        WheelFit& fit = fits_[wheel];
+        fit.valid = false;
+
+        //First moving step, the wheel is then assumed to keep moving
+        size_t first = 0;
+        while (first < steps_.size() && steps_[first].speed[wheel] < moving_speed_) first++;
+        const int n = static_cast<int>(steps_.size() - first);
+        fit.steps = n;
+        if (n < TERMS) return false;
+
+        const double moving_pwm = steps_[first].pwm;
+        const double still_pwm = first > 0 ? steps_[first - 1].pwm : moving_pwm;
+        fit.min_cmd = static_cast<int>(std::ceil(0.5 * (still_pwm + moving_pwm)));
+
+        Eigen::VectorXd speed(n), pwm(n);
+        for (int k = 0; k < n; k++){
+            speed(k) = steps_[first + k].speed[wheel];
+            pwm(k) = steps_[first + k].pwm;
+        }
+        Eigen::MatrixXd vandermonde(n, TERMS);
+        vandermonde.col(0).setOnes();
+        for (int j = 1; j < TERMS; j++) vandermonde.col(j) = vandermonde.col(j - 1).cwiseProduct(speed);
+
+        const Eigen::VectorXd c = vandermonde.householderQr().solve(pwm);
+        for (int j = 0; j < TERMS; j++) fit.coefficients[j] = c(j);
+        fit.rms_error = std::sqrt((vandermonde * c - pwm).squaredNorm() / n);
+        fit.valid = true;
+        return true;
+    }
+
+    double moving_speed_;
+    std::vector<Step> steps_;
+    WheelFit fits_[4];
+};
+
+} // namespace sml_nexus_robot
+
+#endif // SML_NEXUS_ROBOT_FEEDFORWARD_IDENTIFICATION_H
@@ -0,0 +1,130 @@
+#ifndef SML_NEXUS_ROBOT_ODOMETRY_BROADCASTER_H
+#define SML_NEXUS_ROBOT_ODOMETRY_BROADCASTER_H
+
+#include <ros/ros.h>
+#include <ros/time.h>
+#include "std_msgs/Float32MultiArray.h"
+#include "sml_nexus_msgs/WheelVelocityStamped.h"
+#include "sml_nexus_msgs/WheelFeedback.h"
+#include "sml_nexus_msgs/WheelSlip.h"
+#include "nav_msgs/Odometry.h"
+#include "diagnostic_msgs/DiagnosticArray.h"
+#include <tf2_ros/transform_broadcaster.h>
+#include <geometry_msgs/TransformStamped.h>
+#include "sml_nexus_robot/planar_odometry.h"
+#include "sml_nexus_kinematics.h"
+
+//==========================================================
+//  Wheel odometry for the nexus robot. Used both by the
+//  standalone odometry_broadcaster node and by the
+//  sml_nexus_robot/OdometryBroadcaster nodelet, which
+//  share the node handle they are constructed with.
+//
+//  Feedback is integrated as it arrives. odom and TF are
+//  published with every sample, or, with publish_rate > 0,
+//  from a timer with the latest sample so that raising the
+//  feedback rate does not flood /tf.
+//
+//  The slip residual of the four wheel speeds is checked on
+//  every sample. Above slip_threshold the odom covariances
+//  are inflated and, with slip_downweight, the wheel that
+//  departs most from the previous twist is trusted less.
+//==========================================================
+class SmlNexusOdometryBroadcaster
+{
+public:
+    SmlNexusOdometryBroadcaster(ros::NodeHandle& nh, ros::NodeHandle& private_nh);
+    ~SmlNexusOdometryBroadcaster();
+private:
+    //Wheel feedback topics, by priority: the same samples are published on
+    //several of them, only the highest priority one received is integrated
+    enum WheelSource { NONE = 0, LEGACY = 1, STAMPED = 2, COMPACT = 3 };
+    bool acceptWheelSource(WheelSource source);
+
+    void wheelVelCallback(const std_msgs::Float32MultiArray& msg);
+    void wheelVelStampedCallback(const sml_nexus_msgs::WheelVelocityStamped& msg);
+    void wheelFeedbackCallback(const sml_nexus_msgs::WheelFeedback& msg);
+
+    void runOdometry(const float& ULWheelVel,
+                     const float& URWheelVel,
+                     const float& LLWheelVel,
+                     const float& LRWheelVel,
+                     const float& time_interval_ms,
+                     const ros::Time& time_stamp,
+                     const float* measured_wheel_vel = nullptr); //UL, UR, LL, LR speeds for the published twist instead of the integrated ones
+    sml_nexus_robot::PlanarTwist computeTwist(const float wheel_vel[4]) const;
+    void publishOdometry();
+    void publishCallback(const ros::TimerEvent& event);
+    void diagnosticsCallback(const ros::TimerEvent& event);
+
+    //ROS variables
+    //=============
+    void getParams(ros::NodeHandle& nh_, ros::NodeHandle& private_nh_);
+    void setSubAndPub(ros::NodeHandle& nh_);
+    std::string ns; //Parameters namespace
+    //Subscriber and publishers
+    ros::Subscriber feedback_sub;
+    ros::Subscriber stamped_feedback_sub;
+    ros::Subscriber compact_feedback_sub;
+    ros::Publisher odom_pub;
+    ros::Publisher diagnostics_pub;
+    ros::Publisher slip_pub;
+    ros::Timer publish_timer;
+    ros::Timer diagnostics_timer;
+    tf2_ros::TransformBroadcaster transform_broadcaster;
+
+    //Output policy
+    double publish_rate;          //Hz, 0 to publish with every feedback sample
+    bool publish_tf;              //false to publish odom only
+    sml_nexus_robot::PlanarTwist sample_twist; //twist of the latest sample
+    ros::Time sample_stamp;       //time stamp of the latest sample
+    bool sample_pending = false;  //latest sample not published yet
+
+    //Slip detection and covariances
+    double slip_threshold;        //m/s, slip residual above which the wheels are not trusted
+    double slip_covariance_scale; //covariance inflation while slipping
+    bool slip_downweight;         //trust the slipping wheel less
+    double slip_wheel_weight;     //least-squares weight of the slipping wheel
+    double wheel_speed_std;       //m/s, standard deviation of one wheel speed
+    int slip_wheel = -1;          //wheel down-weighted on the latest sample, -1 for none
+    double slip_residual = 0.0;   //m/s, largest residual magnitude since the last publish
+    double twist_variance[3] = {0.0, 0.0, 0.0}; //vx, vy, wz of the latest sample
+    double pose_variance[3] = {0.0, 0.0, 0.0};  //x, y, yaw, accumulated
+    sml_nexus_msgs::WheelSlip slip_msg;
+
+    //Counters reported on diagnostics
+    unsigned long sample_count = 0;   //feedback samples integrated
+    unsigned long rejected_count = 0; //feedback samples not integrated: gaps, stamps back in time, bad intervals
+    unsigned long odom_count = 0;
+    unsigned long tf_count = 0;
+    unsigned long slip_count = 0;     //feedback samples over slip_threshold
+    unsigned long last_sample_count = 0;
+    unsigned long last_odom_count = 0;
+    unsigned long last_tf_count = 0;
+    ros::Time last_diagnostics;
+
+    //Planar dead-reckoning state
+    sml_nexus_robot::PlanarOdometry odometry{nexusGeometry<nexusMecanum2x>::wheelbase()}; //robot wheelbase in meters, kept equal to kinematics
+    ros::Time last_received_data;
+    ros::Time time_now;
+    bool init = false;
+    WheelSource wheel_source = NONE; //Feedback topic integrated, lower priority ones are ignored
+
+    //Kinematics shared with the firmware, with the calibrated lever arm and travel per tick
+    mecanumKinematics<double> kinematics;
+
+    //Compact feedback decoding
+    uint16_t feedback_dt = 0;     //us, interval of the latest feedback
+    double feedback_rate = 0.0;   //1/s, its reciprocal, recomputed when the interval changes
+    double max_device_time_lag;   //s, reanchor the reconstructed device clock past this lag
+    ros::Time device_time;        //device clock reconstructed from the feedback dt
+    uint16_t last_feedback_seq = 0;
+    static const int16_t max_reordered_feedback = 16; //sequence steps back skipped as duplicates, larger ones resync
+    unsigned long dropped_feedback = 0;
+    nav_msgs::Odometry odom_msg;  //constant fields of the published odometry
+    nav_msgs::OdometryPtr odom_out; //message filled and published, reallocated only while a subscriber holds it
+    geometry_msgs::TransformStamped odom_transform;
+
+};
+
+#endif // SML_NEXUS_ROBOT_ODOMETRY_BROADCASTER_H
@@ -0,0 +1,116 @@
+#ifndef SML_NEXUS_ROBOT_ODOMETRY_CALIBRATION_H
+#define SML_NEXUS_ROBOT_ODOMETRY_CALIBRATION_H
+
+#include <cmath>
+#include <Eigen/Core>
+
+namespace sml_nexus_robot
+{
+
+//=======================================================
+//   Recursive least squares calibration of the wheel
+//   odometry against ground truth displacements
+//
+//  Parameters: the radius scale of each wheel (UL, UR,
+//  LL, LR) and the effective wheelbase b, as used by
+//  PlanarOdometry (half the lever arm L1 + L2 of the
+//  firmware). For a window in which the wheels travel
+//  d_i (m, as measured) and the base turns by dyaw and
+//  moves by dx, dy (the chord, in the base frame at the
+//  middle of the window, scaled up to the arc length by
+//  1/sinc(dyaw/2)), constant twist kinematics give three
+//  equations linear in (s_UL, s_UR, s_LL, s_LR, b):
+//
+//    ( s0 d0 + s1 d1 + s2 d2 + s3 d3) / 4 = dx
+//    (-s0 d0 + s1 d1 + s2 d2 - s3 d3) / 4 = dy
+//    (-s0 d0 + s1 d1 - s2 d2 + s3 d3) - 8 b dyaw = 0
+//
+//  Each is fed to the estimator as a scalar RLS update,
+//  weighted by its noise: constant memory and time per
+//  window, no matter how long the recording.
+//=======================================================
+class OdometryCalibration
+{
+public:
+    static const int N = 5;
+    typedef Eigen::Matrix<double, N, 1> Parameters;
+    typedef Eigen::Matrix<double, N, N> Covariance;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    //Prior: nominal wheelbase, unit scales, with their standard deviations
+    explicit OdometryCalibration(double nominal_wheelbase = 0.15,
+                                 double scale_std = 0.05,
+                                 double wheelbase_std = 0.02,
+                                 double forgetting_factor = 1.0)
+        : lambda(forgetting_factor), nominal_wheelbase_(nominal_wheelbase), windows_(0)
+    {
+        theta_ << 1.0, 1.0, 1.0, 1.0, nominal_wheelbase;
+        P_.setZero();
+        P_.diagonal().head<4>().setConstant(scale_std * scale_std);
+        P_(4, 4) = wheelbase_std * wheelbase_std;
+    }
+
+    //=============================================
+    //  One window: wheel travels UL, UR, LL, LR in
+    //  m, base displacement in the base frame at the
+    //  start of the window and rotation, with their
+    //  standard deviations
+    //=============================================
+    void addWindow(const double travel[4], double start_dx, double start_dy, double dyaw,
+                   double position_std, double yaw_std)
+    {
+        //Chord in the middle frame, to arc length
+        const double half = 0.5 * dyaw;
+        const double sinc = std::abs(half) < 1e-4 ? 1.0 - half * half / 6.0 : std::sin(half) / half;
+        const double c = std::cos(half) / sinc;
+        const double s = std::sin(half) / sinc;
+        const double dx = c * start_dx + s * start_dy;
+        const double dy = -s * start_dx + c * start_dy;
+
+        const double* d = travel;
+        Parameters h;
+
+        h << d[0] / 4, d[1] / 4, d[2] / 4, d[3] / 4, 0.0;
+        update(h, dx, position_std);
+
+        h << -d[0] / 4, d[1] / 4, d[2] / 4, -d[3] / 4, 0.0;
+        update(h, dy, position_std);
+
+        //Rotation equation divided by 8 b, in rad: its noise is the yaw noise
+        const double k = 1.0 / (8.0 * nominal_wheelbase_);
+        h << -d[0] * k, d[1] * k, -d[2] * k, d[3] * k, -dyaw / nominal_wheelbase_;
+        update(h, 0.0, yaw_std);
+
+        windows_++;
+    }
+
+    double wheelScale(int wheel) const { return theta_(wheel); }
+    double wheelbase() const { return theta_(4); }
+    double wheelScaleStd(int wheel) const { return std::sqrt(P_(wheel, wheel)); }
+    double wheelbaseStd() const { return std::sqrt(P_(4, 4)); }
+    unsigned long windows() const { return windows_; }
+
+    double lambda; //forgetting factor, 1 to weigh all windows alike
+
+private:
+    void update(const Parameters& h, double y, double noise_std)
+    {
+        const double r = noise_std * noise_std;
+        const Parameters Ph = P_ * h;
+        const double s = lambda * r + h.dot(Ph);
+        const Parameters k = Ph / s;
+        theta_ += k * (y - h.dot(theta_));
+        P_ = (P_ - k * Ph.transpose()) / lambda;
+        P_ = 0.5 * (P_ + P_.transpose()).eval(); //keep symmetric
+    }
+
+    Parameters theta_;
+    Covariance P_;
+    double nominal_wheelbase_;
+    unsigned long windows_;
+};
+
+} // namespace sml_nexus_robot
+
+#endif // SML_NEXUS_ROBOT_ODOMETRY_CALIBRATION_H
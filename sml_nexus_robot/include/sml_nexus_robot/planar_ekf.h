@@ -0,0 +1,199 @@
+#ifndef SML_NEXUS_ROBOT_PLANAR_EKF_H
+#define SML_NEXUS_ROBOT_PLANAR_EKF_H
+
+#include <cmath>
+#include <Eigen/Core>
+#include <Eigen/Cholesky>
+#include "sml_nexus_robot/planar_odometry.h"
+
+namespace sml_nexus_robot
+{
+
+//=======================================================
+//   Extended Kalman filter for the mecanum base
+//
+//  State: x, y, yaw in the world frame, vx, vy, wz in
+//  the base link frame. Constant velocity motion model,
+//  velocities driven by white acceleration noise. The
+//  pose also drifts with the distance the wheels travel,
+//  which covers the wheel radius errors and the slip that
+//  white wheel speed noise does not: averaged over many
+//  updates, it would leave the filter overconfident.
+//
+//  Measurements:
+//   - wheel velocities, mapped to the base twist
+//   - absolute pose (motion capture)
+//   - yaw rate (IMU gyro)
+//
+//  Fixed-size Eigen matrices only: no heap allocation
+//  in predict() or the updates, and no ROS types.
+//=======================================================
+class PlanarEkf
+{
+public:
+    static const int N = 6;
+    typedef Eigen::Matrix<double, N, 1> State;
+    typedef Eigen::Matrix<double, N, N> Covariance;
+    typedef Eigen::Matrix<double, 3, 1> Vector3;
+    typedef Eigen::Matrix<double, 3, 3> Matrix3;
+
+    enum Index { X = 0, Y = 1, YAW = 2, VX = 3, VY = 4, WZ = 5 };
+
+    struct Noise
+    {
+        double linear_acceleration;  //m/s^2, standard deviation of the velocity random walk
+        double angular_acceleration; //rad/s^2
+        double wheel_speed;          //m/s, standard deviation of one wheel speed
+        double travel_position;      //m/sqrt(m), position drift per square root of the distance travelled
+        double travel_yaw;           //rad/sqrt(m), yaw drift per square root of the distance travelled
+    };
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    explicit PlanarEkf(double robot_wheelbase = 0.15)
+        : wheelbase(robot_wheelbase)
+    {
+        noise.linear_acceleration = 1.0;
+        noise.angular_acceleration = 3.0;
+        noise.wheel_speed = 0.01;
+        noise.travel_position = 0.025;
+        noise.travel_yaw = 0.02;
+        reset();
+    }
+
+    void reset(const Vector3& pose = Vector3::Zero(), const Vector3& pose_std = Vector3::Constant(1e-3))
+    {
+        state_.setZero();
+        state_.head<3>() = pose;
+        covariance_.setZero();
+        covariance_.diagonal().head<3>() = pose_std.cwiseProduct(pose_std);
+        covariance_.diagonal().tail<3>().setConstant(1e-2);
+    }
+
+    //=============================================
+    //  Propagate the state over dt seconds
+    //=============================================
+    void predict(double dt)
+    {
+        if (dt <= 0.0) return;
+        const double c = std::cos(state_(YAW));
+        const double s = std::sin(state_(YAW));
+        const double vx = state_(VX);
+        const double vy = state_(VY);
+
+        state_(X) += (c * vx - s * vy) * dt;
+        state_(Y) += (s * vx + c * vy) * dt;
+        state_(YAW) = PlanarOdometry::wrapAngle(state_(YAW) + state_(WZ) * dt);
+
+        //Jacobian of the motion model
+        Covariance F = Covariance::Identity();
+        F(X, YAW) = (-s * vx - c * vy) * dt;
+        F(X, VX) = c * dt;
+        F(X, VY) = -s * dt;
+        F(Y, YAW) = (c * vx - s * vy) * dt;
+        F(Y, VX) = s * dt;
+        F(Y, VY) = c * dt;
+        F(YAW, WZ) = dt;
+
+        //Velocity random walk, integrated into the pose
+        const double ql = noise.linear_acceleration * noise.linear_acceleration;
+        const double qa = noise.angular_acceleration * noise.angular_acceleration;
+        Covariance Q = Covariance::Zero();
+        const double dt2 = dt * dt;
+        const double dt3 = dt2 * dt / 3.0;
+        Q(X, X) = Q(Y, Y) = ql * dt3;
+        Q(YAW, YAW) = qa * dt3;
+        Q(VX, VX) = Q(VY, VY) = ql * dt;
+        Q(WZ, WZ) = qa * dt;
+        Q(X, VX) = Q(VX, X) = Q(Y, VY) = Q(VY, Y) = 0.5 * ql * dt2;
+        Q(YAW, WZ) = Q(WZ, YAW) = 0.5 * qa * dt2;
+
+        //Drift with the distance travelled by the wheels, in translation
+        //and with the rotation of the base
+        const double travel = (std::sqrt(vx * vx + vy * vy) + 2.0 * wheelbase * std::fabs(state_(WZ))) * dt;
+        Q(X, X) += noise.travel_position * noise.travel_position * travel;
+        Q(Y, Y) += noise.travel_position * noise.travel_position * travel;
+        Q(YAW, YAW) += noise.travel_yaw * noise.travel_yaw * travel;
+
+        covariance_ = F * covariance_ * F.transpose() + Q;
+    }
+
+    //=============================================
+    //  Wheel velocities, UL, UR, LL, LR in m/s
+    //=============================================
+    void updateWheels(double ul, double ur, double ll, double lr)
+    {
+        //Base twist of the mecanum kinematics, and its covariance
+        //for independent wheel speed errors
+        Eigen::Matrix<double, 3, 4> A;
+        A << 0.25, 0.25, 0.25, 0.25,
+             -0.25, 0.25, 0.25, -0.25,
+             -1.0, 1.0, -1.0, 1.0;
+        A.row(2) /= 8.0 * wheelbase;
+        const Eigen::Vector4d wheels(ul, ur, ll, lr);
+        const Vector3 z = A * wheels;
+        const Matrix3 R = noise.wheel_speed * noise.wheel_speed * A * A.transpose();
+
+        Eigen::Matrix<double, 3, N> H = Eigen::Matrix<double, 3, N>::Zero();
+        H.block<3, 3>(0, VX) = Matrix3::Identity();
+        const Vector3 innovation = z - state_.tail<3>();
+        update(H, innovation, R);
+    }
+
+    //=============================================
+    //  Absolute pose x, y, yaw and its covariance
+    //=============================================
+    void updatePose(const Vector3& pose, const Matrix3& R)
+    {
+        Eigen::Matrix<double, 3, N> H = Eigen::Matrix<double, 3, N>::Zero();
+        H.block<3, 3>(0, X) = Matrix3::Identity();
+        Vector3 innovation = pose - state_.head<3>();
+        innovation(2) = PlanarOdometry::wrapAngle(innovation(2));
+        update(H, innovation, R);
+    }
+
+    //=============================================
+    //  Yaw rate in rad/s and its variance
+    //=============================================
+    void updateYawRate(double wz, double variance)
+    {
+        Eigen::Matrix<double, 1, N> H = Eigen::Matrix<double, 1, N>::Zero();
+        H(0, WZ) = 1.0;
+        Eigen::Matrix<double, 1, 1> innovation, R;
+        innovation(0) = wz - state_(WZ);
+        R(0) = variance;
+        update(H, innovation, R);
+    }
+
+    const State& state() const { return state_; }
+    const Covariance& covariance() const { return covariance_; }
+
+    //Orientation as a unit quaternion about z, (z, w) components
+    double quaternionZ() const { return std::sin(0.5 * state_(YAW)); }
+    double quaternionW() const { return std::cos(0.5 * state_(YAW)); }
+
+    Noise noise;
+    double wheelbase; //robot wheelbase in meters
+
+private:
+    //Joseph form, which keeps the covariance symmetric positive definite
+    template <int M>
+    void update(const Eigen::Matrix<double, M, N>& H,
+                const Eigen::Matrix<double, M, 1>& innovation,
+                const Eigen::Matrix<double, M, M>& R)
+    {
+        const Eigen::Matrix<double, M, M> S = H * covariance_ * H.transpose() + R;
+        const Eigen::Matrix<double, N, M> K = S.ldlt().solve(H * covariance_).transpose();
+        state_ += K * innovation;
+        state_(YAW) = PlanarOdometry::wrapAngle(state_(YAW));
+        const Covariance I_KH = Covariance::Identity() - K * H;
+        covariance_ = I_KH * covariance_ * I_KH.transpose() + K * R * K.transpose();
+    }
+
+    State state_;
+    Covariance covariance_;
+};
+
+} // namespace sml_nexus_robot
+
+#endif // SML_NEXUS_ROBOT_PLANAR_EKF_H
@@ -0,0 +1,344 @@
+#ifndef SML_NEXUS_ROBOT_PLANAR_ODOMETRY_H
+#define SML_NEXUS_ROBOT_PLANAR_ODOMETRY_H
+
+#include <cmath>
+#include <limits>
+#include <string>
+
+namespace sml_nexus_robot
+{
+
+//====================================
+//   Compact planar (SE(2)) states
+//====================================
+template <typename Scalar>
+struct BasicPlanarTwist
+{
+    Scalar vx; //m/s, base link frame
+    Scalar vy; //m/s, base link frame
+    Scalar wz; //rad/s
+};
+
+template <typename Scalar>
+struct BasicPlanarPose
+{
+    Scalar x;   //m, odom frame
+    Scalar y;   //m, odom frame
+    Scalar yaw; //rad, wrapped to [-pi, pi]
+};
+
+typedef BasicPlanarTwist<double> PlanarTwist;
+typedef BasicPlanarPose<double> PlanarPose;
+
+//=======================================================
+//  Pose integration over one feedback interval
+//   - ARC: constant twist over the interval, straight
+//     line below 0.0001 rad/s (the original integrator)
+//   - EXACT: constant twist through the SE(2)
+//     exponential map, with a series expansion for
+//     small rotations instead of a threshold
+//   - RK4: twist varying linearly from the previous
+//     sample to the current one, fourth-order Runge-Kutta
+//=======================================================
+enum class PoseIntegrator { ARC, EXACT, RK4 };
+
+inline bool parsePoseIntegrator(const std::string& name, PoseIntegrator& integrator)
+{
+    if (name == "arc") integrator = PoseIntegrator::ARC;
+    else if (name == "exact") integrator = PoseIntegrator::EXACT;
+    else if (name == "rk4") integrator = PoseIntegrator::RK4;
+    else return false;
+    return true;
+}
+
+//=======================================================
+//   Dead-reckoning integrator for the mecanum base
+//
+//  Plain data only: no ROS types, no heap allocation,
+//  so it can be driven from the wheel velocity callback
+//  and from ROS-free benchmarks alike. Templated on the
+//  scalar type so that float can be weighed against
+//  double on the robot computers.
+//=======================================================
+template <typename Scalar>
+class BasicPlanarOdometry
+{
+public:
+    typedef BasicPlanarTwist<Scalar> Twist;
+    typedef BasicPlanarPose<Scalar> Pose;
+
+    explicit BasicPlanarOdometry(Scalar robot_wheelbase = Scalar(0.15),
+                                 PoseIntegrator pose_integrator = PoseIntegrator::ARC)
+        : integrator(pose_integrator)
+    {
+        setWheelbase(robot_wheelbase);
+        reset();
+    }
+
+    //Robot wheelbase (L1 + L2)/2 in meters, with the inverse computeVel multiplies by
+    void setWheelbase(Scalar robot_wheelbase)
+    {
+        wheelbase_ = robot_wheelbase;
+        inv_eight_wheelbase_ = Scalar(1) / (Scalar(8) * robot_wheelbase);
+    }
+    Scalar wheelbase() const { return wheelbase_; }
+
+    void reset()
+    {
+        pose_.x = 0;
+        pose_.y = 0;
+        pose_.yaw = 0;
+        twist_.vx = 0;
+        twist_.vy = 0;
+        twist_.wz = 0;
+        has_twist_ = false;
+    }
+
+    //======================================
+    //    Compute velocity in base link frame
+    //======================================
+    Twist computeVel(Scalar ULWheelVel, Scalar URWheelVel, Scalar LLWheelVel, Scalar LRWheelVel) const
+    {
+        Twist vel;
+        vel.vx = Scalar(0.25) * (ULWheelVel + URWheelVel + LLWheelVel + LRWheelVel);
+        vel.vy = Scalar(0.25) * (- ULWheelVel + URWheelVel + LLWheelVel - LRWheelVel);
+        vel.wz = inv_eight_wheelbase_ * (- ULWheelVel + URWheelVel - LLWheelVel + LRWheelVel);
+        return vel;
+    }
+
+    //=====================================================
+    //  Motion over timeSeconds, expressed in the base link
+    //  frame at the start of the interval
+    //=====================================================
+    Pose computeRelativeMotion(const Twist& vel, Scalar timeSeconds) const
+    {
+        Pose rel_motion;
+        rel_motion.yaw = 0;
+
+        if (std::abs(vel.wz) < Scalar(0.0001)) {
+            //----------------
+            // Drive straight
+            //----------------
+            rel_motion.x = vel.vx * timeSeconds;
+            rel_motion.y = vel.vy * timeSeconds;
+        } else {
+            //---------------------
+            // Follow circular arc
+            //---------------------
+            // Rotating the chord of the arc by the drive direction is
+            // the same as applying the arc's [sin, 1-cos] map to (dx, dy)
+            const Scalar distX = vel.vx * timeSeconds;
+            const Scalar distY = vel.vy * timeSeconds;
+            const Scalar angleChange = vel.wz * timeSeconds;
+            const Scalar a = std::sin(angleChange) / angleChange;
+            const Scalar b = (Scalar(1) - std::cos(angleChange)) / angleChange;
+
+            rel_motion.x = a * distX - b * distY;
+            rel_motion.y = b * distX + a * distY;
+            rel_motion.yaw = angleChange;
+        }
+        return rel_motion;
+    }
+
+    //=====================================================
+    //  SE(2) exponential map of the twist over timeSeconds.
+    //  Below the series threshold, sin(t)/t and
+    //  (1-cos(t))/t lose digits to cancellation and are
+    //  taken from their Taylor series instead, truncated
+    //  where the next term is under the scalar epsilon
+    //=====================================================
+    static Pose computeExactMotion(const Twist& vel, Scalar timeSeconds)
+    {
+        const Scalar distX = vel.vx * timeSeconds;
+        const Scalar distY = vel.vy * timeSeconds;
+        const Scalar angleChange = vel.wz * timeSeconds;
+        Scalar a, b;
+        if (std::abs(angleChange) < seriesThreshold()) {
+            const Scalar t2 = angleChange * angleChange;
+            a = Scalar(1) - t2 / Scalar(6) * (Scalar(1) - t2 / Scalar(20));
+            b = angleChange / Scalar(2) * (Scalar(1) - t2 / Scalar(12) * (Scalar(1) - t2 / Scalar(30)));
+        } else {
+            a = std::sin(angleChange) / angleChange;
+            b = (Scalar(1) - std::cos(angleChange)) / angleChange;
+        }
+
+        Pose rel_motion;
+        rel_motion.x = a * distX - b * distY;
+        rel_motion.y = b * distX + a * distY;
+        rel_motion.yaw = angleChange;
+        return rel_motion;
+    }
+
+    //=====================================================
+    //  Fourth-order Runge-Kutta of the pose, the twist
+    //  going linearly from previous to current over
+    //  timeSeconds
+    //=====================================================
+    static Pose computeRK4Motion(const Twist& previous, const Twist& current, Scalar timeSeconds)
+    {
+        const Scalar h = timeSeconds;
+        Twist middle;
+        middle.vx = Scalar(0.5) * (previous.vx + current.vx);
+        middle.vy = Scalar(0.5) * (previous.vy + current.vy);
+        middle.wz = Scalar(0.5) * (previous.wz + current.wz);
+
+        //Heading along the interval, at the RK4 stages
+        const Scalar yaw2 = Scalar(0.5) * h * previous.wz;
+        const Scalar yaw3 = Scalar(0.5) * h * middle.wz;
+        const Scalar yaw4 = h * middle.wz;
+        const Scalar c2 = std::cos(yaw2), s2 = std::sin(yaw2);
+        const Scalar c3 = std::cos(yaw3), s3 = std::sin(yaw3);
+        const Scalar c4 = std::cos(yaw4), s4 = std::sin(yaw4);
+
+        Pose rel_motion;
+        rel_motion.x = h / Scalar(6) * (previous.vx
+                                        + Scalar(2) * (c2 * middle.vx - s2 * middle.vy)
+                                        + Scalar(2) * (c3 * middle.vx - s3 * middle.vy)
+                                        + (c4 * current.vx - s4 * current.vy));
+        rel_motion.y = h / Scalar(6) * (previous.vy
+                                        + Scalar(2) * (s2 * middle.vx + c2 * middle.vy)
+                                        + Scalar(2) * (s3 * middle.vx + c3 * middle.vy)
+                                        + (s4 * current.vx + c4 * current.vy));
+        rel_motion.yaw = h * middle.wz;
+        return rel_motion;
+    }
+
+    //=====================================================
+    //  Wheel speeds of a base twist, UL, UR, LL, LR
+    //=====================================================
+    void computeWheelVel(const Twist& vel, Scalar wheels[4]) const
+    {
+        const Scalar l = Scalar(2) * wheelbase_ * vel.wz;
+        wheels[0] = vel.vx - vel.vy - l;
+        wheels[1] = vel.vx + vel.vy + l;
+        wheels[2] = vel.vx + vel.vy - l;
+        wheels[3] = vel.vx - vel.vy + l;
+    }
+
+    //=====================================================
+    //  Four wheel speeds for three base velocities: the
+    //  columns of the kinematics are orthogonal, so
+    //  computeVel is already the least-squares twist, and
+    //  what it leaves out is the component of the wheel
+    //  speeds along (1, 1, -1, -1). No rigid motion of the
+    //  base produces it: it is the slip residual, in m/s
+    //=====================================================
+    Scalar computeSlipResidual(Scalar ULWheelVel, Scalar URWheelVel, Scalar LLWheelVel, Scalar LRWheelVel) const
+    {
+        return (ULWheelVel + URWheelVel - LLWheelVel - LRWheelVel) / Scalar(4);
+    }
+
+    //=====================================================
+    //  Weighted least-squares twist, to trust some wheels
+    //  less than others. Solves the 3x3 normal equations
+    //  by Cramer's rule; needs three wheels with non-zero
+    //  weights
+    //=====================================================
+    Twist computeWeightedVel(const Scalar wheels[4], const Scalar weights[4]) const
+    {
+        const Scalar L = Scalar(2) * wheelbase_;
+        const Scalar A[4][3] = {{1, -1, -L}, {1, 1, L}, {1, 1, -L}, {1, -1, L}};
+        Scalar N[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+        Scalar b[3] = {0, 0, 0};
+        for (int k = 0; k < 4; k++) {
+            for (int i = 0; i < 3; i++) {
+                b[i] += weights[k] * A[k][i] * wheels[k];
+                for (int j = 0; j < 3; j++) N[i][j] += weights[k] * A[k][i] * A[k][j];
+            }
+        }
+        const Scalar det = N[0][0] * (N[1][1] * N[2][2] - N[1][2] * N[2][1])
+                         - N[0][1] * (N[1][0] * N[2][2] - N[1][2] * N[2][0])
+                         + N[0][2] * (N[1][0] * N[2][1] - N[1][1] * N[2][0]);
+        Scalar t[3];
+        for (int c = 0; c < 3; c++) {
+            Scalar M[3][3];
+            for (int i = 0; i < 3; i++) {
+                for (int j = 0; j < 3; j++) M[i][j] = (j == c) ? b[i] : N[i][j];
+            }
+            t[c] = (M[0][0] * (M[1][1] * M[2][2] - M[1][2] * M[2][1])
+                  - M[0][1] * (M[1][0] * M[2][2] - M[1][2] * M[2][0])
+                  + M[0][2] * (M[1][0] * M[2][1] - M[1][1] * M[2][0])) / det;
+        }
+        Twist vel;
+        vel.vx = t[0];
+        vel.vy = t[1];
+        vel.wz = t[2];
+        return vel;
+    }
+
+    //=============================================
+    //  Integrate one wheel velocity sample into the
+    //  odometry pose
+    //=============================================
+    void computeOdometry(Scalar ULWheelVel,
+                         Scalar URWheelVel,
+                         Scalar LLWheelVel,
+                         Scalar LRWheelVel,
+                         Scalar time_interval_ms)
+    {
+        integrateTwist(computeVel(ULWheelVel, URWheelVel, LLWheelVel, LRWheelVel), time_interval_ms);
+    }
+
+    //=============================================
+    //  Integrate one base twist sample into the
+    //  odometry pose
+    //=============================================
+    void integrateTwist(const Twist& vel, Scalar time_interval_ms)
+    {
+        const Twist previous = has_twist_ ? twist_ : vel;
+        twist_ = vel;
+        has_twist_ = true;
+
+        const Scalar dt = time_interval_ms / Scalar(1000);
+        Pose rel;
+        switch (integrator) {
+        case PoseIntegrator::EXACT: rel = computeExactMotion(twist_, dt); break;
+        case PoseIntegrator::RK4: rel = computeRK4Motion(previous, twist_, dt); break;
+        default: rel = computeRelativeMotion(twist_, dt); break;
+        }
+
+        //Rotate relative translation to odometry frame of reference
+        const Scalar c = std::cos(pose_.yaw);
+        const Scalar s = std::sin(pose_.yaw);
+        pose_.x += c * rel.x - s * rel.y;
+        pose_.y += s * rel.x + c * rel.y;
+        pose_.yaw = wrapAngle(pose_.yaw + rel.yaw);
+    }
+
+    const Pose& pose() const { return pose_; }
+    const Twist& twist() const { return twist_; }
+
+    //Orientation as a unit quaternion about z, (z, w) components
+    Scalar quaternionZ() const { return std::sin(Scalar(0.5) * pose_.yaw); }
+    Scalar quaternionW() const { return std::cos(Scalar(0.5) * pose_.yaw); }
+
+    static Scalar wrapAngle(Scalar angle)
+    {
+        if (angle > Scalar(M_PI)) angle -= Scalar(2.0 * M_PI);
+        else if (angle < -Scalar(M_PI)) angle += Scalar(2.0 * M_PI);
+        return angle;
+    }
+
+    //Rotation per step under which computeExactMotion uses the series:
+    //t^6/5040, the first term left out, is below epsilon
+    static Scalar seriesThreshold()
+    {
+        static const Scalar threshold = std::pow(Scalar(5040) * std::numeric_limits<Scalar>::epsilon(), Scalar(1) / Scalar(6));
+        return threshold;
+    }
+
+    PoseIntegrator integrator;
+
+private:
+    Scalar wheelbase_;           //robot wheelbase in meters
+    Scalar inv_eight_wheelbase_; //1/(8 wheelbase), 1/m
+    Pose pose_;
+    Twist twist_;
+    bool has_twist_; //twist_ holds the previous sample
+};
+
+typedef BasicPlanarOdometry<double> PlanarOdometry;
+
+} // namespace sml_nexus_robot
+
+#endif // SML_NEXUS_ROBOT_PLANAR_ODOMETRY_H
@@ -0,0 +1,116 @@
+#ifndef SML_NEXUS_ROBOT_ROSSERIAL_BRIDGE_H
+#define SML_NEXUS_ROBOT_ROSSERIAL_BRIDGE_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ros/ros.h>
+#include <topic_tools/shape_shifter.h>
+#include "diagnostic_msgs/DiagnosticArray.h"
+#include "sml_nexus_robot/rosserial_protocol.h"
+#include "sml_nexus_robot/serial_link.h"
+
+//==========================================================
+//  rosserial host side for the low-level controller, in
+//  place of rosserial_python's serial_node.py. Used both
+//  by the standalone rosserial_bridge node and by the
+//  sml_nexus_robot/RosserialBridge nodelet, which share the
+//  node handle they are constructed with.
+//
+//  A reader thread waits on the tty with epoll, and
+//  publishes every frame as soon as it is parsed, in the
+//  thread that read it. The topics of the firmware are
+//  deserialized straight into their message types, in
+//  messages that are reused unless a subscriber in the
+//  same nodelet manager still holds them. Other types are
+//  passed through as serialized messages. Topics to the
+//  device are forwarded in their serialized form, without
+//  deserializing them.
+//
+//  Like serial_node.py, the bridge requests the topics of
+//  the device, answers its time and parameter requests,
+//  forwards its logs to rosout, and requests the topics
+//  again when the device stays silent for sync_timeout.
+//==========================================================
+class SmlNexusRosserialBridge
+{
+public:
+    SmlNexusRosserialBridge(ros::NodeHandle& nh, ros::NodeHandle& private_nh);
+    ~SmlNexusRosserialBridge();
+
+    //Device publisher, published to ROS
+    class Publication
+    {
+    public:
+        virtual ~Publication() {}
+        //False if the data does not deserialize
+        virtual bool publish(const uint8_t* data, size_t length) = 0;
+        std::string topic;
+        std::string type;
+    };
+
+private:
+    //Device subscriber, subscribed to in ROS
+    struct Subscription
+    {
+        ros::Subscriber sub;
+        std::string topic;
+        std::string type;
+        std::string md5sum;
+    };
+
+    void readLoop();
+    bool reconnect();
+    void handleFrame(uint16_t topic, const uint8_t* data, size_t length);
+    void setupPublisher(const uint8_t* data, size_t length);
+    void setupSubscriber(const uint8_t* data, size_t length);
+    void handleTimeRequest();
+    void handleParameterRequest(const uint8_t* data, size_t length);
+    void handleLog(const uint8_t* data, size_t length);
+    void subscriptionCallback(const topic_tools::ShapeShifter::ConstPtr& msg, uint16_t topic_id, const std::string& md5sum);
+    void requestTopics();
+    bool sendFrame(uint16_t topic, const uint8_t* data, size_t length);
+    void diagnosticsCallback(const ros::TimerEvent& event);
+
+    ros::NodeHandle nh;
+    std::string ns; //Parameters namespace
+    ros::Publisher diagnostics_pub;
+    ros::Timer diagnostics_timer;
+
+    //Serial link
+    std::string port;
+    int baud;
+    double sync_timeout;          //s, silence after which the topics are requested again
+    sml_nexus_robot::SerialLink link;
+    sml_nexus_robot::rosserial::FrameParser parser;
+    std::thread reader;
+    std::atomic<bool> running;
+
+    //Topics, by device topic id. Only the reader thread changes them.
+    std::map<uint16_t, std::shared_ptr<Publication> > publications;
+    std::map<uint16_t, std::shared_ptr<Subscription> > subscriptions;
+
+    //Frames to the device, from the reader and the subscriber callbacks
+    std::mutex write_mutex;
+    std::vector<uint8_t> write_buffer;
+    std::vector<uint8_t> message_buffer;
+
+    //Handshake, in the reader thread
+    ros::WallTime last_received;
+    ros::WallTime last_topic_request;
+    bool service_warned = false;
+
+    //Statistics, for the diagnostics
+    std::atomic<unsigned long> frames_in, frames_out, bytes_in, write_errors, deserialization_errors;
+    std::atomic<unsigned long> checksum_errors, dropped_bytes, unknown_frames, topic_requests;
+    std::atomic<bool> synced;     //device topics received
+    std::atomic<bool> connected;  //port open
+    unsigned long last_frames_in = 0, last_frames_out = 0, last_bytes_in = 0;
+    ros::Time last_diagnostics;
+};
+
+#endif // SML_NEXUS_ROBOT_ROSSERIAL_BRIDGE_H
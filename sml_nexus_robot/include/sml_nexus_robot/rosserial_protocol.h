@@ -0,0 +1,304 @@
+#ifndef SML_NEXUS_ROBOT_ROSSERIAL_PROTOCOL_H
+#define SML_NEXUS_ROBOT_ROSSERIAL_PROTOCOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace sml_nexus_robot
+{
+namespace rosserial
+{
+
+//==========================================================
+//  rosserial protocol (version 2, Hydro and newer), as
+//  spoken by rosserial_arduino on the low-level controller.
+//
+//  A frame is
+//    0xFF 0xFE  len_L len_H  len_checksum  topic_L topic_H
+//    data[len]  checksum
+//  with len_checksum = 255 - (len_L + len_H) % 256 and
+//  checksum = 255 - (topic_L + topic_H + sum(data)) % 256.
+//  The data is the ROS serialization of the message.
+//
+//  Plain data only, shared by the rosserial_bridge, the
+//  firmware stand-in and ROS-free benchmarks.
+//==========================================================
+enum TopicId
+{
+    ID_PUBLISHER = 0,          //TopicInfo of a device publisher, or a topic request from the host
+    ID_SUBSCRIBER = 1,         //TopicInfo of a device subscriber
+    ID_SERVICE_SERVER = 2,
+    ID_SERVICE_CLIENT = 4,
+    ID_PARAMETER_REQUEST = 6,  //RequestParam request from the device, response from the host
+    ID_LOG = 7,
+    ID_TIME = 10,              //Time request from the device, time from the host
+    ID_TX_STOP = 11            //The host stops
+};
+
+//Log levels of rosserial_msgs/Log
+enum LogLevel {LOG_DEBUG = 0, LOG_INFO = 1, LOG_WARN = 2, LOG_ERROR = 3, LOG_FATAL = 4};
+
+static const uint8_t SYNC_FLAG = 0xFF;
+static const uint8_t PROTOCOL_VERSION = 0xFE;
+static const size_t FRAME_OVERHEAD = 8;
+
+//=============================================
+//  Append the frame of a message to out
+//=============================================
+inline void encodeFrame(uint16_t topic, const uint8_t* data, size_t length, std::vector<uint8_t>& out)
+{
+    const size_t start = out.size();
+    out.resize(start + FRAME_OVERHEAD + length);
+    uint8_t* frame = &out[start];
+    frame[0] = SYNC_FLAG;
+    frame[1] = PROTOCOL_VERSION;
+    frame[2] = length & 0xFF;
+    frame[3] = (length >> 8) & 0xFF;
+    frame[4] = 255 - ((frame[2] + frame[3]) % 256);
+    frame[5] = topic & 0xFF;
+    frame[6] = topic >> 8;
+    unsigned int sum = frame[5] + frame[6];
+    for (size_t i = 0; i < length; i++){
+        frame[7 + i] = data[i];
+        sum += data[i];
+    }
+    frame[7 + length] = 255 - (sum % 256);
+}
+
+//=============================================
+//  Byte stream to frames. Bytes are fed as they
+//  are read, each complete frame with valid
+//  checksums goes to the handler as (topic,
+//  data, length), the data pointing into the
+//  parser until the handler returns. Anything
+//  else is skipped up to the next sync flag.
+//=============================================
+class FrameParser
+{
+public:
+    explicit FrameParser(size_t max_length = 2048)
+        : max_length_(max_length), state_(SYNC), length_(0), topic_(0), sum_(0),
+          frames_(0), checksum_errors_(0), length_errors_(0), skipped_bytes_(0)
+    {
+        data_.reserve(max_length);
+    }
+
+    template <typename Handler>
+    void feed(const uint8_t* bytes, size_t count, Handler&& handler)
+    {
+        for (size_t i = 0; i < count; i++){
+            const uint8_t byte = bytes[i];
+            switch (state_){
+                case SYNC:
+                    if (byte == SYNC_FLAG) state_ = VERSION;
+                    else skipped_bytes_++;
+                    break;
+                case VERSION:
+                    if (byte == PROTOCOL_VERSION) state_ = LENGTH_L;
+                    //The previous flag was not a sync, this one may be
+                    else if (byte == SYNC_FLAG) skipped_bytes_++;
+                    else{
+                        skipped_bytes_ += 2;
+                        state_ = SYNC;
+                    }
+                    break;
+                case LENGTH_L:
+                    length_ = byte;
+                    sum_ = byte;
+                    state_ = LENGTH_H;
+                    break;
+                case LENGTH_H:
+                    length_ |= static_cast<size_t>(byte) << 8;
+                    sum_ += byte;
+                    state_ = LENGTH_CHECKSUM;
+                    break;
+                case LENGTH_CHECKSUM:
+                    if ((sum_ + byte) % 256 != 255){
+                        checksum_errors_++;
+                        state_ = SYNC;
+                    }
+                    else if (length_ > max_length_){
+                        length_errors_++;
+                        state_ = SYNC;
+                    }
+                    else state_ = TOPIC_L;
+                    break;
+                case TOPIC_L:
+                    topic_ = byte;
+                    sum_ = byte;
+                    state_ = TOPIC_H;
+                    break;
+                case TOPIC_H:
+                    topic_ |= static_cast<uint16_t>(byte) << 8;
+                    sum_ += byte;
+                    data_.clear();
+                    state_ = length_ > 0 ? DATA : CHECKSUM;
+                    break;
+                case DATA:{
+                    //Take as much of the data as is there at once
+                    const size_t take = std::min(length_ - data_.size(), count - i);
+                    data_.insert(data_.end(), bytes + i, bytes + i + take);
+                    for (size_t k = 0; k < take; k++) sum_ += bytes[i + k];
+                    i += take - 1;
+                    if (data_.size() == length_) state_ = CHECKSUM;
+                    break;
+                }
+                case CHECKSUM:
+                    state_ = SYNC;
+                    if ((sum_ + byte) % 256 != 255){
+                        checksum_errors_++;
+                        break;
+                    }
+                    frames_++;
+                    handler(topic_, data_.data(), data_.size());
+                    break;
+            }
+        }
+    }
+
+    void reset() { state_ = SYNC; }
+
+    unsigned long frames() const { return frames_; }
+    unsigned long checksumErrors() const { return checksum_errors_; }
+    unsigned long lengthErrors() const { return length_errors_; }
+    unsigned long skippedBytes() const { return skipped_bytes_; }
+
+private:
+    enum State {SYNC, VERSION, LENGTH_L, LENGTH_H, LENGTH_CHECKSUM, TOPIC_L, TOPIC_H, DATA, CHECKSUM};
+
+    size_t max_length_;
+    State state_;
+    size_t length_;
+    uint16_t topic_;
+    unsigned int sum_;
+    std::vector<uint8_t> data_;
+    unsigned long frames_, checksum_errors_, length_errors_, skipped_bytes_;
+};
+
+//=============================================
+//  Little-endian ROS serialization of the few
+//  rosserial_msgs the bridge handles itself.
+//  Reads past the end leave ok() false.
+//=============================================
+class Reader
+{
+public:
+    Reader(const uint8_t* data, size_t length) : data_(data), end_(data + length), ok_(true) {}
+
+    bool ok() const { return ok_; }
+
+    template <typename T>
+    T read()
+    {
+        T value = T();
+        if (!take(sizeof(T))) return value;
+        std::memcpy(&value, data_ - sizeof(T), sizeof(T)); //little-endian hosts only, as roscpp
+        return value;
+    }
+
+    std::string readString()
+    {
+        const uint32_t length = read<uint32_t>();
+        if (!ok_ || !take(length)) return std::string();
+        return std::string(reinterpret_cast<const char*>(data_ - length), length);
+    }
+
+private:
+    bool take(size_t count)
+    {
+        if (static_cast<size_t>(end_ - data_) < count){
+            ok_ = false;
+            return false;
+        }
+        data_ += count;
+        return true;
+    }
+
+    const uint8_t* data_;
+    const uint8_t* end_;
+    bool ok_;
+};
+
+class Writer
+{
+public:
+    explicit Writer(std::vector<uint8_t>& out) : out_(out) {}
+
+    template <typename T>
+    void write(T value)
+    {
+        const size_t start = out_.size();
+        out_.resize(start + sizeof(T));
+        std::memcpy(&out_[start], &value, sizeof(T));
+    }
+
+    void writeString(const std::string& value)
+    {
+        write<uint32_t>(static_cast<uint32_t>(value.size()));
+        out_.insert(out_.end(), value.begin(), value.end());
+    }
+
+private:
+    std::vector<uint8_t>& out_;
+};
+
+//rosserial_msgs/TopicInfo
+struct TopicInfo
+{
+    TopicInfo() : topic_id(0), buffer_size(0) {}
+
+    uint16_t topic_id;
+    std::string topic_name;
+    std::string message_type;
+    std::string md5sum;
+    int32_t buffer_size;
+
+    bool read(const uint8_t* data, size_t length)
+    {
+        Reader reader(data, length);
+        topic_id = reader.read<uint16_t>();
+        topic_name = reader.readString();
+        message_type = reader.readString();
+        md5sum = reader.readString();
+        buffer_size = reader.read<int32_t>();
+        return reader.ok();
+    }
+
+    void write(std::vector<uint8_t>& out) const
+    {
+        Writer writer(out);
+        writer.write<uint16_t>(topic_id);
+        writer.writeString(topic_name);
+        writer.writeString(message_type);
+        writer.writeString(md5sum);
+        writer.write<int32_t>(buffer_size);
+    }
+};
+
+//rosserial_msgs/RequestParam response
+struct ParamResponse
+{
+    std::vector<int32_t> ints;
+    std::vector<float> floats;
+    std::vector<std::string> strings;
+
+    void write(std::vector<uint8_t>& out) const
+    {
+        Writer writer(out);
+        writer.write<uint32_t>(static_cast<uint32_t>(ints.size()));
+        for (size_t i = 0; i < ints.size(); i++) writer.write<int32_t>(ints[i]);
+        writer.write<uint32_t>(static_cast<uint32_t>(floats.size()));
+        for (size_t i = 0; i < floats.size(); i++) writer.write<float>(floats[i]);
+        writer.write<uint32_t>(static_cast<uint32_t>(strings.size()));
+        for (size_t i = 0; i < strings.size(); i++) writer.writeString(strings[i]);
+    }
+};
+
+} // namespace rosserial
+} // namespace sml_nexus_robot
+
+#endif // SML_NEXUS_ROBOT_ROSSERIAL_PROTOCOL_H
@@ -0,0 +1,211 @@
+#ifndef SML_NEXUS_ROBOT_SERIAL_LINK_H
+#define SML_NEXUS_ROBOT_SERIAL_LINK_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <linux/serial.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+
+namespace sml_nexus_robot
+{
+
+//==========================================================
+//  Raw, non-blocking serial port (or pty) with an epoll
+//  wait that wakes up as soon as bytes arrive, or when
+//  another thread calls wake().
+//
+//  The tty is set to 8N1 without flow control or line
+//  processing, and the USB serial drivers that support it
+//  to low latency, so that the bytes are handed over
+//  without the 16 ms batching of some adapters.
+//
+//  Plain POSIX only, shared by the rosserial_bridge, the
+//  firmware stand-in and ROS-free benchmarks.
+//==========================================================
+class SerialLink
+{
+public:
+    SerialLink() : fd_(-1), epoll_fd_(-1), wake_fd_(-1) {}
+    ~SerialLink() { close(); }
+
+    //=============================================
+    //  Open a tty at baud (0 to keep its speed, as
+    //  for a pty), false with error() on failure
+    //=============================================
+    bool open(const std::string& path, int baud)
+    {
+        close();
+        fd_ = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+        if (fd_ < 0) return fail("open " + path);
+        return setup(baud);
+    }
+
+    //Use an open descriptor, e.g. the master side of a pty
+    bool attach(int fd, int baud)
+    {
+        close();
+        fd_ = fd;
+        const int flags = fcntl(fd_, F_GETFL);
+        if (flags < 0 || fcntl(fd_, F_SETFL, flags | O_NONBLOCK) < 0) return fail("fcntl");
+        return setup(baud);
+    }
+
+    void close()
+    {
+        if (epoll_fd_ >= 0) ::close(epoll_fd_);
+        if (wake_fd_ >= 0) ::close(wake_fd_);
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = epoll_fd_ = wake_fd_ = -1;
+    }
+
+    bool isOpen() const { return fd_ >= 0; }
+    int fd() const { return fd_; }
+    const std::string& error() const { return error_; }
+
+    //=============================================
+    //  Wait up to timeout_ms (-1 for ever) for
+    //  bytes. True if there are bytes to read,
+    //  false on timeout, wake() or error.
+    //=============================================
+    bool wait(int timeout_ms)
+    {
+        epoll_event events[2];
+        const int count = epoll_wait(epoll_fd_, events, 2, timeout_ms);
+        bool readable = false;
+        for (int i = 0; i < count; i++){
+            if (events[i].data.fd == wake_fd_){
+                uint64_t value;
+                if (::read(wake_fd_, &value, sizeof(value)) < 0) {} //only clears the wake up
+            }
+            else if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) readable = true;
+        }
+        return readable;
+    }
+
+    //Interrupt a wait() from another thread
+    void wake()
+    {
+        const uint64_t value = 1;
+        if (::write(wake_fd_, &value, sizeof(value)) < 0) {} //already pending
+    }
+
+    //Bytes read, 0 if none is there, -1 if the port is gone
+    ssize_t read(uint8_t* buffer, size_t size)
+    {
+        const ssize_t count = ::read(fd_, buffer, size);
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return 0;
+        if (count == 0) return -1; //hang up
+        return count;
+    }
+
+    //=============================================
+    //  Write all the bytes, waiting up to
+    //  timeout_ms for room in the output buffer
+    //=============================================
+    bool write(const uint8_t* data, size_t size, int timeout_ms = 100)
+    {
+        while (size > 0){
+            const ssize_t count = ::write(fd_, data, size);
+            if (count > 0){
+                data += count;
+                size -= count;
+                continue;
+            }
+            if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+                error_ = std::string("write: ") + std::strerror(errno);
+                return false;
+            }
+            pollfd output = {fd_, POLLOUT, 0};
+            if (poll(&output, 1, timeout_ms) <= 0){
+                error_ = "write timeout";
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    bool setup(int baud)
+    {
+        termios tty;
+        if (tcgetattr(fd_, &tty) == 0){
+            cfmakeraw(&tty);
+            tty.c_cflag |= CLOCAL | CREAD;
+            tty.c_cflag &= ~(CSTOPB | CRTSCTS);
+            tty.c_cc[VMIN] = 0;
+            tty.c_cc[VTIME] = 0;
+            const speed_t speed = baudConstant(baud);
+            if (baud > 0 && speed == B0){
+                close();
+                error_ = "unsupported baud rate";
+                return false;
+            }
+            if (speed != B0){
+                cfsetispeed(&tty, speed);
+                cfsetospeed(&tty, speed);
+            }
+            if (tcsetattr(fd_, TCSANOW, &tty) != 0) return fail("tcsetattr");
+            tcflush(fd_, TCIOFLUSH);
+        }
+
+        //Not all drivers have it, ACM ports are low latency already
+        serial_struct serial;
+        if (ioctl(fd_, TIOCGSERIAL, &serial) == 0){
+            serial.flags |= ASYNC_LOW_LATENCY;
+            ioctl(fd_, TIOCSSERIAL, &serial);
+        }
+
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd_ < 0 || wake_fd_ < 0) return fail("epoll");
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = fd_;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd_, &event) != 0) return fail("epoll_ctl");
+        event.data.fd = wake_fd_;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) != 0) return fail("epoll_ctl");
+        return true;
+    }
+
+    static speed_t baudConstant(int baud)
+    {
+        switch (baud){
+            case 9600: return B9600;
+            case 19200: return B19200;
+            case 38400: return B38400;
+            case 57600: return B57600;
+            case 115200: return B115200;
+            case 230400: return B230400;
+            case 460800: return B460800;
+            case 500000: return B500000;
+            case 921600: return B921600;
+            case 1000000: return B1000000;
+            default: return B0;
+        }
+    }
+
+    bool fail(const std::string& what)
+    {
+        error_ = what + ": " + std::strerror(errno);
+        close();
+        return false;
+    }
+
+    int fd_;
+    int epoll_fd_;
+    int wake_fd_;
+    std::string error_;
+};
+
+} // namespace sml_nexus_robot
+
+#endif // SML_NEXUS_ROBOT_SERIAL_LINK_H
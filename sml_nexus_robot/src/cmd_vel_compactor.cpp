@@ -0,0 +1,48 @@
+#include <ros/ros.h>
+#include <algorithm>
+#include <cmath>
+#include "geometry_msgs/Twist.h"
+#include "sml_nexus_msgs/VelocityCommand.h"
+
+//==========================================================
+//  Translates cmd_vel into the compact VelocityCommand
+//  understood by the low-level controller when it is built
+//  with COMPACT_SERIAL_MESSAGES
+//==========================================================
+class SmlNexusCmdVelCompactor
+{
+public:
+    SmlNexusCmdVelCompactor(){
+        ros::NodeHandle nh;
+        cmd_sub = nh.subscribe("cmd_vel", 10, &SmlNexusCmdVelCompactor::cmdVelCallback, this);
+        compact_cmd_pub = nh.advertise<sml_nexus_msgs::VelocityCommand>("cmd_vel_compact", 10);
+    }
+
+private:
+    //Scale to milli-units and saturate to the int16 range
+    static int16_t toMilli(const double& value){
+        const double milli = std::round(value * 1000.0);
+        return static_cast<int16_t>(std::max(-32767.0, std::min(32767.0, milli)));
+    }
+
+    void cmdVelCallback(const geometry_msgs::Twist& msg){
+        compact_cmd.vx = toMilli(msg.linear.x);
+        compact_cmd.vy = toMilli(msg.linear.y);
+        compact_cmd.w = toMilli(msg.angular.z);
+        compact_cmd_pub.publish(compact_cmd);
+    }
+
+    ros::Subscriber cmd_sub;
+    ros::Publisher compact_cmd_pub;
+    sml_nexus_msgs::VelocityCommand compact_cmd;
+};
+
+//==============================
+//             Main
+//==============================
+int main(int argc, char** argv){
+    ros::init(argc, argv, "cmd_vel_compactor");
+    SmlNexusCmdVelCompactor cmd_vel_compactor;
+    ros::spin();
+    return 0;
+}
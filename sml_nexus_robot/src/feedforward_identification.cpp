@@ -0,0 +1,567 @@
+#include <ros/ros.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include "std_msgs/Float32MultiArray.h"
+#include "sml_nexus_msgs/WheelVelocityStamped.h"
+#include "sml_nexus_msgs/WheelFeedback.h"
+#include "sml_nexus_robot/feedforward_identification.h"
+
+using sml_nexus_robot::FeedforwardIdentification;
+
+static const char* wheel_names[4] = {"UL", "UR", "LL", "LR"};
+
+//==========================================================
+//  Sweep logs: one step per line, PWM command then the
+//  speeds of UL, UR, LL and LR in m/s. Lines that do not
+//  start with five numbers (headers, comments) are skipped
+//==========================================================
+static bool loadCsvLog(const std::string& path, FeedforwardIdentification& identification, std::string& error){
+    std::ifstream file(path.c_str());
+    if (!file){
+        error = "could not open " + path;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)){
+        for (size_t i = 0; i < line.size(); i++){
+            if (line[i] == ',' || line[i] == ';' || line[i] == '\t') line[i] = ' ';
+        }
+        std::istringstream fields(line);
+        double pwm, speed[4];
+        if (fields >> pwm >> speed[0] >> speed[1] >> speed[2] >> speed[3]) identification.addStep(pwm, speed);
+    }
+    return true;
+}
+
+//==========================================================
+//  Minimal reader of the MATLAB v5 files written by
+//  nexus_robot_pwm_logger.m: log_pwm, a numeric vector, and
+//  log_vel, an array of std_msgs/Float32MultiArray objects.
+//  MATLAB saves the properties of such objects as structs
+//  in the subsystem data of the file, in the order of the
+//  array; their Data fields are read in that order. A
+//  numeric log_vel (steps x 4) is read as well.
+//==========================================================
+namespace mat
+{
+
+enum DataType { miINT8 = 1, miUINT8, miINT16, miUINT16, miINT32, miUINT32, miSINGLE,
+                miDOUBLE = 9, miINT64 = 12, miUINT64, miMATRIX, miCOMPRESSED };
+enum ArrayClass { mxCELL = 1, mxSTRUCT = 2, mxCHAR = 4, mxDOUBLE = 6, mxUINT64 = 15, mxOPAQUE = 17 };
+
+struct Array
+{
+    int array_class = 0;
+    std::string name;
+    std::vector<double> values;      //numeric arrays, column-major
+    std::vector<std::string> fields; //struct arrays
+    std::vector<Array> children;     //cell elements, struct fields, opaque content
+};
+
+struct Element
+{
+    uint32_t type;
+    const uint8_t* data;
+    uint32_t size;
+};
+
+class Reader
+{
+public:
+    Reader(const uint8_t* data, size_t size) : p_(data), end_(data + size) {}
+
+    bool next(Element& element){
+        if (end_ - p_ < 8) return false;
+        uint32_t tag[2];
+        std::memcpy(tag, p_, 8);
+        if (tag[0] >> 16){
+            //Small data element, up to 4 bytes packed in the tag
+            element.type = tag[0] & 0xFFFF;
+            element.size = tag[0] >> 16;
+            element.data = p_ + 4;
+            p_ += 8;
+            return element.size <= 4;
+        }
+        element.type = tag[0];
+        element.size = tag[1];
+        element.data = p_ + 8;
+        if (static_cast<size_t>(end_ - element.data) < element.size) return false;
+        //Compressed elements are not padded
+        const size_t padded = element.type == miCOMPRESSED ? element.size : (element.size + 7) / 8 * 8;
+        p_ = element.data + std::min(padded, static_cast<size_t>(end_ - element.data));
+        return true;
+    }
+
+private:
+    const uint8_t* p_;
+    const uint8_t* end_;
+};
+
+static bool inflateElement(const Element& element, std::vector<uint8_t>& out){
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) return false;
+    stream.next_in = const_cast<Bytef*>(element.data);
+    stream.avail_in = element.size;
+    out.clear();
+    int status = Z_OK;
+    while (status == Z_OK){
+        const size_t done = out.size();
+        out.resize(done + 65536);
+        stream.next_out = out.data() + done;
+        stream.avail_out = 65536;
+        status = ::inflate(&stream, Z_NO_FLUSH);
+        out.resize(done + 65536 - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    return status == Z_STREAM_END;
+}
+
+template <typename T>
+static void appendValues(const Element& element, std::vector<double>& values){
+    const size_t n = element.size / sizeof(T);
+    for (size_t i = 0; i < n; i++){
+        T value;
+        std::memcpy(&value, element.data + i * sizeof(T), sizeof(T));
+        values.push_back(static_cast<double>(value));
+    }
+}
+
+static bool readValues(const Element& element, std::vector<double>& values){
+    switch (element.type){
+    case miINT8: appendValues<int8_t>(element, values); return true;
+    case miUINT8: appendValues<uint8_t>(element, values); return true;
+    case miINT16: appendValues<int16_t>(element, values); return true;
+    case miUINT16: appendValues<uint16_t>(element, values); return true;
+    case miINT32: appendValues<int32_t>(element, values); return true;
+    case miUINT32: appendValues<uint32_t>(element, values); return true;
+    case miSINGLE: appendValues<float>(element, values); return true;
+    case miDOUBLE: appendValues<double>(element, values); return true;
+    case miINT64: appendValues<int64_t>(element, values); return true;
+    case miUINT64: appendValues<uint64_t>(element, values); return true;
+    default: return false;
+    }
+}
+
+static bool parseMatrix(const Element& matrix, Array& array, int depth = 0){
+    if (matrix.size == 0) return true; //empty array
+    if (depth > 16) return false;
+    Reader reader(matrix.data, matrix.size);
+    Element flags, dims, name;
+    if (!reader.next(flags) || flags.size < 8) return false;
+    uint32_t flag_words[2];
+    std::memcpy(flag_words, flags.data, 8);
+    array.array_class = flag_words[0] & 0xFF;
+
+    if (array.array_class == mxOPAQUE){
+        //Name, object system, class name, then the content as a matrix
+        Element type, class_name, content;
+        if (!reader.next(name) || !reader.next(type) || !reader.next(class_name)) return false;
+        array.name.assign(reinterpret_cast<const char*>(name.data), name.size);
+        while (reader.next(content)){
+            if (content.type != miMATRIX) continue;
+            array.children.push_back(Array());
+            if (!parseMatrix(content, array.children.back(), depth + 1)) return false;
+        }
+        return true;
+    }
+
+    if (!reader.next(dims) || !reader.next(name)) return false;
+    array.name.assign(reinterpret_cast<const char*>(name.data), name.size);
+    size_t count = 1;
+    for (uint32_t i = 0; i + 4 <= dims.size; i += 4){
+        int32_t dim;
+        std::memcpy(&dim, dims.data + i, 4);
+        count *= static_cast<size_t>(std::max(dim, 0));
+    }
+
+    if (array.array_class == mxCELL || array.array_class == mxSTRUCT){
+        size_t children = count;
+        if (array.array_class == mxSTRUCT){
+            Element name_length, names;
+            if (!reader.next(name_length) || !reader.next(names) || name_length.size < 4) return false;
+            int32_t length;
+            std::memcpy(&length, name_length.data, 4);
+            if (length <= 0) return false;
+            for (uint32_t i = 0; i + length <= names.size; i += length){
+                const char* field = reinterpret_cast<const char*>(names.data + i);
+                array.fields.push_back(std::string(field, strnlen(field, length)));
+            }
+            children *= array.fields.size();
+        }
+        Element child;
+        for (size_t i = 0; i < children; i++){
+            if (!reader.next(child) || child.type != miMATRIX) return false;
+            array.children.push_back(Array());
+            if (!parseMatrix(child, array.children.back(), depth + 1)) return false;
+        }
+        return true;
+    }
+
+    if (array.array_class >= mxDOUBLE && array.array_class <= mxUINT64){
+        //Real part only
+        Element real;
+        return reader.next(real) && readValues(real, array.values);
+    }
+    return true; //char, sparse, function handles: skipped
+}
+
+//Top-level arrays of a v5 element stream
+static bool parseStream(const uint8_t* data, size_t size, std::vector<Array>& arrays){
+    Reader reader(data, size);
+    Element element;
+    std::vector<uint8_t> inflated;
+    while (reader.next(element)){
+        if (element.type == miCOMPRESSED){
+            if (!inflateElement(element, inflated)) return false;
+            Reader inner(inflated.data(), inflated.size());
+            if (!inner.next(element)) return false;
+        }
+        if (element.type != miMATRIX) continue;
+        arrays.push_back(Array());
+        if (!parseMatrix(element, arrays.back())) return false;
+    }
+    return true;
+}
+
+//Data fields of the structs under array, in file order
+static void collectDataFields(const Array& array, std::vector<const Array*>& data){
+    if (array.array_class == mxSTRUCT && !array.fields.empty()){
+        const size_t n = array.fields.size();
+        for (size_t i = 0; i < array.children.size(); i++){
+            if (array.fields[i % n] == "Data") data.push_back(&array.children[i]);
+            else collectDataFields(array.children[i], data);
+        }
+        return;
+    }
+    for (size_t i = 0; i < array.children.size(); i++) collectDataFields(array.children[i], data);
+}
+
+static const Array* find(const std::vector<Array>& arrays, const std::string& name){
+    for (size_t i = 0; i < arrays.size(); i++){
+        if (arrays[i].name == name) return &arrays[i];
+    }
+    return NULL;
+}
+
+} // namespace mat
+
+static bool loadMatLog(const std::string& path, FeedforwardIdentification& identification, std::string& error){
+    std::ifstream file(path.c_str(), std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (bytes.size() < 128 || bytes[126] != 'I' || bytes[127] != 'M'){
+        error = path + " is not a little-endian MATLAB v5 file";
+        return false;
+    }
+    std::vector<mat::Array> arrays;
+    if (!mat::parseStream(bytes.data() + 128, bytes.size() - 128, arrays)){
+        error = "could not parse " + path;
+        return false;
+    }
+    const mat::Array* log_pwm = mat::find(arrays, "log_pwm");
+    const mat::Array* log_vel = mat::find(arrays, "log_vel");
+    if (!log_pwm || !log_vel || log_pwm->values.empty()){
+        error = path + " has no log_pwm and log_vel";
+        return false;
+    }
+    const size_t n = log_pwm->values.size();
+
+    //Numeric log_vel, steps x 4 or more
+    if (log_vel->values.size() >= 4 * n){
+        for (size_t k = 0; k < n; k++){
+            const double speed[4] = {log_vel->values[k], log_vel->values[n + k], log_vel->values[2 * n + k], log_vel->values[3 * n + k]};
+            identification.addStep(log_pwm->values[k], speed);
+        }
+        return true;
+    }
+
+    //Message objects, saved in the subsystem data: an unnamed uint8
+    //array holding an element stream after an 8 byte header
+    std::vector<mat::Array> objects;
+    for (size_t i = 0; i < arrays.size(); i++){
+        if (!arrays[i].name.empty() || arrays[i].values.size() < 8) continue;
+        const std::vector<double>& values = arrays[i].values;
+        std::vector<uint8_t> subsystem(values.begin(), values.end());
+        mat::parseStream(subsystem.data() + 8, subsystem.size() - 8, objects);
+    }
+    std::vector<const mat::Array*> data;
+    for (size_t i = 0; i < objects.size(); i++) mat::collectDataFields(objects[i], data);
+    if (data.size() < n){
+        error = path + ": found " + std::to_string(data.size()) + " wheel speed messages for " + std::to_string(n) + " PWM commands";
+        return false;
+    }
+    for (size_t k = 0; k < n; k++){
+        if (data[k]->values.size() < 4){
+            error = path + ": wheel speed message with less than 4 values";
+            return false;
+        }
+        identification.addStep(log_pwm->values[k], data[k]->values.data());
+    }
+    return true;
+}
+
+static bool loadLog(const std::string& path, FeedforwardIdentification& identification, std::string& error){
+    if (path.size() > 4 && path.compare(path.size() - 4, 4, ".mat") == 0) return loadMatLog(path, identification, error);
+    return loadCsvLog(path, identification, error);
+}
+
+//==========================================================
+//  Print the fit and write it in the format of
+//  nexus_pid_params.yaml, to be copied to the robot's
+//  PID parameter file
+//==========================================================
+static bool writeFeedforward(const FeedforwardIdentification& identification, const std::string& source, const std::string& path){
+    for (int i = 0; i < 4; i++){
+        const FeedforwardIdentification::WheelFit& fit = identification.wheel(i);
+        if (!fit.valid){
+            std::fprintf(stderr, "%s: %d moving steps, %d needed\n", wheel_names[i], fit.steps, static_cast<int>(FeedforwardIdentification::TERMS));
+            continue;
+        }
+        std::printf("%s: feedforward [%.3f, %.3f, %.2f, %.2f, %.2f], min_cmd %d, %d steps, rms error %.2f PWM\n", wheel_names[i],
+                    fit.coefficients[0], fit.coefficients[1], fit.coefficients[2], fit.coefficients[3], fit.coefficients[4],
+                    fit.min_cmd, fit.steps, fit.rms_error);
+    }
+
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file){
+        std::fprintf(stderr, "Could not write %s\n", path.c_str());
+        return false;
+    }
+    std::fprintf(file, "# Feedforward identification from %zu PWM steps of %s\n", identification.steps(), source.c_str());
+    std::fprintf(file, "# PWM command against |wheel speed| in m/s, constant term first, and smallest moving PWM command\n");
+    for (int i = 0; i < 4; i++){
+        const FeedforwardIdentification::WheelFit& fit = identification.wheel(i);
+        if (!fit.valid) continue;
+        std::fprintf(file, "feedforward_%s: [%.3f, %.3f, %.1f, %.1f, %.1f]\n", wheel_names[i],
+                     fit.coefficients[0], fit.coefficients[1], fit.coefficients[2], fit.coefficients[3], fit.coefficients[4]);
+    }
+    for (int i = 0; i < 4; i++){
+        if (identification.wheel(i).valid) std::fprintf(file, "min_cmd_%s: %d\n", wheel_names[i], identification.wheel(i).min_cmd);
+    }
+    std::fclose(file);
+    std::printf("Written to %s\n", path.c_str());
+    return true;
+}
+
+//==========================================================
+//  PWM sweep through the firmware. Every step, the same
+//  command is sent to the four wheels on cmd_pwm; after
+//  settle_time, the wheel speeds are averaged over
+//  measure_time. The steps are logged to log_file, and the
+//  fit written to output_file once the sweep is over.
+//
+//  Put the robot on a stand, wheels free, before starting.
+//  Velocity commands take over the PWM commands in the
+//  firmware, stop anything publishing on cmd_vel.
+//==========================================================
+class SmlNexusFeedforwardIdentification
+{
+public:
+    SmlNexusFeedforwardIdentification(ros::NodeHandle& nh, ros::NodeHandle& private_nh)
+        : identification(private_nh.param("moving_speed", 0.005))
+    {
+        ns = nh.getNamespace()+"/";
+        if (ns == "//") ns = "";
+        agent = ns.empty() ? std::string("nexus") : ns.substr(1, ns.size() - 2);
+
+        std::vector<double> scales;
+        if (nh.getParam("wheel_scale", scales) && scales.size() == 4){
+            for (int i = 0; i < 4; i++) wheel_scale[i] = scales[i];
+        }
+        const int encoder_cpr = private_nh.param("encoder_cpr", 1536);
+        const double wheel_radius = private_nh.param("wheel_radius", 0.05);
+        tick_to_meters = 2.0 * M_PI * wheel_radius / encoder_cpr;
+
+        pwm_min = private_nh.param("pwm_min", 0);
+        pwm_max = std::min(private_nh.param("pwm_max", 245), 245);
+        pwm_step = std::max(private_nh.param("pwm_step", 5), 1);
+        direction = private_nh.param("direction", 1) < 0 ? -1 : 1;
+        settle_time = private_nh.param("settle_time", 1.5);
+        measure_time = private_nh.param("measure_time", 1.0);
+        const double rate = private_nh.param("rate", 20.0);
+        log_file = private_nh.param("log_file", "feedforward_sweep_" + agent + ".csv");
+        output_file = private_nh.param("output_file", "feedforward_" + agent + ".yaml");
+
+        log_stream = std::fopen(log_file.c_str(), "w");
+        if (log_stream){
+            std::fprintf(log_stream, "# PWM sweep of %s, steady wheel speeds in m/s\n", agent.c_str());
+            std::fprintf(log_stream, "pwm,UL,UR,LL,LR\n");
+        }
+        else{
+            ROS_WARN_STREAM(ns << "Feedforward identification: could not write " << log_file);
+        }
+
+        pwm_pub = nh.advertise<std_msgs::Float32MultiArray>("cmd_pwm", 1);
+        compact_feedback_sub = nh.subscribe("wheel_feedback", 100, &SmlNexusFeedforwardIdentification::wheelFeedbackCallback, this);
+        stamped_feedback_sub = nh.subscribe("wheel_velocity_stamped", 100, &SmlNexusFeedforwardIdentification::wheelVelStampedCallback, this);
+        feedback_sub = nh.subscribe("wheel_velocity", 100, &SmlNexusFeedforwardIdentification::wheelVelCallback, this);
+        sweep_timer = nh.createTimer(ros::Duration(1.0 / rate), &SmlNexusFeedforwardIdentification::sweepCallback, this);
+
+        pwm = pwm_min;
+        step_start = ros::Time::now();
+        ROS_INFO_STREAM(ns << "Feedforward identification: PWM sweep from " << pwm_min << " to " << pwm_max << " in steps of " << pwm_step
+                        << ", " << (settle_time + measure_time) << " s each");
+    }
+
+    ~SmlNexusFeedforwardIdentification(){
+        if (log_stream) std::fclose(log_stream);
+    }
+
+private:
+    enum WheelSource { NONE = 0, LEGACY = 1, STAMPED = 2, COMPACT = 3 };
+
+    //Keep the highest priority wheel feedback topic
+    bool acceptWheelSource(WheelSource source){
+        if (source < wheel_source) return false;
+        if (source > wheel_source){
+            wheel_source = source;
+            resetMeasurement();
+        }
+        return true;
+    }
+
+    //Wheel travel over dt seconds, averaged while measuring
+    void addTravel(const double travel[4], double dt){
+        if (!measuring || dt <= 0.0) return;
+        for (int i = 0; i < 4; i++) measured_travel[i] += travel[i];
+        measured_time += dt;
+    }
+
+    void wheelFeedbackCallback(const sml_nexus_msgs::WheelFeedback& msg){
+        if (!acceptWheelSource(COMPACT) || msg.dt == 0 || msg.dt == 65535) return;
+        double travel[4];
+        for (int i = 0; i < 4; i++) travel[i] = msg.ticks[i] * tick_to_meters * wheel_scale[i];
+        addTravel(travel, msg.dt * 1e-6);
+    }
+
+    void wheelVelStampedCallback(const sml_nexus_msgs::WheelVelocityStamped& msg){
+        if (!acceptWheelSource(STAMPED)) return;
+        const double dt = msg.dt * 1e-3;
+        const double travel[4] = {msg.UL * dt, msg.UR * dt, msg.LL * dt, msg.LR * dt};
+        addTravel(travel, dt);
+    }
+
+    void wheelVelCallback(const std_msgs::Float32MultiArray& msg){
+        if (msg.data.size() != 5 || !acceptWheelSource(LEGACY)) return;
+        const double dt = msg.data[4] * 1e-3;
+        const double travel[4] = {msg.data[0] * dt, msg.data[1] * dt, msg.data[2] * dt, msg.data[3] * dt};
+        addTravel(travel, dt);
+    }
+
+    void resetMeasurement(){
+        for (int i = 0; i < 4; i++) measured_travel[i] = 0.0;
+        measured_time = 0.0;
+    }
+
+    void publishPwm(int command){
+        std_msgs::Float32MultiArray msg;
+        msg.data.assign(4, static_cast<float>(direction * command));
+        pwm_pub.publish(msg);
+    }
+
+    //==========================================================
+    //  Keep the command alive, and step the sweep
+    //==========================================================
+    void sweepCallback(const ros::TimerEvent&){
+        if (done) return;
+        publishPwm(pwm);
+
+        const double elapsed = (ros::Time::now() - step_start).toSec();
+        if (!measuring && elapsed >= settle_time){
+            resetMeasurement();
+            measuring = true;
+        }
+        if (elapsed < settle_time + measure_time) return;
+        measuring = false;
+
+        if (measured_time <= 0.0){
+            ROS_WARN_STREAM_THROTTLE(5.0, ns << "Feedforward identification: no wheel feedback at PWM " << pwm << ", waiting");
+            step_start = ros::Time::now();
+            return;
+        }
+        double speed[4];
+        for (int i = 0; i < 4; i++) speed[i] = measured_travel[i] / measured_time;
+        identification.addStep(pwm, speed);
+        if (log_stream){
+            std::fprintf(log_stream, "%d,%.5f,%.5f,%.5f,%.5f\n", direction * pwm, speed[0], speed[1], speed[2], speed[3]);
+            std::fflush(log_stream);
+        }
+        ROS_INFO("%sFeedforward identification: PWM %d, wheel speeds [%.3f, %.3f, %.3f, %.3f] m/s",
+                 ns.c_str(), direction * pwm, speed[0], speed[1], speed[2], speed[3]);
+
+        pwm += pwm_step;
+        step_start = ros::Time::now();
+        if (pwm <= pwm_max) return;
+
+        //Sweep over: stop the wheels and fit
+        done = true;
+        publishPwm(0);
+        identification.fit();
+        writeFeedforward(identification, "the sweep of " + agent, output_file);
+        ros::shutdown();
+    }
+
+    std::string ns;
+    std::string agent;
+    ros::Publisher pwm_pub;
+    ros::Subscriber compact_feedback_sub;
+    ros::Subscriber stamped_feedback_sub;
+    ros::Subscriber feedback_sub;
+    ros::Timer sweep_timer;
+
+    FeedforwardIdentification identification;
+    WheelSource wheel_source = NONE;
+    double wheel_scale[4] = {1.0, 1.0, 1.0, 1.0};
+    double tick_to_meters;
+
+    //Sweep
+    int pwm_min, pwm_max, pwm_step, direction;
+    double settle_time, measure_time;
+    int pwm = 0;
+    ros::Time step_start;
+    bool measuring = false;
+    bool done = false;
+    double measured_travel[4] = {0.0, 0.0, 0.0, 0.0};
+    double measured_time = 0.0;
+
+    std::string log_file;
+    std::string output_file;
+    FILE* log_stream = NULL;
+};
+
+//==============================
+//             Main
+//==============================
+int main(int argc, char** argv){
+    //Offline: fit a sweep log, no ROS master needed
+    std::vector<std::string> args;
+    ros::removeROSArgs(argc, argv, args);
+    if (args.size() >= 2){
+        FeedforwardIdentification identification;
+        std::string error;
+        if (!loadLog(args[1], identification, error)){
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        const bool valid = identification.fit();
+        const std::string output = args.size() >= 3 ? args[2] : "feedforward.yaml";
+        if (!writeFeedforward(identification, args[1], output)) return 1;
+        return valid ? 0 : 1;
+    }
+
+    ros::init(argc, argv, "feedforward_identification");
+    ros::NodeHandle nh;
+    ros::NodeHandle private_nh("~");
+    SmlNexusFeedforwardIdentification feedforward_identification(nh, private_nh);
+    ros::spin();
+    return 0;
+}
@@ -0,0 +1,388 @@
+#include <ros/ros.h>
+#include <ros/master.h>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include "std_msgs/Float32MultiArray.h"
+#include "sml_nexus_msgs/WheelVelocityStamped.h"
+#include "sml_nexus_msgs/WheelFeedback.h"
+#include "nav_msgs/Odometry.h"
+#include <tf2_ros/transform_broadcaster.h>
+#include <geometry_msgs/TransformStamped.h>
+#include "sml_nexus_robot/planar_odometry.h"
+#include "sml_nexus_kinematics.h"
+
+//==========================================================
+//  Wheel odometry for a whole fleet in one process.
+//
+//  Robots are the namespaces listed in ~robots, or, when
+//  the list is empty, the namespaces publishing wheel
+//  feedback, discovered from the master every
+//  discovery_period seconds. Each robot gets the same
+//  subscribers and <robot>/odom as an odometry_broadcaster
+//  running in its namespace. The planar states of all the
+//  robots sit in one array, the callbacks are serviced by
+//  an AsyncSpinner, and the odom to base_link transforms
+//  updated since the last cycle go out in a single
+//  TFMessage at publish_rate.
+//==========================================================
+class SmlNexusFleetOdometryServer
+{
+public:
+    SmlNexusFleetOdometryServer(ros::NodeHandle& nh, ros::NodeHandle& private_nh)
+        : nh(nh), private_nh(private_nh){
+        max_robots = private_nh.param("max_robots", 32);
+        const double publish_rate = private_nh.param("publish_rate", 50.0);
+        const double discovery_period = private_nh.param("discovery_period", 2.0);
+        max_device_time_lag = private_nh.param("max_device_time_lag", 0.1);
+        const std::string integrator_name = private_nh.param("integrator", std::string("arc"));
+        if (!sml_nexus_robot::parsePoseIntegrator(integrator_name, integrator)){
+            ROS_WARN_STREAM("Fleet odometry server: unknown integrator " << integrator_name << ", using arc");
+        }
+
+        //Fixed capacity: callbacks hold indices into these arrays
+        //while the discovery adds robots
+        odometry.assign(max_robots, sml_nexus_robot::PlanarOdometry(nexusGeometry<nexusMecanum2x>::wheelbase()));
+        robots.reset(new Robot[max_robots]);
+        transforms.reserve(max_robots);
+
+        std::vector<std::string> robot_names;
+        private_nh.getParam("robots", robot_names);
+        for (size_t i = 0; i < robot_names.size(); i++) addRobot(robot_names[i]);
+        if (robot_names.empty()){
+            ROS_INFO_STREAM("Fleet odometry server: no robots listed, discovering wheel feedback topics every " << discovery_period << " sec");
+            discovery_timer = nh.createTimer(ros::Duration(discovery_period), &SmlNexusFleetOdometryServer::discoveryCallback, this);
+        }
+
+        publish_timer = nh.createTimer(ros::Duration(1.0 / publish_rate), &SmlNexusFleetOdometryServer::publishCallback, this);
+    }
+
+private:
+    static const int16_t max_reordered_feedback = 16; //sequence steps back skipped as duplicates, larger ones resync
+
+    //Wheel feedback topics, by priority, as in the odometry broadcaster
+    enum WheelSource { NONE = 0, LEGACY = 1, STAMPED = 2, COMPACT = 3 };
+
+    //Feedback bookkeeping of one robot, same as in the odometry broadcaster
+    struct Robot
+    {
+        std::mutex lock;              //the feedback topics of one robot may be serviced concurrently
+        std::string ns;
+        ros::Subscriber feedback_sub;
+        ros::Subscriber stamped_feedback_sub;
+        ros::Subscriber compact_feedback_sub;
+        ros::Publisher odom_pub;
+        nav_msgs::Odometry odom_msg;  //constant fields of the published odometry
+        nav_msgs::OdometryPtr odom_out; //message filled and published, reused while no subscriber holds it
+
+        ros::Time last_received_data;
+        ros::Time stamp;              //time of the latest odometry sample
+        bool init = false;
+        WheelSource wheel_source = NONE; //feedback topic integrated, lower priority ones are ignored
+        bool updated = false;         //new sample since the last TF cycle
+
+        mecanumKinematics<double> kinematics; //calibrated lever arm and travel per tick, shared with the firmware
+        uint16_t feedback_dt = 0;     //us, interval feedback_rate was computed for
+        double feedback_rate = 0.0;   //Hz
+        ros::Time device_time;
+        uint16_t last_feedback_seq = 0;
+        unsigned long dropped_feedback = 0;
+    };
+
+    //=======================================
+    //  Subscribe to the feedback of a robot
+    //=======================================
+    void addRobot(const std::string& name){
+        const std::string ns = ros::names::resolve(name);
+        const size_t count = robot_count.load();
+        for (size_t i = 0; i < count; i++){
+            if (robots[i].ns == ns + "/") return;
+        }
+        if (count == static_cast<size_t>(max_robots)){
+            ROS_WARN_STREAM_ONCE("Fleet odometry server: max_robots (" << max_robots << ") reached, ignoring " << ns);
+            return;
+        }
+
+        //Per robot parameters under ~<robot>/, fleet-wide defaults under ~
+        const std::string robot_param = ns.substr(1) + "/";
+        ros::NodeHandle robot_nh(ns);
+        const int encoder_cpr = private_nh.param(robot_param + "encoder_cpr",
+                                                 private_nh.param("encoder_cpr", static_cast<int>(nexusMecanum2x::encoderCPR())));
+        const double wheel_radius = private_nh.param(robot_param + "wheel_radius",
+                                                     private_nh.param("wheel_radius", nexusMecanum2x::wheelRadius()));
+
+        //Robot geometry, from the calibration file loaded in the robot namespace
+        //as for the odometry broadcaster, private values first
+        const double wheelbase = private_nh.param(robot_param + "wheelbase",
+                                                  robot_nh.param("wheelbase", private_nh.param("wheelbase", nexusGeometry<nexusMecanum2x>::wheelbase())));
+        double wheel_scale[4] = {1.0, 1.0, 1.0, 1.0};
+        std::vector<double> scales;
+        if (private_nh.getParam(robot_param + "wheel_scale", scales) || robot_nh.getParam("wheel_scale", scales)){
+            if (scales.size() == 4){
+                for (int i = 0; i < 4; i++) wheel_scale[i] = scales[i];
+            }
+            else{
+                ROS_WARN_STREAM(ns << "/Fleet odometry server: wheel_scale needs 4 values, ignoring it");
+            }
+        }
+
+        Robot& robot = robots[count];
+        robot.ns = ns + "/";
+        mecanumKinematicsSetup(robot.kinematics, wheelbase, kinematicsTickToMeters(wheel_radius, encoder_cpr), wheel_scale);
+        odometry[count] = sml_nexus_robot::PlanarOdometry(wheelbase, integrator);
+
+        robot.odom_msg.header.frame_id = robot.ns+"odom";
+        robot.odom_msg.child_frame_id = robot.ns+"base_link";
+        robot.odom_msg.pose.pose.orientation.w = 1; //unit quaternion
+        robot.odom_out = boost::make_shared<nav_msgs::Odometry>(robot.odom_msg);
+
+        robot.odom_pub = robot_nh.advertise<nav_msgs::Odometry>("odom", 1000);
+        robot.feedback_sub = robot_nh.subscribe<std_msgs::Float32MultiArray>("wheel_velocity", 1000,
+            boost::bind(&SmlNexusFleetOdometryServer::wheelVelCallback, this, _1, count));
+        robot.stamped_feedback_sub = robot_nh.subscribe<sml_nexus_msgs::WheelVelocityStamped>("wheel_velocity_stamped", 1000,
+            boost::bind(&SmlNexusFleetOdometryServer::wheelVelStampedCallback, this, _1, count));
+        robot.compact_feedback_sub = robot_nh.subscribe<sml_nexus_msgs::WheelFeedback>("wheel_feedback", 1000,
+            boost::bind(&SmlNexusFleetOdometryServer::wheelFeedbackCallback, this, _1, count));
+
+        robot_count.store(count + 1);
+        ROS_INFO_STREAM("Fleet odometry server: serving " << ns);
+    }
+
+    //Namespaces publishing wheel feedback
+    void discoveryCallback(const ros::TimerEvent&){
+        ros::master::V_TopicInfo topics;
+        if (!ros::master::getTopics(topics)) return;
+        const char* suffixes[3] = {"/wheel_velocity", "/wheel_velocity_stamped", "/wheel_feedback"};
+        for (size_t i = 0; i < topics.size(); i++){
+            const std::string& topic = topics[i].name;
+            for (int k = 0; k < 3; k++){
+                const std::string suffix(suffixes[k]);
+                if (topic.size() > suffix.size() + 1 &&
+                    topic.compare(topic.size() - suffix.size(), suffix.size(), suffix) == 0){
+                    addRobot(topic.substr(0, topic.size() - suffix.size()));
+                }
+            }
+        }
+    }
+
+    //Keep the highest priority wheel feedback topic of a robot, called with its lock held
+    bool acceptWheelSource(Robot& robot, WheelSource source){
+        if (source < robot.wheel_source) return false;
+        if (source > robot.wheel_source){
+            robot.wheel_source = source;
+            ROS_INFO_STREAM(robot.ns << "Fleet odometry server: integrating wheel feedback from " << (source == COMPACT ? "wheel_feedback" :
+                            source == STAMPED ? "wheel_velocity_stamped" : "wheel_velocity"));
+        }
+        return true;
+    }
+
+    void wheelVelCallback(const std_msgs::Float32MultiArray::ConstPtr& msg, size_t i){
+        Robot& robot = robots[i];
+        std::lock_guard<std::mutex> guard(robot.lock);
+        if (msg->data.size() != 5 || !acceptWheelSource(robot, LEGACY)){
+            //Malformed, or the same feedback is received on a device-timed topic
+            return;
+        }
+        const ros::Time time_now = ros::Time::now();
+        if (!robot.init){
+            robot.last_received_data = time_now;
+            robot.init = true;
+            ROS_INFO_STREAM(robot.ns << "Fleet odometry server: initialized and receiving data!");
+            return;
+        }
+        const float time_interval_sec = (time_now - robot.last_received_data).toSec();
+        if (time_interval_sec < 2.0){
+            runOdometry(i, msg->data[0], msg->data[1], msg->data[2], msg->data[3], msg->data[4], time_now);
+        }
+        else{
+            ROS_WARN_STREAM(robot.ns << "Fleet odometry server: last data received " << time_interval_sec << " sec ago, odometry might lose accuracy");
+        }
+        robot.last_received_data = time_now;
+    }
+
+    void wheelVelStampedCallback(const sml_nexus_msgs::WheelVelocityStamped::ConstPtr& msg, size_t i){
+        Robot& robot = robots[i];
+        std::lock_guard<std::mutex> guard(robot.lock);
+        const bool first = robot.wheel_source != STAMPED;
+        if (!acceptWheelSource(robot, STAMPED)) return;
+        if (first){
+            robot.last_received_data = msg->header.stamp;
+            robot.init = true;
+            return;
+        }
+        const float time_interval_sec = (msg->header.stamp - robot.last_received_data).toSec();
+        if (time_interval_sec <= 0.0){
+            ROS_WARN_STREAM(robot.ns << "Fleet odometry server: wheel velocity stamp went back in time by " << -time_interval_sec << " sec");
+        }
+        else if (time_interval_sec < 2.0){
+            runOdometry(i, msg->UL, msg->UR, msg->LL, msg->LR, msg->dt, msg->header.stamp);
+        }
+        else{
+            ROS_WARN_STREAM(robot.ns << "Fleet odometry server: last data received " << time_interval_sec << " sec ago, odometry might lose accuracy");
+        }
+        robot.last_received_data = msg->header.stamp;
+    }
+
+    void wheelFeedbackCallback(const sml_nexus_msgs::WheelFeedback::ConstPtr& msg, size_t i){
+        Robot& robot = robots[i];
+        std::lock_guard<std::mutex> guard(robot.lock);
+        const ros::Time host_time = ros::Time::now();
+        const bool first = robot.wheel_source != COMPACT;
+        if (!acceptWheelSource(robot, COMPACT)) return;
+        if (first){
+            //Anchor the device clock on the host clock, whichever topic was integrated until now
+            robot.device_time = host_time;
+            robot.last_feedback_seq = msg->seq;
+            robot.init = true;
+            return;
+        }
+
+        //Sequence step: a small step back is a duplicated or reordered frame,
+        //already integrated, a larger one a restart of the firmware
+        const int16_t step = static_cast<int16_t>(msg->seq - robot.last_feedback_seq);
+        if (step <= 0){
+            if (step > -max_reordered_feedback){
+                ROS_WARN_STREAM_THROTTLE(1.0, robot.ns << "Fleet odometry server: skipping duplicated or reordered wheel feedback sample " << msg->seq);
+                return;
+            }
+            ROS_WARN_STREAM(robot.ns << "Fleet odometry server: wheel feedback sequence restarted, the low-level controller was reset?");
+            robot.device_time = host_time;
+            robot.last_feedback_seq = msg->seq;
+            return;
+        }
+        robot.last_feedback_seq = msg->seq;
+        if (step > 1){
+            const unsigned long lost = step - 1;
+            robot.dropped_feedback += lost;
+            ROS_WARN_STREAM_THROTTLE(1.0, robot.ns << "Fleet odometry server: lost " << lost << " wheel feedback samples (" << robot.dropped_feedback << " in total)");
+        }
+
+        robot.device_time += ros::Duration(0, msg->dt * 1000);
+        if (robot.device_time > host_time || (host_time - robot.device_time).toSec() > max_device_time_lag){
+            robot.device_time = host_time;
+        }
+        if (msg->dt == 0 || msg->dt == 65535){
+            ROS_WARN_STREAM(robot.ns << "Fleet odometry server: wheel feedback interval out of range, odometry might lose accuracy");
+            return;
+        }
+
+        //The interval rarely changes, keep the division out of the common path
+        if (msg->dt != robot.feedback_dt){
+            robot.feedback_dt = msg->dt;
+            robot.feedback_rate = 1e6 / msg->dt;
+        }
+        const double feedback_rate = robot.feedback_rate;
+        const double speeds[4] = {msg->speed[0] * 1e-4, msg->speed[1] * 1e-4, msg->speed[2] * 1e-4, msg->speed[3] * 1e-4};
+        const sml_nexus_robot::PlanarTwist edge_twist = computeTwist(robot, speeds);
+        runOdometry(i,
+                    msg->ticks[0] * robot.kinematics.tickToMeters[0] * feedback_rate,
+                    msg->ticks[1] * robot.kinematics.tickToMeters[1] * feedback_rate,
+                    msg->ticks[2] * robot.kinematics.tickToMeters[2] * feedback_rate,
+                    msg->ticks[3] * robot.kinematics.tickToMeters[3] * feedback_rate,
+                    msg->dt * 1e-3,
+                    robot.device_time,
+                    &edge_twist);
+    }
+
+    //Base twist of four wheel speeds, from the calibrated map of the firmware
+    static sml_nexus_robot::PlanarTwist computeTwist(const Robot& robot, const double wheels[4]){
+        double twist[3];
+        mecanumForward(robot.kinematics, wheels, twist);
+        sml_nexus_robot::PlanarTwist vel;
+        vel.vx = twist[0];
+        vel.vy = twist[1];
+        vel.wz = twist[2];
+        return vel;
+    }
+
+    //Called with the robot lock held
+    void runOdometry(size_t i, float ULWheelVel, float URWheelVel, float LLWheelVel, float LRWheelVel,
+                     float time_interval_ms, const ros::Time& time_stamp,
+                     const sml_nexus_robot::PlanarTwist* measured_twist = nullptr){
+        Robot& robot = robots[i];
+        sml_nexus_robot::PlanarOdometry& state = odometry[i];
+        const double wheels[4] = {ULWheelVel, URWheelVel, LLWheelVel, LRWheelVel};
+        state.integrateTwist(computeTwist(robot, wheels), time_interval_ms);
+        robot.stamp = time_stamp;
+        robot.updated = true;
+
+        const sml_nexus_robot::PlanarPose& pose = state.pose();
+        const sml_nexus_robot::PlanarTwist& twist = measured_twist ? *measured_twist : state.twist();
+        const nav_msgs::OdometryPtr& odom_out = robot.odom_out;
+        odom_out->header.stamp = time_stamp;
+        odom_out->pose.pose.position.x = pose.x;
+        odom_out->pose.pose.position.y = pose.y;
+        odom_out->pose.pose.orientation.z = state.quaternionZ();
+        odom_out->pose.pose.orientation.w = state.quaternionW();
+        odom_out->twist.twist.linear.x = twist.vx;
+        odom_out->twist.twist.linear.y = twist.vy;
+        odom_out->twist.twist.angular.z = twist.wz;
+        robot.odom_pub.publish(nav_msgs::OdometryConstPtr(odom_out));
+        //Without intra-process subscribers the message was serialized and
+        //can be filled again, otherwise a subscriber still holds it
+        if (!robot.odom_out.unique()) robot.odom_out = boost::make_shared<nav_msgs::Odometry>(robot.odom_msg);
+    }
+
+    //==========================================================
+    //  One TFMessage with the transforms of all the robots
+    //  that integrated new feedback since the last cycle
+    //==========================================================
+    void publishCallback(const ros::TimerEvent&){
+        const size_t count = robot_count.load();
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++){
+            Robot& robot = robots[i];
+            std::lock_guard<std::mutex> guard(robot.lock);
+            if (!robot.updated) continue;
+            robot.updated = false;
+
+            if (n == transforms.size()) transforms.push_back(geometry_msgs::TransformStamped());
+            geometry_msgs::TransformStamped& transform = transforms[n++];
+            transform.header.stamp = robot.stamp;
+            transform.header.frame_id = robot.odom_msg.header.frame_id;
+            transform.child_frame_id = robot.odom_msg.child_frame_id;
+            transform.transform.translation.x = odometry[i].pose().x;
+            transform.transform.translation.y = odometry[i].pose().y;
+            transform.transform.rotation.z = odometry[i].quaternionZ();
+            transform.transform.rotation.w = odometry[i].quaternionW();
+        }
+        if (n == 0) return;
+        transforms.resize(n);
+        transform_broadcaster.sendTransform(transforms);
+    }
+
+    ros::NodeHandle nh;
+    ros::NodeHandle private_nh;
+    ros::Timer discovery_timer;
+    ros::Timer publish_timer;
+    tf2_ros::TransformBroadcaster transform_broadcaster;
+    std::vector<geometry_msgs::TransformStamped> transforms; //reused every cycle, only touched by the publish timer
+
+    int max_robots;
+    double max_device_time_lag;   //s, reanchor the reconstructed device clocks past this lag
+    sml_nexus_robot::PoseIntegrator integrator = sml_nexus_robot::PoseIntegrator::ARC;
+    std::vector<sml_nexus_robot::PlanarOdometry> odometry; //planar states of all the robots
+    std::unique_ptr<Robot[]> robots;
+    std::atomic<size_t> robot_count{0};
+};
+
+//==============================
+//             Main
+//==============================
+int main(int argc, char** argv){
+    ros::init(argc, argv, "fleet_odometry_server");
+    ros::NodeHandle nh;
+    ros::NodeHandle private_nh("~");
+    SmlNexusFleetOdometryServer server(nh, private_nh);
+
+    //0 threads: one per core
+    ros::AsyncSpinner spinner(private_nh.param("threads", 0));
+    spinner.start();
+    ros::waitForShutdown();
+    return 0;
+}
@@ -1,79 +1,73 @@
-#include <ros/ros.h>
+#include <algorithm>
 #include <cmath>
-#include <ros/time.h>
-#include "std_msgs/Float32MultiArray.h"
-#include "geometry_msgs/Pose.h"
-#include "geometry_msgs/Twist.h"
-#include "nav_msgs/Odometry.h"
-#include <tf/transform_broadcaster.h>
-#include <tf2_ros/transform_broadcaster.h>
-#include <geometry_msgs/TransformStamped.h>
-#include <tf2_geometry_msgs/tf2_geometry_msgs.h>
-
-class SmlNexusOdometryBroadcaster
-{
-public:
-    SmlNexusOdometryBroadcaster();
-    ~SmlNexusOdometryBroadcaster();
-private:
-    void wheelVelCallback(const std_msgs::Float32MultiArray& msg);
-
-    void runOdometry(const std_msgs::Float32MultiArray& msg_,
-                     const ros::Time& time_stamp);
-
-    void computeOdometry(nav_msgs::Odometry& odom,
-                         const float& ULWheelVel,
-                         const float& URWheelVel,
-                         const float& LLWheelVel, 
-                         const float& LRWheelVel, 
-                         const float& time_interval_ms);
-
-    geometry_msgs::Twist computeVel(const float& ULWheelVel,
-                                    const float& URWheelVel,
-                                    const float& LLWheelVel,
-                                    const float& LRWheelVel);
-
-    nav_msgs::Odometry computeRelativeMotion(const float& ULWheelVel,
-                                             const float& URWheelVel,
-                                             const float& LLWheelVel,
-                                             const float& LRWheelVel,
-                                             const float& timeSeconds);
-
-    //ROS variables
-    //=============
-    void setSubAndPub(ros::NodeHandle& nh_);
-    std::string ns; //Parameters namespace
-    //Subscriber and publishers
-    ros::Subscriber feedback_sub;
-    ros::Publisher odom_pub;
-    tf2_ros::TransformBroadcaster transform_broadcaster;
-
-    //
-    float robot_wheelbase = 0.15; //robot wheelbase in meters
-    ros::Time last_received_data;
-    ros::Time time_now;
-    bool init = false;
-    nav_msgs::Odometry odom_msg;
-    geometry_msgs::TransformStamped odom_transform;
-
-};
+#include <sstream>
+#include <vector>
+#include <boost/make_shared.hpp>
+#include "sml_nexus_robot/odometry_broadcaster.h"
 
 //=====================
 //        constructor
 //=====================
-SmlNexusOdometryBroadcaster::SmlNexusOdometryBroadcaster(){
-    ros::NodeHandle nh;
+SmlNexusOdometryBroadcaster::SmlNexusOdometryBroadcaster(ros::NodeHandle& nh, ros::NodeHandle& private_nh){
     ns = nh.getNamespace()+"/";
     if (ns == "//") ns = "";
 
     ROS_INFO_STREAM(ns << "Odometry broadcaster: startup...");
 
+    //Get parameters
+    getParams(nh, private_nh);
+
     //Setup ROS subscribers and publishers
     setSubAndPub(nh);
 }
 
 SmlNexusOdometryBroadcaster::~SmlNexusOdometryBroadcaster(){}
 
+//=======================================
+//            Get parameters
+//=======================================
+void SmlNexusOdometryBroadcaster::getParams(ros::NodeHandle& nh_, ros::NodeHandle& private_nh_){
+    //Robot geometry, loaded in the robot namespace from the calibration
+    //file shared with the low-level controller, private values first
+    const double wheelbase = private_nh_.param("wheelbase", nh_.param("wheelbase", nexusGeometry<nexusMecanum2x>::wheelbase()));
+    double wheel_scale[4] = {1.0, 1.0, 1.0, 1.0};
+    std::vector<double> scales;
+    if (private_nh_.getParam("wheel_scale", scales) || nh_.getParam("wheel_scale", scales)){
+        if (scales.size() == 4){
+            for (int i = 0; i < 4; i++) wheel_scale[i] = scales[i];
+        }
+        else{
+            ROS_WARN_STREAM(ns << "Odometry broadcaster: wheel_scale needs 4 values, ignoring it");
+        }
+    }
+
+    //Encoder resolution and wheel radius, to decode compact feedback,
+    //those of the firmware unless set
+    const int encoder_cpr = private_nh_.param("encoder_cpr", static_cast<int>(nexusMecanum2x::encoderCPR()));
+    const double wheel_radius = private_nh_.param("wheel_radius", nexusMecanum2x::wheelRadius());
+    mecanumKinematicsSetup(kinematics, wheelbase, kinematicsTickToMeters(wheel_radius, encoder_cpr), wheel_scale);
+    odometry.setWheelbase(wheelbase);
+
+    max_device_time_lag = private_nh_.param("max_device_time_lag", 0.1);
+
+    //Pose integrator: arc, exact or rk4
+    const std::string integrator = private_nh_.param("integrator", std::string("arc"));
+    if (!sml_nexus_robot::parsePoseIntegrator(integrator, odometry.integrator)){
+        ROS_WARN_STREAM(ns << "Odometry broadcaster: unknown integrator " << integrator << ", using arc");
+    }
+
+    //Output policy
+    publish_rate = private_nh_.param("publish_rate", 0.0);
+    publish_tf = private_nh_.param("publish_tf", true);
+
+    //Slip detection and covariances
+    slip_threshold = private_nh_.param("slip_threshold", 0.03);
+    slip_covariance_scale = private_nh_.param("slip_covariance_scale", 100.0);
+    slip_downweight = private_nh_.param("slip_downweight", false);
+    slip_wheel_weight = private_nh_.param("slip_wheel_weight", 0.1);
+    wheel_speed_std = private_nh_.param("wheel_speed_std", 0.01);
+}
+
 //=======================================
 //   Setup ROS subscribers, publishers
 //        and pre-fill messages
@@ -85,31 +79,66 @@ void SmlNexusOdometryBroadcaster::setSubAndPub(ros::NodeHandle& nh_){
     // Setup wheel velocity feedback subscriber
     //------------------------------------------
     feedback_sub = nh_.subscribe("wheel_velocity", 1000, &SmlNexusOdometryBroadcaster::wheelVelCallback, this);
+    //Stamped with the time the encoders were latched on the low-level controller
+    stamped_feedback_sub = nh_.subscribe("wheel_velocity_stamped", 1000, &SmlNexusOdometryBroadcaster::wheelVelStampedCallback, this);
+    //Compact encoder tick feedback
+    compact_feedback_sub = nh_.subscribe("wheel_feedback", 1000, &SmlNexusOdometryBroadcaster::wheelFeedbackCallback, this);
 
     //--------------------------
     // Setup odometry publisher
     //--------------------------
     odom_pub = nh_.advertise<nav_msgs::Odometry>("odom", 1000);
 
+    //-------------------------------------------
+    // Decoupled publishing and rate diagnostics
+    //-------------------------------------------
+    if (publish_rate > 0.0){
+        publish_timer = nh_.createTimer(ros::Duration(1.0 / publish_rate), &SmlNexusOdometryBroadcaster::publishCallback, this);
+        ROS_INFO_STREAM(ns << "Odometry broadcaster: publishing odom" << (publish_tf ? " and TF" : "") << " at " << publish_rate << " Hz");
+    }
+    slip_pub = nh_.advertise<sml_nexus_msgs::WheelSlip>("wheel_slip", 100);
+    diagnostics_pub = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
+    diagnostics_timer = nh_.createTimer(ros::Duration(1.0), &SmlNexusOdometryBroadcaster::diagnosticsCallback, this);
+
     //-----------------------------
     // Initialize odometry message
     //-----------------------------
     odom_msg.header.frame_id = ns+"odom";
     odom_msg.child_frame_id = ns+"base_link";
     odom_msg.pose.pose.orientation.w = 1; //unit quaternion
+    //z, roll and pitch are not estimated
+    for (int k = 2; k < 5; k++){
+        odom_msg.pose.covariance[k * 6 + k] = 1e6;
+        odom_msg.twist.covariance[k * 6 + k] = 1e6;
+    }
+    odom_out = boost::make_shared<nav_msgs::Odometry>(odom_msg);
+    slip_msg.header.frame_id = ns+"base_link";
 
     //------------------------------
     // Initialize transform message
     //------------------------------
     odom_transform.header.frame_id = ns+"odom";
     odom_transform.child_frame_id = ns+"base_link";
+    odom_transform.transform.rotation.w = 1; //unit quaternion
 
 }
 
 
+//Keep the highest priority wheel feedback topic
+bool SmlNexusOdometryBroadcaster::acceptWheelSource(WheelSource source){
+    if (source < wheel_source) return false;
+    if (source > wheel_source){
+        wheel_source = source;
+        ROS_INFO_STREAM(ns << "Odometry broadcaster: integrating wheel feedback from " << (source == COMPACT ? "wheel_feedback" :
+                        source == STAMPED ? "wheel_velocity_stamped" : "wheel_velocity"));
+    }
+    return true;
+}
+
 void SmlNexusOdometryBroadcaster::wheelVelCallback(const std_msgs::Float32MultiArray& msg){
-    if (msg.data.size() != 5){
-        //Exit if msg is malformed
+    if (msg.data.size() != 5 || !acceptWheelSource(LEGACY)){
+        //Exit if msg is malformed, or if the same feedback is already
+        //received on a device-timed topic
     }
     else if (!init){
         //If first message do nothing but init last received data time
@@ -123,10 +152,11 @@ void SmlNexusOdometryBroadcaster::wheelVelCallback(const std_msgs::Float32MultiA
         float time_interval_sec = time_interval.toSec();
 
         if (time_interval_sec < 2.0){
-            runOdometry(msg, time_now);
+            runOdometry(msg.data[0], msg.data[1], msg.data[2], msg.data[3], msg.data[4], time_now);
             last_received_data = time_now;
         }
         else{
+            rejected_count++;
             ROS_WARN_STREAM(ns << "Odometry broadcaster: last data received " << time_interval_sec << " sec ago, odometry might lose accuracy");
             last_received_data = time_now;
         }
@@ -134,142 +164,289 @@ void SmlNexusOdometryBroadcaster::wheelVelCallback(const std_msgs::Float32MultiA
     
 }
 
-void SmlNexusOdometryBroadcaster::runOdometry(const std_msgs::Float32MultiArray& msg_, const ros::Time& time_stamp){
-        computeOdometry(odom_msg, msg_.data[0], msg_.data[1], msg_.data[2], msg_.data[3], msg_.data[4]);
-
-        //Publish odometry
-        odom_msg.header.stamp = time_stamp;
-        odom_pub.publish(odom_msg);
-
-        //Publish transform
-        odom_transform.header.stamp = time_stamp;
-        odom_transform.transform.translation.x = odom_msg.pose.pose.position.x;
-        odom_transform.transform.translation.y = odom_msg.pose.pose.position.y;
-        odom_transform.transform.translation.z = odom_msg.pose.pose.position.z;
-        odom_transform.transform.rotation = odom_msg.pose.pose.orientation;
-        transform_broadcaster.sendTransform(odom_transform);
+//==========================================================
+//  Device-stamped feedback: integrate over the device time
+//  elapsed between encoder latches and stamp odometry with
+//  the latch time, so that serial and scheduling jitter on
+//  the host do not end up in odom/TF
+//==========================================================
+void SmlNexusOdometryBroadcaster::wheelVelStampedCallback(const sml_nexus_msgs::WheelVelocityStamped& msg){
+    const bool first = wheel_source != STAMPED;
+    if (!acceptWheelSource(STAMPED)) return;
+    if (first){
+        //First stamped message: switch over from the legacy topic
+        last_received_data = msg.header.stamp;
+        init = true;
+        return;
+    }
 
+    const float time_interval_sec = (msg.header.stamp - last_received_data).toSec();
+    if (time_interval_sec <= 0.0){
+        //Device clock was resynchronized backwards, restart from this sample
+        rejected_count++;
+        ROS_WARN_STREAM(ns << "Odometry broadcaster: wheel velocity stamp went back in time by " << -time_interval_sec << " sec");
+    }
+    else if (time_interval_sec < 2.0){
+        runOdometry(msg.UL, msg.UR, msg.LL, msg.LR, msg.dt, msg.header.stamp);
+    }
+    else{
+        rejected_count++;
+        ROS_WARN_STREAM(ns << "Odometry broadcaster: last data received " << time_interval_sec << " sec ago, odometry might lose accuracy");
+    }
+    last_received_data = msg.header.stamp;
 }
 
-void SmlNexusOdometryBroadcaster::computeOdometry(nav_msgs::Odometry& odom,
-                     const float& ULWheelVel,
-                     const float& URWheelVel,
-                     const float& LLWheelVel, 
-                     const float& LRWheelVel, 
-                     const float& time_interval_ms)
-{   
-    const nav_msgs::Odometry relativeMotion = computeRelativeMotion(ULWheelVel, URWheelVel, LLWheelVel, LRWheelVel, time_interval_ms / 1000);
-    tf2::Quaternion q_prev, q_rot, q_new, new_translation;
-    tf2::Vector3 rel_translation;
-
-    //Convert to quaternion type for computation
-    tf2::convert(odom.pose.pose.orientation, q_prev);
-    tf2::convert(relativeMotion.pose.pose.orientation, q_rot);
-    q_new = q_rot * q_prev;
-
-    q_new.normalize();
-    tf2::convert(q_new, odom.pose.pose.orientation);
-
-    //Rotate relative translation to odometry frame of reference
-    tf2::convert(relativeMotion.pose.pose.position, rel_translation);
-    new_translation = (q_prev * rel_translation) * q_prev.inverse(); //rotate relative translation to odometry frame
-
-    odom.pose.pose.position.x = odom.pose.pose.position.x + new_translation.x();
-    odom.pose.pose.position.y = odom.pose.pose.position.y + new_translation.y();
-    odom.pose.pose.position.z = odom.pose.pose.position.z + new_translation.z();
-
-    odom.twist = relativeMotion.twist;
-}
+//==========================================================
+//  Compact feedback: decode encoder tick deltas, integrate
+//  over the device dt and stamp with the device clock
+//  reconstructed from the accumulated dt. The pose follows
+//  the ticks, the published twist the wheel speeds the
+//  controller measured from encoder edge timing
+//==========================================================
+void SmlNexusOdometryBroadcaster::wheelFeedbackCallback(const sml_nexus_msgs::WheelFeedback& msg){
+    const ros::Time host_time = ros::Time::now();
+
+    const bool first = wheel_source != COMPACT;
+    if (!acceptWheelSource(COMPACT)) return;
+    if (first){
+        //First compact message: anchor the device clock on the host clock,
+        //whichever topic was integrated until now
+        device_time = host_time;
+        last_feedback_seq = msg.seq;
+        init = true;
+        return;
+    }
 
-//======================================
-//    Compute velocity in base link frame
-//======================================
-geometry_msgs::Twist SmlNexusOdometryBroadcaster::computeVel(const float& ULWheelVel, const float& URWheelVel, const float& LLWheelVel, const float& LRWheelVel){
-    geometry_msgs::Twist relativeVel;
+    //Sequence step: a small step back is a duplicated or reordered frame,
+    //already integrated, a larger one a restart of the firmware
+    const int16_t step = static_cast<int16_t>(msg.seq - last_feedback_seq);
+    if (step <= 0){
+        if (step > -max_reordered_feedback){
+            ROS_WARN_STREAM_THROTTLE(1.0, ns << "Odometry broadcaster: skipping duplicated or reordered wheel feedback sample " << msg.seq);
+            return;
+        }
+        ROS_WARN_STREAM(ns << "Odometry broadcaster: wheel feedback sequence restarted, the low-level controller was reset?");
+        device_time = host_time;
+        last_feedback_seq = msg.seq;
+        return;
+    }
+    last_feedback_seq = msg.seq;
+    if (step > 1){
+        const unsigned long lost = step - 1;
+        dropped_feedback += lost;
+        ROS_WARN_STREAM_THROTTLE(1.0, ns << "Odometry broadcaster: lost " << lost << " wheel feedback samples (" << dropped_feedback << " in total)");
+    }
 
-    relativeVel.linear.x = (ULWheelVel + URWheelVel + LLWheelVel + LRWheelVel) / 4;
-    relativeVel.linear.y = (- ULWheelVel + URWheelVel + LLWheelVel - LRWheelVel) / 4;
-    relativeVel.linear.z = 0.0;
+    //Advance the device clock, keeping it from drifting into the
+    //future or lagging behind after lost samples
+    device_time += ros::Duration(0, msg.dt * 1000);
+    if (device_time > host_time || (host_time - device_time).toSec() > max_device_time_lag){
+        device_time = host_time;
+    }
 
-    relativeVel.angular.x = 0.0;
-    relativeVel.angular.y = 0.0;
-    relativeVel.angular.z = (- ULWheelVel + URWheelVel - LLWheelVel + LRWheelVel) / (8 * robot_wheelbase);
+    if (msg.dt == 0 || msg.dt == 65535){
+        rejected_count++;
+        ROS_WARN_STREAM(ns << "Odometry broadcaster: wheel feedback interval out of range, odometry might lose accuracy");
+        return;
+    }
 
-    return relativeVel;
+    //The feedback interval only changes with the decimation: divide then only
+    if (msg.dt != feedback_dt){
+        feedback_dt = msg.dt;
+        feedback_rate = 1e6 / msg.dt;
+    }
+    const float edge_speeds[4] = {msg.speed[0] * 1e-4f, msg.speed[1] * 1e-4f, msg.speed[2] * 1e-4f, msg.speed[3] * 1e-4f};
+    runOdometry(msg.ticks[0] * kinematics.tickToMeters[0] * feedback_rate,
+                msg.ticks[1] * kinematics.tickToMeters[1] * feedback_rate,
+                msg.ticks[2] * kinematics.tickToMeters[2] * feedback_rate,
+                msg.ticks[3] * kinematics.tickToMeters[3] * feedback_rate,
+                msg.dt * 1e-3,
+                device_time,
+                edge_speeds);
 }
 
-nav_msgs::Odometry SmlNexusOdometryBroadcaster::computeRelativeMotion(const float& ULWheelVel, const float& URWheelVel, const float& LLWheelVel, const float& LRWheelVel, const float& timeSeconds){
-    nav_msgs::Odometry rel_motion;
-    const geometry_msgs::Twist vel = computeVel(ULWheelVel, URWheelVel, LLWheelVel, LRWheelVel);
-    rel_motion.twist.twist = vel;
-
-    double angleChange = 0.0;
-
-    if (std::abs(vel.angular.z) < 0.0001) {
-        //----------------
-        // Drive straight
-        //----------------
-        rel_motion.pose.pose.position.x = static_cast<double>(vel.linear.x*timeSeconds);
-        rel_motion.pose.pose.position.y = static_cast<double>(vel.linear.y*timeSeconds);
-        rel_motion.pose.pose.position.z = 0.0;
-
-    } else {
-        //---------------------
-        // Follow circular arc
-        //---------------------
-        const double distX = vel.linear.x * timeSeconds;
-        const double distY = vel.linear.y * timeSeconds;
-        const double distChange = std::sqrt(distX * distX + distY * distY);
-        angleChange = vel.angular.z * timeSeconds;
-
-
-        if (distChange == 0){
-            //Rotating on the spot
-            rel_motion.pose.pose.position.x = 0.0;
-            rel_motion.pose.pose.position.y = 0.0;
-            rel_motion.pose.pose.position.z = 0.0;
+void SmlNexusOdometryBroadcaster::runOdometry(const float& ULWheelVel,
+                                              const float& URWheelVel,
+                                              const float& LLWheelVel,
+                                              const float& LRWheelVel,
+                                              const float& time_interval_ms,
+                                              const ros::Time& time_stamp,
+                                              const float* measured_wheel_vel){
+        const float wheel_vel[4] = {ULWheelVel, URWheelVel, LLWheelVel, LRWheelVel};
+
+        //Slip residual: the part of the wheel speeds no base motion explains
+        const double residual = std::fabs(odometry.computeSlipResidual(ULWheelVel, URWheelVel, LLWheelVel, LRWheelVel));
+        const bool slipping = residual > slip_threshold;
+        slip_residual = std::max(slip_residual, residual);
+        slip_wheel = -1;
+        if (slipping){
+            slip_count++;
+            if (slip_downweight){
+                //The wheel departing most from the previous twist
+                double predicted[4];
+                odometry.computeWheelVel(odometry.twist(), predicted);
+                double largest = -1.0;
+                for (int i = 0; i < 4; i++){
+                    const double departure = std::fabs(wheel_vel[i] - predicted[i]);
+                    if (departure > largest){
+                        largest = departure;
+                        slip_wheel = i;
+                    }
+                }
+            }
         }
-        else{
-            const double angleDriveDirection = std::atan2(distY, distX);
-
-            const double arcRadius = distChange / angleChange;
+        odometry.integrateTwist(computeTwist(wheel_vel), time_interval_ms);
+        sample_twist = measured_wheel_vel ? computeTwist(measured_wheel_vel) : odometry.twist();
+
+        //Covariances for independent wheel speed errors, inflated while
+        //slipping. The pose covariance accumulates the twist covariance
+        const double scale = slipping ? slip_covariance_scale : 1.0;
+        const double wheel_variance = scale * wheel_speed_std * wheel_speed_std;
+        const double dt = time_interval_ms * 1e-3;
+        twist_variance[0] = wheel_variance / 4.0;
+        twist_variance[1] = wheel_variance / 4.0;
+        twist_variance[2] = wheel_variance * 4.0 * kinematics.invFourLeverArm * kinematics.invFourLeverArm;
+        for (int i = 0; i < 3; i++) pose_variance[i] += twist_variance[i] * dt * dt;
+
+        sample_stamp = time_stamp;
+        sample_pending = true;
+        sample_count++;
+
+        //Without a publish rate, publish every sample
+        if (publish_rate <= 0.0) publishOdometry();
+}
 
-            tf::Vector3 endPos = tf::Vector3(std::sin(angleChange) * arcRadius,
-                                            arcRadius - std::cos(angleChange) * arcRadius,
-                                            0.0);
+//Least-squares twist, with the slipping wheel down-weighted if any
+sml_nexus_robot::PlanarTwist SmlNexusOdometryBroadcaster::computeTwist(const float wheel_vel[4]) const{
+    const double wheels[4] = {wheel_vel[0], wheel_vel[1], wheel_vel[2], wheel_vel[3]};
+    if (slip_wheel < 0){
+        double twist[3];
+        mecanumForward(kinematics, wheels, twist);
+        sml_nexus_robot::PlanarTwist vel;
+        vel.vx = twist[0];
+        vel.vy = twist[1];
+        vel.wz = twist[2];
+        return vel;
+    }
+    double weights[4] = {1.0, 1.0, 1.0, 1.0};
+    weights[slip_wheel] = slip_wheel_weight;
+    return odometry.computeWeightedVel(wheels, weights);
+}
 
-            endPos = endPos.rotate(tf::Vector3(0.0, 0.0, 1.0), angleDriveDirection);
+//==========================================================
+//  Publish the latest sample at the decoupled rate. Nothing
+//  is sent when no feedback arrived since the last cycle,
+//  so that TF never receives the same stamp twice
+//==========================================================
+void SmlNexusOdometryBroadcaster::publishCallback(const ros::TimerEvent& event){
+    if (sample_pending) publishOdometry();
+}
 
-            rel_motion.pose.pose.position.x = endPos[0];
-            rel_motion.pose.pose.position.y = endPos[1];
-            rel_motion.pose.pose.position.z = 0.0;
+void SmlNexusOdometryBroadcaster::publishOdometry(){
+        sample_pending = false;
+
+        //Fill preallocated messages from the planar state
+        const sml_nexus_robot::PlanarPose& pose = odometry.pose();
+        const double qz = odometry.quaternionZ();
+        const double qw = odometry.quaternionW();
+
+        //Publish odometry. The message is handed over by reference, so that
+        //subscribers in the same nodelet manager need no serialized copy
+        odom_out->header.stamp = sample_stamp;
+        odom_out->pose.pose.position.x = pose.x;
+        odom_out->pose.pose.position.y = pose.y;
+        odom_out->pose.pose.orientation.z = qz;
+        odom_out->pose.pose.orientation.w = qw;
+        odom_out->twist.twist.linear.x = sample_twist.vx;
+        odom_out->twist.twist.linear.y = sample_twist.vy;
+        odom_out->twist.twist.angular.z = sample_twist.wz;
+        //x, y, yaw into the 6x6 (x, y, z, roll, pitch, yaw) covariances
+        const int planar[3] = {0, 7, 35};
+        for (int i = 0; i < 3; i++){
+            odom_out->pose.covariance[planar[i]] = pose_variance[i];
+            odom_out->twist.covariance[planar[i]] = twist_variance[i];
         }
+        odom_pub.publish(nav_msgs::OdometryConstPtr(odom_out));
+        odom_count++;
+        //Without intra-process subscribers the message was serialized and
+        //can be filled again, otherwise a subscriber still holds it
+        if (!odom_out.unique()) odom_out = boost::make_shared<nav_msgs::Odometry>(odom_msg);
+
+        //Slip metric, largest residual since the last publish
+        slip_msg.header.stamp = sample_stamp;
+        slip_msg.residual = slip_residual;
+        slip_msg.slipping = slip_residual > slip_threshold;
+        slip_msg.wheel = slip_wheel;
+        slip_pub.publish(slip_msg);
+        slip_residual = 0.0;
 
-    }
-    tf::quaternionTFToMsg(tf::createQuaternionFromYaw(angleChange), rel_motion.pose.pose.orientation);
-    return rel_motion;
+        //Publish transform
+        if (publish_tf){
+            odom_transform.header.stamp = sample_stamp;
+            odom_transform.transform.translation.x = pose.x;
+            odom_transform.transform.translation.y = pose.y;
+            odom_transform.transform.rotation.z = qz;
+            odom_transform.transform.rotation.w = qw;
+            transform_broadcaster.sendTransform(odom_transform);
+            tf_count++;
+        }
 }
 
+//==========================================================
+//  Input and output rates, and lost and rejected feedback
+//  samples, on /diagnostics once per second
+//==========================================================
+void SmlNexusOdometryBroadcaster::diagnosticsCallback(const ros::TimerEvent& event){
+    const ros::Time now = ros::Time::now();
+    if (last_diagnostics.isZero()){
+        last_diagnostics = now;
+        return;
+    }
+    const double elapsed = (now - last_diagnostics).toSec();
+    if (elapsed <= 0.0) return;
+
+    diagnostic_msgs::DiagnosticArray diagnostics;
+    diagnostics.header.stamp = now;
+    diagnostics.status.resize(1);
+    diagnostic_msgs::DiagnosticStatus& status = diagnostics.status[0];
+    status.name = ns + "odometry_broadcaster";
+    status.hardware_id = ns.empty() ? "nexus" : ns.substr(0, ns.size() - 1);
+    if (!init){
+        status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+        status.message = "No wheel feedback received";
+    }
+    else if (sample_count == last_sample_count){
+        status.level = diagnostic_msgs::DiagnosticStatus::ERROR;
+        status.message = "Wheel feedback stopped";
+    }
+    else{
+        status.level = diagnostic_msgs::DiagnosticStatus::OK;
+        status.message = "OK";
+    }
 
-//==============================
-//             Main
-//==============================
-int main(int argc, char** argv){
-    ros::init(argc, argv, "odometry_node");
-    
-    try{
-        SmlNexusOdometryBroadcaster odometry_broadcaster;
-        ros::spin();
+    const double rates[3] = {(sample_count - last_sample_count) / elapsed,
+                             (odom_count - last_odom_count) / elapsed,
+                             (tf_count - last_tf_count) / elapsed};
+    const char* rate_keys[3] = {"Feedback rate (Hz)", "Odom publish rate (Hz)", "TF publish rate (Hz)"};
+    const unsigned long counts[4] = {sample_count, dropped_feedback, rejected_count, slip_count};
+    const char* count_keys[4] = {"Feedback samples", "Dropped samples", "Rejected samples", "Slip samples"};
+    status.values.resize(7);
+    for (int i = 0; i < 3; i++){
+        std::ostringstream rate;
+        rate << rates[i];
+        status.values[i].key = rate_keys[i];
+        status.values[i].value = rate.str();
     }
-    //Error handling
-    catch (int error){
-        if (error == 1){
-            ROS_FATAL("Node can't initialize, failed to get parameters");
-        }
-        else{
-            ROS_FATAL("Node encountered an unexpected error");        
-        }
-        return 1;
+    for (int i = 0; i < 4; i++){
+        std::ostringstream count;
+        count << counts[i];
+        status.values[3 + i].key = count_keys[i];
+        status.values[3 + i].value = count.str();
     }
-    return 0;
-}
\ No newline at end of file
+    diagnostics_pub.publish(diagnostics);
+
+    last_sample_count = sample_count;
+    last_odom_count = odom_count;
+    last_tf_count = tf_count;
+    last_diagnostics = now;
+}
@@ -0,0 +1,27 @@
+#include <ros/ros.h>
+#include "sml_nexus_robot/odometry_broadcaster.h"
+
+//==============================
+//             Main
+//==============================
+int main(int argc, char** argv){
+    ros::init(argc, argv, "odometry_node");
+    
+    try{
+        ros::NodeHandle nh;
+        ros::NodeHandle private_nh("~");
+        SmlNexusOdometryBroadcaster odometry_broadcaster(nh, private_nh);
+        ros::spin();
+    }
+    //Error handling
+    catch (int error){
+        if (error == 1){
+            ROS_FATAL("Node can't initialize, failed to get parameters");
+        }
+        else{
+            ROS_FATAL("Node encountered an unexpected error");        
+        }
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
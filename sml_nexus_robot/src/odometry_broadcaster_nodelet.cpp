@@ -0,0 +1,26 @@
+#include <boost/shared_ptr.hpp>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include "sml_nexus_robot/odometry_broadcaster.h"
+
+namespace sml_nexus_robot
+{
+
+//==========================================================
+//  Nodelet wrapper of the odometry broadcaster. Loaded in
+//  the same manager as its consumers, odom is passed by
+//  shared pointer instead of being serialized over TCPROS.
+//==========================================================
+class OdometryBroadcasterNodelet : public nodelet::Nodelet
+{
+private:
+    virtual void onInit(){
+        odometry_broadcaster.reset(new SmlNexusOdometryBroadcaster(getNodeHandle(), getPrivateNodeHandle()));
+    }
+
+    boost::shared_ptr<SmlNexusOdometryBroadcaster> odometry_broadcaster;
+};
+
+} // namespace sml_nexus_robot
+
+PLUGINLIB_EXPORT_CLASS(sml_nexus_robot::OdometryBroadcasterNodelet, nodelet::Nodelet)
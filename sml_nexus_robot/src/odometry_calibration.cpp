@@ -0,0 +1,226 @@
+#include <ros/ros.h>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "std_msgs/Float32MultiArray.h"
+#include "std_srvs/Trigger.h"
+#include "sml_nexus_msgs/WheelVelocityStamped.h"
+#include "sml_nexus_msgs/WheelFeedback.h"
+#include "nav_msgs/Odometry.h"
+#include <tf2/utils.h>
+#include "sml_nexus_robot/odometry_calibration.h"
+#include "sml_nexus_robot/planar_odometry.h"
+
+//==========================================================
+//  Calibration of the wheel odometry against motion
+//  capture. Wheel travel is accumulated between mocap
+//  poses window_duration apart, and each window updates
+//  a recursive least squares estimate of the per-wheel
+//  radius scales and of the wheelbase. The result is
+//  written to output_file, to be loaded in the robot
+//  namespace like the PID parameters, on the ~save
+//  service and at shutdown.
+//
+//  Drive the robot around under mocap, with rotations and
+//  both translations, for a few minutes.
+//==========================================================
+class SmlNexusOdometryCalibration
+{
+public:
+    SmlNexusOdometryCalibration(ros::NodeHandle& nh, ros::NodeHandle& private_nh)
+        : calibration(nh.param("wheelbase", 0.15))
+    {
+        ns = nh.getNamespace()+"/";
+        if (ns == "//") ns = "";
+        agent = ns.empty() ? std::string("nexus") : ns.substr(1, ns.size() - 2);
+
+        //Calibration in use: the firmware applies it to the wheel speeds it
+        //publishes, so the estimated scales are relative to it
+        std::vector<double> scales;
+        if (nh.getParam("wheel_scale", scales) && scales.size() == 4){
+            for (int i = 0; i < 4; i++) loaded_scale[i] = scales[i];
+        }
+        const int encoder_cpr = private_nh.param("encoder_cpr", 1536);
+        const double wheel_radius = private_nh.param("wheel_radius", 0.05);
+        tick_to_meters = 2.0 * M_PI * wheel_radius / encoder_cpr;
+
+        window_duration = private_nh.param("window_duration", 0.5);
+        mocap_position_std = private_nh.param("mocap_position_std", 0.002);
+        mocap_yaw_std = private_nh.param("mocap_yaw_std", 0.01);
+        calibration.lambda = private_nh.param("forgetting_factor", 1.0);
+        output_file = private_nh.param("output_file", "calibration_" + agent + ".yaml");
+        const std::string mocap_topic = private_nh.param("mocap_topic", "/qualisys/" + agent + "/odom");
+
+        compact_feedback_sub = nh.subscribe("wheel_feedback", 1000, &SmlNexusOdometryCalibration::wheelFeedbackCallback, this);
+        stamped_feedback_sub = nh.subscribe("wheel_velocity_stamped", 1000, &SmlNexusOdometryCalibration::wheelVelStampedCallback, this);
+        feedback_sub = nh.subscribe("wheel_velocity", 1000, &SmlNexusOdometryCalibration::wheelVelCallback, this);
+        mocap_sub = nh.subscribe(mocap_topic, 1000, &SmlNexusOdometryCalibration::mocapCallback, this);
+        save_service = private_nh.advertiseService("save", &SmlNexusOdometryCalibration::saveCallback, this);
+        report_timer = nh.createTimer(ros::Duration(5.0), &SmlNexusOdometryCalibration::reportCallback, this);
+
+        ROS_INFO_STREAM(ns << "Odometry calibration: recording wheel feedback against " << mocap_topic);
+    }
+
+    ~SmlNexusOdometryCalibration(){
+        if (calibration.windows() > 0) save();
+    }
+
+private:
+    enum WheelSource { NONE = 0, LEGACY = 1, STAMPED = 2, COMPACT = 3 };
+
+    //Keep the highest priority wheel feedback topic
+    bool acceptWheelSource(WheelSource source){
+        if (source < wheel_source) return false;
+        if (source > wheel_source){
+            wheel_source = source;
+            resetWindow();
+        }
+        return true;
+    }
+
+    //Wheel travel over dt seconds, the sample ending at stamp. Ticks
+    //are raw while the speeds of the other topics carry the calibration
+    //in use, which the estimates are then relative to
+    void addTravel(const double speed[4], double dt, const ros::Time& stamp, bool calibrated){
+        if (window_start.isZero() || stamp <= window_start) return;
+        for (int i = 0; i < 4; i++) travel[i] += speed[i] * dt;
+        relative_scales = calibrated;
+        wheel_samples++;
+    }
+
+    void wheelFeedbackCallback(const sml_nexus_msgs::WheelFeedback& msg){
+        if (!acceptWheelSource(COMPACT) || msg.dt == 0 || msg.dt == 65535) return;
+        const double dt = msg.dt * 1e-6;
+        const double speed[4] = {msg.ticks[0] * tick_to_meters / dt, msg.ticks[1] * tick_to_meters / dt,
+                                 msg.ticks[2] * tick_to_meters / dt, msg.ticks[3] * tick_to_meters / dt};
+        addTravel(speed, dt, ros::Time::now(), false);
+    }
+
+    void wheelVelStampedCallback(const sml_nexus_msgs::WheelVelocityStamped& msg){
+        if (!acceptWheelSource(STAMPED)) return;
+        const double speed[4] = {msg.UL, msg.UR, msg.LL, msg.LR};
+        addTravel(speed, msg.dt * 1e-3, msg.header.stamp, true);
+    }
+
+    void wheelVelCallback(const std_msgs::Float32MultiArray& msg){
+        if (msg.data.size() != 5 || !acceptWheelSource(LEGACY)) return;
+        const double speed[4] = {msg.data[0], msg.data[1], msg.data[2], msg.data[3]};
+        addTravel(speed, msg.data[4] * 1e-3, ros::Time::now(), true);
+    }
+
+    //==========================================================
+    //  Close the window once it is long enough: mocap
+    //  displacement in the base frame at the window start
+    //  against the wheel travel accumulated over it
+    //==========================================================
+    void mocapCallback(const nav_msgs::Odometry& msg){
+        const double x = msg.pose.pose.position.x;
+        const double y = msg.pose.pose.position.y;
+        const double yaw = tf2::getYaw(msg.pose.pose.orientation);
+        const ros::Time stamp = msg.header.stamp;
+
+        if (window_start.isZero() || stamp <= window_start){
+            startWindow(x, y, yaw, stamp);
+            return;
+        }
+        const double elapsed = (stamp - window_start).toSec();
+        if (elapsed < window_duration) return;
+
+        //Skip windows with gaps in the wheel feedback or the mocap
+        if (wheel_samples > 0 && elapsed < 2.0 * window_duration){
+            const double c = std::cos(window_yaw);
+            const double s = std::sin(window_yaw);
+            const double dx = c * (x - window_x) + s * (y - window_y);
+            const double dy = -s * (x - window_x) + c * (y - window_y);
+            const double dyaw = sml_nexus_robot::PlanarOdometry::wrapAngle(yaw - window_yaw);
+            //Two poses per displacement
+            calibration.addWindow(travel, dx, dy, dyaw, std::sqrt(2.0) * mocap_position_std, std::sqrt(2.0) * mocap_yaw_std);
+        }
+        startWindow(x, y, yaw, stamp);
+    }
+
+    void startWindow(double x, double y, double yaw, const ros::Time& stamp){
+        window_x = x;
+        window_y = y;
+        window_yaw = yaw;
+        window_start = stamp;
+        resetWindow();
+    }
+
+    void resetWindow(){
+        for (int i = 0; i < 4; i++) travel[i] = 0.0;
+        wheel_samples = 0;
+    }
+
+    //Calibration in the units the firmware and broadcaster load
+    double absoluteScale(int wheel) const{
+        return relative_scales ? loaded_scale[wheel] * calibration.wheelScale(wheel) : calibration.wheelScale(wheel);
+    }
+
+    void reportCallback(const ros::TimerEvent&){
+        if (calibration.windows() == 0) return;
+        ROS_INFO("%sOdometry calibration: %lu windows, wheel_scale [%.4f, %.4f, %.4f, %.4f] (+-%.4f), wheelbase %.4f (+-%.4f) m",
+                 ns.c_str(), calibration.windows(), absoluteScale(0), absoluteScale(1), absoluteScale(2), absoluteScale(3),
+                 calibration.wheelScaleStd(0), calibration.wheelbase(), calibration.wheelbaseStd());
+    }
+
+    bool saveCallback(std_srvs::Trigger::Request& req, std_srvs::Trigger::Response& res){
+        res.success = save();
+        res.message = res.success ? output_file : "could not write " + output_file;
+        return true;
+    }
+
+    bool save(){
+        FILE* file = std::fopen(output_file.c_str(), "w");
+        if (!file){
+            ROS_ERROR_STREAM(ns << "Odometry calibration: could not write " << output_file);
+            return false;
+        }
+        std::fprintf(file, "# Odometry calibration of %s from %lu windows of motion capture\n", agent.c_str(), calibration.windows());
+        std::fprintf(file, "# Radius scale of each wheel (UL, UR, LL, LR) and (L1 + L2)/2, in m\n");
+        std::fprintf(file, "wheel_scale: [%.5f, %.5f, %.5f, %.5f]\n", absoluteScale(0), absoluteScale(1), absoluteScale(2), absoluteScale(3));
+        std::fprintf(file, "wheelbase: %.5f\n", calibration.wheelbase());
+        std::fclose(file);
+        ROS_INFO_STREAM(ns << "Odometry calibration: written to " << output_file);
+        return true;
+    }
+
+    std::string ns;
+    std::string agent;
+    ros::Subscriber compact_feedback_sub;
+    ros::Subscriber stamped_feedback_sub;
+    ros::Subscriber feedback_sub;
+    ros::Subscriber mocap_sub;
+    ros::ServiceServer save_service;
+    ros::Timer report_timer;
+
+    sml_nexus_robot::OdometryCalibration calibration;
+    WheelSource wheel_source = NONE;
+    double loaded_scale[4] = {1.0, 1.0, 1.0, 1.0};
+    bool relative_scales = true;
+    double tick_to_meters;
+
+    //Current window
+    ros::Time window_start;
+    double window_x = 0.0, window_y = 0.0, window_yaw = 0.0;
+    double travel[4] = {0.0, 0.0, 0.0, 0.0};
+    unsigned long wheel_samples = 0;
+
+    double window_duration;
+    double mocap_position_std;
+    double mocap_yaw_std;
+    std::string output_file;
+};
+
+//==============================
+//             Main
+//==============================
+int main(int argc, char** argv){
+    ros::init(argc, argv, "odometry_calibration");
+    ros::NodeHandle nh;
+    ros::NodeHandle private_nh("~");
+    SmlNexusOdometryCalibration odometry_calibration(nh, private_nh);
+    ros::spin();
+    return 0;
+}
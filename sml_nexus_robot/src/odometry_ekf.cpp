@@ -0,0 +1,231 @@
+#include <ros/ros.h>
+#include <string>
+#include <boost/make_shared.hpp>
+#include "std_msgs/Float32MultiArray.h"
+#include "sml_nexus_msgs/WheelVelocityStamped.h"
+#include "sml_nexus_msgs/WheelFeedback.h"
+#include "nav_msgs/Odometry.h"
+#include "sensor_msgs/Imu.h"
+#include <tf2/utils.h>
+#include <tf2_ros/transform_broadcaster.h>
+#include <geometry_msgs/TransformStamped.h>
+#include "sml_nexus_robot/planar_ekf.h"
+
+//==========================================================
+//  Odometry from an EKF fusing the wheel feedback of the
+//  low-level controller with, when they are published,
+//  motion capture poses and IMU yaw rates. Publishes odom
+//  with the filter covariances, and the matching TF, at
+//  publish_rate, the state being predicted to the time of
+//  publication.
+//
+//  Wheel feedback is taken from the richest topic the
+//  controller publishes: wheel_feedback, then
+//  wheel_velocity_stamped, then wheel_velocity.
+//==========================================================
+class SmlNexusOdometryEkf
+{
+public:
+    SmlNexusOdometryEkf(ros::NodeHandle& nh, ros::NodeHandle& private_nh){
+        ns = nh.getNamespace()+"/";
+        if (ns == "//") ns = "";
+
+        ekf.wheelbase = private_nh.param("wheelbase", 0.15);
+        ekf.noise.linear_acceleration = private_nh.param("linear_acceleration_std", 1.0);
+        ekf.noise.angular_acceleration = private_nh.param("angular_acceleration_std", 3.0);
+        ekf.noise.wheel_speed = private_nh.param("wheel_speed_std", 0.01);
+        ekf.noise.travel_position = private_nh.param("travel_position_std", ekf.noise.travel_position);
+        ekf.noise.travel_yaw = private_nh.param("travel_yaw_std", ekf.noise.travel_yaw);
+        mocap_position_std = private_nh.param("mocap_position_std", 0.002);
+        mocap_yaw_std = private_nh.param("mocap_yaw_std", 0.01);
+        imu_yaw_rate_std = private_nh.param("imu_yaw_rate_std", 0.02);
+        publish_tf = private_nh.param("publish_tf", true);
+        const double publish_rate = private_nh.param("publish_rate", 100.0);
+
+        //Subscribers: wheel feedback, optional mocap and IMU
+        compact_feedback_sub = nh.subscribe("wheel_feedback", 1000, &SmlNexusOdometryEkf::wheelFeedbackCallback, this);
+        stamped_feedback_sub = nh.subscribe("wheel_velocity_stamped", 1000, &SmlNexusOdometryEkf::wheelVelStampedCallback, this);
+        feedback_sub = nh.subscribe("wheel_velocity", 1000, &SmlNexusOdometryEkf::wheelVelCallback, this);
+        mocap_sub = nh.subscribe("mocap_odom", 100, &SmlNexusOdometryEkf::mocapCallback, this);
+        imu_sub = nh.subscribe("imu", 1000, &SmlNexusOdometryEkf::imuCallback, this);
+        odom_pub = nh.advertise<nav_msgs::Odometry>("odom", 1000);
+
+        odom_msg.header.frame_id = ns+"odom";
+        odom_msg.child_frame_id = ns+"base_link";
+        odom_transform.header.frame_id = ns+"odom";
+        odom_transform.child_frame_id = ns+"base_link";
+
+        publish_timer = nh.createTimer(ros::Duration(1.0 / publish_rate), &SmlNexusOdometryEkf::publishCallback, this);
+        ROS_INFO_STREAM(ns << "Odometry EKF: publishing at " << publish_rate << " Hz");
+    }
+
+private:
+    enum WheelSource { NONE = 0, LEGACY = 1, STAMPED = 2, COMPACT = 3 };
+
+    //Move the filter to the time of a measurement. Measurements older
+    //than the filter are applied at the current filter time
+    void predictTo(const ros::Time& stamp){
+        if (filter_time.isZero()){
+            filter_time = stamp;
+            return;
+        }
+        const double dt = (stamp - filter_time).toSec();
+        if (dt <= 0.0) return;
+        ekf.predict(dt);
+        filter_time = stamp;
+    }
+
+    //Keep the highest priority wheel feedback topic
+    bool acceptWheelSource(WheelSource source){
+        if (source < wheel_source) return false;
+        if (source > wheel_source){
+            wheel_source = source;
+            ROS_INFO_STREAM(ns << "Odometry EKF: fusing wheel feedback from " << (source == COMPACT ? "wheel_feedback" :
+                            source == STAMPED ? "wheel_velocity_stamped" : "wheel_velocity"));
+        }
+        return true;
+    }
+
+    void wheelFeedbackCallback(const sml_nexus_msgs::WheelFeedback& msg){
+        if (!acceptWheelSource(COMPACT)) return;
+        predictTo(ros::Time::now());
+        ekf.updateWheels(msg.speed[0] * 1e-4, msg.speed[1] * 1e-4, msg.speed[2] * 1e-4, msg.speed[3] * 1e-4);
+    }
+
+    void wheelVelStampedCallback(const sml_nexus_msgs::WheelVelocityStamped& msg){
+        if (!acceptWheelSource(STAMPED)) return;
+        predictTo(msg.header.stamp);
+        ekf.updateWheels(msg.UL, msg.UR, msg.LL, msg.LR);
+    }
+
+    void wheelVelCallback(const std_msgs::Float32MultiArray& msg){
+        if (msg.data.size() != 5 || !acceptWheelSource(LEGACY)) return;
+        predictTo(ros::Time::now());
+        ekf.updateWheels(msg.data[0], msg.data[1], msg.data[2], msg.data[3]);
+    }
+
+    void mocapCallback(const nav_msgs::Odometry& msg){
+        const sml_nexus_robot::PlanarEkf::Vector3 pose(msg.pose.pose.position.x,
+                                                       msg.pose.pose.position.y,
+                                                       tf2::getYaw(msg.pose.pose.orientation));
+        //Covariance of the message when it is filled in, parameters otherwise
+        sml_nexus_robot::PlanarEkf::Matrix3 R = sml_nexus_robot::PlanarEkf::Matrix3::Zero();
+        if (msg.pose.covariance[0] > 0.0 && msg.pose.covariance[7] > 0.0 && msg.pose.covariance[35] > 0.0){
+            R(0, 0) = msg.pose.covariance[0];
+            R(1, 1) = msg.pose.covariance[7];
+            R(2, 2) = msg.pose.covariance[35];
+        }
+        else{
+            R(0, 0) = R(1, 1) = mocap_position_std * mocap_position_std;
+            R(2, 2) = mocap_yaw_std * mocap_yaw_std;
+        }
+
+        if (!mocap_received){
+            //Start from the first mocap pose
+            ekf.reset(pose, R.diagonal().cwiseSqrt());
+            filter_time = msg.header.stamp;
+            mocap_received = true;
+            ROS_INFO_STREAM(ns << "Odometry EKF: fusing motion capture poses");
+            return;
+        }
+        predictTo(msg.header.stamp);
+        ekf.updatePose(pose, R);
+    }
+
+    void imuCallback(const sensor_msgs::Imu& msg){
+        const double variance = msg.angular_velocity_covariance[8] > 0.0 ? msg.angular_velocity_covariance[8]
+                                                                         : imu_yaw_rate_std * imu_yaw_rate_std;
+        if (!imu_received){
+            imu_received = true;
+            ROS_INFO_STREAM(ns << "Odometry EKF: fusing IMU yaw rates");
+        }
+        predictTo(msg.header.stamp);
+        ekf.updateYawRate(msg.angular_velocity.z, variance);
+    }
+
+    //==========================================================
+    //  Publish the state predicted to now, on a copy of the
+    //  filter so that measurements arriving late still apply
+    //==========================================================
+    void publishCallback(const ros::TimerEvent&){
+        if (filter_time.isZero()) return;
+        const ros::Time now = ros::Time::now();
+        sml_nexus_robot::PlanarEkf predicted = ekf;
+        const double dt = (now - filter_time).toSec();
+        if (dt > 0.0) predicted.predict(dt);
+
+        const sml_nexus_robot::PlanarEkf::State& x = predicted.state();
+        const sml_nexus_robot::PlanarEkf::Covariance& P = predicted.covariance();
+        const double qz = predicted.quaternionZ();
+        const double qw = predicted.quaternionW();
+
+        nav_msgs::OdometryPtr odom_out = boost::make_shared<nav_msgs::Odometry>(odom_msg);
+        odom_out->header.stamp = now;
+        odom_out->pose.pose.position.x = x(0);
+        odom_out->pose.pose.position.y = x(1);
+        odom_out->pose.pose.orientation.z = qz;
+        odom_out->pose.pose.orientation.w = qw;
+        odom_out->twist.twist.linear.x = x(3);
+        odom_out->twist.twist.linear.y = x(4);
+        odom_out->twist.twist.angular.z = x(5);
+
+        //Planar states into the 6x6 (x, y, z, roll, pitch, yaw) covariances.
+        //z, roll and pitch are not estimated
+        const int planar[3] = {0, 1, 5};
+        for (int i = 0; i < 3; i++){
+            for (int j = 0; j < 3; j++){
+                odom_out->pose.covariance[planar[i] * 6 + planar[j]] = P(i, j);
+                odom_out->twist.covariance[planar[i] * 6 + planar[j]] = P(3 + i, 3 + j);
+            }
+        }
+        for (int k = 2; k < 5; k++){
+            odom_out->pose.covariance[k * 6 + k] = 1e6;
+            odom_out->twist.covariance[k * 6 + k] = 1e6;
+        }
+        odom_pub.publish(nav_msgs::OdometryConstPtr(odom_out));
+
+        if (publish_tf){
+            odom_transform.header.stamp = now;
+            odom_transform.transform.translation.x = x(0);
+            odom_transform.transform.translation.y = x(1);
+            odom_transform.transform.rotation.z = qz;
+            odom_transform.transform.rotation.w = qw;
+            transform_broadcaster.sendTransform(odom_transform);
+        }
+    }
+
+    std::string ns;
+    ros::Subscriber compact_feedback_sub;
+    ros::Subscriber stamped_feedback_sub;
+    ros::Subscriber feedback_sub;
+    ros::Subscriber mocap_sub;
+    ros::Subscriber imu_sub;
+    ros::Publisher odom_pub;
+    ros::Timer publish_timer;
+    tf2_ros::TransformBroadcaster transform_broadcaster;
+
+    sml_nexus_robot::PlanarEkf ekf;
+    ros::Time filter_time;
+    WheelSource wheel_source = NONE;
+    bool mocap_received = false;
+    bool imu_received = false;
+
+    double mocap_position_std;
+    double mocap_yaw_std;
+    double imu_yaw_rate_std;
+    bool publish_tf;
+    nav_msgs::Odometry odom_msg;
+    geometry_msgs::TransformStamped odom_transform;
+};
+
+//==============================
+//             Main
+//==============================
+int main(int argc, char** argv){
+    ros::init(argc, argv, "odometry_ekf");
+    ros::NodeHandle nh;
+    ros::NodeHandle private_nh("~");
+    SmlNexusOdometryEkf odometry_ekf(nh, private_nh);
+    ros::spin();
+    return 0;
+}
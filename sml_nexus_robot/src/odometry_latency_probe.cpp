@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <ros/ros.h>
+#include "nav_msgs/Odometry.h"
+
+namespace sml_nexus_robot
+{
+
+//==========================================================
+//  Measures the delivery latency of odom, i.e. the time
+//  between the odometry stamp and its reception.
+//
+//  Loaded in the broadcaster's nodelet manager it measures
+//  the zero-copy intra-process path; run with
+//  "nodelet standalone" it measures the TCPROS path.
+//==========================================================
+class OdometryLatencyProbe : public nodelet::Nodelet
+{
+private:
+    virtual void onInit(){
+        ros::NodeHandle& nh = getNodeHandle();
+        ros::NodeHandle& private_nh = getPrivateNodeHandle();
+        double report_period = private_nh.param("report_period", 5.0);
+
+        resetStats();
+        odom_sub = nh.subscribe("odom", 1000, &OdometryLatencyProbe::odomCallback, this);
+        report_timer = nh.createWallTimer(ros::WallDuration(report_period), &OdometryLatencyProbe::report, this);
+    }
+
+    void odomCallback(const nav_msgs::OdometryConstPtr& msg){
+        const double latency_us = (ros::Time::now() - msg->header.stamp).toSec() * 1e6;
+        sum_us += latency_us;
+        min_us = std::min(min_us, latency_us);
+        max_us = std::max(max_us, latency_us);
+        samples++;
+    }
+
+    void report(const ros::WallTimerEvent&){
+        if (samples == 0){
+            NODELET_WARN_STREAM("Odometry latency probe: no odom received");
+            return;
+        }
+        NODELET_INFO_STREAM("Odometry latency over " << samples << " msgs [us]: mean " << sum_us / samples
+                            << ", min " << min_us << ", max " << max_us);
+        resetStats();
+    }
+
+    void resetStats(){
+        samples = 0;
+        sum_us = 0.0;
+        min_us = 1e12;
+        max_us = 0.0;
+    }
+
+    ros::Subscriber odom_sub;
+    ros::WallTimer report_timer;
+    unsigned long samples;
+    double sum_us, min_us, max_us;
+};
+
+} // namespace sml_nexus_robot
+
+PLUGINLIB_EXPORT_CLASS(sml_nexus_robot::OdometryLatencyProbe, nodelet::Nodelet)
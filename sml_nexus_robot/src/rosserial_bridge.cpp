@@ -0,0 +1,489 @@
+#include <sstream>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <ros/serialization.h>
+#include "sensor_msgs/Range.h"
+#include "sensor_msgs/Temperature.h"
+#include "std_msgs/Float32MultiArray.h"
+#include "sml_nexus_msgs/WheelFeedback.h"
+#include "sml_nexus_msgs/WheelVelocityStamped.h"
+#include "sml_nexus_robot/rosserial_bridge.h"
+
+namespace rosserial = sml_nexus_robot::rosserial;
+
+namespace
+{
+
+//==========================================================
+//  Device publisher of a type known at compile time,
+//  deserialized straight into a preallocated message. The
+//  message is reused from one frame to the next unless an
+//  intra-process subscriber still holds it, so that the
+//  arrays keep their capacity.
+//==========================================================
+template <typename M>
+class TypedPublication : public SmlNexusRosserialBridge::Publication
+{
+public:
+    TypedPublication(ros::NodeHandle& nh, const std::string& topic_name, int queue_size){
+        topic = topic_name;
+        type = ros::message_traits::datatype<M>();
+        pub = nh.advertise<M>(topic_name, queue_size);
+    }
+
+    virtual bool publish(const uint8_t* data, size_t length){
+        if (!msg || !msg.unique()) msg = boost::make_shared<M>();
+        try{
+            ros::serialization::IStream stream(const_cast<uint8_t*>(data), length);
+            ros::serialization::deserialize(stream, *msg);
+        }
+        catch (const ros::serialization::StreamOverrunException&){
+            return false;
+        }
+        pub.publish(msg);
+        return true;
+    }
+
+private:
+    ros::Publisher pub;
+    boost::shared_ptr<M> msg;
+};
+
+//==========================================================
+//  Device publisher of any other type, passed through in
+//  its serialized form
+//==========================================================
+class SerializedPublication : public SmlNexusRosserialBridge::Publication
+{
+public:
+    SerializedPublication(ros::NodeHandle& nh, const rosserial::TopicInfo& info, int queue_size){
+        topic = info.topic_name;
+        type = info.message_type;
+        shape.morph(info.md5sum, info.message_type, "", "false");
+        pub = shape.advertise(nh, info.topic_name, queue_size);
+    }
+
+    virtual bool publish(const uint8_t* data, size_t length){
+        boost::shared_ptr<topic_tools::ShapeShifter> msg = boost::make_shared<topic_tools::ShapeShifter>(shape);
+        ros::serialization::IStream stream(const_cast<uint8_t*>(data), length);
+        msg->read(stream);
+        pub.publish(msg);
+        return true;
+    }
+
+private:
+    ros::Publisher pub;
+    topic_tools::ShapeShifter shape;
+};
+
+//Typed publication when the device type and md5sum are those of M
+template <typename M>
+bool makeTypedPublication(ros::NodeHandle& nh, const rosserial::TopicInfo& info, int queue_size,
+                          std::shared_ptr<SmlNexusRosserialBridge::Publication>& publication){
+    if (info.message_type != ros::message_traits::datatype<M>()) return false;
+    if (info.md5sum != ros::message_traits::md5sum<M>()) return false;
+    publication = std::make_shared<TypedPublication<M> >(nh, info.topic_name, queue_size);
+    return true;
+}
+
+} // namespace
+
+//=====================
+//        constructor
+//=====================
+SmlNexusRosserialBridge::SmlNexusRosserialBridge(ros::NodeHandle& nh_, ros::NodeHandle& private_nh)
+    : nh(nh_), running(false), frames_in(0), frames_out(0), bytes_in(0), write_errors(0),
+      deserialization_errors(0), checksum_errors(0), dropped_bytes(0), unknown_frames(0),
+      topic_requests(0), synced(false), connected(false){
+    ns = nh.getNamespace()+"/";
+    if (ns == "//") ns = "";
+
+    //Same parameters as serial_node.py
+    port = private_nh.param("port", std::string("/dev/ttyACM0"));
+    baud = private_nh.param("baud", 57600);
+    sync_timeout = private_nh.param("sync_timeout", 5.0);
+    parser = rosserial::FrameParser(private_nh.param("max_frame_length", 2048));
+    write_buffer.reserve(512);
+    message_buffer.reserve(512);
+
+    diagnostics_pub = nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
+    diagnostics_timer = nh.createTimer(ros::Duration(1.0), &SmlNexusRosserialBridge::diagnosticsCallback, this);
+
+    ROS_INFO_STREAM(ns << "Rosserial bridge: connecting to " << port << " at " << baud << " baud");
+    if (!reconnect()){
+        ROS_WARN_STREAM(ns << "Rosserial bridge: " << link.error() << ", retrying every second");
+    }
+    running = true;
+    reader = std::thread(&SmlNexusRosserialBridge::readLoop, this);
+}
+
+SmlNexusRosserialBridge::~SmlNexusRosserialBridge(){
+    running = false;
+    link.wake();
+    if (reader.joinable()) reader.join();
+
+    //Tell the device the host is gone, as serial_node.py does
+    std::lock_guard<std::mutex> lock(write_mutex);
+    if (link.isOpen()){
+        write_buffer.clear();
+        rosserial::encodeFrame(rosserial::ID_TX_STOP, NULL, 0, write_buffer);
+        link.write(write_buffer.data(), write_buffer.size());
+    }
+    link.close();
+}
+
+//==========================================================
+//  Reader thread: wait for bytes, parse and handle the
+//  frames, and keep the device synced
+//==========================================================
+void SmlNexusRosserialBridge::readLoop(){
+    uint8_t buffer[1024];
+    ros::WallTime last_reconnect = ros::WallTime::now();
+    last_received = last_reconnect;
+    requestTopics();
+
+    while (running){
+        if (!connected){
+            const ros::WallTime now = ros::WallTime::now();
+            if ((now - last_reconnect).toSec() >= 1.0){
+                last_reconnect = now;
+                if (reconnect()){
+                    ROS_INFO_STREAM(ns << "Rosserial bridge: reconnected to " << port);
+                    last_received = now;
+                    requestTopics();
+                }
+            }
+            ros::WallDuration(0.1).sleep();
+            continue;
+        }
+
+        //Wake up at least every 100 ms for the sync timeout and shutdown
+        if (link.wait(100)){
+            const ssize_t count = link.read(buffer, sizeof(buffer));
+            if (count < 0){
+                ROS_ERROR_STREAM(ns << "Rosserial bridge: lost " << port << ", reconnecting");
+                std::lock_guard<std::mutex> lock(write_mutex);
+                link.close();
+                connected = false;
+                synced = false;
+                continue;
+            }
+            if (count > 0){
+                bytes_in += count;
+                const unsigned long frames_before = parser.frames();
+                parser.feed(buffer, count, [this](uint16_t topic, const uint8_t* data, size_t length){
+                    handleFrame(topic, data, length);
+                });
+                if (parser.frames() != frames_before) last_received = ros::WallTime::now();
+                frames_in = parser.frames();
+                checksum_errors = parser.checksumErrors() + parser.lengthErrors();
+                dropped_bytes = parser.skippedBytes();
+            }
+        }
+
+        //Request the topics until the device answers, then when it
+        //stays silent for sync_timeout
+        const ros::WallTime now = ros::WallTime::now();
+        if (!synced && (now - last_topic_request).toSec() >= 1.0) requestTopics();
+        else if (synced && (now - last_received).toSec() > sync_timeout){
+            ROS_WARN_STREAM(ns << "Rosserial bridge: lost sync with the device, requesting its topics");
+            synced = false;
+            requestTopics();
+        }
+    }
+}
+
+bool SmlNexusRosserialBridge::reconnect(){
+    std::lock_guard<std::mutex> lock(write_mutex);
+    connected = link.open(port, baud);
+    parser.reset();
+    return connected;
+}
+
+//=======================================
+//  Dispatch a frame by its topic id
+//=======================================
+void SmlNexusRosserialBridge::handleFrame(uint16_t topic, const uint8_t* data, size_t length){
+    switch (topic){
+        case rosserial::ID_PUBLISHER:
+            setupPublisher(data, length);
+            return;
+        case rosserial::ID_SUBSCRIBER:
+            setupSubscriber(data, length);
+            return;
+        case rosserial::ID_TIME:
+            handleTimeRequest();
+            return;
+        case rosserial::ID_PARAMETER_REQUEST:
+            handleParameterRequest(data, length);
+            return;
+        case rosserial::ID_LOG:
+            handleLog(data, length);
+            return;
+        default:
+            break;
+    }
+
+    std::map<uint16_t, std::shared_ptr<Publication> >::iterator publication = publications.find(topic);
+    if (publication != publications.end()){
+        if (!publication->second->publish(data, length)){
+            deserialization_errors++;
+            ROS_WARN_STREAM_THROTTLE(1.0, ns << "Rosserial bridge: malformed " << publication->second->type
+                                     << " on " << publication->second->topic);
+        }
+    }
+    else if (topic >= rosserial::ID_SERVICE_SERVER && topic < rosserial::ID_PARAMETER_REQUEST){
+        if (!service_warned){
+            ROS_WARN_STREAM(ns << "Rosserial bridge: services are not supported, ignoring them");
+            service_warned = true;
+        }
+    }
+    else{
+        //Published before the topics were negotiated, e.g. after a reset of the device
+        unknown_frames++;
+        if ((ros::WallTime::now() - last_topic_request).toSec() >= 1.0) requestTopics();
+    }
+}
+
+//=======================================
+//  Device publishers and subscribers
+//=======================================
+void SmlNexusRosserialBridge::setupPublisher(const uint8_t* data, size_t length){
+    rosserial::TopicInfo info;
+    if (!info.read(data, length)){
+        deserialization_errors++;
+        return;
+    }
+    synced = true;
+
+    //Advertised again on every topic request, keep the existing publisher
+    std::shared_ptr<Publication>& publication = publications[info.topic_id];
+    if (publication && publication->topic == info.topic_name && publication->type == info.message_type) return;
+
+    //The firmware topics are deserialized into their types, anything else is passed through
+    const int queue_size = 100;
+    if (!makeTypedPublication<sml_nexus_msgs::WheelFeedback>(nh, info, queue_size, publication) &&
+        !makeTypedPublication<sml_nexus_msgs::WheelVelocityStamped>(nh, info, queue_size, publication) &&
+        !makeTypedPublication<std_msgs::Float32MultiArray>(nh, info, queue_size, publication) &&
+        !makeTypedPublication<sensor_msgs::Range>(nh, info, queue_size, publication) &&
+        !makeTypedPublication<sensor_msgs::Temperature>(nh, info, queue_size, publication)){
+        publication = std::make_shared<SerializedPublication>(nh, info, queue_size);
+    }
+    ROS_INFO_STREAM(ns << "Rosserial bridge: publishing " << info.topic_name << " [" << info.message_type << "]");
+}
+
+void SmlNexusRosserialBridge::setupSubscriber(const uint8_t* data, size_t length){
+    rosserial::TopicInfo info;
+    if (!info.read(data, length)){
+        deserialization_errors++;
+        return;
+    }
+    synced = true;
+
+    std::shared_ptr<Subscription>& subscription = subscriptions[info.topic_id];
+    if (subscription && subscription->topic == info.topic_name && subscription->md5sum == info.md5sum) return;
+
+    subscription = std::make_shared<Subscription>();
+    subscription->topic = info.topic_name;
+    subscription->type = info.message_type;
+    subscription->md5sum = info.md5sum;
+    //Commands go out as soon as they are received, without Nagle's delay
+    subscription->sub = nh.subscribe<topic_tools::ShapeShifter>(info.topic_name, 10,
+        boost::bind(&SmlNexusRosserialBridge::subscriptionCallback, this, _1, info.topic_id, info.md5sum),
+        ros::VoidConstPtr(), ros::TransportHints().tcpNoDelay());
+    ROS_INFO_STREAM(ns << "Rosserial bridge: subscribing to " << info.topic_name << " [" << info.message_type << "]");
+}
+
+//==========================================================
+//  Forward a message to the device in its serialized
+//  form, if its type is the one the device expects
+//==========================================================
+void SmlNexusRosserialBridge::subscriptionCallback(const topic_tools::ShapeShifter::ConstPtr& msg, uint16_t topic_id,
+                                                   const std::string& md5sum){
+    if (msg->getMD5Sum() != md5sum){
+        ROS_WARN_STREAM_THROTTLE(1.0, ns << "Rosserial bridge: dropping " << msg->getDataType()
+                                 << ", the device expects another type on this topic");
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(write_mutex);
+    message_buffer.resize(msg->size());
+    ros::serialization::OStream stream(message_buffer.data(), message_buffer.size());
+    msg->write(stream);
+
+    write_buffer.clear();
+    rosserial::encodeFrame(topic_id, message_buffer.data(), message_buffer.size(), write_buffer);
+    if (!link.isOpen()) return;
+    if (link.write(write_buffer.data(), write_buffer.size())) frames_out++;
+    else{
+        write_errors++;
+        ROS_WARN_STREAM_THROTTLE(1.0, ns << "Rosserial bridge: " << link.error());
+    }
+}
+
+//=======================================
+//  Handshake, time and parameters
+//=======================================
+void SmlNexusRosserialBridge::requestTopics(){
+    last_topic_request = ros::WallTime::now();
+    if (sendFrame(rosserial::ID_PUBLISHER, NULL, 0)) topic_requests++;
+}
+
+bool SmlNexusRosserialBridge::sendFrame(uint16_t topic, const uint8_t* data, size_t length){
+    std::lock_guard<std::mutex> lock(write_mutex);
+    if (!link.isOpen()) return false;
+    write_buffer.clear();
+    rosserial::encodeFrame(topic, data, length, write_buffer);
+    if (!link.write(write_buffer.data(), write_buffer.size())){
+        write_errors++;
+        ROS_WARN_STREAM_THROTTLE(1.0, ns << "Rosserial bridge: " << link.error());
+        return false;
+    }
+    frames_out++;
+    return true;
+}
+
+void SmlNexusRosserialBridge::handleTimeRequest(){
+    const ros::Time now = ros::Time::now();
+    uint8_t data[8];
+    const uint32_t time[2] = {now.sec, now.nsec};
+    std::memcpy(data, time, sizeof(data));
+    sendFrame(rosserial::ID_TIME, data, sizeof(data));
+}
+
+//==========================================================
+//  Parameter of the robot namespace, as ints, floats or
+//  strings. An empty response for a missing or unsupported
+//  parameter, so that the device falls back to its default
+//  at once instead of after its request timeout.
+//==========================================================
+void SmlNexusRosserialBridge::handleParameterRequest(const uint8_t* data, size_t length){
+    rosserial::Reader reader(data, length);
+    const std::string name = reader.readString();
+    if (!reader.ok()){
+        deserialization_errors++;
+        return;
+    }
+
+    rosserial::ParamResponse response;
+    XmlRpc::XmlRpcValue value;
+    if (!nh.getParam(name, value)){
+        ROS_ERROR_STREAM(ns << "Rosserial bridge: parameter " << name << " does not exist");
+    }
+    else{
+        XmlRpc::XmlRpcValue values;
+        if (value.getType() == XmlRpc::XmlRpcValue::TypeArray) values = value;
+        else{
+            values.setSize(1);
+            values[0] = value;
+        }
+        for (int i = 0; i < values.size(); i++){
+            switch (values[i].getType()){
+                case XmlRpc::XmlRpcValue::TypeInt:
+                    response.ints.push_back(static_cast<int>(values[i]));
+                    break;
+                case XmlRpc::XmlRpcValue::TypeBoolean:
+                    response.ints.push_back(static_cast<bool>(values[i]) ? 1 : 0);
+                    break;
+                case XmlRpc::XmlRpcValue::TypeDouble:
+                    response.floats.push_back(static_cast<double>(values[i]));
+                    break;
+                case XmlRpc::XmlRpcValue::TypeString:
+                    response.strings.push_back(static_cast<std::string>(values[i]));
+                    break;
+                default:
+                    ROS_ERROR_STREAM(ns << "Rosserial bridge: parameter " << name << " has an unsupported type");
+                    response = rosserial::ParamResponse();
+                    i = values.size();
+                    break;
+            }
+        }
+    }
+
+    std::vector<uint8_t> out;
+    response.write(out);
+    sendFrame(rosserial::ID_PARAMETER_REQUEST, out.data(), out.size());
+}
+
+void SmlNexusRosserialBridge::handleLog(const uint8_t* data, size_t length){
+    rosserial::Reader reader(data, length);
+    const uint8_t level = reader.read<uint8_t>();
+    const std::string msg = reader.readString();
+    if (!reader.ok()){
+        deserialization_errors++;
+        return;
+    }
+    switch (level){
+        case rosserial::LOG_DEBUG: ROS_DEBUG_STREAM(ns << "Low-level controller: " << msg); break;
+        case rosserial::LOG_INFO: ROS_INFO_STREAM(ns << "Low-level controller: " << msg); break;
+        case rosserial::LOG_WARN: ROS_WARN_STREAM(ns << "Low-level controller: " << msg); break;
+        case rosserial::LOG_ERROR: ROS_ERROR_STREAM(ns << "Low-level controller: " << msg); break;
+        default: ROS_FATAL_STREAM(ns << "Low-level controller: " << msg); break;
+    }
+}
+
+//==========================================================
+//  Frame rates and link errors, on /diagnostics once per
+//  second
+//==========================================================
+void SmlNexusRosserialBridge::diagnosticsCallback(const ros::TimerEvent& event){
+    const ros::Time now = ros::Time::now();
+    if (last_diagnostics.isZero()){
+        last_diagnostics = now;
+        return;
+    }
+    const double elapsed = (now - last_diagnostics).toSec();
+    if (elapsed <= 0.0) return;
+
+    diagnostic_msgs::DiagnosticArray diagnostics;
+    diagnostics.header.stamp = now;
+    diagnostics.status.resize(1);
+    diagnostic_msgs::DiagnosticStatus& status = diagnostics.status[0];
+    status.name = ns + "rosserial_bridge";
+    status.hardware_id = port;
+    const unsigned long frames = frames_in, frames_sent = frames_out, bytes = bytes_in;
+    if (!connected){
+        status.level = diagnostic_msgs::DiagnosticStatus::ERROR;
+        status.message = "Port not open";
+    }
+    else if (!synced){
+        status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+        status.message = "Waiting for the device topics";
+    }
+    else if (frames == last_frames_in){
+        status.level = diagnostic_msgs::DiagnosticStatus::ERROR;
+        status.message = "No frames from the device";
+    }
+    else{
+        status.level = diagnostic_msgs::DiagnosticStatus::OK;
+        status.message = "OK";
+    }
+
+    const double rates[3] = {(frames - last_frames_in) / elapsed,
+                             (frames_sent - last_frames_out) / elapsed,
+                             (bytes - last_bytes_in) / elapsed};
+    const char* rate_keys[3] = {"Frames received (Hz)", "Frames sent (Hz)", "Bytes received (B/s)"};
+    const unsigned long counts[6] = {checksum_errors, dropped_bytes, deserialization_errors,
+                                     unknown_frames, write_errors, topic_requests};
+    const char* count_keys[6] = {"Checksum errors", "Dropped bytes", "Malformed messages",
+                                 "Unknown topic frames", "Write errors", "Topic requests"};
+    status.values.resize(9);
+    for (int i = 0; i < 3; i++){
+        std::ostringstream rate;
+        rate << rates[i];
+        status.values[i].key = rate_keys[i];
+        status.values[i].value = rate.str();
+    }
+    for (int i = 0; i < 6; i++){
+        std::ostringstream count;
+        count << counts[i];
+        status.values[3 + i].key = count_keys[i];
+        status.values[3 + i].value = count.str();
+    }
+    diagnostics_pub.publish(diagnostics);
+
+    last_frames_in = frames;
+    last_frames_out = frames_sent;
+    last_bytes_in = bytes;
+    last_diagnostics = now;
+}
@@ -0,0 +1,14 @@
+#include <ros/ros.h>
+#include "sml_nexus_robot/rosserial_bridge.h"
+
+//==============================
+//             Main
+//==============================
+int main(int argc, char** argv){
+    ros::init(argc, argv, "rosserial_bridge");
+    ros::NodeHandle nh;
+    ros::NodeHandle private_nh("~");
+    SmlNexusRosserialBridge bridge(nh, private_nh);
+    ros::spin();
+    return 0;
+}
@@ -0,0 +1,27 @@
+#include <boost/shared_ptr.hpp>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include "sml_nexus_robot/rosserial_bridge.h"
+
+namespace sml_nexus_robot
+{
+
+//==========================================================
+//  Nodelet wrapper of the rosserial bridge. Loaded in the
+//  manager of the odometry broadcaster, the wheel feedback
+//  goes from the serial port to the odometry by shared
+//  pointer, without TCPROS in between.
+//==========================================================
+class RosserialBridgeNodelet : public nodelet::Nodelet
+{
+private:
+    virtual void onInit(){
+        bridge.reset(new SmlNexusRosserialBridge(getNodeHandle(), getPrivateNodeHandle()));
+    }
+
+    boost::shared_ptr<SmlNexusRosserialBridge> bridge;
+};
+
+} // namespace sml_nexus_robot
+
+PLUGINLIB_EXPORT_CLASS(sml_nexus_robot::RosserialBridgeNodelet, nodelet::Nodelet)
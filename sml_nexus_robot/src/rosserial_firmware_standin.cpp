@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "sml_nexus_robot/rosserial_protocol.h"
+#include "sml_nexus_robot/serial_link.h"
+#include "sml_nexus_kinematics.h"
+
+//==========================================================
+//  Stand-in for the low-level controller on a pseudo
+//  terminal, to run a rosserial bridge without the robot.
+//  ROS-free, it speaks the device side of rosserial as the
+//  firmware does:
+//    - advertises wheel_feedback, wheel_velocity and
+//      front_range, subscribes to cmd_vel_compact
+//    - requests the time and the wheelbase parameter once
+//      the topics are negotiated, and the time every 5 s
+//    - integrates cmd_vel_compact into wheel_feedback and
+//      wheel_velocity at --rate Hz (50 by default), with a
+//      500 ms command timeout, and front_range at 10 Hz
+//  With --echo, it publishes nothing periodically and
+//  answers every cmd_vel_compact at once with a
+//  wheel_feedback whose seq is the vx of the command, for
+//  round trip measurements through the bridge.
+//
+//  The slave side of the pty is linked at --link
+//  (/tmp/sml_nexus_standin by default), the port of the
+//  bridge. Arguments of roslaunch (__name:= etc.) are
+//  ignored.
+//==========================================================
+
+namespace rosserial = sml_nexus_robot::rosserial;
+
+namespace
+{
+
+//Device topic ids as rosserial_arduino: subscribers from 100, publishers from 125
+enum StandinTopic {CMD_VEL_COMPACT = 100, WHEEL_FEEDBACK = 125, WHEEL_VELOCITY = 126, FRONT_RANGE = 127};
+
+const char* WHEEL_FEEDBACK_MD5 = "3e361366c800280e506389fd5f2d0eed";
+const char* VELOCITY_COMMAND_MD5 = "08d8eb7955a914b95f9549c5728c93e8";
+const char* FLOAT32_MULTI_ARRAY_MD5 = "6a40e0ffa6a17a503ac3f8616991b1f6";
+const char* RANGE_MD5 = "c005c34273dc426c67a020a87bc24148";
+
+typedef nexusGeometry<nexusMecanum2x> Geometry;
+const double WHEELBASE = Geometry::wheelbase();         //m, default of the firmware
+const double TICK_TO_METERS = Geometry::tickToMeters();
+const double COMMAND_TIMEOUT = 0.5;   //s
+
+volatile std::sig_atomic_t running = 1;
+void stop(int) { running = 0; }
+
+double seconds(){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class FirmwareStandin
+{
+public:
+    FirmwareStandin(bool echo, double rate) : echo(echo), period(1.0 / rate) {}
+
+    bool open(const std::string& link_path){
+        const int master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0){
+            std::perror("posix_openpt");
+            return false;
+        }
+        const std::string slave_path = ptsname(master);
+        //Keep the slave open, the master would read EIO between two bridges
+        slave = ::open(slave_path.c_str(), O_RDWR | O_NOCTTY);
+        if (slave < 0 || !link.attach(master, 0)){
+            std::fprintf(stderr, "Firmware stand-in: %s\n", link.error().c_str());
+            return false;
+        }
+        unlink(link_path.c_str());
+        if (symlink(slave_path.c_str(), link_path.c_str()) != 0){
+            std::perror("symlink");
+            return false;
+        }
+        std::printf("Firmware stand-in: %s -> %s%s\n", link_path.c_str(), slave_path.c_str(), echo ? ", echo mode" : "");
+        std::fflush(stdout);
+        return true;
+    }
+
+    void run(){
+        uint8_t buffer[1024];
+        double next_tick = seconds() + period;
+        double next_report = seconds() + 5.0;
+        while (running){
+            const int timeout_ms = std::max(0, static_cast<int>(1000.0 * (next_tick - seconds())));
+            if (link.wait(timeout_ms)){
+                const ssize_t count = link.read(buffer, sizeof(buffer));
+                if (count > 0){
+                    parser.feed(buffer, count, [this](uint16_t topic, const uint8_t* data, size_t length){
+                        handleFrame(topic, data, length);
+                    });
+                }
+            }
+
+            const double now = seconds();
+            if (now >= next_tick){
+                if (configured && !echo) publishFeedback(now);
+                if (configured && now - last_time_request > 5.0) requestTime(now);
+                next_tick += period;
+                if (next_tick < now) next_tick = now + period;
+            }
+            if (now >= next_report){
+                std::printf("Firmware stand-in: %s, %lu frames in, %lu out, %lu checksum errors, %lu commands\n",
+                            configured ? "configured" : "waiting for the host", parser.frames(), frames_out,
+                            parser.checksumErrors(), commands);
+                std::fflush(stdout);
+                next_report = now + 5.0;
+            }
+        }
+    }
+
+private:
+    void handleFrame(uint16_t topic, const uint8_t* data, size_t length){
+        if (topic == rosserial::ID_PUBLISHER){
+            //Topic request of the host
+            negotiateTopics();
+            configured = true;
+            requestTime(seconds());
+            requestParameter("wheelbase");
+        }
+        else if (topic == rosserial::ID_TX_STOP){
+            configured = false;
+        }
+        else if (topic == rosserial::ID_TIME && length >= 8){
+            uint32_t time[2];
+            std::memcpy(time, data, sizeof(time));
+            host_time = time[0] + 1e-9 * time[1];
+            host_time_offset = host_time - seconds();
+        }
+        else if (topic == rosserial::ID_PARAMETER_REQUEST){
+            rosserial::Reader reader(data, length);
+            const uint32_t int_count = reader.read<uint32_t>();
+            for (uint32_t i = 0; i < int_count; i++) reader.read<int32_t>();
+            const uint32_t float_count = reader.read<uint32_t>();
+            if (reader.ok() && float_count == 1){
+                std::printf("Firmware stand-in: wheelbase %g\n", reader.read<float>());
+            }
+            else std::printf("Firmware stand-in: no wheelbase, using %g\n", WHEELBASE);
+            std::fflush(stdout);
+        }
+        else if (topic == CMD_VEL_COMPACT && length == 6){
+            int16_t command[3];
+            std::memcpy(command, data, sizeof(command));
+            commands++;
+            if (echo){
+                feedback_seq = static_cast<uint16_t>(command[0]);
+                publishWheelFeedback(0, velocities);
+                return;
+            }
+            //Inverse kinematics of the firmware, UL, UR, LL, LR
+            const double vx = 1e-3 * command[0], vy = 1e-3 * command[1], w = 1e-3 * command[2];
+            for (int k = 0; k < 4; k++) velocities[k] = Geometry::wheelSpeed(k, vx, vy, w);
+            last_command = seconds();
+        }
+    }
+
+    void negotiateTopics(){
+        const struct { uint16_t id; rosserial::TopicId kind; const char* name; const char* type; const char* md5; } topics[] = {
+            {CMD_VEL_COMPACT, rosserial::ID_SUBSCRIBER, "cmd_vel_compact", "sml_nexus_msgs/VelocityCommand", VELOCITY_COMMAND_MD5},
+            {WHEEL_FEEDBACK, rosserial::ID_PUBLISHER, "wheel_feedback", "sml_nexus_msgs/WheelFeedback", WHEEL_FEEDBACK_MD5},
+            {WHEEL_VELOCITY, rosserial::ID_PUBLISHER, "wheel_velocity", "std_msgs/Float32MultiArray", FLOAT32_MULTI_ARRAY_MD5},
+            {FRONT_RANGE, rosserial::ID_PUBLISHER, "front_range", "sensor_msgs/Range", RANGE_MD5}};
+        for (const auto& topic : topics){
+            rosserial::TopicInfo info;
+            info.topic_id = topic.id;
+            info.topic_name = topic.name;
+            info.message_type = topic.type;
+            info.md5sum = topic.md5;
+            info.buffer_size = 512;
+            message.clear();
+            info.write(message);
+            send(topic.kind, message);
+        }
+    }
+
+    void requestTime(double now){
+        last_time_request = now;
+        message.assign(8, 0);
+        send(rosserial::ID_TIME, message);
+    }
+
+    void requestParameter(const std::string& name){
+        message.clear();
+        rosserial::Writer(message).writeString(name);
+        send(rosserial::ID_PARAMETER_REQUEST, message);
+    }
+
+    //Encoder feedback of the commanded wheel speeds, as a perfect plant
+    void publishFeedback(double now){
+        if (now - last_command > COMMAND_TIMEOUT){
+            for (int k = 0; k < 4; k++) velocities[k] = 0.0;
+        }
+        int16_t ticks[4];
+        for (int k = 0; k < 4; k++){
+            tick_residual[k] += velocities[k] * period / TICK_TO_METERS;
+            ticks[k] = static_cast<int16_t>(std::lround(tick_residual[k]));
+            tick_residual[k] -= ticks[k];
+        }
+        feedback_seq++;
+        publishWheelFeedback(ticks, velocities);
+
+        //Legacy wheel_velocity: UL, UR, LL, LR in m/s and dt in ms
+        message.clear();
+        rosserial::Writer writer(message);
+        writer.write<uint32_t>(0); //layout.dim
+        writer.write<uint32_t>(0); //layout.data_offset
+        writer.write<uint32_t>(5);
+        for (int k = 0; k < 4; k++) writer.write<float>(static_cast<float>(velocities[k]));
+        writer.write<float>(static_cast<float>(1000.0 * period));
+        send(WHEEL_VELOCITY, message);
+
+        //Nothing in front, 10 Hz
+        if (++range_decimation >= std::max(1, static_cast<int>(0.1 / period))){
+            range_decimation = 0;
+            const double stamp = now + host_time_offset;
+            message.clear();
+            rosserial::Writer range(message);
+            range.write<uint32_t>(range_seq++);
+            range.write<uint32_t>(static_cast<uint32_t>(stamp));
+            range.write<uint32_t>(static_cast<uint32_t>(1e9 * (stamp - std::floor(stamp))));
+            range.writeString("front_sonar");
+            range.write<uint8_t>(0);        //ULTRASOUND
+            range.write<float>(60.0f);      //field of view, as the firmware
+            range.write<float>(0.04f);
+            range.write<float>(5.0f);
+            range.write<float>(500.0f);     //cm
+            send(FRONT_RANGE, message);
+        }
+    }
+
+    void publishWheelFeedback(const int16_t* ticks, const double* speeds){
+        message.clear();
+        rosserial::Writer writer(message);
+        writer.write<uint16_t>(feedback_seq);
+        writer.write<uint16_t>(static_cast<uint16_t>(1e6 * period));
+        for (int k = 0; k < 4; k++) writer.write<int16_t>(ticks ? ticks[k] : 0);
+        for (int k = 0; k < 4; k++) writer.write<int16_t>(static_cast<int16_t>(std::lround(1e4 * speeds[k])));
+        send(WHEEL_FEEDBACK, message);
+    }
+
+    void send(uint16_t topic, const std::vector<uint8_t>& data){
+        frame.clear();
+        rosserial::encodeFrame(topic, data.data(), data.size(), frame);
+        if (link.write(frame.data(), frame.size())) frames_out++;
+    }
+
+    bool echo;
+    double period;                     //s, feedback period
+    int slave = -1;
+    sml_nexus_robot::SerialLink link;
+    rosserial::FrameParser parser;
+    std::vector<uint8_t> message, frame;
+
+    bool configured = false;
+    double last_time_request = 0.0;
+    double host_time = 0.0, host_time_offset = 0.0;
+    double last_command = 0.0;
+    double velocities[4] = {0.0, 0.0, 0.0, 0.0};  //m/s, UL, UR, LL, LR
+    double tick_residual[4] = {0.0, 0.0, 0.0, 0.0};
+    uint16_t feedback_seq = 0;
+    uint32_t range_seq = 0;
+    int range_decimation = 0;
+    unsigned long frames_out = 0, commands = 0;
+};
+
+} // namespace
+
+//==============================
+//             Main
+//==============================
+int main(int argc, char** argv){
+    std::string link_path = "/tmp/sml_nexus_standin";
+    bool echo = false;
+    double rate = 50.0;
+    for (int i = 1; i < argc; i++){
+        const std::string arg = argv[i];
+        if (arg == "--link" && i + 1 < argc) link_path = argv[++i];
+        else if (arg == "--rate" && i + 1 < argc) rate = std::atof(argv[++i]);
+        else if (arg == "--echo") echo = true;
+        else if (arg.compare(0, 2, "__") == 0) continue;
+        else{
+            std::fprintf(stderr, "Usage: %s [--link PATH] [--rate HZ] [--echo]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (rate <= 0.0) rate = 50.0;
+
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+    FirmwareStandin standin(echo, rate);
+    if (!standin.open(link_path)) return 1;
+    standin.run();
+    unlink(link_path.c_str());
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <ros/ros.h>
+#include "sml_nexus_msgs/VelocityCommand.h"
+#include "sml_nexus_msgs/WheelFeedback.h"
+
+namespace sml_nexus_robot
+{
+
+//==========================================================
+//  Measures the round trip through a rosserial bridge to
+//  the firmware stand-in in echo mode, which answers every
+//  cmd_vel_compact with a wheel_feedback whose seq is the
+//  vx of the command. Only for the stand-in: the commands
+//  are counters, not velocities.
+//
+//  Publishes cmd_vel_compact at ~rate Hz and reports the
+//  round trip percentiles every ~report_period seconds.
+//==========================================================
+class RosserialLatencyProbe : public nodelet::Nodelet
+{
+private:
+    virtual void onInit(){
+        ros::NodeHandle& nh = getNodeHandle();
+        ros::NodeHandle& private_nh = getPrivateNodeHandle();
+        const double rate = private_nh.param("rate", 50.0);
+        const double report_period = private_nh.param("report_period", 5.0);
+
+        sent.resize(1 << 16);
+        command_pub = nh.advertise<sml_nexus_msgs::VelocityCommand>("cmd_vel_compact", 10);
+        feedback_sub = nh.subscribe("wheel_feedback", 1000, &RosserialLatencyProbe::feedbackCallback, this,
+                                    ros::TransportHints().tcpNoDelay());
+        command_timer = nh.createWallTimer(ros::WallDuration(1.0 / rate), &RosserialLatencyProbe::send, this);
+        report_timer = nh.createWallTimer(ros::WallDuration(report_period), &RosserialLatencyProbe::report, this);
+    }
+
+    void send(const ros::WallTimerEvent&){
+        sml_nexus_msgs::VelocityCommandPtr msg(new sml_nexus_msgs::VelocityCommand);
+        std::lock_guard<std::mutex> lock(mutex);
+        msg->vx = static_cast<int16_t>(counter);
+        sent[counter] = ros::WallTime::now();
+        counter++;
+        commands++;
+        command_pub.publish(msg);
+    }
+
+    void feedbackCallback(const sml_nexus_msgs::WheelFeedbackConstPtr& msg){
+        std::lock_guard<std::mutex> lock(mutex);
+        const ros::WallTime sent_time = sent[msg->seq];
+        if (sent_time.isZero()) return;
+        sent[msg->seq] = ros::WallTime();
+        round_trips_us.push_back((ros::WallTime::now() - sent_time).toSec() * 1e6);
+    }
+
+    void report(const ros::WallTimerEvent&){
+        std::lock_guard<std::mutex> lock(mutex);
+        if (round_trips_us.empty()){
+            NODELET_WARN_STREAM("Rosserial latency probe: no echo received for " << commands << " commands");
+            commands = 0;
+            return;
+        }
+        std::sort(round_trips_us.begin(), round_trips_us.end());
+        const size_t count = round_trips_us.size();
+        NODELET_INFO_STREAM("Rosserial round trip over " << count << "/" << commands << " commands [us]: median "
+                            << round_trips_us[count / 2] << ", p90 " << round_trips_us[count * 9 / 10]
+                            << ", p99 " << round_trips_us[count * 99 / 100] << ", max " << round_trips_us.back());
+        round_trips_us.clear();
+        commands = 0;
+    }
+
+    ros::Publisher command_pub;
+    ros::Subscriber feedback_sub;
+    ros::WallTimer command_timer;
+    ros::WallTimer report_timer;
+    std::mutex mutex;                     //timers and subscriber may run in parallel in a manager
+    std::vector<ros::WallTime> sent;      //send time by command counter
+    std::vector<double> round_trips_us;
+    uint16_t counter = 0;
+    unsigned long commands = 0;
+};
+
+} // namespace sml_nexus_robot
+
+PLUGINLIB_EXPORT_CLASS(sml_nexus_robot::RosserialLatencyProbe, nodelet::Nodelet)